@@ -11,11 +11,55 @@
 #ifndef __ARCH_SEL4BENCH_H__
 #define __ARCH_SEL4BENCH_H__
 
+#include <autoconf.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+/* How the timestamp counter is read is chosen in Kconfig. rdtsc is not
+ * serialising, so on its own it can be executed before earlier instructions
+ * have finished or after later ones have started.
+ *  - CPUID brackets rdtsc with cpuid on both sides. This is the strictest, but
+ *    each cpuid costs a hundred or more cycles (and traps when virtualised).
+ *  - LFENCE brackets rdtsc with lfence, which stops it being reordered with
+ *    respect to other instructions but does not drain the store buffer.
+ *  - RDTSCP waits for all earlier instructions to execute before reading the
+ *    counter, and a trailing lfence stops later instructions from starting
+ *    early. Requires a processor with rdtscp (Nehalem onwards).
+ * Whichever mode is used, sel4bench_get_cycle_count_overhead() measures its
+ * cost so that it can be subtracted from results.
+ */
+#if defined(CONFIG_LIB_SEL4_BENCH_X86_TSC_RDTSCP)
+#define SEL4BENCH_READ_CCNT(var) do { \
+    uint32_t low, high; \
+    asm volatile( \
+        "rdtscp \n" \
+        "lfence \n" \
+        : \
+         "=a"(low), \
+         "=d"(high) \
+        : \
+        : "ecx", "memory" \
+    ); \
+    (var) = (((uint64_t)high) << 32ull) | ((uint64_t)low); \
+} while(0)
+#elif defined(CONFIG_LIB_SEL4_BENCH_X86_TSC_LFENCE)
+#define SEL4BENCH_READ_CCNT(var) do { \
+    uint32_t low, high; \
+    asm volatile( \
+        "lfence \n" \
+        "rdtsc \n" \
+        "lfence \n" \
+        : \
+         "=a"(low), \
+         "=d"(high) \
+        : \
+        : "memory" \
+    ); \
+    (var) = (((uint64_t)high) << 32ull) | ((uint64_t)low); \
+} while(0)
+#else
 #define SEL4BENCH_READ_CCNT(var) do { \
     uint32_t low, high; \
     asm volatile( \
@@ -36,6 +80,7 @@
     ); \
     (var) = (((uint64_t)high) << 32ull) | ((uint64_t)low); \
 } while(0)
+#endif
 
 //standard libsel4bench events
 #define SEL4BENCH_EVENT_CACHE_L1I_MISS    SEL4BENCH_IA32_EVENT_CACHE_L1I_MISS
@@ -55,20 +100,18 @@
 
 #include "sel4bench_private.h"
 
+/* unsigned long long rather than uint64_t so that the format is correct for
+ * both 32 and 64-bit builds */
 #define CCNT_FORMAT "%llu"
-typedef uint64_t ccnt_t;
+typedef unsigned long long ccnt_t;
 
 /* The framework as it stands supports the following Intel processors:
  * - All P6-family processors (up to and including the Pentium M)
  * - All processors supporting IA-32 architectural performance
  *   monitoring (that is, processors starting from the Intel Core Solo,
  *   codenamed Yonah)
- * - Note: only works if compiled -m32. -m64 will break the inline
- *   assembly.
+ * in both 32 and 64-bit mode.
  */
-#if __x86_64__
-    #error this code only works for a 32-bit architecture
-#endif
 
 /* Silence warnings about including the following functions when seL4_DebugRun
  * is not enabled when we are not calling them. If we actually call these
@@ -102,9 +145,8 @@ static FASTFN void sel4bench_init() {
 }
 
 static FASTFN sel4bench_counter_t sel4bench_get_cycle_count() {
-	sel4bench_private_serialize_pmc(); /* Serialise all preceding instructions */
-	uint64_t time = sel4bench_private_rdtsc();
-	sel4bench_private_serialize_pmc(); /* Serialise all following instructions */
+	sel4bench_counter_t time;
+	SEL4BENCH_READ_CCNT(time);
 
 	return time;
 }
@@ -118,8 +160,11 @@ static FASTFN seL4_Word sel4bench_get_num_counters() {
 	if(max_basic_leaf >= IA32_CPUID_LEAF_PMC) { //Core Solo or later supports PMC discovery via CPUID...
 		//query the processor's PMC data
 		ia32_cpuid_leaf_pmc_eax_t pmc_eax;
+		seL4_Word eax;
 
-		sel4bench_private_cpuid(IA32_CPUID_LEAF_PMC, 0, &pmc_eax.raw, &dummy, &dummy, &dummy);
+		//cpuid fills a whole word, which is wider than pmc_eax on x86-64
+		sel4bench_private_cpuid(IA32_CPUID_LEAF_PMC, 0, &eax, &dummy, &dummy, &dummy);
+		pmc_eax.raw = eax;
 		return pmc_eax.gp_pmc_count_per_core;
 	} else { //P6 (including Pentium M) doesn't...
 		ia32_cpuid_model_info_t model_info;
@@ -139,7 +184,6 @@ static FASTFN sel4bench_counter_t sel4bench_get_counter(seL4_Word counter) {
 	return counter_val;
 }
 
-//ASSUMES x86-32 -- NEEDS A REWRITE FOR x86-64!
 static CACHESENSFN sel4bench_counter_t sel4bench_get_counters(seL4_Word counters, sel4bench_counter_t* values) {
 	unsigned char counter = 0;
 
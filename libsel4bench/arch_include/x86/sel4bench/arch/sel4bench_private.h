@@ -14,7 +14,7 @@
 #include <stdint.h>
 #include <utils/util.h>
 
-typedef uint64_t sel4bench_counter_t;
+typedef unsigned long long sel4bench_counter_t;
 #define SEL4BENCH_COUNTER_FORMAT "llu"
 
 //function attributes
@@ -143,7 +143,7 @@ static FASTFN void sel4bench_private_lfence() {
 
 static FASTFN uint64_t sel4bench_private_rdtsc() {
 	uint64_t time;
-#ifdef X86_64
+#ifdef __x86_64__
     uint64_t lo, hi;
     asm volatile (
             "rdtsc"
@@ -160,7 +160,7 @@ static FASTFN uint64_t sel4bench_private_rdtsc() {
 }
 
 static FASTFN uint64_t sel4bench_private_rdpmc(uint32_t counter) {
-#ifdef X86_64
+#ifdef __x86_64__
     uint64_t hi, lo;
     asm volatile (
             "rdpmc"
@@ -189,7 +189,7 @@ static FASTFN uint64_t sel4bench_private_rdpmc(uint32_t counter) {
 
 //enable user-level pmc access
 static KERNELFN void sel4bench_private_enable_user_pmc(void* arg) {
-#ifdef X86_64
+#ifdef __x86_64__
 
     uint64_t dummy;
     asm volatile (
@@ -216,7 +216,7 @@ static KERNELFN void sel4bench_private_enable_user_pmc(void* arg) {
 
 //disable user-level pmc access
 static KERNELFN void sel4bench_private_disable_user_pmc(void* arg) {
-#ifdef X86_64
+#ifdef __x86_64__
     uint64_t dummy;
     asm volatile (
         "movq   %%cr4, %0;"
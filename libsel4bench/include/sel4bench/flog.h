@@ -12,6 +12,7 @@
 
 #include <autoconf.h>
 #include <sel4bench/sel4bench.h>
+#include <sel4bench/stats.h>
 #include <stdlib.h>
 #include <utils/util.h>
 
@@ -20,8 +21,13 @@ typedef struct {
     size_t length;
     size_t next;
     ccnt_t start;
+    /* if set, samples are summarised here instead of stored in results */
+    sel4bench_stats_t *stats;
 } flog_t;
 
+/* number of counter reads used to measure their overhead in flog_init_stats */
+#define FLOG_OVERHEAD_RUNS 100
+
 #ifdef CONFIG_FLOG
 static inline flog_t *
 flog_init(ccnt_t *results, int length) 
@@ -38,11 +44,30 @@ flog_init(ccnt_t *results, int length)
     return flog;
 }
 
+/* Create a flog that summarises samples into stats rather than storing them,
+ * so runs of any length can be made in bounded memory. The cost of reading
+ * the cycle counter is measured and set as the overhead of stats, so it is
+ * subtracted from every sample. */
+static inline flog_t *
+flog_init_stats(sel4bench_stats_t *stats)
+{
+    flog_t *flog = flog_init(NULL, 0);
+    if (flog != NULL) {
+        flog->stats = stats;
+        stats->overhead = sel4bench_get_cycle_count_overhead(FLOG_OVERHEAD_RUNS);
+    }
+    return flog;
+}
+
 static inline void
 flog_end(flog_t *flog) {
     ccnt_t end;
     SEL4BENCH_READ_CCNT(end);
-    if (likely(flog->start != 0 && flog->next < flog->length)) {
+    if (flog->stats != NULL) {
+        if (likely(flog->start != 0)) {
+            sel4bench_stats_record(flog->stats, end - flog->start);
+        }
+    } else if (likely(flog->start != 0 && flog->next < flog->length)) {
         flog->results[flog->next] = end - flog->start;
         flog->next++;
     }
@@ -62,6 +87,7 @@ flog_free(flog_t *flog)
 #else
 
 #define flog_init(r, l) NULL
+#define flog_init_stats(s) NULL
 #define flog_end(f)
 #define flog_start(f)
 #define flog_free(f)
@@ -44,12 +44,14 @@ void logging_append_log_buffer(log_buffer_t *log_buffer, seL4_Word data);
 void logging_separate_log(kernel_log_entry_t *logs, unsigned int num_logs, log_buffer_t *buffers, unsigned int num_buffers);
 
 /* Sorts an array of logs in place, in ascending order of key.
- * Not necessarily a stable sort.
+ * Not necessarily a stable sort, although the current implementation is unless scratch
+ * memory can't be allocated.
  */
 void logging_sort_log(kernel_log_entry_t *logs, unsigned int num_logs);
 
 /* Sorts an array of logs in place, in ascending order of key.
- * Guaranteed to be stable.
+ * Guaranteed to be stable, so entries with the same key remain in time order.
+ * Runs in linear time unless scratch memory can't be allocated.
  */
 void logging_stable_sort_log(kernel_log_entry_t *logs, unsigned int num_logs);
 
@@ -59,4 +61,15 @@ void logging_stable_sort_log(kernel_log_entry_t *logs, unsigned int num_logs);
 void logging_group_log_by_key(kernel_log_entry_t *logs, unsigned int num_logs,
                               unsigned int *sizes, unsigned int *offsets,
                               unsigned int max_groups);
+
+/* Reorders an array of logs in place so that entries are grouped by key, and for each key below
+ * max_groups records the offset and size of its group as logging_group_log_by_key does. Entries with
+ * keys of max_groups or above are placed after all the groups, and their number is returned.
+ * Runs in O(num_logs + max_groups) and keeps entries in their original order within a group. If
+ * scratch memory can't be allocated it falls back to an O(num_logs log num_logs) in place sort,
+ * which does not preserve the order within a group.
+ */
+unsigned int logging_sort_and_group_log(kernel_log_entry_t *logs, unsigned int num_logs,
+                                        unsigned int *sizes, unsigned int *offsets,
+                                        unsigned int max_groups);
 #endif
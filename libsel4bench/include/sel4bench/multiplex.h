@@ -0,0 +1,147 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file
+ *
+ * Counting more events than there are hardware counters by multiplexing.
+ *
+ * Events are packed into groups of as many events as there are counters, and
+ * the groups take turns on the counters. Each call to sel4bench_mux_end() (or
+ * sel4bench_mux_rotate(), for time slices within one long run) closes a slice
+ * and moves on to the next group. For each event the library keeps the count
+ * observed and the cycles it was scheduled for, and estimates its total count
+ * over all measured cycles by scaling up, much as perf does.
+ *
+ * The estimate assumes the event occurs at a similar rate in every slice. The
+ * spread of the per slice rates gives the standard error reported with each
+ * estimate: more slices, or more uniform behaviour, give tighter estimates.
+ *
+ * The scheduling logic only talks to the counters through a backend, so it can
+ * be driven by a simulated one on the host, as in test/multiplex.
+ * sel4bench_mux_hardware_backend() returns the backend for the real counters.
+ *
+ * Counters may be narrower than 64 bits (they are 32 bits on ARM), so slices
+ * must be shorter than the time it takes a counter to wrap twice.
+ */
+
+/* Largest number of events that can be multiplexed */
+#define SEL4BENCH_MUX_MAX_EVENTS 32
+/* Largest number of hardware counters that will be used */
+#define SEL4BENCH_MUX_MAX_COUNTERS 8
+
+/* Operations on the counters, mirroring the sel4bench API. */
+typedef struct sel4bench_mux_backend {
+    void *cookie;
+    /* number of generic counters, excluding the cycle counter */
+    unsigned int (*num_counters)(void *cookie);
+    void (*set_count_event)(void *cookie, unsigned int counter, uint32_t event);
+    void (*start_counters)(void *cookie, uint32_t counters);
+    void (*stop_counters)(void *cookie, uint32_t counters);
+    /* read the counters in the bitmask into values, indexed by counter, and
+     * return the cycle count */
+    uint64_t (*get_counters)(void *cookie, uint32_t counters, uint64_t *values);
+    /* width in bits of the values read, including the cycle count, or 0 for
+     * 64. Slices are measured modulo this, so each counter may wrap at most
+     * once per slice. */
+    unsigned int counter_bits;
+} sel4bench_mux_backend_t;
+
+typedef struct sel4bench_mux_event {
+    uint32_t event;
+    /* total count while this event was scheduled */
+    uint64_t count;
+    /* cycles this event was scheduled for */
+    uint64_t active_cycles;
+    /* slices this event was scheduled for */
+    uint64_t slices;
+    /* running mean and sum of squared differences of the per slice rates,
+     * in events per cycle */
+    double rate_mean;
+    double rate_m2;
+} sel4bench_mux_event_t;
+
+typedef struct sel4bench_mux {
+    sel4bench_mux_backend_t backend;
+    unsigned int num_counters;
+    /* mask for the backend's counter width */
+    uint64_t counter_mask;
+    size_t num_events;
+    sel4bench_mux_event_t events[SEL4BENCH_MUX_MAX_EVENTS];
+    /* group currently, or next to be, on the counters */
+    size_t group;
+    /* whether group has been programmed onto the counters */
+    int programmed;
+    /* whether a slice is open */
+    int running;
+    uint64_t start_cycles;
+    uint64_t start_values[SEL4BENCH_MUX_MAX_COUNTERS];
+    /* cycles covered by all closed slices */
+    uint64_t total_cycles;
+} sel4bench_mux_t;
+
+typedef struct sel4bench_mux_result {
+    uint32_t event;
+    /* count scaled to all measured cycles */
+    double estimate;
+    /* standard error of the estimate. 0 if the event was scheduled for every
+     * cycle, so the count is exact. -1 if it is unknown because the event was
+     * scheduled for fewer than 2 slices. */
+    double error;
+    /* fraction of the measured cycles the event was scheduled for */
+    double active;
+    /* count actually observed */
+    uint64_t count;
+} sel4bench_mux_result_t;
+
+/**
+ * Initialise a multiplexer.
+ *
+ * @param mux     Multiplexer to initialise.
+ * @param backend Counters to use, copied into the multiplexer.
+ * @return 0 on success, -1 if the backend has no counters.
+ */
+int sel4bench_mux_init(sel4bench_mux_t *mux, const sel4bench_mux_backend_t *backend);
+
+/**
+ * Add an event to be counted. Must not be called while a slice is open.
+ *
+ * @return Index of the event, for sel4bench_mux_get_result(), or -1 if
+ *         SEL4BENCH_MUX_MAX_EVENTS have already been added.
+ */
+int sel4bench_mux_add_event(sel4bench_mux_t *mux, uint32_t event);
+
+/** Number of groups the events are split into, i.e. slices per rotation. */
+size_t sel4bench_mux_num_groups(sel4bench_mux_t *mux);
+
+/** Open a slice, putting the current group on the counters. */
+void sel4bench_mux_begin(sel4bench_mux_t *mux);
+
+/** Close the open slice, accounting it to the current group, and move on to
+ * the next group. */
+void sel4bench_mux_end(sel4bench_mux_t *mux);
+
+/** Close the open slice and immediately open the next, e.g. from a periodic
+ * timer during one long benchmark run. */
+void sel4bench_mux_rotate(sel4bench_mux_t *mux);
+
+/** Discard everything measured, keeping the events. */
+void sel4bench_mux_reset(sel4bench_mux_t *mux);
+
+/** Get the estimate for the event at index. */
+void sel4bench_mux_get_result(sel4bench_mux_t *mux, size_t index, sel4bench_mux_result_t *result);
+
+/** Backend for the hardware counters. sel4bench_init() must have been called. */
+const sel4bench_mux_backend_t *sel4bench_mux_hardware_backend(void);
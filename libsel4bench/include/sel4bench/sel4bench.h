@@ -167,5 +167,30 @@ SEL4BENCH_API void sel4bench_stop_counters(seL4_Word counters);
  */
 SEL4BENCH_API void sel4bench_reset_counters(seL4_Word counters);
 
+/**
+ * Estimate the cost of reading the cycle counter, using whichever method the
+ * library is configured with. This is the smallest difference seen between two
+ * back-to-back reads, and should be subtracted from measurements of short
+ * operations.
+ *
+ * @param runs Number of pairs of reads to take the minimum over.
+ * @return The smallest observed overhead, in cycles.
+ */
+SEL4BENCH_API sel4bench_counter_t sel4bench_get_cycle_count_overhead(int runs)
+{
+    sel4bench_counter_t overhead = (sel4bench_counter_t) -1;
+
+    for (int i = 0; i < runs; i++) {
+        sel4bench_counter_t start = sel4bench_get_cycle_count();
+        SEL4BENCH_FENCE();
+        sel4bench_counter_t end = sel4bench_get_cycle_count();
+        if (end - start < overhead) {
+            overhead = end - start;
+        }
+    }
+
+    return runs > 0 ? overhead : 0;
+}
+
 #endif /* __SEL4BENCH_H__ */
 
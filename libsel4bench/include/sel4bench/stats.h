@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file
+ *
+ * Summary statistics for benchmark samples that do not require keeping every
+ * sample. Samples are accumulated into a running mean and variance and,
+ * optionally, a histogram from which percentiles can be read.
+ *
+ * The histogram is log-linear: values below 2^sub_bucket_bits each get their
+ * own bucket, and every power of 2 above that is split into
+ * 2^(sub_bucket_bits - 1) equal buckets. Any value is therefore recorded with
+ * a relative error of at most 2^-(sub_bucket_bits - 1), and memory is bounded
+ * by the largest value of interest rather than by the number of samples.
+ * Values at or above 2^max_bits are counted in the last bucket.
+ *
+ * Nothing here depends on seL4, so it can be tested on the host.
+ */
+
+/* Number of buckets needed for a histogram with the given parameters. */
+#define SEL4BENCH_HISTOGRAM_BUCKETS(sub_bucket_bits, max_bits) \
+    ((1u << (sub_bucket_bits)) + ((max_bits) - (sub_bucket_bits)) * (1u << ((sub_bucket_bits) - 1)))
+
+typedef struct sel4bench_histogram {
+    uint32_t *counts;
+    size_t num_buckets;
+    unsigned int sub_bucket_bits;
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+} sel4bench_histogram_t;
+
+typedef struct sel4bench_stats {
+    /* Samples recorded. */
+    uint64_t count;
+    /* Running mean and sum of squared differences from it (Welford). */
+    double mean;
+    double m2;
+    uint64_t min;
+    uint64_t max;
+    /* Subtracted from every sample before it is recorded, e.g. the cost of
+     * reading the cycle counter. */
+    uint64_t overhead;
+    /* Samples above this (after subtracting overhead) are discarded as
+     * outliers and only counted. 0 disables the limit. */
+    uint64_t outlier_limit;
+    uint64_t outliers;
+    /* Optional histogram, for percentiles. */
+    sel4bench_histogram_t *histogram;
+} sel4bench_stats_t;
+
+/**
+ * Initialise a histogram.
+ *
+ * @param hist            Histogram to initialise.
+ * @param counts          Storage for num_buckets counts. It will be zeroed.
+ * @param num_buckets     Use SEL4BENCH_HISTOGRAM_BUCKETS to size this.
+ * @param sub_bucket_bits Precision, see above. Between 1 and 16.
+ */
+void sel4bench_histogram_init(sel4bench_histogram_t *hist, uint32_t *counts, size_t num_buckets,
+                              unsigned int sub_bucket_bits);
+
+/** Record a value in a histogram. */
+void sel4bench_histogram_record(sel4bench_histogram_t *hist, uint64_t value);
+
+/** Discard all recorded values. */
+void sel4bench_histogram_reset(sel4bench_histogram_t *hist);
+
+/**
+ * Query a percentile.
+ *
+ * @param percentile Between 0 and 100, e.g. 99.9 for the 999th permille.
+ * @return The highest value equivalent to the recorded value at that rank,
+ *         which is within the histogram's precision of the true value and never
+ *         above the largest value recorded. 0 if nothing has been recorded.
+ */
+uint64_t sel4bench_histogram_percentile(sel4bench_histogram_t *hist, double percentile);
+
+/** Count the recorded values strictly greater than value, to within the
+ * histogram's precision. */
+uint64_t sel4bench_histogram_count_above(sel4bench_histogram_t *hist, uint64_t value);
+
+/**
+ * Approximate mean of the values between two percentiles, discarding the
+ * tails on either side, e.g. 1 and 99 to ignore the top and bottom 1%.
+ */
+double sel4bench_histogram_trimmed_mean(sel4bench_histogram_t *hist, double low, double high);
+
+/**
+ * Initialise a statistics accumulator.
+ *
+ * @param stats     Accumulator to initialise.
+ * @param histogram Initialised histogram to also record into, or NULL.
+ * @param overhead  Subtracted from every sample, saturating at 0.
+ */
+void sel4bench_stats_init(sel4bench_stats_t *stats, sel4bench_histogram_t *histogram, uint64_t overhead);
+
+/** Record a sample. */
+void sel4bench_stats_record(sel4bench_stats_t *stats, uint64_t sample);
+
+/** Discard all recorded samples, keeping the configuration. */
+void sel4bench_stats_reset(sel4bench_stats_t *stats);
+
+/** Sample variance of the recorded samples, 0 for fewer than 2 samples. */
+double sel4bench_stats_variance(sel4bench_stats_t *stats);
+
+/** Sample standard deviation of the recorded samples. */
+double sel4bench_stats_stddev(sel4bench_stats_t *stats);
+
+/** Percentile of the recorded samples. Requires a histogram, otherwise 0. */
+uint64_t sel4bench_stats_percentile(sel4bench_stats_t *stats, double percentile);
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <malloc.h>
 #include <assert.h>
+#include <string.h>
 
 void
 logging_init_log_buffer(log_buffer_t *log_buffer, unsigned int initial_capacity)
@@ -62,36 +63,137 @@ logging_separate_log(kernel_log_entry_t *logs, unsigned int num_logs, log_buffer
     }
 }
 
+/* Digit size for the radix sort. 8 bits keeps the bucket counts on the stack
+ * and sorts the small keys typically found in kernel logs in a single pass. */
+#define RADIX_BITS 8
+#define RADIX (1u << RADIX_BITS)
+
+/* Stable insertion sort, only used if we can't allocate scratch space for the
+ * radix sort. */
+static void
+insertion_sort_log(kernel_log_entry_t *logs, unsigned int num_logs)
+{
+    for (unsigned int i = 1; i < num_logs; ++i) {
+        kernel_log_entry_t entry = logs[i];
+        seL4_Word key = kernel_logging_entry_get_key(&entry);
+        unsigned int j = i;
+        while (j > 0 && kernel_logging_entry_get_key(&logs[j - 1]) > key) {
+            logs[j] = logs[j - 1];
+            --j;
+        }
+        logs[j] = entry;
+    }
+}
+
+static void
+heap_sift_down_log(kernel_log_entry_t *logs, unsigned int root, unsigned int num_logs)
+{
+    kernel_log_entry_t entry = logs[root];
+    seL4_Word key = kernel_logging_entry_get_key(&entry);
+    unsigned int child;
+    while ((child = 2 * root + 1) < num_logs) {
+        if (child + 1 < num_logs &&
+                kernel_logging_entry_get_key(&logs[child + 1]) > kernel_logging_entry_get_key(&logs[child])) {
+            ++child;
+        }
+        if (kernel_logging_entry_get_key(&logs[child]) <= key) {
+            break;
+        }
+        logs[root] = logs[child];
+        root = child;
+    }
+    logs[root] = entry;
+}
+
+/* In place heapsort, used by the unstable sorts if we can't allocate scratch
+ * space. */
+static void
+heap_sort_log(kernel_log_entry_t *logs, unsigned int num_logs)
+{
+    for (unsigned int i = num_logs / 2; i-- > 0;) {
+        heap_sift_down_log(logs, i, num_logs);
+    }
+    for (unsigned int end = num_logs; end-- > 1;) {
+        kernel_log_entry_t tmp = logs[0];
+        logs[0] = logs[end];
+        logs[end] = tmp;
+        heap_sift_down_log(logs, 0, end);
+    }
+}
+
+/* Least significant digit radix sort on the key. Each pass is a stable
+ * counting sort, so entries with equal keys stay in their original (time)
+ * order. Only as many passes as the largest key needs are made. */
 static int
-log_compare(const void *a, const void *b)
+radix_sort_log(kernel_log_entry_t *logs, unsigned int num_logs)
 {
-    return kernel_logging_entry_get_key((kernel_log_entry_t*)a) -
-           kernel_logging_entry_get_key((kernel_log_entry_t*)b);
+    seL4_Word max_key = 0;
+    for (unsigned int i = 0; i < num_logs; ++i) {
+        seL4_Word key = kernel_logging_entry_get_key(&logs[i]);
+        if (key > max_key) {
+            max_key = key;
+        }
+    }
+    if (max_key == 0) {
+        /* every key is the same */
+        return 0;
+    }
+
+    kernel_log_entry_t *scratch = (kernel_log_entry_t*)malloc(num_logs * sizeof(kernel_log_entry_t));
+    if (scratch == NULL) {
+        return -1;
+    }
+
+    kernel_log_entry_t *src = logs;
+    kernel_log_entry_t *dst = scratch;
+    unsigned int counts[RADIX];
+
+    for (unsigned int shift = 0; shift < sizeof(seL4_Word) * 8 && (max_key >> shift) != 0; shift += RADIX_BITS) {
+        memset(counts, 0, sizeof(counts));
+        for (unsigned int i = 0; i < num_logs; ++i) {
+            ++counts[(kernel_logging_entry_get_key(&src[i]) >> shift) & (RADIX - 1)];
+        }
+
+        /* turn the counts into the starting index of each digit */
+        unsigned int index = 0;
+        for (unsigned int d = 0; d < RADIX; ++d) {
+            unsigned int count = counts[d];
+            counts[d] = index;
+            index += count;
+        }
+
+        for (unsigned int i = 0; i < num_logs; ++i) {
+            unsigned int d = (kernel_logging_entry_get_key(&src[i]) >> shift) & (RADIX - 1);
+            dst[counts[d]++] = src[i];
+        }
+
+        kernel_log_entry_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != logs) {
+        memcpy(logs, src, num_logs * sizeof(kernel_log_entry_t));
+    }
+    free(scratch);
+    return 0;
 }
 
 void
 logging_sort_log(kernel_log_entry_t *logs, unsigned int num_logs)
 {
-    qsort(logs, num_logs, sizeof(kernel_log_entry_t), log_compare);
+    /* The stable sort is linear, so there is nothing to gain from an unstable
+     * one unless it has to be done without scratch space. */
+    if (radix_sort_log(logs, num_logs) != 0) {
+        heap_sort_log(logs, num_logs);
+    }
 }
 
 void
 logging_stable_sort_log(kernel_log_entry_t *logs, unsigned int num_logs)
 {
-    /* Modify the keys so sorting preserves order within a single key */
-    for (int i = 0; i < num_logs; ++i) {
-        kernel_log_entry_t *entry = &logs[i];
-        seL4_Word key = kernel_logging_entry_get_key(entry);
-        key = key * num_logs + i;
-    }
-
-    logging_sort_log(logs, num_logs);
-
-    /* Restore the original key values */
-    for (int i = 0; i < num_logs; ++i) {
-        kernel_log_entry_t *entry = &logs[i];
-        seL4_Word key = kernel_logging_entry_get_key(entry);
-        key = key / num_logs;
+    if (radix_sort_log(logs, num_logs) != 0) {
+        insertion_sort_log(logs, num_logs);
     }
 }
 
@@ -110,3 +212,56 @@ logging_group_log_by_key(kernel_log_entry_t *logs, unsigned int num_logs,
         sizes[i] = index - offsets[i];
     }
 }
+
+unsigned int
+logging_sort_and_group_log(kernel_log_entry_t *logs, unsigned int num_logs,
+                           unsigned int *sizes, unsigned int *offsets,
+                           unsigned int max_groups)
+{
+    kernel_log_entry_t *scratch = (kernel_log_entry_t*)malloc(num_logs * sizeof(kernel_log_entry_t));
+    if (scratch == NULL) {
+        heap_sort_log(logs, num_logs);
+        logging_group_log_by_key(logs, num_logs, sizes, offsets, max_groups);
+        unsigned int grouped = max_groups == 0 ? 0 : offsets[max_groups - 1] + sizes[max_groups - 1];
+        return num_logs - grouped;
+    }
+
+    /* count the entries for each group; keys outside the groups go last */
+    unsigned int overflow = 0;
+    for (unsigned int i = 0; i < max_groups; ++i) {
+        sizes[i] = 0;
+    }
+    for (unsigned int i = 0; i < num_logs; ++i) {
+        seL4_Word key = kernel_logging_entry_get_key(&logs[i]);
+        if (key < max_groups) {
+            ++sizes[key];
+        } else {
+            ++overflow;
+        }
+    }
+
+    unsigned int index = 0;
+    for (unsigned int i = 0; i < max_groups; ++i) {
+        offsets[i] = index;
+        index += sizes[i];
+    }
+
+    /* scatter in order, using offsets as the insertion cursor for each group */
+    for (unsigned int i = 0; i < num_logs; ++i) {
+        seL4_Word key = kernel_logging_entry_get_key(&logs[i]);
+        if (key < max_groups) {
+            scratch[offsets[key]++] = logs[i];
+        } else {
+            scratch[index++] = logs[i];
+        }
+    }
+    assert(index == num_logs);
+
+    for (unsigned int i = 0; i < max_groups; ++i) {
+        offsets[i] -= sizes[i];
+    }
+
+    memcpy(logs, scratch, num_logs * sizeof(kernel_log_entry_t));
+    free(scratch);
+    return overflow;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <sel4bench/multiplex.h>
+
+/* first event and number of events in the current group */
+static size_t
+group_events(sel4bench_mux_t *mux, size_t *first)
+{
+    *first = mux->group * mux->num_counters;
+    size_t n = mux->num_events - *first;
+    return n < mux->num_counters ? n : mux->num_counters;
+}
+
+static uint32_t
+group_mask(size_t n)
+{
+    return (uint32_t) ((1ull << n) - 1);
+}
+
+int
+sel4bench_mux_init(sel4bench_mux_t *mux, const sel4bench_mux_backend_t *backend)
+{
+    memset(mux, 0, sizeof(*mux));
+    mux->backend = *backend;
+    mux->counter_mask = (backend->counter_bits == 0 || backend->counter_bits >= 64) ?
+                        UINT64_MAX : (1ull << backend->counter_bits) - 1;
+    mux->num_counters = backend->num_counters(backend->cookie);
+    if (mux->num_counters > SEL4BENCH_MUX_MAX_COUNTERS) {
+        mux->num_counters = SEL4BENCH_MUX_MAX_COUNTERS;
+    }
+    return mux->num_counters == 0 ? -1 : 0;
+}
+
+int
+sel4bench_mux_add_event(sel4bench_mux_t *mux, uint32_t event)
+{
+    assert(!mux->running);
+
+    if (mux->num_events == SEL4BENCH_MUX_MAX_EVENTS) {
+        return -1;
+    }
+    memset(&mux->events[mux->num_events], 0, sizeof(mux->events[0]));
+    mux->events[mux->num_events].event = event;
+    /* the current group may have gained an event */
+    mux->programmed = 0;
+    return mux->num_events++;
+}
+
+size_t
+sel4bench_mux_num_groups(sel4bench_mux_t *mux)
+{
+    return (mux->num_events + mux->num_counters - 1) / mux->num_counters;
+}
+
+void
+sel4bench_mux_begin(sel4bench_mux_t *mux)
+{
+    sel4bench_mux_backend_t *b = &mux->backend;
+    size_t first;
+    size_t n = group_events(mux, &first);
+
+    assert(!mux->running);
+    assert(mux->num_events > 0);
+
+    if (!mux->programmed) {
+        for (size_t i = 0; i < n; i++) {
+            b->set_count_event(b->cookie, i, mux->events[first + i].event);
+        }
+        mux->programmed = 1;
+    }
+
+    /* Counters are never reset, as on some platforms that would also reset
+     * the cycle counter. Instead slices are measured by difference. */
+    b->start_counters(b->cookie, group_mask(n));
+    mux->start_cycles = b->get_counters(b->cookie, group_mask(n), mux->start_values);
+    mux->running = 1;
+}
+
+void
+sel4bench_mux_end(sel4bench_mux_t *mux)
+{
+    sel4bench_mux_backend_t *b = &mux->backend;
+    uint64_t values[SEL4BENCH_MUX_MAX_COUNTERS];
+    size_t first;
+    size_t n = group_events(mux, &first);
+
+    assert(mux->running);
+
+    uint64_t cycles = b->get_counters(b->cookie, group_mask(n), values);
+    b->stop_counters(b->cookie, group_mask(n));
+    mux->running = 0;
+
+    /* subtract in the counters' own width, so that a counter that wrapped
+     * during the slice gives its true difference */
+    uint64_t elapsed = (cycles - mux->start_cycles) & mux->counter_mask;
+    mux->total_cycles += elapsed;
+    for (size_t i = 0; i < n; i++) {
+        sel4bench_mux_event_t *e = &mux->events[first + i];
+        uint64_t count = (values[i] - mux->start_values[i]) & mux->counter_mask;
+
+        e->count += count;
+        e->active_cycles += elapsed;
+        if (elapsed != 0) {
+            e->slices++;
+            double rate = (double) count / elapsed;
+            double delta = rate - e->rate_mean;
+            e->rate_mean += delta / e->slices;
+            e->rate_m2 += delta * (rate - e->rate_mean);
+        }
+    }
+
+    size_t groups = sel4bench_mux_num_groups(mux);
+    if (groups > 1) {
+        mux->group = (mux->group + 1) % groups;
+        mux->programmed = 0;
+    }
+}
+
+void
+sel4bench_mux_rotate(sel4bench_mux_t *mux)
+{
+    sel4bench_mux_end(mux);
+    sel4bench_mux_begin(mux);
+}
+
+void
+sel4bench_mux_reset(sel4bench_mux_t *mux)
+{
+    assert(!mux->running);
+
+    for (size_t i = 0; i < mux->num_events; i++) {
+        uint32_t event = mux->events[i].event;
+        memset(&mux->events[i], 0, sizeof(mux->events[i]));
+        mux->events[i].event = event;
+    }
+    mux->total_cycles = 0;
+}
+
+void
+sel4bench_mux_get_result(sel4bench_mux_t *mux, size_t index, sel4bench_mux_result_t *result)
+{
+    assert(index < mux->num_events);
+    sel4bench_mux_event_t *e = &mux->events[index];
+
+    result->event = e->event;
+    result->count = e->count;
+    if (e->active_cycles == 0) {
+        result->estimate = 0;
+        result->error = -1;
+        result->active = 0;
+        return;
+    }
+
+    result->active = (double) e->active_cycles / mux->total_cycles;
+    result->estimate = (double) e->count / result->active;
+    if (e->active_cycles == mux->total_cycles) {
+        result->error = 0;
+    } else if (e->slices < 2) {
+        result->error = -1;
+    } else {
+        /* Standard error of the mean rate, scaled to all cycles. The slices
+         * are a sample of the run without replacement, so the error shrinks
+         * to nothing as they cover all of it. */
+        double variance = e->rate_m2 / (e->slices - 1);
+        double correction = 1 - result->active;
+        result->error = sqrt(variance / e->slices * correction) * mux->total_cycles;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* The real counters as a multiplexer backend. Kept apart from multiplex.c so
+ * that the scheduling logic builds without seL4. */
+
+#include <sel4bench/sel4bench.h>
+#include <sel4bench/multiplex.h>
+
+static unsigned int
+hw_num_counters(void *cookie)
+{
+    return sel4bench_get_num_counters();
+}
+
+static void
+hw_set_count_event(void *cookie, unsigned int counter, uint32_t event)
+{
+    sel4bench_set_count_event(counter, event);
+}
+
+static void
+hw_start_counters(void *cookie, uint32_t counters)
+{
+    sel4bench_start_counters(counters);
+}
+
+static void
+hw_stop_counters(void *cookie, uint32_t counters)
+{
+    sel4bench_stop_counters(counters);
+}
+
+static uint64_t
+hw_get_counters(void *cookie, uint32_t counters, uint64_t *values)
+{
+    sel4bench_counter_t raw[SEL4BENCH_MUX_MAX_COUNTERS];
+    sel4bench_counter_t cycles = sel4bench_get_counters(counters, raw);
+
+    for (unsigned int i = 0; i < SEL4BENCH_MUX_MAX_COUNTERS; i++) {
+        if (counters & (1u << i)) {
+            values[i] = raw[i];
+        }
+    }
+    return cycles;
+}
+
+static const sel4bench_mux_backend_t hardware_backend = {
+    .cookie = NULL,
+    .num_counters = hw_num_counters,
+    .set_count_event = hw_set_count_event,
+    .start_counters = hw_start_counters,
+    .stop_counters = hw_stop_counters,
+    .get_counters = hw_get_counters,
+    .counter_bits = sizeof(sel4bench_counter_t) * 8,
+};
+
+const sel4bench_mux_backend_t *
+sel4bench_mux_hardware_backend(void)
+{
+    return &hardware_backend;
+}
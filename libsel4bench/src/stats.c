@@ -0,0 +1,260 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <sel4bench/stats.h>
+
+static unsigned int
+msb64(uint64_t value)
+{
+    assert(value != 0);
+    return 63 - __builtin_clzll(value);
+}
+
+static size_t
+bucket_index(sel4bench_histogram_t *hist, uint64_t value)
+{
+    unsigned int s = hist->sub_bucket_bits;
+    size_t index;
+
+    if (value < (1ull << s)) {
+        index = value;
+    } else {
+        /* keep the top s bits of the value; the shift selects the group */
+        unsigned int shift = msb64(value) - s + 1;
+        index = ((size_t) shift << (s - 1)) + (value >> shift);
+    }
+    return index < hist->num_buckets ? index : hist->num_buckets - 1;
+}
+
+/* Smallest value recorded in a bucket. */
+static uint64_t
+bucket_low(sel4bench_histogram_t *hist, size_t index)
+{
+    unsigned int s = hist->sub_bucket_bits;
+
+    if (index < (1ull << s)) {
+        return index;
+    }
+    unsigned int shift = (index >> (s - 1)) - 1;
+    uint64_t mantissa = index - ((uint64_t) shift << (s - 1));
+    return mantissa << shift;
+}
+
+/* Largest value recorded in a bucket. */
+static uint64_t
+bucket_high(sel4bench_histogram_t *hist, size_t index)
+{
+    if (index + 1 >= hist->num_buckets) {
+        return UINT64_MAX;
+    }
+    return bucket_low(hist, index + 1) - 1;
+}
+
+void
+sel4bench_histogram_init(sel4bench_histogram_t *hist, uint32_t *counts, size_t num_buckets,
+                         unsigned int sub_bucket_bits)
+{
+    assert(sub_bucket_bits >= 1 && sub_bucket_bits <= 16);
+    assert(num_buckets >= (1u << sub_bucket_bits));
+
+    hist->counts = counts;
+    hist->num_buckets = num_buckets;
+    hist->sub_bucket_bits = sub_bucket_bits;
+    sel4bench_histogram_reset(hist);
+}
+
+void
+sel4bench_histogram_reset(sel4bench_histogram_t *hist)
+{
+    memset(hist->counts, 0, hist->num_buckets * sizeof(hist->counts[0]));
+    hist->count = 0;
+    hist->min = UINT64_MAX;
+    hist->max = 0;
+}
+
+void
+sel4bench_histogram_record(sel4bench_histogram_t *hist, uint64_t value)
+{
+    hist->counts[bucket_index(hist, value)]++;
+    hist->count++;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+/* Index of the bucket holding the value of the given rank (1 based). */
+static size_t
+bucket_of_rank(sel4bench_histogram_t *hist, uint64_t rank)
+{
+    uint64_t seen = 0;
+    size_t i;
+
+    for (i = 0; i < hist->num_buckets - 1; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return i;
+}
+
+static uint64_t
+rank_of(sel4bench_histogram_t *hist, double percentile)
+{
+    if (percentile <= 0) {
+        return 1;
+    }
+    if (percentile >= 100) {
+        return hist->count;
+    }
+    uint64_t rank = (uint64_t) ceil(percentile / 100.0 * hist->count);
+    return rank == 0 ? 1 : rank;
+}
+
+uint64_t
+sel4bench_histogram_percentile(sel4bench_histogram_t *hist, double percentile)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    uint64_t value = bucket_high(hist, bucket_of_rank(hist, rank_of(hist, percentile)));
+    if (value > hist->max) {
+        value = hist->max;
+    }
+    if (value < hist->min) {
+        value = hist->min;
+    }
+    return value;
+}
+
+uint64_t
+sel4bench_histogram_count_above(sel4bench_histogram_t *hist, uint64_t value)
+{
+    uint64_t count = 0;
+
+    for (size_t i = bucket_index(hist, value) + 1; i < hist->num_buckets; i++) {
+        count += hist->counts[i];
+    }
+    return count;
+}
+
+double
+sel4bench_histogram_trimmed_mean(sel4bench_histogram_t *hist, double low, double high)
+{
+    if (hist->count == 0 || low >= high) {
+        return 0;
+    }
+
+    uint64_t first = rank_of(hist, low);
+    uint64_t last = rank_of(hist, high);
+    uint64_t seen = 0;
+    uint64_t used = 0;
+    double sum = 0;
+
+    for (size_t i = 0; i < hist->num_buckets && seen < last; i++) {
+        uint64_t bucket_first = seen + 1;
+        seen += hist->counts[i];
+        if (seen < first || hist->counts[i] == 0) {
+            continue;
+        }
+        /* the part of this bucket's ranks within [first, last] */
+        uint64_t from = bucket_first > first ? bucket_first : first;
+        uint64_t to = seen < last ? seen : last;
+        uint64_t n = to - from + 1;
+
+        uint64_t lo = bucket_low(hist, i);
+        uint64_t hi = bucket_high(hist, i);
+        if (hi > hist->max) {
+            hi = hist->max;
+        }
+        if (lo < hist->min) {
+            lo = hist->min;
+        }
+        sum += n * (lo / 2.0 + hi / 2.0);
+        used += n;
+    }
+    return used ? sum / used : 0;
+}
+
+void
+sel4bench_stats_init(sel4bench_stats_t *stats, sel4bench_histogram_t *histogram, uint64_t overhead)
+{
+    stats->histogram = histogram;
+    stats->overhead = overhead;
+    stats->outlier_limit = 0;
+    sel4bench_stats_reset(stats);
+}
+
+void
+sel4bench_stats_reset(sel4bench_stats_t *stats)
+{
+    stats->count = 0;
+    stats->mean = 0;
+    stats->m2 = 0;
+    stats->min = UINT64_MAX;
+    stats->max = 0;
+    stats->outliers = 0;
+    if (stats->histogram) {
+        sel4bench_histogram_reset(stats->histogram);
+    }
+}
+
+void
+sel4bench_stats_record(sel4bench_stats_t *stats, uint64_t sample)
+{
+    sample = sample > stats->overhead ? sample - stats->overhead : 0;
+    if (stats->outlier_limit != 0 && sample > stats->outlier_limit) {
+        stats->outliers++;
+        return;
+    }
+
+    stats->count++;
+    double delta = sample - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (sample - stats->mean);
+
+    if (sample < stats->min) {
+        stats->min = sample;
+    }
+    if (sample > stats->max) {
+        stats->max = sample;
+    }
+    if (stats->histogram) {
+        sel4bench_histogram_record(stats->histogram, sample);
+    }
+}
+
+double
+sel4bench_stats_variance(sel4bench_stats_t *stats)
+{
+    return stats->count > 1 ? stats->m2 / (stats->count - 1) : 0;
+}
+
+double
+sel4bench_stats_stddev(sel4bench_stats_t *stats)
+{
+    return sqrt(sel4bench_stats_variance(stats));
+}
+
+uint64_t
+sel4bench_stats_percentile(sel4bench_stats_t *stats, double percentile)
+{
+    if (!stats->histogram) {
+        return 0;
+    }
+    return sel4bench_histogram_percentile(stats->histogram, percentile);
+}
@@ -0,0 +1,15 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Host stand in for the generated Kconfig header */
+
+#pragma once
+
+#define CONFIG_MAX_NUM_TRACE_POINTS 1
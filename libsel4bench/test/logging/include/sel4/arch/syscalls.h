@@ -0,0 +1,35 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* The log system calls do nothing on the host, as logs are built by hand */
+
+#pragma once
+
+static inline void
+seL4_BenchmarkResetLog(void)
+{
+}
+
+static inline void
+seL4_BenchmarkFinalizeLog(void)
+{
+}
+
+static inline seL4_Word
+seL4_BenchmarkLogSize(void)
+{
+    return 0;
+}
+
+static inline seL4_Word
+seL4_BenchmarkDumpLog(seL4_Word start, seL4_Word size)
+{
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Host stand ins for the parts of libsel4 that sel4bench/logging.h uses */
+
+#pragma once
+
+#include <stdint.h>
+#include <autoconf.h>
+
+typedef uintptr_t seL4_Word;
+
+typedef struct {
+    seL4_Word key;
+    seL4_Word data;
+} seL4_LogEntry;
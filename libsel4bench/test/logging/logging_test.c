@@ -0,0 +1,269 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Tests for the log sorting and grouping in sel4bench/logging.h, run on the
+ * host. logging.c is included directly so that malloc can be made to fail,
+ * which forces the fallbacks that work without scratch space. Every entry's
+ * data is its original position, so order within a key can be checked. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+static int fail_malloc;
+
+static void *
+test_malloc(size_t size)
+{
+    return fail_malloc ? NULL : malloc(size);
+}
+
+#define malloc test_malloc
+#include "../../src/logging.c"
+#undef malloc
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    uint64_t _a = (a), _b = (b); \
+    if (_a != _b) { \
+        printf("%s:%d: %s is %" PRIu64 ", expected %" PRIu64 "\n", __FILE__, __LINE__, #a, _a, _b); \
+        failures++; \
+    } \
+} while (0)
+
+#define MAX_LOGS 5000
+#define MAX_GROUPS 300
+
+static kernel_log_entry_t logs[MAX_LOGS];
+static kernel_log_entry_t expected[MAX_LOGS];
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* Fill the log with keys below max_key, or anywhere in a word if max_key is 0 */
+static void
+make_log(unsigned int num_logs, seL4_Word max_key)
+{
+    for (unsigned int i = 0; i < num_logs; i++) {
+        seL4_Word key = (seL4_Word) rng();
+        kernel_logging_entry_set_key(&logs[i], max_key ? key % max_key : key);
+        kernel_logging_entry_set_data(&logs[i], i);
+    }
+}
+
+/* Orders by key then original position, which is what a stable sort gives */
+static int
+compare_stable(const void *a, const void *b)
+{
+    kernel_log_entry_t *x = (kernel_log_entry_t *) a, *y = (kernel_log_entry_t *) b;
+    seL4_Word kx = kernel_logging_entry_get_key(x), ky = kernel_logging_entry_get_key(y);
+    if (kx != ky) {
+        return kx < ky ? -1 : 1;
+    }
+    return kernel_logging_entry_get_data(x) < kernel_logging_entry_get_data(y) ? -1 : 1;
+}
+
+static int
+stably_sorted(unsigned int num_logs)
+{
+    memcpy(expected, logs, num_logs * sizeof(logs[0]));
+    qsort(expected, num_logs, sizeof(expected[0]), compare_stable);
+    return memcmp(logs, expected, num_logs * sizeof(logs[0])) == 0;
+}
+
+/* Check logs holds the same entries as expected, sorted by key in any order
+ * within a key */
+static int
+sorted(unsigned int num_logs)
+{
+    for (unsigned int i = 1; i < num_logs; i++) {
+        if (kernel_logging_entry_get_key(&logs[i - 1]) > kernel_logging_entry_get_key(&logs[i])) {
+            return 0;
+        }
+    }
+    static kernel_log_entry_t copy[MAX_LOGS];
+    memcpy(copy, logs, num_logs * sizeof(logs[0]));
+    qsort(copy, num_logs, sizeof(copy[0]), compare_stable);
+    qsort(expected, num_logs, sizeof(expected[0]), compare_stable);
+    return memcmp(copy, expected, num_logs * sizeof(logs[0])) == 0;
+}
+
+static void
+test_stable_sort(void)
+{
+    /* one radix pass, several, every bit of the key, and all keys the same */
+    static const seL4_Word max_keys[] = {7, 256, 1000, 1ul << 20, 0, 1};
+    static const unsigned int sizes[] = {0, 1, 2, 100, MAX_LOGS};
+
+    for (int f = 0; f < 2; f++) {
+        fail_malloc = f;
+        for (int k = 0; k < sizeof(max_keys) / sizeof(max_keys[0]); k++) {
+            for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                if (fail_malloc && sizes[s] == MAX_LOGS) {
+                    /* insertion sort is too slow for the big one */
+                    continue;
+                }
+                make_log(sizes[s], max_keys[k]);
+                logging_stable_sort_log(logs, sizes[s]);
+                CHECK(stably_sorted(sizes[s]));
+            }
+        }
+    }
+    fail_malloc = 0;
+}
+
+/* keys that differ only in their top digit need every pass */
+static void
+test_radix_top_digit(void)
+{
+    seL4_Word top = (seL4_Word) 1 << (sizeof(seL4_Word) * 8 - 1);
+    for (unsigned int i = 0; i < 1000; i++) {
+        kernel_logging_entry_set_key(&logs[i], (i % 3) * (top >> 1) + (i % 2 ? top : 0) + (i % 5));
+        kernel_logging_entry_set_data(&logs[i], i);
+    }
+    logging_stable_sort_log(logs, 1000);
+    CHECK(stably_sorted(1000));
+}
+
+static void
+test_unstable_sort(void)
+{
+    for (int f = 0; f < 2; f++) {
+        fail_malloc = f;
+        for (unsigned int n = 0; n < 300; n += 7) {
+            make_log(n, n % 2 ? 50 : 0);
+            memcpy(expected, logs, n * sizeof(logs[0]));
+            logging_sort_log(logs, n);
+            CHECK(sorted(n));
+        }
+        make_log(MAX_LOGS, 100);
+        memcpy(expected, logs, sizeof(logs));
+        logging_sort_log(logs, MAX_LOGS);
+        CHECK(sorted(MAX_LOGS));
+    }
+    fail_malloc = 0;
+}
+
+/* Check the groups from sorting and grouping the current log, which was made
+ * with keys below max_key */
+static void
+check_groups(unsigned int num_logs, seL4_Word max_key, unsigned int max_groups)
+{
+    unsigned int sizes[MAX_GROUPS], offsets[MAX_GROUPS];
+    unsigned int counts[MAX_GROUPS] = {0};
+    unsigned int overflow = 0;
+
+    for (unsigned int i = 0; i < num_logs; i++) {
+        seL4_Word key = kernel_logging_entry_get_key(&logs[i]);
+        if (key < max_groups) {
+            counts[key]++;
+        } else {
+            overflow++;
+        }
+    }
+    memcpy(expected, logs, num_logs * sizeof(logs[0]));
+
+    CHECK_EQ(logging_sort_and_group_log(logs, num_logs, sizes, offsets, max_groups), overflow);
+    unsigned int index = 0;
+    for (unsigned int g = 0; g < max_groups; g++) {
+        CHECK_EQ(sizes[g], counts[g]);
+        CHECK_EQ(offsets[g], index);
+        for (unsigned int j = 0; j < sizes[g]; j++) {
+            kernel_log_entry_t *entry = &logs[offsets[g] + j];
+            CHECK_EQ(kernel_logging_entry_get_key(entry), g);
+            /* only the counting sort keeps time order within a group */
+            if (!fail_malloc && j > 0) {
+                CHECK(kernel_logging_entry_get_data(entry) > kernel_logging_entry_get_data(entry - 1));
+            }
+        }
+        index += sizes[g];
+    }
+    for (unsigned int i = index; i < num_logs; i++) {
+        CHECK(kernel_logging_entry_get_key(&logs[i]) >= max_groups);
+    }
+
+    /* nothing is lost or duplicated */
+    qsort(expected, num_logs, sizeof(expected[0]), compare_stable);
+    static kernel_log_entry_t copy[MAX_LOGS];
+    memcpy(copy, logs, num_logs * sizeof(logs[0]));
+    qsort(copy, num_logs, sizeof(copy[0]), compare_stable);
+    CHECK(memcmp(copy, expected, num_logs * sizeof(logs[0])) == 0);
+}
+
+static void
+test_sort_and_group(void)
+{
+    for (int f = 0; f < 2; f++) {
+        fail_malloc = f;
+        /* all in groups, some out, most out and none at all */
+        make_log(MAX_LOGS, 20);
+        check_groups(MAX_LOGS, 20, 20);
+        make_log(MAX_LOGS, 30);
+        check_groups(MAX_LOGS, 30, 20);
+        make_log(MAX_LOGS, 0);
+        check_groups(MAX_LOGS, 0, MAX_GROUPS);
+        make_log(100, 20);
+        check_groups(100, 20, 0);
+        make_log(0, 20);
+        check_groups(0, 20, 20);
+    }
+    fail_malloc = 0;
+}
+
+/* grouping an already sorted log */
+static void
+test_group_by_key(void)
+{
+    unsigned int sizes[5], offsets[5];
+    static const seL4_Word keys[] = {0, 0, 2, 2, 2, 3, 7};
+
+    for (unsigned int i = 0; i < 7; i++) {
+        kernel_logging_entry_set_key(&logs[i], keys[i]);
+    }
+    logging_group_log_by_key(logs, 7, sizes, offsets, 5);
+    CHECK(sizes[0] == 2 && offsets[0] == 0);
+    CHECK(sizes[1] == 0 && offsets[1] == 2);
+    CHECK(sizes[2] == 3 && offsets[2] == 2);
+    CHECK(sizes[3] == 1 && offsets[3] == 5);
+    CHECK(sizes[4] == 0 && offsets[4] == 6);
+}
+
+int
+main(void)
+{
+    test_stable_sort();
+    test_radix_top_digit();
+    test_unstable_sort();
+    test_sort_and_group();
+    test_group_by_key();
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All logging tests passed\n");
+    return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Tests for sel4bench/multiplex.h, run on the host against a simulated PMU.
+ * Each simulated event has a known rate in events per cycle, so the
+ * multiplexer's estimates can be checked against the true totals. */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sel4bench/multiplex.h>
+
+#define SIM_EVENTS 16
+
+typedef struct sim_pmu {
+    unsigned int num_counters;
+    unsigned int counter_bits;
+    uint64_t cycles;
+    uint64_t counters[SEL4BENCH_MUX_MAX_COUNTERS];
+    uint32_t programmed[SEL4BENCH_MUX_MAX_COUNTERS];
+    uint32_t running;
+    /* events per cycle for each event, and the true totals */
+    double rates[SIM_EVENTS];
+    double totals[SIM_EVENTS];
+} sim_pmu_t;
+
+static unsigned int
+sim_num_counters(void *cookie)
+{
+    return ((sim_pmu_t *) cookie)->num_counters;
+}
+
+static void
+sim_set_count_event(void *cookie, unsigned int counter, uint32_t event)
+{
+    ((sim_pmu_t *) cookie)->programmed[counter] = event;
+}
+
+static void
+sim_start_counters(void *cookie, uint32_t counters)
+{
+    ((sim_pmu_t *) cookie)->running |= counters;
+}
+
+static void
+sim_stop_counters(void *cookie, uint32_t counters)
+{
+    ((sim_pmu_t *) cookie)->running &= ~counters;
+}
+
+static uint64_t
+sim_mask(sim_pmu_t *pmu)
+{
+    return pmu->counter_bits == 64 ? UINT64_MAX : (1ull << pmu->counter_bits) - 1;
+}
+
+static uint64_t
+sim_get_counters(void *cookie, uint32_t counters, uint64_t *values)
+{
+    sim_pmu_t *pmu = cookie;
+
+    for (unsigned int i = 0; i < pmu->num_counters; i++) {
+        if (counters & (1u << i)) {
+            values[i] = pmu->counters[i] & sim_mask(pmu);
+        }
+    }
+    return pmu->cycles & sim_mask(pmu);
+}
+
+/* Run the workload for some cycles, with every event at its current rate */
+static void
+sim_run(sim_pmu_t *pmu, uint64_t cycles)
+{
+    pmu->cycles += cycles;
+    for (unsigned int e = 0; e < SIM_EVENTS; e++) {
+        pmu->totals[e] += pmu->rates[e] * cycles;
+    }
+    for (unsigned int i = 0; i < pmu->num_counters; i++) {
+        if (pmu->running & (1u << i)) {
+            pmu->counters[i] += (uint64_t) llround(pmu->rates[pmu->programmed[i]] * cycles);
+        }
+    }
+}
+
+static void
+sim_init(sim_pmu_t *pmu, sel4bench_mux_backend_t *backend, unsigned int num_counters,
+         unsigned int counter_bits, uint64_t start)
+{
+    memset(pmu, 0, sizeof(*pmu));
+    pmu->num_counters = num_counters;
+    pmu->counter_bits = counter_bits;
+    pmu->cycles = start;
+    for (unsigned int i = 0; i < num_counters; i++) {
+        pmu->counters[i] = start;
+    }
+    for (unsigned int e = 0; e < SIM_EVENTS; e++) {
+        pmu->rates[e] = (e + 1) / 8.0;
+    }
+
+    *backend = (sel4bench_mux_backend_t) {
+        .cookie = pmu,
+        .num_counters = sim_num_counters,
+        .set_count_event = sim_set_count_event,
+        .start_counters = sim_start_counters,
+        .stop_counters = sim_stop_counters,
+        .get_counters = sim_get_counters,
+        .counter_bits = counter_bits,
+    };
+}
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    uint64_t _a = (a), _b = (b); \
+    if (_a != _b) { \
+        printf("%s:%d: %s is %" PRIu64 ", expected %" PRIu64 "\n", __FILE__, __LINE__, #a, _a, _b); \
+        failures++; \
+    } \
+} while (0)
+
+static void
+test_setup(void)
+{
+    sim_pmu_t pmu;
+    sel4bench_mux_backend_t backend;
+    sel4bench_mux_t mux;
+
+    sim_init(&pmu, &backend, 0, 64, 0);
+    CHECK(sel4bench_mux_init(&mux, &backend) == -1);
+
+    sim_init(&pmu, &backend, 4, 64, 0);
+    CHECK(sel4bench_mux_init(&mux, &backend) == 0);
+    for (int i = 0; i < SEL4BENCH_MUX_MAX_EVENTS; i++) {
+        CHECK(sel4bench_mux_add_event(&mux, i % SIM_EVENTS) == i);
+    }
+    CHECK(sel4bench_mux_add_event(&mux, 0) == -1);
+    CHECK_EQ(sel4bench_mux_num_groups(&mux), SEL4BENCH_MUX_MAX_EVENTS / 4);
+}
+
+/* with no more events than counters every count is exact */
+static void
+test_exact(void)
+{
+    sim_pmu_t pmu;
+    sel4bench_mux_backend_t backend;
+    sel4bench_mux_t mux;
+    sel4bench_mux_result_t result;
+
+    sim_init(&pmu, &backend, 4, 64, 12345);
+    sel4bench_mux_init(&mux, &backend);
+    for (int e = 0; e < 3; e++) {
+        sel4bench_mux_add_event(&mux, e);
+    }
+    CHECK_EQ(sel4bench_mux_num_groups(&mux), 1);
+    for (int i = 0; i < 10; i++) {
+        sel4bench_mux_begin(&mux);
+        sim_run(&pmu, 8000);
+        sel4bench_mux_end(&mux);
+    }
+    for (int e = 0; e < 3; e++) {
+        sel4bench_mux_get_result(&mux, e, &result);
+        CHECK_EQ(result.count, (uint64_t) pmu.totals[e]);
+        CHECK(result.estimate == pmu.totals[e]);
+        CHECK(result.active == 1);
+        CHECK(result.error == 0);
+    }
+}
+
+/* counters that wrap within a slice still give the right difference */
+static void
+test_wrap(void)
+{
+    sim_pmu_t pmu;
+    sel4bench_mux_backend_t backend;
+    sel4bench_mux_t mux;
+    sel4bench_mux_result_t result;
+
+    sim_init(&pmu, &backend, 2, 32, UINT32_MAX - 1000);
+    sel4bench_mux_init(&mux, &backend);
+    sel4bench_mux_add_event(&mux, 7);
+    sel4bench_mux_begin(&mux);
+    sim_run(&pmu, 16000);
+    sel4bench_mux_end(&mux);
+
+    CHECK_EQ(mux.total_cycles, 16000);
+    sel4bench_mux_get_result(&mux, 0, &result);
+    CHECK_EQ(result.count, 16000);
+    CHECK(result.estimate == 16000);
+}
+
+/* three groups rotating over a long run with constant rates are estimated
+ * closely, and with varying rates the truth is within the reported error */
+static void
+test_rotation(int vary)
+{
+    sim_pmu_t pmu;
+    sel4bench_mux_backend_t backend;
+    sel4bench_mux_t mux;
+    sel4bench_mux_result_t result;
+
+    sim_init(&pmu, &backend, 4, 32, UINT32_MAX - 50000);
+    sel4bench_mux_init(&mux, &backend);
+    for (int e = 0; e < 10; e++) {
+        sel4bench_mux_add_event(&mux, e);
+    }
+    CHECK_EQ(sel4bench_mux_num_groups(&mux), 3);
+
+    sel4bench_mux_begin(&mux);
+    for (int i = 0; i < 3000; i++) {
+        if (vary) {
+            for (int e = 0; e < SIM_EVENTS; e++) {
+                pmu.rates[e] = (e + 1) / 8.0 * (1 + 0.5 * sin(i * 0.37 + e));
+            }
+        }
+        sim_run(&pmu, 1000 + i % 7);
+        sel4bench_mux_rotate(&mux);
+    }
+    sel4bench_mux_end(&mux);
+
+    for (int e = 0; e < 10; e++) {
+        sel4bench_mux_get_result(&mux, e, &result);
+        double diff = fabs(result.estimate - pmu.totals[e]);
+        CHECK(result.active > 0.3 && result.active < 0.4);
+        if (vary) {
+            CHECK(result.error > 0);
+            CHECK(diff < 4 * result.error);
+        } else {
+            CHECK(diff < pmu.totals[e] * 0.001);
+        }
+    }
+
+    sel4bench_mux_reset(&mux);
+    CHECK_EQ(mux.total_cycles, 0);
+    CHECK_EQ(mux.num_events, 10);
+    sel4bench_mux_get_result(&mux, 0, &result);
+    CHECK(result.error == -1);
+}
+
+int
+main(void)
+{
+    test_setup();
+    test_exact();
+    test_wrap();
+    test_rotation(0);
+    test_rotation(1);
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All multiplex tests passed\n");
+    return 0;
+}
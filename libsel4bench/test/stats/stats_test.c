@@ -0,0 +1,229 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Unit tests for sel4bench/stats.h, run on the host. stats.c is included
+ * directly so that the bucket boundaries can be checked. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "../../src/stats.c"
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    uint64_t _a = (a), _b = (b); \
+    if (_a != _b) { \
+        printf("%s:%d: %s is %" PRIu64 ", expected %" PRIu64 "\n", __FILE__, __LINE__, #a, _a, _b); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_WITHIN(a, b, tolerance) do { \
+    double _a = (a), _b = (b); \
+    if (fabs(_a - _b) > (tolerance) * (fabs(_b) > 1 ? fabs(_b) : 1)) { \
+        printf("%s:%d: %s is %.12g, expected %.12g\n", __FILE__, __LINE__, #a, _a, _b); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(a, b) CHECK_WITHIN(a, b, 1e-9)
+
+#define SUB_BITS 3
+#define MAX_BITS 12
+#define NUM_BUCKETS SEL4BENCH_HISTOGRAM_BUCKETS(SUB_BITS, MAX_BITS)
+
+static uint32_t counts[SEL4BENCH_HISTOGRAM_BUCKETS(8, 20)];
+
+static void
+test_mean_variance(void)
+{
+    sel4bench_stats_t stats;
+    static const uint64_t samples[] = {2, 4, 4, 4, 5, 5, 7, 9};
+
+    sel4bench_stats_init(&stats, NULL, 0);
+    CHECK_NEAR(sel4bench_stats_variance(&stats), 0);
+    sel4bench_stats_record(&stats, 10);
+    CHECK_NEAR(stats.mean, 10);
+    CHECK_NEAR(sel4bench_stats_variance(&stats), 0);
+
+    sel4bench_stats_reset(&stats);
+    for (int i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        sel4bench_stats_record(&stats, samples[i]);
+    }
+    CHECK_EQ(stats.count, 8);
+    CHECK_EQ(stats.min, 2);
+    CHECK_EQ(stats.max, 9);
+    CHECK_NEAR(stats.mean, 5);
+    /* sum of squared differences is 32 */
+    CHECK_NEAR(sel4bench_stats_variance(&stats), 32.0 / 7);
+    CHECK_NEAR(sel4bench_stats_stddev(&stats), sqrt(32.0 / 7));
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 50), 0);
+
+    /* a large common offset, such as a second's worth of cycles, only costs
+     * what the precision of the mean allows */
+    sel4bench_stats_reset(&stats);
+    for (int i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        sel4bench_stats_record(&stats, 1000000000ull + samples[i]);
+    }
+    CHECK_NEAR(stats.mean, 1000000005.0);
+    CHECK_WITHIN(sel4bench_stats_variance(&stats), 32.0 / 7, 1e-6);
+}
+
+static void
+test_overhead_outliers(void)
+{
+    sel4bench_stats_t stats;
+
+    sel4bench_stats_init(&stats, NULL, 3);
+    stats.outlier_limit = 100;
+    sel4bench_stats_record(&stats, 1);
+    sel4bench_stats_record(&stats, 3);
+    sel4bench_stats_record(&stats, 7);
+    sel4bench_stats_record(&stats, 103);
+    sel4bench_stats_record(&stats, 104);
+    /* 0, 0, 4, 100 are kept, 101 is an outlier */
+    CHECK_EQ(stats.count, 4);
+    CHECK_EQ(stats.outliers, 1);
+    CHECK_EQ(stats.min, 0);
+    CHECK_EQ(stats.max, 100);
+    CHECK_NEAR(stats.mean, 26);
+
+    sel4bench_stats_reset(&stats);
+    CHECK_EQ(stats.count, 0);
+    CHECK_EQ(stats.outliers, 0);
+    CHECK_EQ(stats.overhead, 3);
+    CHECK_EQ(stats.outlier_limit, 100);
+}
+
+static void
+test_bucket_boundaries(void)
+{
+    sel4bench_histogram_t hist;
+
+    sel4bench_histogram_init(&hist, counts, NUM_BUCKETS, SUB_BITS);
+    /* 8 exact buckets, then 4 for each power of 2 up to 2^12 */
+    CHECK_EQ(NUM_BUCKETS, 8 + 9 * 4);
+
+    for (uint64_t v = 0; v < 8; v++) {
+        CHECK_EQ(bucket_index(&hist, v), v);
+        CHECK_EQ(bucket_low(&hist, v), v);
+        CHECK_EQ(bucket_high(&hist, v), v);
+    }
+    /* [8, 9] [10, 11] [12, 13] [14, 15] [16, 19] ... */
+    CHECK_EQ(bucket_index(&hist, 8), 8);
+    CHECK_EQ(bucket_index(&hist, 9), 8);
+    CHECK_EQ(bucket_index(&hist, 10), 9);
+    CHECK_EQ(bucket_index(&hist, 15), 11);
+    CHECK_EQ(bucket_index(&hist, 16), 12);
+    CHECK_EQ(bucket_index(&hist, 19), 12);
+    CHECK_EQ(bucket_index(&hist, 20), 13);
+    CHECK_EQ(bucket_low(&hist, 12), 16);
+    CHECK_EQ(bucket_high(&hist, 12), 19);
+    /* the last bucket takes everything from 2^12 - 2^9 up */
+    CHECK_EQ(bucket_low(&hist, NUM_BUCKETS - 1), 3584);
+    CHECK_EQ(bucket_index(&hist, 3583), NUM_BUCKETS - 2);
+    CHECK_EQ(bucket_index(&hist, 3584), NUM_BUCKETS - 1);
+    CHECK_EQ(bucket_index(&hist, UINT64_MAX), NUM_BUCKETS - 1);
+    CHECK_EQ(bucket_high(&hist, NUM_BUCKETS - 1), UINT64_MAX);
+
+    /* buckets tile the range, and are no wider than the promised precision */
+    for (size_t i = 0; i + 1 < NUM_BUCKETS; i++) {
+        uint64_t low = bucket_low(&hist, i);
+        uint64_t high = bucket_high(&hist, i);
+        CHECK(low <= high);
+        CHECK_EQ(bucket_low(&hist, i + 1), high + 1);
+        CHECK_EQ(bucket_index(&hist, low), i);
+        CHECK_EQ(bucket_index(&hist, high), i);
+        CHECK(high - low <= low >> (SUB_BITS - 1));
+    }
+
+    /* and the same at the precision used for real runs */
+    sel4bench_histogram_init(&hist, counts, SEL4BENCH_HISTOGRAM_BUCKETS(8, 20), 8);
+    for (uint64_t v = 1; v < (1ull << 20); v = v * 3 / 2 + 1) {
+        size_t i = bucket_index(&hist, v);
+        CHECK(bucket_low(&hist, i) <= v && v <= bucket_high(&hist, i));
+        CHECK(bucket_high(&hist, i) - bucket_low(&hist, i) <= v >> 7);
+    }
+}
+
+static void
+test_percentiles(void)
+{
+    sel4bench_histogram_t hist;
+    sel4bench_stats_t stats;
+
+    sel4bench_histogram_init(&hist, counts, SEL4BENCH_HISTOGRAM_BUCKETS(8, 20), 8);
+    sel4bench_stats_init(&stats, &hist, 0);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 50), 0);
+
+    /* values 1 to 200 all have exact buckets */
+    for (uint64_t v = 200; v > 0; v--) {
+        sel4bench_stats_record(&stats, v);
+    }
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 0), 1);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 0.1), 1);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 0.5), 1);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 0.6), 2);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 50), 100);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 50.1), 101);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 99), 198);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 99.9), 200);
+    CHECK_EQ(sel4bench_stats_percentile(&stats, 100), 200);
+    CHECK_EQ(sel4bench_histogram_count_above(&hist, 150), 50);
+    CHECK_EQ(sel4bench_histogram_count_above(&hist, 200), 0);
+    CHECK_EQ(sel4bench_histogram_count_above(&hist, 0), 200);
+    /* ranks 20 to 180 */
+    CHECK_NEAR(sel4bench_histogram_trimmed_mean(&hist, 10, 90), 100);
+    CHECK_NEAR(sel4bench_histogram_trimmed_mean(&hist, 0, 100), 100.5);
+    CHECK_NEAR(sel4bench_histogram_trimmed_mean(&hist, 90, 10), 0);
+
+    /* 1000 is in the bucket [1000, 1003], but nothing above it was recorded */
+    sel4bench_histogram_init(&hist, counts, SEL4BENCH_HISTOGRAM_BUCKETS(8, 20), 8);
+    for (int i = 0; i < 9; i++) {
+        sel4bench_histogram_record(&hist, 10);
+    }
+    sel4bench_histogram_record(&hist, 1000);
+    CHECK_EQ(sel4bench_histogram_percentile(&hist, 90), 10);
+    CHECK_EQ(sel4bench_histogram_percentile(&hist, 91), 1000);
+    sel4bench_histogram_record(&hist, 1002);
+    CHECK_EQ(sel4bench_histogram_percentile(&hist, 95), 1002);
+    CHECK_EQ(sel4bench_histogram_count_above(&hist, 999), 2);
+
+    /* values past max_bits all land in the last bucket */
+    sel4bench_histogram_init(&hist, counts, NUM_BUCKETS, SUB_BITS);
+    sel4bench_histogram_record(&hist, 5);
+    sel4bench_histogram_record(&hist, 1ull << 40);
+    CHECK_EQ(hist.counts[NUM_BUCKETS - 1], 1);
+    CHECK_EQ(sel4bench_histogram_percentile(&hist, 50), 5);
+    CHECK_EQ(sel4bench_histogram_percentile(&hist, 100), 1ull << 40);
+}
+
+int
+main(void)
+{
+    test_mean_variance();
+    test_overhead_outliers();
+    test_bucket_boundaries();
+    test_percentiles();
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All stats tests passed\n");
+    return 0;
+}
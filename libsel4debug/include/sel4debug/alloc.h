@@ -0,0 +1,64 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _LIBSEL4DEBUG_ALLOC_H_
+#define _LIBSEL4DEBUG_ALLOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Allocation site profiling for the malloc instrumentation in alloc.c. These
+ * functions are only provided when CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE is set and
+ * only produce meaningful results when allocation functions are wrapped as
+ * described in alloc.c.
+ */
+
+/* Per-site allocation statistics. A site is the return address of the call
+ * into malloc, calloc or realloc. A NULL site collects allocations from sites
+ * that did not fit in the profiling table.
+ */
+typedef struct {
+    void *site;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t live_count;
+    uint64_t live_bytes;
+    uint64_t peak_live_bytes;
+    uint64_t total_bytes;
+} debug_alloc_site_t;
+
+typedef enum {
+    /* Largest outstanding memory first; use to find leaks. */
+    DEBUG_ALLOC_SORT_LIVE_BYTES,
+    /* Most outstanding allocations first. */
+    DEBUG_ALLOC_SORT_LIVE_COUNT,
+    /* Most memory ever allocated first; use to find hot allocators. */
+    DEBUG_ALLOC_SORT_TOTAL_BYTES,
+    /* Most calls first. */
+    DEBUG_ALLOC_SORT_ALLOCS,
+} debug_alloc_sort_t;
+
+/* Copy the statistics of up to max sites that have allocated since the last
+ * reset into out, in no particular order. Returns the number copied. This does
+ * not allocate.
+ */
+size_t debug_alloc_profile_snapshot(debug_alloc_site_t *out, size_t max);
+
+/* Restart cumulative counters from the current live state. Calling this after
+ * a warm-up phase of a soak test means later dumps only show growth.
+ */
+void debug_alloc_profile_reset(void);
+
+/* Print per-site statistics sorted by the given key, descending. At most
+ * limit sites are printed; pass 0 to print all of them.
+ */
+void debug_alloc_profile_dump(debug_alloc_sort_t order, size_t limit);
+
+#endif
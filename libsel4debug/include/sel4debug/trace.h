@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _LIBSEL4DEBUG_TRACE_H_
+#define _LIBSEL4DEBUG_TRACE_H_
+
+#include <autoconf.h>
+
+#ifdef CONFIG_LIBSEL4DEBUG_FUNCTION_INSTRUMENTATION_TRACE_RING
+
+/* Print the calling thread's function trace ring. Recording is suspended for
+ * the thread while the dump is in progress.
+ */
+void debug_trace_dump(void) __attribute__((no_instrument_function));
+
+/* Print the function trace rings of every traced thread. This is intended to
+ * be called from a fault handler after another thread has faulted.
+ */
+void debug_trace_dump_all(void) __attribute__((no_instrument_function));
+
+/* Discard the calling thread's recorded events. */
+void debug_trace_reset(void) __attribute__((no_instrument_function));
+
+#else
+#define debug_trace_dump()
+#define debug_trace_dump_all()
+#define debug_trace_reset()
+#endif /* CONFIG_LIBSEL4DEBUG_FUNCTION_INSTRUMENTATION_TRACE_RING */
+
+#endif /* !_LIBSEL4DEBUG_TRACE_H_ */
@@ -48,6 +48,7 @@
 #include <stdio.h>
 #include <stdlib.h> /* for size_t */
 #include <string.h>
+#include <sel4debug/alloc.h>
 
 /* Maximum alignment of a data type. The malloc spec requires that returned
  * pointers are aligned to this.
@@ -79,6 +80,10 @@ static uintptr_t post_canary(void *ptr)
 typedef struct {
     uintptr_t canary;
     size_t size;
+#ifdef CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE
+    /* Allocation site this region is charged to. */
+    void *site;
+#endif
 } __attribute__((aligned(MAX_ALIGNMENT))) metadata_t;
 
 /* A `uintptr_t` that is not naturally aligned. It is necessary to explicitly
@@ -165,46 +170,131 @@ static void *unbox(void *ptr, void *ret_addr)
     return (void*)pre;
 }
 
-/* Buffer for tracking currently live heap pointers. This is used to detect
+/* Wrapped functions that will be exported to us from libmuslc. */
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+/* Hash set for tracking currently live heap pointers. This is used to detect
  * when the user attempts to free an invalid pointer. Note that we always track
  * *boxed* pointers as these are the ones seen by the user.
+ *
+ * The set uses open addressing with linear probing. Removed entries are left
+ * as tombstones so that probe sequences passing through them stay intact, and
+ * are discarded whenever the table is rebuilt. The table itself is allocated
+ * with the real allocation functions, so growing it never recurses into the
+ * wrappers below.
  */
 #ifndef CONFIG_LIBSEL4DEBUG_ALLOC_BUFFER_ENTRIES
 #define CONFIG_LIBSEL4DEBUG_ALLOC_BUFFER_ENTRIES 128
 #endif
-static uintptr_t alloced[CONFIG_LIBSEL4DEBUG_ALLOC_BUFFER_ENTRIES];
+
+/* Slot markers. Neither can collide with a boxed pointer, which is always
+ * MAX_ALIGNMENT aligned and never NULL.
+ */
+#define SLOT_EMPTY     ((uintptr_t)0)
+#define SLOT_TOMBSTONE ((uintptr_t)1)
+
+static uintptr_t *alloced = NULL;
+static size_t alloced_capacity = 0; /* always 0 or a power of 2 */
+static size_t alloced_live = 0;
+static size_t alloced_tombstones = 0;
+
+static size_t slot_of(uintptr_t ptr)
+{
+    /* The low bits of a boxed pointer are always 0, so mix the remaining bits
+     * down before masking.
+     */
+    uintptr_t h = ptr / MAX_ALIGNMENT;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return (size_t)h & (alloced_capacity - 1);
+}
+
+/* Insert a pointer known not to be in the set, without checking for space. */
+static void insert_slot(uintptr_t ptr)
+{
+    size_t i = slot_of(ptr);
+    while (alloced[i] != SLOT_EMPTY && alloced[i] != SLOT_TOMBSTONE) {
+        i = (i + 1) & (alloced_capacity - 1);
+    }
+    if (alloced[i] == SLOT_TOMBSTONE) {
+        alloced_tombstones--;
+    }
+    alloced[i] = ptr;
+    alloced_live++;
+}
+
+/* Rebuild the set into a table of the given capacity, dropping tombstones. */
+static void rehash(size_t capacity)
+{
+    uintptr_t *old = alloced;
+    size_t old_capacity = alloced_capacity;
+
+    alloced = __real_calloc(capacity, sizeof(uintptr_t));
+    if (alloced == NULL) {
+        alloced = old;
+        error("Failed to grow pointer tracking table to %zu entries\n",
+              capacity);
+    }
+    alloced_capacity = capacity;
+    alloced_live = 0;
+    alloced_tombstones = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i] != SLOT_EMPTY && old[i] != SLOT_TOMBSTONE) {
+            insert_slot(old[i]);
+        }
+    }
+    __real_free(old);
+}
 
 /* Track the given heap pointer as currently live. */
 static void track(void *ptr)
 {
-    if (sizeof(alloced) == 0 || ptr == NULL) {
-        /* Disable tracking if we have no buffer and never track NULL. */
+    if (CONFIG_LIBSEL4DEBUG_ALLOC_BUFFER_ENTRIES == 0 || ptr == NULL) {
+        /* Tracking is disabled and we never track NULL. */
         return;
     }
-    for (unsigned int i = 0; i < sizeof(alloced) / sizeof(uintptr_t); i++) {
-        if (alloced[i] == 0) {
-            /* Found a free slot. */
-            alloced[i] = (uintptr_t)ptr;
-            return;
+
+    /* Keep the load factor, counting tombstones, at or below 3/4. */
+    if ((alloced_live + alloced_tombstones + 1) * 4 > alloced_capacity * 3) {
+        size_t capacity = alloced_capacity;
+        if (capacity == 0) {
+            capacity = 8;
+            while (capacity < CONFIG_LIBSEL4DEBUG_ALLOC_BUFFER_ENTRIES) {
+                capacity *= 2;
+            }
+        }
+        /* If the table is mostly tombstones, clearing them out is enough. */
+        while ((alloced_live + 1) * 2 > capacity) {
+            capacity *= 2;
         }
+        rehash(capacity);
     }
-    /* Failed to find a free slot. */
-    error("Exhausted pointer tracking buffer; try increasing "
-          "CONFIG_LIBSEL4DEBUG_ALLOC_BUFFER_ENTRIES value\n");
+
+    insert_slot((uintptr_t)ptr);
 }
 
 /* Stop tracking the given pointer (mark it as dead). */
 static void untrack(void *ptr, void *ret_addr)
 {
-    if (sizeof(alloced) == 0 || ptr == NULL) {
-        /* Ignore tracking if we have no buffer or are freeing NULL. */
+    if (CONFIG_LIBSEL4DEBUG_ALLOC_BUFFER_ENTRIES == 0 || ptr == NULL) {
+        /* Ignore tracking if it is disabled or we are freeing NULL. */
         return;
     }
-    for (unsigned int i = 0; i < sizeof(alloced) / sizeof(uintptr_t); i++) {
-        if (alloced[i] == (uintptr_t)ptr) {
-            /* Found it. */
-            alloced[i] = 0;
-            return;
+    if (alloced_capacity > 0) {
+        for (size_t i = slot_of((uintptr_t)ptr); alloced[i] != SLOT_EMPTY;
+                i = (i + 1) & (alloced_capacity - 1)) {
+            if (alloced[i] == (uintptr_t)ptr) {
+                /* Found it. */
+                alloced[i] = SLOT_TOMBSTONE;
+                alloced_live--;
+                alloced_tombstones++;
+                return;
+            }
         }
     }
     /* Failed to find it. */
@@ -212,11 +302,163 @@ static void untrack(void *ptr, void *ret_addr)
           "to %p)\n", ptr, ret_addr);
 }
 
-/* Wrapped functions that will be exported to us from libmuslc. */
-void *__real_malloc(size_t size);
-void __real_free(void *ptr);
-void *__real_calloc(size_t num, size_t size);
-void *__real_realloc(void *ptr, size_t size);
+#ifdef CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE
+
+/* Allocation site profiler. Every allocation is charged to the return address
+ * of the wrapper that made it, and every free is credited back to the site
+ * recorded in the region's metadata. Sites are kept in a fixed open-addressed
+ * table that is never shrunk; allocations from sites that do not fit are
+ * charged to a single overflow entry with a NULL site.
+ */
+#ifndef CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE_SITES
+#define CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE_SITES 256
+#endif
+#define PROFILE_SITES (CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE_SITES + 1)
+
+static debug_alloc_site_t sites[PROFILE_SITES];
+static debug_alloc_site_t *const overflow_site =
+    &sites[CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE_SITES];
+
+static debug_alloc_site_t *lookup_site(void *site)
+{
+    if (site == NULL) {
+        return overflow_site;
+    }
+    size_t start = ((uintptr_t)site ^ ((uintptr_t)site >> 12)) %
+                   CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE_SITES;
+    size_t i = start;
+    do {
+        if (sites[i].site == site) {
+            return &sites[i];
+        }
+        if (sites[i].site == NULL) {
+            sites[i].site = site;
+            return &sites[i];
+        }
+        i = (i + 1) % CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE_SITES;
+    } while (i != start);
+    return overflow_site;
+}
+
+static void profile_alloc(void *ptr, void *site)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    metadata_t *pre = (metadata_t*)(ptr - sizeof(*pre));
+    debug_alloc_site_t *s = lookup_site(site);
+    /* Remember the entry actually charged so the free is credited to it even
+     * if this site ended up in the overflow entry.
+     */
+    pre->site = s->site;
+    s->allocs++;
+    s->total_bytes += pre->size;
+    s->live_count++;
+    s->live_bytes += pre->size;
+    if (s->live_bytes > s->peak_live_bytes) {
+        s->peak_live_bytes = s->live_bytes;
+    }
+}
+
+static void profile_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    metadata_t *pre = (metadata_t*)(ptr - sizeof(*pre));
+    debug_alloc_site_t *s = lookup_site(pre->site);
+    s->frees++;
+    s->live_count--;
+    s->live_bytes -= pre->size;
+}
+
+size_t debug_alloc_profile_snapshot(debug_alloc_site_t *out, size_t max)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < PROFILE_SITES && n < max; i++) {
+        if (sites[i].allocs > 0) {
+            out[n++] = sites[i];
+        }
+    }
+    return n;
+}
+
+void debug_alloc_profile_reset(void)
+{
+    /* Cumulative counters restart from here but live state is kept, so frees
+     * of regions allocated before the reset still balance.
+     */
+    for (size_t i = 0; i < PROFILE_SITES; i++) {
+        sites[i].allocs = sites[i].live_count;
+        sites[i].frees = 0;
+        sites[i].total_bytes = sites[i].live_bytes;
+        sites[i].peak_live_bytes = sites[i].live_bytes;
+    }
+}
+
+static uint64_t sort_key(const debug_alloc_site_t *s, debug_alloc_sort_t order)
+{
+    switch (order) {
+    case DEBUG_ALLOC_SORT_LIVE_COUNT:
+        return s->live_count;
+    case DEBUG_ALLOC_SORT_TOTAL_BYTES:
+        return s->total_bytes;
+    case DEBUG_ALLOC_SORT_ALLOCS:
+        return s->allocs;
+    case DEBUG_ALLOC_SORT_LIVE_BYTES:
+    default:
+        return s->live_bytes;
+    }
+}
+
+/* Scratch space for dumping. The snapshot is taken before anything is printed
+ * so allocations made by stdio during the dump do not disturb the report.
+ */
+static debug_alloc_site_t dump_buffer[PROFILE_SITES];
+
+void debug_alloc_profile_dump(debug_alloc_sort_t order, size_t limit)
+{
+    size_t n = debug_alloc_profile_snapshot(dump_buffer, PROFILE_SITES);
+
+    /* Insertion sort, descending. The table is small and this avoids pulling
+     * in anything that might allocate.
+     */
+    for (size_t i = 1; i < n; i++) {
+        debug_alloc_site_t tmp = dump_buffer[i];
+        uint64_t key = sort_key(&tmp, order);
+        size_t j = i;
+        while (j > 0 && sort_key(&dump_buffer[j - 1], order) < key) {
+            dump_buffer[j] = dump_buffer[j - 1];
+            j--;
+        }
+        dump_buffer[j] = tmp;
+    }
+
+    if (limit == 0 || limit > n) {
+        limit = n;
+    }
+    printf("%-18s %10s %10s %10s %12s %12s %12s\n", "site", "allocs", "frees",
+           "live", "live bytes", "peak bytes", "total bytes");
+    for (size_t i = 0; i < limit; i++) {
+        debug_alloc_site_t *s = &dump_buffer[i];
+        printf("%-18p %10llu %10llu %10llu %12llu %12llu %12llu\n", s->site,
+               (unsigned long long)s->allocs, (unsigned long long)s->frees,
+               (unsigned long long)s->live_count,
+               (unsigned long long)s->live_bytes,
+               (unsigned long long)s->peak_live_bytes,
+               (unsigned long long)s->total_bytes);
+    }
+    if (limit < n) {
+        printf("(%zu more sites not shown)\n", n - limit);
+    }
+}
+
+#else
+
+#define profile_alloc(ptr, site) do { } while (0)
+#define profile_free(ptr) do { } while (0)
+
+#endif /* CONFIG_LIBSEL4DEBUG_ALLOC_PROFILE */
 
 /* Actual allocation wrappers follow. */
 
@@ -230,6 +472,8 @@ void *__wrap_malloc(size_t size)
     void *ptr = __real_malloc(new_size);
     ptr = box(ptr, size);
     track(ptr);
+    profile_alloc(ptr, __builtin_extract_return_addr(
+                      __builtin_return_address(0)));
     return ptr;
 }
 
@@ -243,6 +487,7 @@ void __wrap_free(void *ptr)
     void *ret = __builtin_extract_return_addr(__builtin_return_address(0));
 
     untrack(ptr, ret);
+    profile_free(ptr);
 
     /* Write garbage all over the region we were handed back to try to expose
      * use-after-free bugs. If we fault while doing this, it probably means the
@@ -272,6 +517,8 @@ void *__wrap_calloc(size_t num, size_t size)
     void *ptr = __real_calloc(new_num, size);
     ptr = box(ptr, num * size);
     track(ptr);
+    profile_alloc(ptr, __builtin_extract_return_addr(
+                      __builtin_return_address(0)));
     return ptr;
 }
 
@@ -284,10 +531,12 @@ void *__wrap_realloc(void *ptr, size_t size)
     void *ret = __builtin_extract_return_addr(__builtin_return_address(0));
 
     untrack(ptr, ret);
+    profile_free(ptr);
     ptr = unbox(ptr, ret);
     size_t new_size = adjust_size(size);
     ptr = __real_realloc(ptr, new_size);
     ptr = box(ptr, size);
     track(ptr);
+    profile_alloc(ptr, ret);
     return ptr;
 }
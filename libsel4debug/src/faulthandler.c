@@ -16,6 +16,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sel4debug/faults.h>
+#include <sel4debug/trace.h>
 #include <sel4debug/unknown_syscall.h>
 #include <sel4debug/user_exception.h>
 
@@ -117,6 +118,9 @@ int debug_fault_handler(seL4_CPtr faultep,
             }
         }
         }
+
+        /* Show what led up to the fault if function tracing is enabled. */
+        debug_trace_dump_all();
     }
 
     assert(!"unreachable");
@@ -9,8 +9,11 @@
  */
 
 #include <autoconf.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <sel4debug/debug.h>
 #include <sel4debug/instrumentation.h>
+#include <sel4debug/trace.h>
 
 #ifdef CONFIG_LIBSEL4DEBUG_FUNCTION_INSTRUMENTATION_TRACE
 
@@ -36,3 +39,182 @@ void __cyg_profile_func_exit(void *func, void *caller)
 }
 
 #endif
+
+#ifdef CONFIG_LIBSEL4DEBUG_FUNCTION_INSTRUMENTATION_TRACE_RING
+
+#include <sel4/sel4.h>
+#include <sel4bench/sel4bench.h>
+#include <utils/util.h>
+
+/* Binary function tracing. Each thread records (function, caller, cycle count)
+ * for every function entry and exit into its own ring buffer, overwriting the
+ * oldest events when full. Recording an event is a handful of stores and a
+ * cycle counter read; nothing is formatted until the rings are dumped. The
+ * dump output is intended to be fed to tools/trace_decode.py.
+ *
+ * Enable this in your app with the same CFLAGS as described for the printf
+ * trace above.
+ *
+ * Rings are handed out from a static pool on a thread's first event. As with
+ * the backtrace instrumentation, we find a thread's ring through the word
+ * directly following its IPC buffer, which is assumed to be mapped, zeroed and
+ * otherwise unused. Threads that arrive after the pool is exhausted are not
+ * traced.
+ */
+
+#define RING_ENTRIES CONFIG_LIBSEL4DEBUG_TRACE_RING_ENTRIES
+#define RING_MASK (RING_ENTRIES - 1)
+compile_time_assert(trace_ring_entries_pow2, (RING_ENTRIES & RING_MASK) == 0);
+
+/* Set in the cycle stamp of exit events. The cycle counter will not reach this
+ * bit in practice.
+ */
+#define EXIT_FLAG (1ull << 63)
+
+typedef struct {
+    uintptr_t func;
+    uintptr_t caller;
+    uint64_t stamp;
+} trace_event_t;
+
+typedef struct {
+    /* IPC buffer of the owning thread, used to identify it in dumps. */
+    seL4_IPCBuffer *owner;
+    /* Total events ever recorded. The next slot is head & RING_MASK. */
+    uint64_t head;
+    /* Non-zero while recording is suspended, e.g. during a dump. */
+    volatile int paused;
+    trace_event_t events[RING_ENTRIES];
+} trace_ring_t;
+
+static trace_ring_t rings[CONFIG_LIBSEL4DEBUG_TRACE_RING_THREADS];
+static unsigned int rings_claimed = 0;
+
+/* Marker for threads that could not be given a ring. */
+static char no_ring_marker;
+#define NO_RING ((trace_ring_t*)&no_ring_marker)
+
+/* Don't instrument seL4_GetIPCBuffer so we don't recurse. */
+seL4_IPCBuffer *seL4_GetIPCBuffer(void) __attribute__((no_instrument_function));
+
+#define NO_INSTRUMENT __attribute__((no_instrument_function))
+
+static trace_ring_t **ring_slot(seL4_IPCBuffer *ipc) NO_INSTRUMENT;
+static trace_ring_t **ring_slot(seL4_IPCBuffer *ipc)
+{
+    return (trace_ring_t**)(((void*)ipc) + sizeof(seL4_IPCBuffer));
+}
+
+static trace_ring_t *claim_ring(seL4_IPCBuffer *ipc) NO_INSTRUMENT;
+static trace_ring_t *claim_ring(seL4_IPCBuffer *ipc)
+{
+    unsigned int i = __atomic_fetch_add(&rings_claimed, 1, __ATOMIC_RELAXED);
+    trace_ring_t *ring = NO_RING;
+    if (i < ARRAY_SIZE(rings)) {
+        ring = &rings[i];
+        ring->owner = ipc;
+    }
+    *ring_slot(ipc) = ring;
+    return ring;
+}
+
+static inline void record(void *func, void *caller, uint64_t flag)
+NO_INSTRUMENT;
+static inline void record(void *func, void *caller, uint64_t flag)
+{
+    seL4_IPCBuffer *ipc = seL4_GetIPCBuffer();
+    if (ipc == NULL) {
+        /* The caller doesn't have a valid IPC buffer. Assume it has not been
+         * setup yet and just skip recording.
+         */
+        return;
+    }
+    trace_ring_t *ring = *ring_slot(ipc);
+    if (ring == NULL) {
+        ring = claim_ring(ipc);
+    }
+    if (ring == NO_RING || ring->paused) {
+        return;
+    }
+
+    uint64_t ccnt;
+    SEL4BENCH_READ_CCNT(ccnt);
+
+    trace_event_t *e = &ring->events[ring->head & RING_MASK];
+    e->func = (uintptr_t)func;
+    e->caller = (uintptr_t)caller;
+    e->stamp = ccnt | flag;
+    ring->head++;
+}
+
+void __cyg_profile_func_enter(void *func, void *caller)
+{
+    record(func, caller, 0);
+}
+
+void __cyg_profile_func_exit(void *func, void *caller)
+{
+    record(func, caller, EXIT_FLAG);
+}
+
+static void dump_ring(trace_ring_t *ring) NO_INSTRUMENT;
+static void dump_ring(trace_ring_t *ring)
+{
+    ring->paused = 1;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    uint64_t head = ring->head;
+    uint64_t count = head < RING_ENTRIES ? head : RING_ENTRIES;
+
+    debug_safe_printf("TRACE_BEGIN thread=%p events=%llu lost=%llu\n",
+                      ring->owner, (unsigned long long)count,
+                      (unsigned long long)(head - count));
+    for (uint64_t i = head - count; i < head; i++) {
+        trace_event_t *e = &ring->events[i & RING_MASK];
+        debug_safe_printf("%c %p %p %llu\n", (e->stamp & EXIT_FLAG) ? 'X' : 'E',
+                          (void*)e->func, (void*)e->caller,
+                          (unsigned long long)(e->stamp & ~EXIT_FLAG));
+    }
+    debug_safe_printf("TRACE_END thread=%p\n", ring->owner);
+
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    ring->paused = 0;
+}
+
+void debug_trace_dump(void)
+{
+    seL4_IPCBuffer *ipc = seL4_GetIPCBuffer();
+    if (ipc == NULL) {
+        return;
+    }
+    trace_ring_t *ring = *ring_slot(ipc);
+    if (ring != NULL && ring != NO_RING) {
+        dump_ring(ring);
+    }
+}
+
+void debug_trace_dump_all(void)
+{
+    unsigned int claimed = __atomic_load_n(&rings_claimed, __ATOMIC_RELAXED);
+    for (unsigned int i = 0; i < claimed && i < ARRAY_SIZE(rings); i++) {
+        dump_ring(&rings[i]);
+    }
+    if (claimed > ARRAY_SIZE(rings)) {
+        debug_safe_printf("TRACE_NOTE untraced_threads=%u\n",
+                          claimed - (unsigned int)ARRAY_SIZE(rings));
+    }
+}
+
+void debug_trace_reset(void)
+{
+    seL4_IPCBuffer *ipc = seL4_GetIPCBuffer();
+    if (ipc == NULL) {
+        return;
+    }
+    trace_ring_t *ring = *ring_slot(ipc);
+    if (ring != NULL && ring != NO_RING) {
+        ring->head = 0;
+    }
+}
+
+#endif
@@ -0,0 +1,191 @@
+#!/usr/bin/env python
+#
+# Copyright 2014, NICTA
+#
+# This software may be distributed and modified according to the terms of
+# the BSD 2-Clause license. Note that NO WARRANTY is provided.
+# See "LICENSE_BSD2.txt" for details.
+#
+# @TAG(NICTA_BSD)
+#
+
+'''
+Decode function trace rings dumped by libsel4debug's binary trace
+instrumentation (CONFIG_LIBSEL4DEBUG_FUNCTION_INSTRUMENTATION_TRACE_RING).
+
+The input is a serial log containing one or more blocks of the form
+
+  TRACE_BEGIN thread=<ipc buffer> events=<n> lost=<n>
+  E|X <function> <caller> <cycles>
+  ...
+  TRACE_END thread=<ipc buffer>
+
+Other lines are ignored. By default per-function call counts and inclusive and
+exclusive cycle totals are printed. With --folded, stacks are emitted in the
+folded format understood by flamegraph.pl instead.
+'''
+
+import argparse, bisect, collections, re, subprocess, sys
+
+BEGIN = re.compile(r'TRACE_BEGIN thread=(\S+)')
+END = re.compile(r'TRACE_END')
+EVENT = re.compile(r'([EX]) (0x[0-9a-fA-F]+|\(nil\)) (0x[0-9a-fA-F]+|\(nil\)) (\d+)')
+
+def parse_addr(s):
+    return 0 if s == '(nil)' else int(s, 16)
+
+def read_blocks(f):
+    '''Yield (thread, [(is_exit, func, cycles)]) for each dumped ring.'''
+    thread = None
+    events = []
+    for line in f:
+        m = BEGIN.search(line)
+        if m is not None:
+            thread = m.group(1)
+            events = []
+            continue
+        if thread is None:
+            continue
+        if END.search(line) is not None:
+            yield thread, events
+            thread = None
+            continue
+        m = EVENT.search(line)
+        if m is not None:
+            events.append((m.group(1) == 'X', parse_addr(m.group(2)),
+                int(m.group(4))))
+
+class Symbols(object):
+    '''Address to symbol name translation using nm.'''
+    def __init__(self, elf):
+        self.addrs = []
+        self.names = []
+        if elf is None:
+            return
+        out = subprocess.check_output(['nm', '--defined-only', elf])
+        syms = []
+        for line in out.decode('utf-8', 'replace').splitlines():
+            fields = line.split()
+            if len(fields) == 3 and fields[1] in 'tTwW':
+                syms.append((int(fields[0], 16), fields[2]))
+        syms.sort()
+        self.addrs = [a for a, _ in syms]
+        self.names = [n for _, n in syms]
+
+    def name(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i >= 0 and self.addrs[i] == addr:
+            return self.names[i]
+        if i >= 0:
+            return '%s+0x%x' % (self.names[i], addr - self.addrs[i])
+        return '0x%x' % addr
+
+def unwrap(events):
+    '''Make cycle counts monotonic. A 32-bit counter wraps every few seconds,
+    so if every stamp fits in 32 bits assume that is what we are looking at.'''
+    if not events:
+        return events
+    width = 32 if max(e[2] for e in events) < (1 << 32) else 64
+    out = []
+    offset = 0
+    prev = events[0][2]
+    for is_exit, func, stamp in events:
+        if stamp < prev:
+            offset += 1 << width
+        prev = stamp
+        out.append((is_exit, func, stamp + offset))
+    return out
+
+class Stats(object):
+    def __init__(self):
+        self.calls = 0
+        self.inclusive = 0
+        self.exclusive = 0
+
+def replay(events, stats, folded, name):
+    '''Walk a thread's events maintaining a shadow call stack. Exits that do not
+    match anything on the stack belong to calls made before the oldest event
+    still in the ring and are dropped. Frames still open at the end are closed
+    at the last timestamp.'''
+    # Each frame is [func, entry cycles, cycles spent in children].
+    stack = []
+
+    def close(end):
+        func, start, children = stack.pop()
+        inclusive = end - start
+        exclusive = inclusive - children
+        s = stats[func]
+        s.calls += 1
+        s.exclusive += exclusive
+        # Don't count recursive calls towards inclusive time twice.
+        if all(f[0] != func for f in stack):
+            s.inclusive += inclusive
+        path = ';'.join(name(f[0]) for f in stack + [[func]])
+        folded[path] += exclusive
+        if stack:
+            stack[-1][2] += inclusive
+
+    events = unwrap(events)
+    for is_exit, func, stamp in events:
+        if not is_exit:
+            stack.append([func, stamp, 0])
+        elif any(f[0] == func for f in stack):
+            # Close any frames that were exited without an event, e.g. by
+            # longjmp, then the one that matches.
+            while stack[-1][0] != func:
+                close(stamp)
+            close(stamp)
+
+    if events:
+        last = events[-1][2]
+        while stack:
+            close(last)
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode libsel4debug function trace rings')
+    parser.add_argument('input',
+        nargs='?', help='Input file', type=argparse.FileType('r'),
+        default=sys.stdin)
+    parser.add_argument('--elf', '-e',
+        help='Image the trace was taken from, for symbol names')
+    parser.add_argument('--folded', '-f',
+        help='Output folded stacks for flamegraph.pl', action='store_true',
+        default=False)
+    parser.add_argument('--thread', '-t',
+        help='Only decode the thread with this IPC buffer address')
+    parser.add_argument('--limit', '-n',
+        help='Maximum number of functions to print', type=int, default=0)
+    parser.add_argument('--sort', '-s',
+        help='Column to sort by', choices=['exclusive', 'inclusive', 'calls'],
+        default='exclusive')
+    args = parser.parse_args()
+
+    syms = Symbols(args.elf)
+    stats = collections.defaultdict(Stats)
+    folded = collections.defaultdict(int)
+
+    for thread, events in read_blocks(args.input):
+        if args.thread is not None and thread != args.thread:
+            continue
+        replay(events, stats, folded, syms.name)
+
+    if args.folded:
+        for path, cycles in sorted(folded.items()):
+            if cycles > 0:
+                sys.stdout.write('%s %d\n' % (path, cycles))
+        return 0
+
+    rows = sorted(stats.items(), key=lambda x: getattr(x[1], args.sort),
+        reverse=True)
+    if args.limit > 0:
+        rows = rows[:args.limit]
+    sys.stdout.write('%12s %16s %16s  %s\n' %
+        ('calls', 'inclusive', 'exclusive', 'function'))
+    for func, s in rows:
+        sys.stdout.write('%12d %16d %16d  %s\n' %
+            (s.calls, s.inclusive, s.exclusive, syms.name(func)))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
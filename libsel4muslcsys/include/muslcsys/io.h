@@ -0,0 +1,63 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _MUSLCSYS_IO_H_
+#define _MUSLCSYS_IO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sel4/sel4.h>
+
+/*
+ * Output written to stdout and stderr is collected in a buffer of
+ * CONFIG_LIB_SEL4_MUSLC_SYS_STDIO_BUFFER bytes, which is flushed when a line
+ * is completed, when it fills, after every write to stderr, and on exit or
+ * abort. Flushed output goes to the first of these that is installed:
+ *
+ *  - a ring buffer in memory shared with a console server
+ *  - a function that writes a whole buffer at once
+ *  - __arch_putchar, one character at a time
+ */
+
+/* Write count bytes of data, returning how many were written */
+typedef size_t (*muslcsys_stdio_write_fn_t)(void *data, size_t count);
+
+/* Install a bulk write function. Returns the previous one */
+muslcsys_stdio_write_fn_t muslcsys_install_stdio_write(muslcsys_stdio_write_fn_t write_fn);
+
+/*
+ * Single producer, single consumer byte ring shared with a console server.
+ * head is only written by us and tail only by the server, both are free
+ * running and taken modulo size, which must be a power of 2. The server sets
+ * consumer_waiting before blocking on its notification, and we signal the
+ * notification after writing only when it is set.
+ */
+typedef struct muslcsys_stdio_ring {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t size;
+    uint32_t consumer_waiting;
+    char data[];
+} muslcsys_stdio_ring_t;
+
+/* Send output to ring, signalling notification (if not 0) when the server
+ * is waiting. Passing NULL removes the ring */
+void muslcsys_install_stdio_ring(muslcsys_stdio_ring_t *ring, seL4_CPtr notification);
+
+/* Write out anything buffered for stdout and stderr */
+void muslcsys_stdio_flush(void);
+
+/* Flush as muslcsys_stdio_flush, for a process that is aborting or exiting.
+ * From then on stdio only tries the lock a bounded number of times, as the
+ * thread holding it may be the one aborting, and output that cannot get the
+ * lock goes straight to __arch_putchar */
+void muslcsys_stdio_abort(void);
+
+#endif /* _MUSLCSYS_IO_H_ */
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _MUSLCSYS_MORECORE_H_
+#define _MUSLCSYS_MORECORE_H_
+
+#include <stddef.h>
+
+/*
+ * Counters for the dynamic (vspace backed) morecore, useful for tuning
+ * CONFIG_LIB_SEL4_MUSLC_SYS_MORECORE_GRANULE.
+ */
+typedef struct muslcsys_morecore_stats {
+    /* number of calls made to the vspace to create new pages */
+    size_t map_calls;
+    /* total bytes currently backed by frames for brk and mmap */
+    size_t bytes_mapped;
+    /* total bytes returned to the vka by munmap and mremap */
+    size_t bytes_unmapped;
+    /* number of base (4K) and larger pages mapped */
+    size_t small_pages;
+    size_t large_pages;
+    /* number of times a large page mapping failed and small pages were used */
+    size_t large_page_failures;
+} muslcsys_morecore_stats_t;
+
+/* Copy out the current morecore statistics */
+void muslcsys_get_morecore_stats(muslcsys_morecore_stats_t *stats);
+
+#endif /* _MUSLCSYS_MORECORE_H_ */
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _MUSLCSYS_THREAD_H_
+#define _MUSLCSYS_THREAD_H_
+
+#include <vka/vka.h>
+
+/*
+ * Create num_waiters notification objects for threads blocking in
+ * FUTEX_WAIT, i.e. the number of threads that can sleep on a contended
+ * pthread mutex or condition variable at once. Any waiters beyond this
+ * yield until they are woken instead of blocking.
+ *
+ * @return 0 on success
+ */
+int muslcsys_futex_init(vka_t *vka, int num_waiters);
+
+/*
+ * seL4 only allows a thread's TLS base to be written through its TCB, so
+ * set_thread_area calls this function, provided by the environment, to point
+ * the calling thread's TLS base at tls_base. On ia32 it returns the GDT entry
+ * the C library should load to reach its thread area. Returns a negative
+ * value on error.
+ *
+ * Without one set_thread_area is ignored, which is fine as long as no
+ * threads are created through libc and TLS is not used.
+ */
+typedef int (*muslcsys_set_tls_base_fn_t)(void *tls_base);
+
+void muslcsys_install_set_tls_base(muslcsys_set_tls_base_fn_t fn);
+
+#endif /* _MUSLCSYS_THREAD_H_ */
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _MUSLCSYS_TIME_H_
+#define _MUSLCSYS_TIME_H_
+
+#include <autoconf.h>
+#include <stdint.h>
+#include <sel4/sel4.h>
+
+#ifdef CONFIG_LIB_SEL4_PLAT_SUPPORT
+#include <sel4platsupport/timer.h>
+#endif
+
+/*
+ * clock_gettime and friends read the cycle counter directly, without any
+ * system call, and scale it to nanoseconds. The frequency of the cycle
+ * counter comes from CONFIG_LIB_SEL4_MUSLC_SYS_CCNT_FREQ_MHZ, from this
+ * function, or is calibrated against a timer given to
+ * muslcsys_clock_install_timer. The monotonic clock starts at 0 when the
+ * frequency is set.
+ *
+ * On platforms with a 32-bit cycle counter the clock must be read at least
+ * once per counter wrap to stay correct. Sleeping on the timer wakes up often
+ * enough to do this.
+ */
+void muslcsys_clock_init(uint64_t ccnt_freq);
+
+/* Set the current time of CLOCK_REALTIME, in nanoseconds since the epoch */
+void muslcsys_clock_set_realtime(uint64_t ns);
+
+#ifdef CONFIG_LIB_SEL4_PLAT_SUPPORT
+/*
+ * Use timer, whose interrupts are delivered to notification, for sleeps
+ * longer than CONFIG_LIB_SEL4_MUSLC_SYS_SLEEP_SPIN_US. If the clock has not
+ * been initialised yet it is calibrated against timer, which must be
+ * running. The caller must not handle this timer's interrupts itself.
+ */
+void muslcsys_clock_install_timer(seL4_timer_t *timer, seL4_CPtr notification);
+#endif
+
+#endif /* _MUSLCSYS_TIME_H_ */
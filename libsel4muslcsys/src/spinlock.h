@@ -0,0 +1,42 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef LIBSEL4MUSLCSYS_SPINLOCK_H_
+#define LIBSEL4MUSLCSYS_SPINLOCK_H_
+
+#include <sel4/sel4.h>
+
+/* Locks for short critical sections inside the syscall implementations,
+ * which cannot rely on anything from libc */
+
+static inline void
+muslcsys_spin_lock(int *lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        /* the holder may be waiting for our core */
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            seL4_Yield();
+        }
+    }
+}
+
+static inline int
+muslcsys_spin_trylock(int *lock)
+{
+    return !__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+muslcsys_spin_unlock(int *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+#endif
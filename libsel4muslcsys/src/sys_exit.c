@@ -14,9 +14,12 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+#include <muslcsys/io.h>
+
 static void
 sel4_abort(void)
 {
+    muslcsys_stdio_abort();
 #if defined(CONFIG_DEBUG_BUILD) && defined(CONFIG_LIB_SEL4_MUSLC_SYS_DEBUG_HALT)
     printf("seL4 root server abort()ed\n");
     seL4_DebugHalt();
@@ -55,6 +58,7 @@ sys_getpid(va_list ap)
 long
 sys_tgkill(va_list ap)
 {
+    muslcsys_stdio_abort();
     printf("%s assuming self kill\n", __FUNCTION__);
     sel4_abort();
     return 0;
@@ -63,6 +67,7 @@ sys_tgkill(va_list ap)
 long
 sys_tkill(va_list ap)
 {
+    muslcsys_stdio_abort();
     printf("%s assuming self kill\n", __FUNCTION__);
     sel4_abort();
     return 0;
@@ -71,6 +76,8 @@ sys_tkill(va_list ap)
 long
 sys_exit_group(va_list ap)
 {
+    /* musl never returns from exit, so this is as good as an abort */
+    muslcsys_stdio_abort();
     printf("Ignoring call to %s\n", __FUNCTION__);
     return 0;
 }
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/*
+ * futex implementation on top of seL4 notifications.
+ *
+ * Waiting threads are queued, in FIFO order, on a bucket of a hash table keyed
+ * by the futex address. A waiter blocks on a notification object taken from a
+ * pool created by muslcsys_futex_init and is woken by signalling it. If the
+ * pool is empty waiters yield until woken instead.
+ *
+ * All futexes are treated as private to the address space, and there is no
+ * timer to implement timeouts with, so timed waits wait until woken.
+ */
+
+#include <autoconf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <bits/errno.h>
+
+#include <sel4/sel4.h>
+#include <vka/object.h>
+#include <utils/util.h>
+
+#include <muslcsys/thread.h>
+
+#include "spinlock.h"
+
+#define FUTEX_WAIT        0
+#define FUTEX_WAKE        1
+#define FUTEX_REQUEUE     3
+#define FUTEX_CMP_REQUEUE 4
+#define FUTEX_PRIVATE     128
+#define FUTEX_CLOCK_REALTIME 256
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_BUCKETS BIT(FUTEX_HASH_BITS)
+
+typedef struct futex_waiter {
+    int *uaddr;
+    /* notification to block on, or 0 if yielding */
+    seL4_CPtr notification;
+    int woken;
+    struct futex_waiter *next;
+} futex_waiter_t;
+
+typedef struct futex_bucket {
+    int lock;
+    futex_waiter_t *head;
+    futex_waiter_t *tail;
+} futex_bucket_t;
+
+static futex_bucket_t futex_table[FUTEX_BUCKETS];
+
+/* free notifications for blocking waiters */
+static int pool_lock;
+static seL4_CPtr *pool;
+static int pool_free;
+
+static futex_bucket_t *
+futex_bucket(int *uaddr)
+{
+    /* fibonacci hash of the word address */
+    uint32_t hash = (uint32_t) ((uintptr_t) uaddr >> 2) * 0x9E3779B1u;
+    return &futex_table[hash >> (32 - FUTEX_HASH_BITS)];
+}
+
+int
+muslcsys_futex_init(vka_t *vka, int num_waiters)
+{
+    seL4_CPtr *new_pool = malloc(num_waiters * sizeof(seL4_CPtr));
+    if (new_pool == NULL) {
+        ZF_LOGE("Failed to allocate futex notification pool");
+        return -1;
+    }
+
+    int allocated;
+    for (allocated = 0; allocated < num_waiters; allocated++) {
+        vka_object_t notification;
+        if (vka_alloc_notification(vka, &notification) != 0) {
+            ZF_LOGE("Failed to allocate futex notification %d/%d", allocated, num_waiters);
+            break;
+        }
+        new_pool[allocated] = notification.cptr;
+    }
+
+    muslcsys_spin_lock(&pool_lock);
+    assert(pool == NULL);
+    pool = new_pool;
+    pool_free = allocated;
+    muslcsys_spin_unlock(&pool_lock);
+
+    return allocated == num_waiters ? 0 : -1;
+}
+
+static seL4_CPtr
+pool_get(void)
+{
+    seL4_CPtr notification = 0;
+    muslcsys_spin_lock(&pool_lock);
+    if (pool_free > 0) {
+        notification = pool[--pool_free];
+    }
+    muslcsys_spin_unlock(&pool_lock);
+    return notification;
+}
+
+static void
+pool_put(seL4_CPtr notification)
+{
+    muslcsys_spin_lock(&pool_lock);
+    pool[pool_free++] = notification;
+    muslcsys_spin_unlock(&pool_lock);
+}
+
+static void
+bucket_append(futex_bucket_t *bucket, futex_waiter_t *waiter)
+{
+    waiter->next = NULL;
+    if (bucket->tail) {
+        bucket->tail->next = waiter;
+    } else {
+        bucket->head = waiter;
+    }
+    bucket->tail = waiter;
+}
+
+/* Remove up to max waiters on uaddr from bucket and return them as a list */
+static futex_waiter_t *
+bucket_take(futex_bucket_t *bucket, int *uaddr, int max, int *taken)
+{
+    futex_waiter_t *list = NULL;
+    futex_waiter_t **list_tail = &list;
+    futex_waiter_t *prev = NULL;
+    futex_waiter_t *waiter = bucket->head;
+
+    *taken = 0;
+    while (waiter != NULL && *taken < max) {
+        futex_waiter_t *next = waiter->next;
+        if (waiter->uaddr == uaddr) {
+            if (prev) {
+                prev->next = next;
+            } else {
+                bucket->head = next;
+            }
+            if (bucket->tail == waiter) {
+                bucket->tail = prev;
+            }
+            waiter->next = NULL;
+            *list_tail = waiter;
+            list_tail = &waiter->next;
+            (*taken)++;
+        } else {
+            prev = waiter;
+        }
+        waiter = next;
+    }
+    return list;
+}
+
+static void
+wake_list(futex_waiter_t *list)
+{
+    while (list != NULL) {
+        /* once woken is set the waiter may return and its stack frame, which
+         * holds the waiter, is gone, so read everything out first */
+        futex_waiter_t *next = list->next;
+        seL4_CPtr notification = list->notification;
+        __atomic_store_n(&list->woken, 1, __ATOMIC_RELEASE);
+        if (notification) {
+            seL4_Signal(notification);
+        }
+        list = next;
+    }
+}
+
+static long
+futex_wait(int *uaddr, int val)
+{
+    futex_bucket_t *bucket = futex_bucket(uaddr);
+    futex_waiter_t waiter = {
+        .uaddr = uaddr,
+        .notification = pool_get(),
+        .woken = 0,
+    };
+
+    muslcsys_spin_lock(&bucket->lock);
+    /* wakers change the value before taking the bucket lock, so checking it
+     * under the lock means we cannot miss a wake up */
+    if (__atomic_load_n(uaddr, __ATOMIC_SEQ_CST) != val) {
+        muslcsys_spin_unlock(&bucket->lock);
+        if (waiter.notification) {
+            pool_put(waiter.notification);
+        }
+        return -EAGAIN;
+    }
+    bucket_append(bucket, &waiter);
+    muslcsys_spin_unlock(&bucket->lock);
+
+    if (waiter.notification) {
+        seL4_Wait(waiter.notification, NULL);
+        pool_put(waiter.notification);
+    } else {
+        while (!__atomic_load_n(&waiter.woken, __ATOMIC_ACQUIRE)) {
+            seL4_Yield();
+        }
+    }
+    return 0;
+}
+
+static long
+futex_wake(int *uaddr, int max)
+{
+    futex_bucket_t *bucket = futex_bucket(uaddr);
+    int woken;
+
+    muslcsys_spin_lock(&bucket->lock);
+    futex_waiter_t *list = bucket_take(bucket, uaddr, max, &woken);
+    muslcsys_spin_unlock(&bucket->lock);
+
+    wake_list(list);
+    return woken;
+}
+
+static long
+futex_requeue(int *uaddr, int max_wake, int *uaddr2, int max_requeue, bool cmp, int val)
+{
+    futex_bucket_t *bucket = futex_bucket(uaddr);
+    futex_bucket_t *bucket2 = futex_bucket(uaddr2);
+    futex_waiter_t *list = NULL;
+    int woken, requeued;
+
+    /* always lock buckets in the same order */
+    if (bucket < bucket2) {
+        muslcsys_spin_lock(&bucket->lock);
+        muslcsys_spin_lock(&bucket2->lock);
+    } else if (bucket > bucket2) {
+        muslcsys_spin_lock(&bucket2->lock);
+        muslcsys_spin_lock(&bucket->lock);
+    } else {
+        muslcsys_spin_lock(&bucket->lock);
+    }
+
+    if (cmp && __atomic_load_n(uaddr, __ATOMIC_SEQ_CST) != val) {
+        woken = -EAGAIN;
+        goto out;
+    }
+
+    list = bucket_take(bucket, uaddr, max_wake, &woken);
+    futex_waiter_t *move = bucket_take(bucket, uaddr, max_requeue, &requeued);
+    while (move != NULL) {
+        futex_waiter_t *next = move->next;
+        move->uaddr = uaddr2;
+        bucket_append(bucket2, move);
+        move = next;
+    }
+    woken += requeued;
+
+out:
+    if (bucket != bucket2) {
+        muslcsys_spin_unlock(&bucket2->lock);
+    }
+    muslcsys_spin_unlock(&bucket->lock);
+
+    if (woken > 0) {
+        wake_list(list);
+    }
+    return woken;
+}
+
+long
+sys_futex(va_list ap)
+{
+    int *uaddr = va_arg(ap, int*);
+    int op = va_arg(ap, int);
+    int val = va_arg(ap, int);
+    /* either a timeout or a second value, depending on op */
+    void *timeout_val2 = va_arg(ap, void*);
+    int *uaddr2 = va_arg(ap, int*);
+    int val3 = va_arg(ap, int);
+
+    switch (op & ~(FUTEX_PRIVATE | FUTEX_CLOCK_REALTIME)) {
+    case FUTEX_WAIT:
+        return futex_wait(uaddr, val);
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, val);
+    case FUTEX_REQUEUE:
+        return futex_requeue(uaddr, val, uaddr2, (int) (uintptr_t) timeout_val2, false, 0);
+    case FUTEX_CMP_REQUEUE:
+        return futex_requeue(uaddr, val, uaddr2, (int) (uintptr_t) timeout_val2, true, val3);
+    default:
+        ZF_LOGE("Unsupported futex op %d", op);
+        return -ENOSYS;
+    }
+}
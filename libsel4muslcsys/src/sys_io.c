@@ -14,6 +14,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,7 +34,11 @@
 
 #include <sel4utils/util.h>
 
+#include <muslcsys/io.h>
+
 #include "arch_stdio.h"
+#include "syscalls.h"
+#include "spinlock.h"
 
 #define FIRST_USER_FD (STDERR_FILENO + 1)
 
@@ -59,6 +64,31 @@ typedef struct muslcsys_fd {
     void *data;
 } muslcsys_fd_t;
 
+#ifdef CONFIG_LIB_SEL4_MUSLC_SYS_CPIO_FS
+/* Hash index over the files in _cpio_archive. It is built on the first open,
+ * after which opening a file no longer has to scan the archive */
+typedef struct cpio_index_entry {
+    const char *name;
+    char *data;
+    unsigned long size;
+} cpio_index_entry_t;
+
+/* open addressed table, the size is a power of 2 */
+static cpio_index_entry_t *cpio_index = NULL;
+static size_t cpio_index_size;
+static int cpio_index_lock;
+/* end of the archive, valid once the index is built */
+static char *cpio_archive_end = NULL;
+
+/* Layout of a "new ASCII" (newc) cpio header. Each field is 8 hex digits */
+#define CPIO_NEWC_MAGIC "070701"
+#define CPIO_HEADER_SIZE 110
+#define CPIO_FIELD_FILESIZE 6
+#define CPIO_FIELD_NAMESIZE 11
+#define CPIO_ALIGN 4
+#define CPIO_TRAILER "TRAILER!!!"
+#endif
+
 /* file table, indexed by file descriptor */
 static muslcsys_fd_t *fd_table = NULL;
 /* stack of free file descriptors */
@@ -68,6 +98,28 @@ static int free_fd_table_index;
 /* total number of fds */
 static int num_fds = 256;
 
+/* stdout and stderr output backends, see muslcsys/io.h */
+static muslcsys_stdio_write_fn_t stdio_write_fn = NULL;
+static muslcsys_stdio_ring_t *stdio_ring = NULL;
+static seL4_CPtr stdio_ring_notification;
+/* buffered output not yet given to a backend */
+static char stdio_buf[CONFIG_LIB_SEL4_MUSLC_SYS_STDIO_BUFFER + 1];
+static size_t stdio_buf_len;
+static int stdio_lock;
+/* thread holding stdio_lock, identified by its IPC buffer */
+static seL4_IPCBuffer *stdio_lock_owner;
+/* set once the process is dying, after which stdio gives up on the lock rather
+ * than wait for a thread that may never release it */
+static int stdio_aborting;
+/* set when the console server stopped draining the ring */
+static bool stdio_ring_stalled;
+
+/* How many times to yield for the lock when aborting */
+#define STDIO_ABORT_LOCK_ATTEMPTS 100
+/* How many times to yield for the console server to make space in a full ring
+ * before deciding it has stopped, and dropping output until it starts again */
+#define STDIO_RING_FULL_YIELDS 1000
+
 
 static void
 add_free_fd(int fd)
@@ -186,15 +238,319 @@ get_fd_struct(int fd)
     return &fd_table[fd - FIRST_USER_FD];
 }
 
+#ifdef CONFIG_LIB_SEL4_MUSLC_SYS_CPIO_FS
+static unsigned long
+cpio_field(const char *header, int field)
+{
+    const char *digits = header + strlen(CPIO_NEWC_MAGIC) + field * 8;
+    unsigned long value = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = digits[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        }
+    }
+    return value;
+}
+
+/* Parse the entry at header. Returns the next header, or NULL at the end of
+ * the archive or if the header is invalid */
+static char *
+cpio_next_entry(char *header, const char **name, char **data, unsigned long *size)
+{
+    if (strncmp(header, CPIO_NEWC_MAGIC, strlen(CPIO_NEWC_MAGIC)) != 0) {
+        ZF_LOGE("Invalid cpio header at %p\n", header);
+        return NULL;
+    }
+    unsigned long namesize = cpio_field(header, CPIO_FIELD_NAMESIZE);
+    *size = cpio_field(header, CPIO_FIELD_FILESIZE);
+    *name = header + CPIO_HEADER_SIZE;
+    if (strcmp(*name, CPIO_TRAILER) == 0) {
+        return NULL;
+    }
+    *data = (char *) ROUND_UP((uintptr_t) *name + namesize, CPIO_ALIGN);
+    return (char *) ROUND_UP((uintptr_t) *data + *size, CPIO_ALIGN);
+}
+
+static uint32_t
+cpio_hash(const char *name)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (uint8_t) *name) * 16777619u;
+    }
+    return hash;
+}
+
+static int
+cpio_index_build(void)
+{
+    const char *name;
+    char *data;
+    unsigned long size;
+    size_t count = 0;
+    char *last = _cpio_archive;
+
+    /* first pass to size the table, which is kept at most half full */
+    for (char *header = _cpio_archive; header; header = cpio_next_entry(header, &name, &data, &size)) {
+        last = header;
+        count++;
+    }
+    /* the trailer header is the last thing in the archive. munmap relies on
+     * knowing where the archive ends, so record it even if the index fails */
+    cpio_archive_end = (char *) ROUND_UP((uintptr_t) last + CPIO_HEADER_SIZE + sizeof(CPIO_TRAILER), CPIO_ALIGN);
+    size_t table_size = 1;
+    while (table_size < count * 2) {
+        table_size <<= 1;
+    }
+
+    cpio_index_entry_t *index = calloc(table_size, sizeof(cpio_index_entry_t));
+    if (index == NULL) {
+        return -ENOMEM;
+    }
+
+    char *header = _cpio_archive;
+    char *next;
+    while ((next = cpio_next_entry(header, &name, &data, &size)) != NULL) {
+        size_t slot = cpio_hash(name) & (table_size - 1);
+        while (index[slot].name != NULL) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        index[slot].name = name;
+        index[slot].data = data;
+        index[slot].size = size;
+        header = next;
+    }
+
+    cpio_index_size = table_size;
+    __atomic_store_n(&cpio_index, index, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static char *
+cpio_index_lookup(const char *pathname, unsigned long *size)
+{
+    cpio_index_entry_t *index = __atomic_load_n(&cpio_index, __ATOMIC_ACQUIRE);
+    if (index == NULL) {
+        muslcsys_spin_lock(&cpio_index_lock);
+        if (cpio_index == NULL && cpio_index_build() != 0) {
+            muslcsys_spin_unlock(&cpio_index_lock);
+            /* no memory for the index, fall back to scanning */
+            return cpio_get_file(_cpio_archive, pathname, size);
+        }
+        muslcsys_spin_unlock(&cpio_index_lock);
+        index = cpio_index;
+    }
+
+    for (size_t slot = cpio_hash(pathname) & (cpio_index_size - 1); index[slot].name != NULL;
+            slot = (slot + 1) & (cpio_index_size - 1)) {
+        if (strcmp(index[slot].name, pathname) == 0) {
+            *size = index[slot].size;
+            return index[slot].data;
+        }
+    }
+    return NULL;
+}
+#endif
+
+int
+muslcsys_cpio_contains(void *addr)
+{
+#ifdef CONFIG_LIB_SEL4_MUSLC_SYS_CPIO_FS
+    return cpio_archive_end != NULL && (char *) addr >= _cpio_archive && (char *) addr < cpio_archive_end;
+#else
+    return 0;
+#endif
+}
+
+muslcsys_stdio_write_fn_t
+muslcsys_install_stdio_write(muslcsys_stdio_write_fn_t write_fn)
+{
+    muslcsys_stdio_flush();
+    muslcsys_stdio_write_fn_t old = stdio_write_fn;
+    stdio_write_fn = write_fn;
+    return old;
+}
+
+void
+muslcsys_install_stdio_ring(muslcsys_stdio_ring_t *ring, seL4_CPtr notification)
+{
+    assert(ring == NULL || (ring->size && (ring->size & (ring->size - 1)) == 0));
+    muslcsys_stdio_flush();
+    stdio_ring_notification = notification;
+    stdio_ring = ring;
+}
+
+static void
+stdio_ring_write(muslcsys_stdio_ring_t *ring, char *data, size_t count)
+{
+    uint32_t head = ring->head;
+    int yields = 0;
+    while (count > 0) {
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        uint32_t space = ring->size - (head - tail);
+        if (space == 0) {
+            if (stdio_ring_stalled || yields == STDIO_RING_FULL_YIELDS) {
+                /* the server has gone away, don't hang waiting for it */
+                stdio_ring_stalled = true;
+                break;
+            }
+            /* let the console server catch up */
+            if (stdio_ring_notification) {
+                seL4_Signal(stdio_ring_notification);
+            }
+            seL4_Yield();
+            yields++;
+            continue;
+        }
+        stdio_ring_stalled = false;
+        yields = 0;
+        /* copy up to the end of the ring at most */
+        uint32_t offset = head & (ring->size - 1);
+        size_t len = MIN(MIN(count, space), ring->size - offset);
+        memcpy(&ring->data[offset], data, len);
+        head += len;
+        data += len;
+        count -= len;
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+
+    /* order the head update before reading consumer_waiting, the server
+     * does the opposite */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (stdio_ring_notification && __atomic_load_n(&ring->consumer_waiting, __ATOMIC_RELAXED)) {
+        seL4_Signal(stdio_ring_notification);
+    }
+}
+
+/* Give data to the output backend */
+static void
+stdio_output(char *data, size_t count)
+{
+    if (stdio_ring != NULL) {
+        stdio_ring_write(stdio_ring, data, count);
+    } else if (stdio_write_fn != NULL) {
+        while (count > 0) {
+            size_t written = stdio_write_fn(data, count);
+            if (written == 0) {
+                break;
+            }
+            data += written;
+            count -= written;
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            __arch_putchar(data[i]);
+        }
+    }
+}
+
+static void
+stdio_flush_locked(void)
+{
+    if (stdio_buf_len > 0) {
+        stdio_output(stdio_buf, stdio_buf_len);
+        stdio_buf_len = 0;
+    }
+}
+
+/* Take stdio_lock. Fails if this thread already holds it, which happens when a
+ * backend writes output (e.g. from an assert), or if the process is aborting
+ * and another thread does not let go of it. */
+static bool
+stdio_lock_acquire(void)
+{
+    seL4_IPCBuffer *self = seL4_GetIPCBuffer();
+    if (self != NULL && __atomic_load_n(&stdio_lock_owner, __ATOMIC_RELAXED) == self) {
+        return false;
+    }
+    if (!__atomic_load_n(&stdio_aborting, __ATOMIC_RELAXED)) {
+        muslcsys_spin_lock(&stdio_lock);
+    } else {
+        for (int i = 0; !muslcsys_spin_trylock(&stdio_lock); i++) {
+            if (i == STDIO_ABORT_LOCK_ATTEMPTS) {
+                return false;
+            }
+            seL4_Yield();
+        }
+    }
+    __atomic_store_n(&stdio_lock_owner, self, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void
+stdio_lock_release(void)
+{
+    __atomic_store_n(&stdio_lock_owner, NULL, __ATOMIC_RELAXED);
+    muslcsys_spin_unlock(&stdio_lock);
+}
+
+void
+muslcsys_stdio_flush(void)
+{
+    if (stdio_lock_acquire()) {
+        stdio_flush_locked();
+        stdio_lock_release();
+    }
+}
+
+void
+muslcsys_stdio_abort(void)
+{
+    __atomic_store_n(&stdio_aborting, 1, __ATOMIC_RELAXED);
+    muslcsys_stdio_flush();
+}
+
+/* Write out the iovecs for stdout or stderr, as a single unit with respect to
+ * other threads. Output is held in stdio_buf until a line is completed, the
+ * buffer fills, or flush is set */
 static size_t
-sys_platform_write(void *data, size_t count)
+sys_platform_writev(struct iovec *iov, int iovcnt, bool flush)
 {
-    size_t i;
-    char *realdata = data;
-    for (i = 0; i < count; i++) {
-        __arch_putchar(realdata[i]);
+    size_t written = 0;
+
+    if (!stdio_lock_acquire()) {
+        /* the buffer and backends are not ours to use. This is the last word
+         * before an assert or abort, so go straight to the console */
+        for (int i = 0; i < iovcnt; i++) {
+            for (size_t j = 0; j < iov[i].iov_len; j++) {
+                __arch_putchar(((char *) iov[i].iov_base)[j]);
+            }
+            written += iov[i].iov_len;
+        }
+        return written;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        char *data = iov[i].iov_base;
+        size_t count = iov[i].iov_len;
+
+        if (count > CONFIG_LIB_SEL4_MUSLC_SYS_STDIO_BUFFER - stdio_buf_len) {
+            stdio_flush_locked();
+        }
+        if (count > CONFIG_LIB_SEL4_MUSLC_SYS_STDIO_BUFFER) {
+            /* too big to be worth buffering */
+            stdio_output(data, count);
+        } else {
+            memcpy(&stdio_buf[stdio_buf_len], data, count);
+            stdio_buf_len += count;
+            if (memchr(data, '\n', count) != NULL) {
+                flush = true;
+            }
+        }
+        written += count;
     }
-    return count;
+    if (flush) {
+        stdio_flush_locked();
+    }
+    stdio_lock_release();
+
+    return written;
 }
 
 long
@@ -217,9 +573,9 @@ sys_open(va_list ap)
     /* wrapped in a config because the _cpio_archive definition is wrapped in a config */
     char *file = NULL;
 #ifdef CONFIG_LIB_SEL4_MUSLC_SYS_CPIO_FS
-    file = cpio_get_file(_cpio_archive, pathname, &size);
+    file = cpio_index_lookup(pathname, &size);
     if (!file && strncmp(pathname, "./", 2) == 0) {
-        file = cpio_get_file(_cpio_archive, pathname + 2, &size);
+        file = cpio_index_lookup(pathname + 2, &size);
     }
 #else
     ZF_LOGE("Warning: attempted to use fopen with no file system (CONFIG_LIB_SEL4_MUSLC_SYS_CPIO_FS not set)\n");
@@ -304,11 +660,10 @@ sys_writev(va_list ap)
         return 0;
     }
 
-    /* Write the buffer to console if the fd is for stdout or stderr. */
+    /* Write the buffer to console if the fd is for stdout or stderr. stderr
+     * is never left in the buffer */
     if (fildes == STDOUT_FILENO || fildes == STDERR_FILENO) {
-        for (int i = 0; i < iovcnt; i++) {
-            ret += sys_platform_write(iov[i].iov_base, iov[i].iov_len);
-        }
+        ret = sys_platform_writev(iov, iovcnt, fildes == STDERR_FILENO);
     } else {
         assert(!"Not implemented");
         return -EBADF;
@@ -353,6 +708,44 @@ long sys_readv(va_list ap)
     return read;
 }
 
+long sys_pread64(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    void *buf = va_arg(ap, void*);
+    size_t count = va_arg(ap, size_t);
+    uint64_t offset;
+#if UINTPTR_MAX == UINT32_MAX
+    /* the 64-bit offset is passed as two words, which on arm start at an
+     * even argument */
+#ifdef ARCH_ARM
+    (void) va_arg(ap, uint32_t);
+#endif
+    uint32_t offset_low = va_arg(ap, uint32_t);
+    uint32_t offset_high = va_arg(ap, uint32_t);
+    offset = ((uint64_t) offset_high << 32) | offset_low;
+#else
+    offset = va_arg(ap, uint64_t);
+#endif
+
+    if (!valid_fd(fd)) {
+        return -EBADF;
+    }
+    muslcsys_fd_t *muslc_fd = get_fd_struct(fd);
+    if (muslc_fd->filetype != FILE_TYPE_CPIO) {
+        assert(!"not implemented");
+        return -EINVAL;
+    }
+    cpio_file_data_t *cpio_fd = muslc_fd->data;
+
+    /* unlike read, the file offset is not used or changed */
+    if (offset >= cpio_fd->size) {
+        return 0;
+    }
+    size_t len = MIN(count, cpio_fd->size - offset);
+    memcpy(buf, cpio_fd->start + offset, len);
+    return len;
+}
+
 long sys_read(va_list ap)
 {
     int fd = va_arg(ap, int);
@@ -505,6 +898,41 @@ long sys__llseek(va_list ap)
     return 0;
 }
 
+long
+muslcsys_mmap_file(size_t length, int prot, int flags, int fd, uint64_t offset)
+{
+    if (!valid_fd(fd)) {
+        return -EBADF;
+    }
+    muslcsys_fd_t *muslc_fd = get_fd_struct(fd);
+    if (muslc_fd->filetype != FILE_TYPE_CPIO) {
+        return -ENODEV;
+    }
+    cpio_file_data_t *cpio_fd = muslc_fd->data;
+    if (offset > cpio_fd->size) {
+        return -EINVAL;
+    }
+
+    if (!(prot & PROT_WRITE)) {
+        /* Nothing ever writes to the archive, so read only mappings can point
+         * straight into it. The result is not page aligned */
+        return (long) (cpio_fd->start + offset);
+    }
+
+    if (flags & MAP_SHARED) {
+        /* files can only be opened for reading */
+        return -EACCES;
+    }
+
+    /* writable private mappings get their own copy */
+    void *copy = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED) {
+        return -ENOMEM;
+    }
+    memcpy(copy, cpio_fd->start + offset, MIN(length, cpio_fd->size - offset));
+    return (long) copy;
+}
+
 long sys_access(va_list ap) {
     const char *pathname = va_arg(ap, const char *);
     int mode = va_arg(ap, int);
@@ -15,15 +15,21 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <errno.h>
 #include <assert.h>
 
 #include <vspace/vspace.h>
+#include <vspace/page.h>
 
 #include <sel4utils/util.h>
 #include <sel4utils/mapping.h>
 
+#include <muslcsys/morecore.h>
+
+#include "syscalls.h"
+
 /* If we have a nonzero static morecore then we are just doing dodgy hacky morecore */
 #if CONFIG_LIB_SEL4_MUSLC_SYS_MORECORE_BYTES > 0
 
@@ -87,8 +93,7 @@ sys_mmap2(va_list ap)
         morecore_top = base;
         return base;
     }
-    assert(!"not implemented");
-    return -ENOMEM;
+    return muslcsys_mmap_file(length, prot, flags, fd, (uint64_t) (unsigned long) offset * PAGE_SIZE_4K);
 }
 
 long 
@@ -98,6 +103,37 @@ sys_mremap(va_list ap)
     return -ENOMEM;
 }
 
+long
+sys_munmap(va_list ap)
+{
+    uintptr_t addr = (uintptr_t) va_arg(ap, void*);
+    size_t length = va_arg(ap, size_t);
+
+    if (muslcsys_cpio_contains((void *) addr)) {
+        /* file mappings point straight into the archive */
+        return 0;
+    }
+
+    /* memory can only be given back if it was the last thing taken from the top */
+    if (addr == morecore_top) {
+        morecore_top += length;
+    }
+    return 0;
+}
+
+long
+sys_madvise(va_list ap)
+{
+    void *addr = va_arg(ap, void*);
+    size_t length = va_arg(ap, size_t);
+    int advice = va_arg(ap, int);
+
+    if (advice == MADV_DONTNEED) {
+        memset(addr, 0, length);
+    }
+    return 0;
+}
+
 #else
 
 /* dynamic morecore based on a vspace. These need to be defined somewhere (probably in the
@@ -122,6 +158,250 @@ static uintptr_t morecore_base = 0;
 static uintptr_t morecore_top = 0;
 
 static uintptr_t brk_start;
+/* end of the part of the brk region that is already backed by frames */
+static uintptr_t brk_mapped;
+
+static muslcsys_morecore_stats_t morecore_stats;
+
+#ifdef CONFIG_LIB_SEL4_MUSLC_SYS_MORECORE_LARGE_PAGES
+#define MORECORE_LARGEST_PAGE (SEL4_NUM_PAGE_SIZES - 1)
+#else
+#define MORECORE_LARGEST_PAGE 0
+#endif
+
+void
+muslcsys_get_morecore_stats(muslcsys_morecore_stats_t *stats)
+{
+    *stats = morecore_stats;
+}
+
+/* Pick the page size (as an index into sel4_page_sizes, no larger than largest)
+ * and number of pages to map next when backing [vaddr, end). Use the largest
+ * page that is aligned and fits, and stop small pages at the next boundary
+ * where a larger page could start. */
+static int
+morecore_next_pages(uintptr_t vaddr, uintptr_t end, int largest, size_t *num_pages)
+{
+    int i;
+    for (i = largest; i > 0; i--) {
+        if (IS_ALIGNED(vaddr, sel4_page_sizes[i]) && end - vaddr >= BIT(sel4_page_sizes[i])) {
+            break;
+        }
+    }
+    *num_pages = (end - vaddr) >> sel4_page_sizes[i];
+    if (i < largest) {
+        uintptr_t boundary = ROUND_UP(vaddr + 1, BIT(sel4_page_sizes[i + 1]));
+        *num_pages = MIN(*num_pages, (boundary - vaddr) >> sel4_page_sizes[i]);
+    }
+    return i;
+}
+
+/* Back [*vaddr, end) with new frames in as few vspace calls as possible. On
+ * return *vaddr is the end of what was successfully mapped. */
+static int
+morecore_map_range(uintptr_t *vaddr, uintptr_t end, int largest, reservation_t reservation)
+{
+    while (*vaddr < end) {
+        size_t num_pages;
+        int i = morecore_next_pages(*vaddr, end, largest, &num_pages);
+
+        morecore_stats.map_calls++;
+        int error = vspace_new_pages_at_vaddr(muslc_this_vspace, (void *) *vaddr, num_pages,
+                                              sel4_page_sizes[i], reservation);
+        if (error) {
+            if (i > 0) {
+                morecore_stats.large_page_failures++;
+            }
+            return error;
+        }
+
+        if (i == 0) {
+            morecore_stats.small_pages += num_pages;
+        } else {
+            morecore_stats.large_pages += num_pages;
+        }
+        morecore_stats.bytes_mapped += num_pages << sel4_page_sizes[i];
+        *vaddr += num_pages << sel4_page_sizes[i];
+    }
+    return 0;
+}
+
+/* Find the page mapped at vaddr. Returns its size as an index into
+ * sel4_page_sizes and its base address, or -1 if nothing is mapped. The
+ * vspace records the frame cap against every 4K of a large page, so a large
+ * page is recognised by its first and last 4K having the same cap. */
+static int
+morecore_page_at(uintptr_t vaddr, uintptr_t *base)
+{
+    seL4_CPtr cap = vspace_get_cap(muslc_this_vspace, (void *) vaddr);
+    if (cap == 0) {
+        return -1;
+    }
+    for (int i = SEL4_NUM_PAGE_SIZES - 1; i > 0; i--) {
+        uintptr_t start = ROUND_DOWN(vaddr, BIT(sel4_page_sizes[i]));
+        uintptr_t last = start + BIT(sel4_page_sizes[i]) - PAGE_SIZE_4K;
+        if (vspace_get_cap(muslc_this_vspace, (void *) start) == cap &&
+                vspace_get_cap(muslc_this_vspace, (void *) last) == cap) {
+            *base = start;
+            return i;
+        }
+    }
+    *base = ROUND_DOWN(vaddr, PAGE_SIZE_4K);
+    return 0;
+}
+
+/* End of the pages backing a mapping that ends at end. This is past end if
+ * the mapping was shrunk to part way through a large page. */
+static uintptr_t
+morecore_backed_end(uintptr_t end)
+{
+    uintptr_t base;
+    int i = morecore_page_at(end - 1, &base);
+    if (i > 0) {
+        return MAX(end, base + BIT(sel4_page_sizes[i]));
+    }
+    return end;
+}
+
+/* Regions handed out by anonymous mmap. munmap and mremap only act on these, so
+ * a stray munmap cannot free the brk heap, a stack or the image. The table
+ * lives in pages of its own rather than on the heap, as malloc calls mmap. */
+typedef struct mmap_region {
+    uintptr_t start;
+    uintptr_t end;
+} mmap_region_t;
+
+static mmap_region_t *mmap_regions;
+static size_t mmap_num_regions;
+static size_t mmap_max_regions;
+
+static int mmap_region_overlaps(uintptr_t start, uintptr_t end);
+
+/* Unmap every page in [start, end) and give the frames back to the vka. seL4
+ * cannot split a frame, so a large page that only partly overlaps the range is
+ * only freed once no mmap region uses any of it, and is otherwise left for
+ * whichever unmap gives up its last part. */
+static void
+morecore_unmap_range(uintptr_t start, uintptr_t end)
+{
+    uintptr_t vaddr = start;
+    while (vaddr < end) {
+        uintptr_t base;
+        int i = morecore_page_at(vaddr, &base);
+        if (i == -1) {
+            vaddr += PAGE_SIZE_4K;
+            continue;
+        }
+        uintptr_t top = base + BIT(sel4_page_sizes[i]);
+        if ((base >= start && top <= end) || !mmap_region_overlaps(base, top)) {
+            vspace_unmap_pages(muslc_this_vspace, (void *) base, 1, sel4_page_sizes[i], VSPACE_FREE);
+            morecore_stats.bytes_mapped -= BIT(sel4_page_sizes[i]);
+            morecore_stats.bytes_unmapped += BIT(sel4_page_sizes[i]);
+        }
+        vaddr = top;
+    }
+}
+
+/* Make room in the table for at least num regions */
+static int
+mmap_regions_reserve(size_t num)
+{
+    if (num <= mmap_max_regions) {
+        return 0;
+    }
+    size_t old_bytes = ROUND_UP(mmap_max_regions * sizeof(mmap_region_t), PAGE_SIZE_4K);
+    size_t bytes = ROUND_UP(MAX(num, mmap_max_regions * 2) * sizeof(mmap_region_t), PAGE_SIZE_4K);
+    mmap_region_t *regions = vspace_new_pages(muslc_this_vspace, seL4_AllRights, bytes / PAGE_SIZE_4K,
+                                              seL4_PageBits);
+    if (!regions) {
+        ZF_LOGE("Failed to grow the mmap region table\n");
+        return -1;
+    }
+    if (mmap_regions) {
+        memcpy(regions, mmap_regions, mmap_num_regions * sizeof(mmap_region_t));
+        vspace_unmap_pages(muslc_this_vspace, mmap_regions, old_bytes / PAGE_SIZE_4K, seL4_PageBits, VSPACE_FREE);
+    }
+    mmap_regions = regions;
+    mmap_max_regions = bytes / sizeof(mmap_region_t);
+    return 0;
+}
+
+/* Record a new region, merging it with any it adjoins so that a region grown in
+ * place is still a single region. There must be room for it */
+static void
+mmap_region_add(uintptr_t start, uintptr_t end)
+{
+    for (size_t i = 0; i < mmap_num_regions; i++) {
+        if (mmap_regions[i].end == start || mmap_regions[i].start == end) {
+            /* take the neighbour out and add the merged region instead */
+            start = MIN(start, mmap_regions[i].start);
+            end = MAX(end, mmap_regions[i].end);
+            mmap_regions[i--] = mmap_regions[--mmap_num_regions];
+        }
+    }
+    assert(mmap_num_regions < mmap_max_regions);
+    mmap_regions[mmap_num_regions++] = (mmap_region_t) {
+        .start = start, .end = end
+    };
+}
+
+/* Whether any region overlaps [start, end) */
+static int
+mmap_region_overlaps(uintptr_t start, uintptr_t end)
+{
+    for (size_t i = 0; i < mmap_num_regions; i++) {
+        if (mmap_regions[i].start < end && start < mmap_regions[i].end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Whether [start, end) lies inside a single region */
+static int
+mmap_region_contains(uintptr_t start, uintptr_t end)
+{
+    for (size_t i = 0; i < mmap_num_regions; i++) {
+        if (mmap_regions[i].start <= start && end <= mmap_regions[i].end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Unmap whatever parts of [start, end) were handed out by mmap and forget them.
+ * Splitting a region needs one free slot in the table. */
+static void
+mmap_region_remove(uintptr_t start, uintptr_t end)
+{
+    if (start >= end) {
+        /* an empty range would split a region into two that adjoin */
+        return;
+    }
+    for (size_t i = 0; i < mmap_num_regions; i++) {
+        mmap_region_t *region = &mmap_regions[i];
+        if (region->end <= start || region->start >= end) {
+            continue;
+        }
+        uintptr_t unmap_start = MAX(region->start, start);
+        uintptr_t unmap_end = MIN(region->end, end);
+        if (region->start < start && region->end > end) {
+            mmap_region_add(end, region->end);
+            region->end = start;
+        } else if (region->start < start) {
+            region->end = start;
+        } else if (region->end > end) {
+            region->start = end;
+        } else {
+            /* the whole region is gone. look at whatever replaces it */
+            *region = mmap_regions[--mmap_num_regions];
+            i--;
+        }
+        /* only once the table is updated, so that large pages the range
+         * shares with what is left of the region are kept */
+        morecore_unmap_range(unmap_start, unmap_end);
+    }
+}
 
 static long
 sys_brk_static(va_list ap)
@@ -164,17 +444,30 @@ sys_brk_dynamic(va_list ap)
     /*if the newbrk is 0, return the bottom of the heap*/
     if (newbrk == 0) {
         brk_start = (uintptr_t)muslc_brk_reservation_start;
+        if (brk_mapped == 0) {
+            brk_mapped = brk_start;
+        }
         ret = brk_start;
     } else {
-        /* try and map pages until this point */
-        while (brk_start < newbrk) {
-            int error = vspace_new_pages_at_vaddr(muslc_this_vspace, (void*) brk_start, 1,
-                        seL4_PageBits, muslc_brk_reservation);
+        if (newbrk > brk_mapped) {
+            /* grow by at least a whole granule, so that a heap growing a page
+             * at a time does not go to the vspace for every page */
+            uintptr_t target = ROUND_UP(newbrk, CONFIG_LIB_SEL4_MUSLC_SYS_MORECORE_GRANULE);
+            int error = morecore_map_range(&brk_mapped, target, MORECORE_LARGEST_PAGE,
+                                           muslc_brk_reservation);
+            if (error) {
+                /* we either ran out of large frames or the granule runs past the
+                 * end of the reservation. Just map what was asked for */
+                error = morecore_map_range(&brk_mapped, ROUND_UP(newbrk, PAGE_SIZE_4K), 0,
+                                           muslc_brk_reservation);
+            }
             if (error) {
                 ZF_LOGE("Mapping new pages to extend brk region failed\n");
                 return 0;
             }
-            brk_start += PAGE_SIZE_4K;
+        }
+        if (newbrk > brk_start) {
+            brk_start = ROUND_UP(newbrk, PAGE_SIZE_4K);
         }
         ret = brk_start;
     }
@@ -221,8 +514,7 @@ sys_mmap2_static(va_list ap)
         morecore_top = base;
         return base;
     }
-    assert(!"not implemented");
-    return -ENOMEM;
+    return muslcsys_mmap_file(length, prot, flags, fd, (uint64_t) (unsigned long) offset * PAGE_SIZE_4K);
 }
 
 
@@ -245,13 +537,42 @@ sys_mmap2_dynamic(va_list ap)
         return 0;
     }
     if (flags & MAP_ANONYMOUS) {
-        /* determine how many pages we need */
-        uint32_t pages = ROUND_UP(length, PAGE_SIZE_4K) / PAGE_SIZE_4K;
-        void *ret = vspace_new_pages(muslc_this_vspace, seL4_AllRights, pages, seL4_PageBits);
+        if (mmap_regions_reserve(mmap_num_regions + 1)) {
+            return -ENOMEM;
+        }
+        size_t bytes = ROUND_UP(length, PAGE_SIZE_4K);
+        /* align the region to the largest page that fits inside it, so the
+         * bulk of it can be mapped with large pages */
+        int largest = MORECORE_LARGEST_PAGE;
+        while (largest > 0 && bytes < BIT(sel4_page_sizes[largest])) {
+            largest--;
+        }
+        void *ret;
+        reservation_t reservation = vspace_reserve_range_aligned(muslc_this_vspace, bytes,
+                                                                 sel4_page_sizes[largest], seL4_AllRights, 1, &ret);
+        if (!reservation.res) {
+            ZF_LOGE("Failed to reserve range for mmap\n");
+            return -ENOMEM;
+        }
+        uintptr_t vaddr = (uintptr_t) ret;
+        int error = morecore_map_range(&vaddr, (uintptr_t) ret + bytes, largest, reservation);
+        if (error && largest > 0) {
+            /* out of large frames, start again with small pages */
+            morecore_unmap_range((uintptr_t) ret, vaddr);
+            vaddr = (uintptr_t) ret;
+            error = morecore_map_range(&vaddr, (uintptr_t) ret + bytes, 0, reservation);
+        }
+        if (error) {
+            morecore_unmap_range((uintptr_t) ret, vaddr);
+            vspace_free_reservation(muslc_this_vspace, reservation);
+            return -ENOMEM;
+        }
+        /* free the reservation book keeping */
+        vspace_free_reservation(muslc_this_vspace, reservation);
+        mmap_region_add((uintptr_t) ret, (uintptr_t) ret + bytes);
         return (long)ret;
     }
-    assert(!"not implemented");
-    return -ENOMEM;
+    return muslcsys_mmap_file(length, prot, flags, fd, (uint64_t) (unsigned long) offset * PAGE_SIZE_4K);
 }
 
 long
@@ -268,75 +589,160 @@ sys_mmap2(va_list ap)
     }
 }
 
-static long
-sys_mremap_dynamic(va_list ap)
+/* Move the frames mapped at [from, from + bytes) to the same offsets from to,
+ * which must be reserved by reservation. Returns how many bytes were moved,
+ * stopping early if a page cannot be moved. */
+static size_t
+morecore_move_frames(uintptr_t from, uintptr_t to, size_t bytes, reservation_t reservation)
 {
+    size_t offset = 0;
+    while (offset < bytes) {
+        uintptr_t base;
+        int i = morecore_page_at(from + offset, &base);
+        if (i == -1) {
+            /* leave holes as holes */
+            offset += PAGE_SIZE_4K;
+            continue;
+        }
+        size_t size_bits = sel4_page_sizes[i];
+        if (base != from + offset || offset + BIT(size_bits) > bytes) {
+            /* frame is not contained in the range */
+            return offset;
+        }
+        seL4_CPtr cap = vspace_get_cap(muslc_this_vspace, (void *) base);
+        uintptr_t cookie = vspace_get_cookie(muslc_this_vspace, (void *) base);
+        vspace_unmap_pages(muslc_this_vspace, (void *) base, 1, size_bits, VSPACE_PRESERVE);
+        int error = vspace_map_pages_at_vaddr(muslc_this_vspace, &cap, &cookie, (void *) (to + offset),
+                                              1, size_bits, reservation);
+        if (error) {
+            /* put the frame back where it came from */
+            reservation_t old = vspace_reserve_range_at(muslc_this_vspace, (void *) base, BIT(size_bits),
+                                                        seL4_AllRights, 1);
+            assert(old.res);
+            error = vspace_map_pages_at_vaddr(muslc_this_vspace, &cap, &cookie, (void *) base,
+                                              1, size_bits, old);
+            assert(!error);
+            vspace_free_reservation(muslc_this_vspace, old);
+            return offset;
+        }
+        offset += BIT(size_bits);
+    }
+    return bytes;
+}
 
+/* Try to grow the mapping at [vaddr, vaddr + old_size) to new_size without
+ * moving it. Only possible if nothing is reserved after it */
+static int
+morecore_grow_in_place(uintptr_t vaddr, size_t old_size, size_t new_size)
+{
+    uintptr_t start = vaddr + old_size;
+    uintptr_t end = vaddr + new_size;
+    reservation_t reservation = vspace_reserve_range_at(muslc_this_vspace, (void *) start,
+                                                        new_size - old_size, seL4_AllRights, 1);
+    if (!reservation.res) {
+        return -1;
+    }
+    uintptr_t mapped = start;
+    int error = morecore_map_range(&mapped, end, MORECORE_LARGEST_PAGE, reservation);
+    if (error) {
+        morecore_unmap_range(start, mapped);
+        mapped = start;
+        error = morecore_map_range(&mapped, end, 0, reservation);
+    }
+    if (error) {
+        morecore_unmap_range(start, mapped);
+    }
+    vspace_free_reservation(muslc_this_vspace, reservation);
+    return error;
+}
 
-    void *old_address = va_arg(ap, void*);
+static long
+sys_mremap_dynamic(va_list ap)
+{
+    uintptr_t old_address = (uintptr_t) va_arg(ap, void*);
     size_t old_size = va_arg(ap, size_t);
     size_t new_size = va_arg(ap, size_t);
     int flags = va_arg(ap, int);
-    UNUSED void *new_address_arg;
-
-    assert(flags == MREMAP_MAYMOVE);
-    assert(IS_ALIGNED_4K(old_size));
-    assert(IS_ALIGNED_4K((uint32_t) old_address));
-    assert(IS_ALIGNED_4K(new_size));
-    /* we currently only support remaping to size >= original */
-    assert(new_size >= old_size);
 
+    if (!IS_ALIGNED(old_address, seL4_PageBits) || new_size == 0) {
+        return -EINVAL;
+    }
     if (flags & MREMAP_FIXED) {
-        new_address_arg = va_arg(ap, void*);
+        ZF_LOGE("MREMAP_FIXED not supported\n");
+        return -EINVAL;
     }
 
-    /* first find all the old caps */
-    int num_pages = old_size >> seL4_PageBits;
-    seL4_CPtr caps[num_pages];
-    uint32_t cookies[num_pages];
-    int i;
-    for (i = 0; i < num_pages; i++) {
-        void *vaddr = old_address + i * BIT(seL4_PageBits);
-        caps[i] = vspace_get_cap(muslc_this_vspace, vaddr);
-        cookies[i] = vspace_get_cookie(muslc_this_vspace, vaddr);
-    }
-    /* unmap the previous mapping */
-    vspace_unmap_pages(muslc_this_vspace, old_address, num_pages, seL4_PageBits, VSPACE_PRESERVE);
-    /* reserve a new region */
-    int error;
+    old_size = ROUND_UP(old_size, PAGE_SIZE_4K);
+    new_size = ROUND_UP(new_size, PAGE_SIZE_4K);
+
+    if (!mmap_region_contains(old_address, old_address + old_size)) {
+        return -EFAULT;
+    }
+    /* the old region may be split and the new one added */
+    if (mmap_regions_reserve(mmap_num_regions + 2)) {
+        return -ENOMEM;
+    }
+
+    if (new_size <= old_size) {
+        /* shrinking always happens in place */
+        mmap_region_remove(old_address + new_size, old_address + old_size);
+        return (long) old_address;
+    }
+
+    /* a large page left over from shrinking may already back part of the growth */
+    size_t backed = morecore_backed_end(old_address + old_size) - old_address;
+    if (new_size <= backed || morecore_grow_in_place(old_address, backed, new_size) == 0) {
+        mmap_region_add(old_address + old_size, old_address + new_size);
+        return (long) old_address;
+    }
+
+    if (!(flags & MREMAP_MAYMOVE)) {
+        return -ENOMEM;
+    }
+
+    /* move the existing frames to a new region at the same offset from a large
+     * page boundary, so any large pages can be moved as they are, and back the
+     * rest with new frames. A region that was grown in place can hold large
+     * pages without starting on a large page boundary itself. */
+    size_t align_bits = sel4_page_sizes[MORECORE_LARGEST_PAGE];
+    size_t offset = old_address & MASK(align_bits);
     void *new_address;
-    int new_pages = new_size >> seL4_PageBits;
-    reservation_t reservation = vspace_reserve_range(muslc_this_vspace, new_pages * PAGE_SIZE_4K, seL4_AllRights, 1, &new_address);
+    reservation_t reservation = vspace_reserve_range_aligned(muslc_this_vspace, offset + new_size, align_bits,
+                                                             seL4_AllRights, 1, &new_address);
     if (!reservation.res) {
         ZF_LOGE("Failed to make reservation for remap\n");
-        goto restore;
+        return -ENOMEM;
     }
-    /* map all the existing pages into the reservation */
-    error = vspace_map_pages_at_vaddr(muslc_this_vspace, caps, cookies, new_address, num_pages, seL4_PageBits, reservation);
-    if (error) {
-        ZF_LOGE("Mapping existing pages into new reservation failed\n");
-        vspace_free_reservation(muslc_this_vspace, reservation);
-        goto restore;
+
+    uintptr_t new_vaddr = (uintptr_t) new_address + offset;
+    size_t moved = morecore_move_frames(old_address, new_vaddr, backed, reservation);
+    uintptr_t mapped = new_vaddr + backed;
+    int error = (moved == backed) ? 0 : -1;
+    if (!error) {
+        error = morecore_map_range(&mapped, new_vaddr + new_size, 0, reservation);
     }
-    /* create any new pages */
-    error = vspace_new_pages_at_vaddr(muslc_this_vspace, new_address + num_pages * PAGE_SIZE_4K, new_pages - num_pages, seL4_PageBits, reservation);
     if (error) {
-        ZF_LOGE("Creating new pages for remap region failed\n");
-        vspace_unmap_pages(muslc_this_vspace, new_address, num_pages, seL4_PageBits, VSPACE_PRESERVE);
+        ZF_LOGE("Failed to remap region\n");
+        morecore_unmap_range(new_vaddr + backed, mapped);
+        /* move whatever was moved back again */
+        if (moved > 0) {
+            reservation_t old = vspace_reserve_range_at(muslc_this_vspace, (void *) old_address, moved,
+                                                        seL4_AllRights, 1);
+            assert(old.res);
+            UNUSED size_t restored = morecore_move_frames(new_vaddr, old_address, moved, old);
+            assert(restored == moved);
+            vspace_free_reservation(muslc_this_vspace, old);
+        }
         vspace_free_reservation(muslc_this_vspace, reservation);
-        goto restore;
+        return -ENOMEM;
     }
+
     /* free the reservation book keeping */
     vspace_free_reservation(muslc_this_vspace, reservation);
-    return (long)new_address;
-restore:
-    /* try and recreate the original mapping */
-    reservation = vspace_reserve_range_at(muslc_this_vspace, old_address, num_pages * PAGE_SIZE_4K, seL4_AllRights, 1);
-    assert(reservation.res);
-    error = vspace_map_pages_at_vaddr(muslc_this_vspace, caps, cookies, old_address,
-            num_pages, seL4_PageBits, reservation);
-    assert(!error);
-    return -ENOMEM;
+    /* the frames have already left the old region, so this only updates the table */
+    mmap_region_remove(old_address, old_address + old_size);
+    mmap_region_add(new_vaddr, new_vaddr + new_size);
+    return (long) new_vaddr;
 }
 
 
@@ -361,5 +767,76 @@ sys_mremap(va_list ap)
     }
 }
 
+long
+sys_munmap(va_list ap)
+{
+    uintptr_t addr = (uintptr_t) va_arg(ap, void*);
+    size_t length = va_arg(ap, size_t);
+
+    if (muslcsys_cpio_contains((void *) addr)) {
+        /* file mappings point straight into the archive */
+        return 0;
+    }
+    if (length == 0) {
+        return -EINVAL;
+    }
+
+    if (morecore_area != NULL) {
+        /* static morecore can only take back the most recent mmap. Its mmaps
+         * are carved off the top of morecore_area, so need not be page aligned */
+        if (addr == morecore_top) {
+            morecore_top += length;
+        }
+        return 0;
+    } else if (muslc_this_vspace != NULL) {
+        if (!IS_ALIGNED(addr, seL4_PageBits)) {
+            return -EINVAL;
+        }
+        uintptr_t end = addr + ROUND_UP(length, PAGE_SIZE_4K);
+        if (brk_mapped != 0 && addr < brk_mapped && end > (uintptr_t) muslc_brk_reservation_start) {
+            ZF_LOGE("munmap of the brk heap\n");
+            return -EINVAL;
+        }
+        /* splitting a region needs a free slot */
+        if (mmap_regions_reserve(mmap_num_regions + 1)) {
+            return -ENOMEM;
+        }
+        /* anything that mmap did not hand out is left alone */
+        mmap_region_remove(addr, end);
+        return 0;
+    } else {
+        ZF_LOGE("munmap requires morecore_area or muslc* vars to be initialised\n");
+        assert(morecore_area != NULL || muslc_this_vspace != NULL);
+        return -EINVAL;
+    }
+}
+
+long
+sys_madvise(va_list ap)
+{
+    uintptr_t addr = (uintptr_t) va_arg(ap, void*);
+    size_t length = va_arg(ap, size_t);
+    int advice = va_arg(ap, int);
+
+    if (!IS_ALIGNED(addr, seL4_PageBits)) {
+        return -EINVAL;
+    }
+    if (advice != MADV_DONTNEED) {
+        /* all other advice can safely be ignored */
+        return 0;
+    }
+
+    /* There is no pager to map fresh frames back in when the range is next
+     * touched (and malloc will touch it again), so the frames have to stay.
+     * Just give the zero fill guarantee, skipping anything not mapped. */
+    uintptr_t end = addr + ROUND_UP(length, PAGE_SIZE_4K);
+    for (uintptr_t vaddr = addr; vaddr < end; vaddr += PAGE_SIZE_4K) {
+        if (muslc_this_vspace == NULL || vspace_get_cap(muslc_this_vspace, (void *) vaddr) != 0) {
+            memset((void *) vaddr, 0, PAGE_SIZE_4K);
+        }
+    }
+    return 0;
+}
+
 
 #endif
@@ -388,11 +388,6 @@ long sys_getrusage(va_list ap)
     assert(!"sys_getrusage not implemented");
     return 0;
 }
-long sys_gettimeofday(va_list ap)
-{
-    assert(!"sys_gettimeofday not implemented");
-    return 0;
-}
 long sys_settimeofday(va_list ap)
 {
     assert(!"sys_settimeofday not implemented");
@@ -453,11 +448,6 @@ long sys_mmap(va_list ap)
     assert(!"sys_mmap not implemented");
     return 0;
 }
-long sys_munmap(va_list ap)
-{
-    assert(!"sys_munmap not implemented");
-    return 0;
-}
 long sys_truncate(va_list ap)
 {
     assert(!"sys_truncate not implemented");
@@ -801,11 +791,6 @@ long sys_sched_rr_get_interval(va_list ap)
     assert(!"sys_sched_rr_get_interval not implemented");
     return 0;
 }
-long sys_nanosleep(va_list ap)
-{
-    assert(!"sys_nanosleep not implemented");
-    return 0;
-}
 long sys_setresuid(va_list ap)
 {
     assert(!"sys_setresuid not implemented");
@@ -886,11 +871,6 @@ long sys_rt_sigsuspend(va_list ap)
     assert(!"sys_rt_sigsuspend not implemented");
     return 0;
 }
-long sys_pread64(va_list ap)
-{
-    assert(!"sys_pread64 not implemented");
-    return 0;
-}
 long sys_pwrite64(va_list ap)
 {
     assert(!"sys_pwrite64 not implemented");
@@ -1080,11 +1060,6 @@ long sys_mincore(va_list ap)
     assert(!"sys_mincore not implemented");
     return 0;
 }
-long sys_madvise(va_list ap)
-{
-    assert(!"sys_madvise not implemented");
-    return 0;
-}
 long sys_madvise1(va_list ap)
 {
     assert(!"sys_madvise1 not implemented");
@@ -1175,11 +1150,6 @@ long sys_sendfile64(va_list ap)
     assert(!"sys_sendfile64 not implemented");
     return 0;
 }
-long sys_futex(va_list ap)
-{
-    assert(!"sys_futex not implemented");
-    return 0;
-}
 long sys_sched_setaffinity(va_list ap)
 {
     assert(!"sys_sched_setaffinity not implemented");
@@ -1285,21 +1255,11 @@ long sys_clock_settime(va_list ap)
     assert(!"sys_clock_settime not implemented");
     return 0;
 }
-long sys_clock_gettime(va_list ap)
-{
-    assert(!"sys_clock_gettime not implemented");
-    return 0;
-}
 long sys_clock_getres(va_list ap)
 {
     assert(!"sys_clock_getres not implemented");
     return 0;
 }
-long sys_clock_nanosleep(va_list ap)
-{
-    assert(!"sys_clock_nanosleep not implemented");
-    return 0;
-}
 long sys_statfs64(va_list ap)
 {
     assert(!"sys_statfs64 not implemented");
@@ -1962,11 +1922,6 @@ long sys_getrusage(va_list ap)
     assert(!"sys_getrusage not implemented");
     return 0;
 }
-long sys_gettimeofday(va_list ap)
-{
-    assert(!"sys_gettimeofday not implemented");
-    return 0;
-}
 long sys_settimeofday(va_list ap)
 {
     assert(!"sys_settimeofday not implemented");
@@ -2007,11 +1962,6 @@ long sys_reboot(va_list ap)
     assert(!"sys_reboot not implemented");
     return 0;
 }
-long sys_munmap(va_list ap)
-{
-    assert(!"sys_munmap not implemented");
-    return 0;
-}
 long sys_truncate(va_list ap)
 {
     assert(!"sys_truncate not implemented");
@@ -2290,11 +2240,6 @@ long sys_sched_rr_get_interval(va_list ap)
     assert(!"sys_sched_rr_get_interval not implemented");
     return 0;
 }
-long sys_nanosleep(va_list ap)
-{
-    assert(!"sys_nanosleep not implemented");
-    return 0;
-}
 
 long sys_setresuid(va_list ap)
 {
@@ -2366,11 +2311,6 @@ long sys_rt_sigsuspend(va_list ap)
     assert(!"sys_rt_sigsuspend not implemented");
     return 0;
 }
-long sys_pread64(va_list ap)
-{
-    assert(!"sys_pread64 not implemented");
-    return 0;
-}
 long sys_pwrite64(va_list ap)
 {
     assert(!"sys_pwrite64 not implemented");
@@ -2555,11 +2495,6 @@ long sys_mincore(va_list ap)
     assert(!"sys_mincore not implemented");
     return 0;
 }
-long sys_madvise(va_list ap)
-{
-    assert(!"sys_madvise not implemented");
-    return 0;
-}
 long sys_fcntl64(va_list ap)
 {
     assert(!"sys_fcntl64 not implemented");
@@ -2640,11 +2575,6 @@ long sys_sendfile64(va_list ap)
     assert(!"sys_sendfile64 not implemented");
     return 0;
 }
-long sys_futex(va_list ap)
-{
-    assert(!"sys_futex not implemented");
-    return 0;
-}
 long sys_sched_setaffinity(va_list ap)
 {
     assert(!"sys_sched_setaffinity not implemented");
@@ -2740,21 +2670,11 @@ long sys_clock_settime(va_list ap)
     assert(!"sys_clock_settime not implemented");
     return 0;
 }
-long sys_clock_gettime(va_list ap)
-{
-    assert(!"sys_clock_gettime not implemented");
-    return 0;
-}
 long sys_clock_getres(va_list ap)
 {
     assert(!"sys_clock_getres not implemented");
     return 0;
 }
-long sys_clock_nanosleep(va_list ap)
-{
-    assert(!"sys_clock_nanosleep not implemented");
-    return 0;
-}
 long sys_statfs64(va_list ap)
 {
     assert(!"sys_statfs64 not implemented");
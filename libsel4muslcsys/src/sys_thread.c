@@ -8,18 +8,61 @@
  * @TAG(NICTA_BSD)
  */
 
+#include <autoconf.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
 #include <bits/errno.h>
 
+#include <muslcsys/thread.h>
+
+#ifdef ARCH_IA32
+/* Argument of set_thread_area on ia32. We only need the first two fields */
+typedef struct user_desc {
+    unsigned int entry_number;
+    unsigned int base_addr;
+} user_desc_t;
+#endif
+
+static muslcsys_set_tls_base_fn_t set_tls_base_fn = NULL;
+
+/* tids handed out by set_tid_address */
+static int next_tid = 1;
+
+void muslcsys_install_set_tls_base(muslcsys_set_tls_base_fn_t fn) {
+    set_tls_base_fn = fn;
+}
+
 long sys_set_thread_area(va_list ap) {
+#ifdef ARCH_IA32
+    user_desc_t *desc = va_arg(ap, user_desc_t*);
+    void *tls_base = (void *) (uintptr_t) desc->base_addr;
+#else
+    void *tls_base = va_arg(ap, void*);
+#endif
+
     /* As part of the initialization of the C library we need to set the
      * thread area (also knows as the TLS base) for thread local storage.
-     * As we do not properly support TLS we just ignore this call. Will
-     * be fine provided we do not create multiple threads (through libc)
-     * or use TLS */
+     * If the environment has not told us how to do that we just ignore
+     * this call. Will be fine provided we do not create multiple threads
+     * (through libc) or use TLS */
+    if (set_tls_base_fn == NULL) {
+        return 0;
+    }
+
+    int entry = set_tls_base_fn(tls_base);
+    if (entry < 0) {
+        return -EINVAL;
+    }
+#ifdef ARCH_IA32
+    desc->entry_number = entry;
+#endif
     return 0;
 }
 
 long sys_set_tid_address(va_list ap) {
-    return -ENOSYS;
+    /* The C library uses the returned tid as the owner of its locks, so each
+     * caller must get a different one. The clear address is only used when a
+     * thread exits, which we do not support, so it is not recorded */
+    return __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
 }
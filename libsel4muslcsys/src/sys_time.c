@@ -0,0 +1,323 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#include <autoconf.h>
+
+#ifdef CONFIG_LIB_SEL4_MUSLC_SYS_CLOCK
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/time.h>
+#include <bits/errno.h>
+
+#include <sel4/sel4.h>
+#include <sel4bench/sel4bench.h>
+#include <utils/util.h>
+
+#include <muslcsys/time.h>
+
+#include "spinlock.h"
+
+#define NS_IN_S  1000000000ull
+#define NS_IN_US 1000ull
+
+/* how long to watch a timer for when calibrating the cycle counter */
+#define CALIBRATE_NS (10 * 1000 * 1000ull)
+
+/* cycles are converted to ns as (cycles * clock_mult) >> clock_shift */
+static uint64_t clock_mult;
+static uint32_t clock_shift;
+static uint64_t clock_base;
+static int clock_ready;
+/* held while setting the clock up, so that it is only set up once */
+static int clock_init_lock;
+static uint64_t realtime_offset;
+
+/* extends a 32-bit cycle counter to 64 bits */
+static int ccnt_lock;
+static ccnt_t ccnt_last;
+static uint32_t ccnt_wraps;
+
+#ifdef CONFIG_LIB_SEL4_PLAT_SUPPORT
+static seL4_timer_t *sleep_timer;
+static seL4_CPtr sleep_notification;
+/* only one thread can use the timer at once, others spin */
+static int sleep_lock;
+#endif
+
+static uint64_t
+read_ccnt(void)
+{
+    ccnt_t ccnt;
+
+    if (sizeof(ccnt_t) >= sizeof(uint64_t)) {
+        SEL4BENCH_READ_CCNT(ccnt);
+        return ccnt;
+    }
+
+    muslcsys_spin_lock(&ccnt_lock);
+    SEL4BENCH_READ_CCNT(ccnt);
+    if (ccnt < ccnt_last) {
+        ccnt_wraps++;
+    }
+    ccnt_last = ccnt;
+    uint64_t result = ((uint64_t) ccnt_wraps << 32) | ccnt;
+    muslcsys_spin_unlock(&ccnt_lock);
+
+    return result;
+}
+
+static uint64_t
+ccnt_to_ns(uint64_t cycles)
+{
+    /* clock_mult fits in 32 bits, so splitting the count means neither
+     * multiplication can overflow */
+    uint64_t hi = cycles >> 32;
+    uint64_t lo = cycles & MASK(32);
+    return ((hi * clock_mult) << (32 - clock_shift)) + ((lo * clock_mult) >> clock_shift);
+}
+
+static void
+clock_setup(uint64_t ccnt_freq)
+{
+    /* use the largest shift that keeps the multiplier in 32 bits */
+    uint32_t shift = 32;
+    uint64_t mult = (NS_IN_S << shift) / ccnt_freq;
+    while (mult > UINT32_MAX && shift > 0) {
+        shift--;
+        mult = (NS_IN_S << shift) / ccnt_freq;
+    }
+
+    clock_mult = mult;
+    clock_shift = shift;
+    clock_base = read_ccnt();
+    __atomic_store_n(&clock_ready, 1, __ATOMIC_RELEASE);
+}
+
+void
+muslcsys_clock_init(uint64_t ccnt_freq)
+{
+    muslcsys_spin_lock(&clock_init_lock);
+    clock_setup(ccnt_freq);
+    muslcsys_spin_unlock(&clock_init_lock);
+}
+
+void
+muslcsys_clock_set_realtime(uint64_t ns)
+{
+    uint64_t now = ccnt_to_ns(read_ccnt() - clock_base);
+    realtime_offset = ns - now;
+}
+
+/* Returns 0 and the time in ns, or an error if there is no clock */
+static int
+clock_get_ns(clockid_t clk_id, uint64_t *ns)
+{
+    if (!__atomic_load_n(&clock_ready, __ATOMIC_ACQUIRE)) {
+        if (CONFIG_LIB_SEL4_MUSLC_SYS_CCNT_FREQ_MHZ == 0) {
+            ZF_LOGE("Cycle counter frequency unknown, call muslcsys_clock_init");
+            return -ENOSYS;
+        }
+        muslcsys_spin_lock(&clock_init_lock);
+        /* another thread may have set it up while we waited */
+        if (!__atomic_load_n(&clock_ready, __ATOMIC_ACQUIRE)) {
+            clock_setup(CONFIG_LIB_SEL4_MUSLC_SYS_CCNT_FREQ_MHZ * 1000000ull);
+        }
+        muslcsys_spin_unlock(&clock_init_lock);
+    }
+
+    uint64_t now = ccnt_to_ns(read_ccnt() - clock_base);
+
+    switch (clk_id) {
+    case CLOCK_REALTIME:
+        now += realtime_offset;
+        break;
+    case CLOCK_MONOTONIC:
+    case CLOCK_MONOTONIC_RAW:
+    case CLOCK_PROCESS_CPUTIME_ID:
+    case CLOCK_THREAD_CPUTIME_ID:
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    *ns = now;
+    return 0;
+}
+
+#ifdef CONFIG_LIB_SEL4_PLAT_SUPPORT
+void
+muslcsys_clock_install_timer(seL4_timer_t *timer, seL4_CPtr notification)
+{
+    muslcsys_spin_lock(&clock_init_lock);
+    if (!__atomic_load_n(&clock_ready, __ATOMIC_ACQUIRE)) {
+        uint64_t start_ns = timer_get_time(timer->timer);
+        uint64_t start = read_ccnt();
+        uint64_t end_ns;
+        do {
+            end_ns = timer_get_time(timer->timer);
+        } while (end_ns - start_ns < CALIBRATE_NS);
+        uint64_t end = read_ccnt();
+
+        clock_setup((end - start) * NS_IN_S / (end_ns - start_ns));
+    }
+    muslcsys_spin_unlock(&clock_init_lock);
+
+    sleep_notification = notification;
+    __atomic_store_n(&sleep_timer, timer, __ATOMIC_RELEASE);
+}
+#endif
+
+static int
+timespec_to_ns(const struct timespec *ts, uint64_t *ns)
+{
+    if (ts->tv_sec < 0 || ts->tv_nsec < 0 || ts->tv_nsec >= NS_IN_S) {
+        return -EINVAL;
+    }
+    *ns = ts->tv_sec * NS_IN_S + ts->tv_nsec;
+    return 0;
+}
+
+static void
+ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / NS_IN_S;
+    ts->tv_nsec = ns % NS_IN_S;
+}
+
+#ifdef CONFIG_LIB_SEL4_PLAT_SUPPORT
+/* Longest single sleep on the timer. read_ccnt has to run at least once per
+ * wrap of a 32-bit cycle counter, so wake up well inside half a wrap */
+static uint64_t
+sleep_max_ns(void)
+{
+    if (sizeof(ccnt_t) >= sizeof(uint64_t)) {
+        return UINT64_MAX;
+    }
+    return ccnt_to_ns(1ull << 30);
+}
+#endif
+
+/* Sleep until clk_id reads deadline */
+static int
+sleep_until(clockid_t clk_id, uint64_t deadline)
+{
+    uint64_t now;
+    int error = clock_get_ns(clk_id, &now);
+
+#ifdef CONFIG_LIB_SEL4_PLAT_SUPPORT
+    seL4_timer_t *timer = __atomic_load_n(&sleep_timer, __ATOMIC_ACQUIRE);
+    if (!error && timer && deadline > now &&
+            deadline - now > CONFIG_LIB_SEL4_MUSLC_SYS_SLEEP_SPIN_US * NS_IN_US &&
+            muslcsys_spin_trylock(&sleep_lock)) {
+        while (!error && now < deadline) {
+            timer_oneshot_relative(timer->timer, MIN(deadline - now, sleep_max_ns()));
+            seL4_Wait(sleep_notification, NULL);
+            sel4_timer_handle_single_irq(timer);
+            error = clock_get_ns(clk_id, &now);
+        }
+        muslcsys_spin_unlock(&sleep_lock);
+    }
+#endif
+
+    /* short sleep, or no timer to sleep on */
+    while (!error && now < deadline) {
+        seL4_Yield();
+        error = clock_get_ns(clk_id, &now);
+    }
+    return error;
+}
+
+long
+sys_clock_gettime(va_list ap)
+{
+    clockid_t clk_id = va_arg(ap, clockid_t);
+    struct timespec *tp = va_arg(ap, struct timespec*);
+    uint64_t ns;
+
+    int error = clock_get_ns(clk_id, &ns);
+    if (error) {
+        return error;
+    }
+    ns_to_timespec(ns, tp);
+    return 0;
+}
+
+long
+sys_gettimeofday(va_list ap)
+{
+    struct timeval *tv = va_arg(ap, struct timeval*);
+    uint64_t ns;
+
+    if (tv == NULL) {
+        return 0;
+    }
+    int error = clock_get_ns(CLOCK_REALTIME, &ns);
+    if (error) {
+        return error;
+    }
+    tv->tv_sec = ns / NS_IN_S;
+    tv->tv_usec = (ns % NS_IN_S) / NS_IN_US;
+    return 0;
+}
+
+long
+sys_clock_nanosleep(va_list ap)
+{
+    clockid_t clk_id = va_arg(ap, clockid_t);
+    int flags = va_arg(ap, int);
+    const struct timespec *req = va_arg(ap, const struct timespec*);
+    struct timespec *rem = va_arg(ap, struct timespec*);
+    uint64_t ns, now;
+
+    int error = timespec_to_ns(req, &ns);
+    if (!error) {
+        error = clock_get_ns(clk_id, &now);
+    }
+    if (error) {
+        return error;
+    }
+
+    if (!(flags & TIMER_ABSTIME)) {
+        ns += now;
+    }
+    error = sleep_until(clk_id, ns);
+    if (!error && rem != NULL) {
+        /* we are never interrupted */
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return error;
+}
+
+long
+sys_nanosleep(va_list ap)
+{
+    const struct timespec *req = va_arg(ap, const struct timespec*);
+    struct timespec *rem = va_arg(ap, struct timespec*);
+    uint64_t ns, now;
+
+    int error = timespec_to_ns(req, &ns);
+    if (!error) {
+        error = clock_get_ns(CLOCK_MONOTONIC, &now);
+    }
+    if (!error) {
+        error = sleep_until(CLOCK_MONOTONIC, now + ns);
+    }
+    if (!error && rem != NULL) {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return error;
+}
+
+#endif /* CONFIG_LIB_SEL4_MUSLC_SYS_CLOCK */
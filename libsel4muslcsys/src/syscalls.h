@@ -12,6 +12,8 @@
 #define LIBSEL4MUSLCSYS_SYSCALLS_H_
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* prototype all the syscalls we implement */
 long sys_set_thread_area(va_list ap);
@@ -36,6 +38,21 @@ long sys_access(va_list ap);
 long sys_brk(va_list ap);
 long sys_mmap2(va_list ap);
 long sys_mremap(va_list ap);
+long sys_munmap(va_list ap);
+long sys_madvise(va_list ap);
+long sys_futex(va_list ap);
+long sys_clock_gettime(va_list ap);
+long sys_gettimeofday(va_list ap);
+long sys_nanosleep(va_list ap);
+long sys_clock_nanosleep(va_list ap);
+long sys_pread64(va_list ap);
+
+/* helpers shared between the syscall implementations */
+
+/* the file backed part of mmap, offset is in bytes */
+long muslcsys_mmap_file(size_t length, int prot, int flags, int fd, uint64_t offset);
+/* returns true if addr points into the cpio archive */
+int muslcsys_cpio_contains(void *addr);
 long sys_writev(va_list ap);
 
 #endif
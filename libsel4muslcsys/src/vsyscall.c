@@ -36,6 +36,7 @@ static long (*syscall_table[])(va_list) = {
     [__NR_close] = sys_close,
     [__NR_readv] = sys_readv,
     [__NR_read] = sys_read,
+    [__NR_pread64] = sys_pread64,
     [__NR_ioctl] = sys_ioctl,
     [__NR_prlimit64] = sys_prlimit64,
     [__NR_lseek] = sys_lseek,
@@ -48,6 +49,15 @@ static long (*syscall_table[])(va_list) = {
     [__NR_mmap2] = sys_mmap2,
 #endif
     [__NR_mremap] = sys_mremap,
+    [__NR_munmap] = sys_munmap,
+    [__NR_madvise] = sys_madvise,
+    [__NR_futex] = sys_futex,
+#ifdef CONFIG_LIB_SEL4_MUSLC_SYS_CLOCK
+    [__NR_clock_gettime] = sys_clock_gettime,
+    [__NR_gettimeofday] = sys_gettimeofday,
+    [__NR_nanosleep] = sys_nanosleep,
+    [__NR_clock_nanosleep] = sys_clock_nanosleep,
+#endif
 };
 
 #ifdef CONFIG_DEBUG_BUILD
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vspace/vspace.h>
+#include <vspace/page.h>
+#include <sel4utils/util.h>
+
+int fake_vspace_quiet;
+
+typedef struct fake_slot {
+    seL4_CPtr cap;
+    uintptr_t cookie;
+    int reserved;
+} fake_slot_t;
+
+typedef struct fake_reservation {
+    uintptr_t start;
+    uintptr_t end;
+} fake_reservation_t;
+
+/* contents of a frame that is unmapped but not freed, so that moving a frame
+ * moves its contents as it would on seL4 */
+typedef struct fake_preserved {
+    seL4_CPtr cap;
+    void *data;
+    struct fake_preserved *next;
+} fake_preserved_t;
+
+static fake_preserved_t *preserved;
+static vspace_t fake_vspace;
+static uintptr_t arena;
+static size_t arena_slots;
+static fake_slot_t *slots;
+static seL4_CPtr next_cap = 1;
+static size_t frame_bytes;
+static size_t fail_bits = 64;
+
+vspace_t *
+fake_vspace_init(size_t size)
+{
+    /* align the arena to the largest page */
+    size_t align = BIT(sel4_page_sizes[SEL4_NUM_PAGE_SIZES - 1]);
+    void *mem = mmap(NULL, size + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                     -1, 0);
+    assert(mem != MAP_FAILED);
+    arena = ROUND_UP((uintptr_t) mem, align);
+    arena_slots = size / PAGE_SIZE_4K;
+    slots = calloc(arena_slots, sizeof(fake_slot_t));
+    assert(slots);
+    return &fake_vspace;
+}
+
+size_t
+fake_vspace_frame_bytes(void)
+{
+    return frame_bytes;
+}
+
+void
+fake_vspace_fail_pages(size_t size_bits)
+{
+    fail_bits = size_bits;
+}
+
+static fake_slot_t *
+slot_at(uintptr_t vaddr)
+{
+    if (vaddr < arena || vaddr >= arena + arena_slots * PAGE_SIZE_4K) {
+        return NULL;
+    }
+    return &slots[(vaddr - arena) / PAGE_SIZE_4K];
+}
+
+/* Whether [vaddr, vaddr + bytes) is in the arena and neither mapped nor reserved */
+static int
+range_free(uintptr_t vaddr, size_t bytes)
+{
+    for (uintptr_t v = vaddr; v < vaddr + bytes; v += PAGE_SIZE_4K) {
+        fake_slot_t *slot = slot_at(v);
+        if (!slot || slot->cap || slot->reserved) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+range_reserve(uintptr_t vaddr, size_t bytes, int reserved)
+{
+    for (uintptr_t v = vaddr; v < vaddr + bytes; v += PAGE_SIZE_4K) {
+        slot_at(v)->reserved = reserved;
+    }
+}
+
+/* Whether [vaddr, vaddr + bytes) can be mapped under reservation */
+static int
+range_mappable(uintptr_t vaddr, size_t bytes, reservation_t reservation)
+{
+    fake_reservation_t *res = reservation.res;
+    if (!res || vaddr < res->start || vaddr + bytes > res->end) {
+        return 0;
+    }
+    for (uintptr_t v = vaddr; v < vaddr + bytes; v += PAGE_SIZE_4K) {
+        if (slot_at(v)->cap) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+map_page(uintptr_t vaddr, size_t size_bits, seL4_CPtr cap, uintptr_t cookie)
+{
+    void *data = NULL;
+    for (fake_preserved_t **p = &preserved; *p; p = &(*p)->next) {
+        if ((*p)->cap == cap) {
+            fake_preserved_t *found = *p;
+            *p = found->next;
+            data = found->data;
+            free(found);
+            break;
+        }
+    }
+    if (data) {
+        memcpy((void *) vaddr, data, BIT(size_bits));
+        free(data);
+    } else {
+        memset((void *) vaddr, 0, BIT(size_bits));
+    }
+    for (uintptr_t v = vaddr; v < vaddr + BIT(size_bits); v += PAGE_SIZE_4K) {
+        slot_at(v)->cap = cap;
+        slot_at(v)->cookie = cookie;
+    }
+}
+
+int
+vspace_new_pages_at_vaddr(vspace_t *vspace, void *vaddr, size_t num_pages, size_t size_bits,
+                          reservation_t reservation)
+{
+    uintptr_t start = (uintptr_t) vaddr;
+    if (size_bits >= fail_bits || !IS_ALIGNED(start, size_bits) ||
+            !range_mappable(start, num_pages << size_bits, reservation)) {
+        return -1;
+    }
+    for (size_t i = 0; i < num_pages; i++) {
+        map_page(start + (i << size_bits), size_bits, next_cap++, 0);
+        frame_bytes += BIT(size_bits);
+    }
+    return 0;
+}
+
+int
+vspace_map_pages_at_vaddr(vspace_t *vspace, seL4_CPtr caps[], uintptr_t cookies[], void *vaddr,
+                          size_t num_pages, size_t size_bits, reservation_t reservation)
+{
+    uintptr_t start = (uintptr_t) vaddr;
+    if (!IS_ALIGNED(start, size_bits) || !range_mappable(start, num_pages << size_bits, reservation)) {
+        return -1;
+    }
+    for (size_t i = 0; i < num_pages; i++) {
+        map_page(start + (i << size_bits), size_bits, caps[i], cookies ? cookies[i] : 0);
+    }
+    return 0;
+}
+
+void
+vspace_unmap_pages(vspace_t *vspace, void *vaddr, size_t num_pages, size_t size_bits, int free)
+{
+    uintptr_t start = (uintptr_t) vaddr;
+    for (size_t i = 0; i < num_pages; i++) {
+        uintptr_t page = start + (i << size_bits);
+        seL4_CPtr cap = slot_at(page)->cap;
+        assert(cap != 0);
+        if (free != VSPACE_FREE) {
+            fake_preserved_t *p = malloc(sizeof(*p));
+            assert(p);
+            p->cap = cap;
+            p->data = malloc(BIT(size_bits));
+            assert(p->data);
+            memcpy(p->data, (void *) page, BIT(size_bits));
+            p->next = preserved;
+            preserved = p;
+        }
+        for (uintptr_t v = page; v < page + BIT(size_bits); v += PAGE_SIZE_4K) {
+            /* a frame must be unmapped with the size it was mapped with */
+            assert(slot_at(v)->cap == cap);
+            slot_at(v)->cap = 0;
+            slot_at(v)->cookie = 0;
+        }
+        assert(slot_at(page - 1) == NULL || slot_at(page - 1)->cap != cap);
+        assert(slot_at(page + BIT(size_bits)) == NULL || slot_at(page + BIT(size_bits))->cap != cap);
+        if (free == VSPACE_FREE) {
+            frame_bytes -= BIT(size_bits);
+        }
+    }
+}
+
+seL4_CPtr
+vspace_get_cap(vspace_t *vspace, void *vaddr)
+{
+    fake_slot_t *slot = slot_at((uintptr_t) vaddr);
+    return slot ? slot->cap : 0;
+}
+
+uintptr_t
+vspace_get_cookie(vspace_t *vspace, void *vaddr)
+{
+    fake_slot_t *slot = slot_at((uintptr_t) vaddr);
+    return slot ? slot->cookie : 0;
+}
+
+static reservation_t
+reserve(uintptr_t vaddr, size_t bytes)
+{
+    fake_reservation_t *res = malloc(sizeof(*res));
+    assert(res);
+    *res = (fake_reservation_t) {
+        .start = vaddr, .end = vaddr + bytes
+    };
+    range_reserve(vaddr, bytes, 1);
+    return (reservation_t) {
+        .res = res
+    };
+}
+
+reservation_t
+vspace_reserve_range_aligned(vspace_t *vspace, size_t bytes, size_t size_bits,
+                             seL4_CapRights_t rights, int cacheable, void **vaddr)
+{
+    bytes = ROUND_UP(bytes, PAGE_SIZE_4K);
+    for (uintptr_t v = ROUND_UP(arena, BIT(size_bits)); v + bytes <= arena + arena_slots * PAGE_SIZE_4K;
+            v += BIT(size_bits)) {
+        if (range_free(v, bytes)) {
+            *vaddr = (void *) v;
+            return reserve(v, bytes);
+        }
+    }
+    return (reservation_t) {
+        .res = NULL
+    };
+}
+
+reservation_t
+vspace_reserve_range_at(vspace_t *vspace, void *vaddr, size_t bytes, seL4_CapRights_t rights, int cacheable)
+{
+    bytes = ROUND_UP(bytes, PAGE_SIZE_4K);
+    if (!range_free((uintptr_t) vaddr, bytes)) {
+        return (reservation_t) {
+            .res = NULL
+        };
+    }
+    return reserve((uintptr_t) vaddr, bytes);
+}
+
+void
+vspace_free_reservation(vspace_t *vspace, reservation_t reservation)
+{
+    fake_reservation_t *res = reservation.res;
+    range_reserve(res->start, res->end - res->start, 0);
+    free(res);
+}
+
+void *
+vspace_new_pages(vspace_t *vspace, seL4_CapRights_t rights, size_t num_pages, size_t size_bits)
+{
+    void *vaddr;
+    reservation_t reservation = vspace_reserve_range_aligned(vspace, num_pages << size_bits, size_bits,
+                                                             rights, 1, &vaddr);
+    if (!reservation.res) {
+        return NULL;
+    }
+    int error = vspace_new_pages_at_vaddr(vspace, vaddr, num_pages, size_bits, reservation);
+    vspace_free_reservation(vspace, reservation);
+    return error ? NULL : vaddr;
+}
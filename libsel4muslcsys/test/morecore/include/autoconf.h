@@ -0,0 +1,16 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+/* dynamic morecore, backed by the fake vspace */
+#define CONFIG_LIB_SEL4_MUSLC_SYS_MORECORE_BYTES 0
+#define CONFIG_LIB_SEL4_MUSLC_SYS_MORECORE_GRANULE 65536
+#define CONFIG_LIB_SEL4_MUSLC_SYS_MORECORE_LARGE_PAGES 1
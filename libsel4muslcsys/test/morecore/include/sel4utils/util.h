@@ -0,0 +1,28 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define ZF_LOGE(...) do { if (!fake_vspace_quiet) { fprintf(stderr, __VA_ARGS__); } } while (0)
+
+#define BIT(n) (1ul << (n))
+#define MASK(n) (BIT(n) - 1ul)
+#define ROUND_DOWN(n, b) (((n) / (b)) * (b))
+#define ROUND_UP(n, b) ((((n) + (b) - 1) / (b)) * (b))
+#define IS_ALIGNED(n, b) (!((n) & MASK(b)))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define UNUSED __attribute__((unused))
+
+/* set to keep expected errors out of the test output */
+extern int fake_vspace_quiet;
@@ -0,0 +1,18 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+/* x86_64 page sizes */
+#define seL4_PageBits 12
+#define PAGE_SIZE_4K BIT(seL4_PageBits)
+#define SEL4_NUM_PAGE_SIZES 2
+
+static const int sel4_page_sizes[SEL4_NUM_PAGE_SIZES] = {12, 21};
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+/* A vspace over a host buffer, enough for morecore. Every 4K of it records
+ * the cap of the frame mapped there, as the sel4utils vspace does, and
+ * whether it is reserved. Frames are never really allocated, but the bytes
+ * of frames handed out and not yet freed are counted. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uintptr_t seL4_CPtr;
+typedef int seL4_CapRights_t;
+#define seL4_AllRights 0
+
+typedef struct vspace {
+    int unused;
+} vspace_t;
+
+typedef struct reservation {
+    void *res;
+} reservation_t;
+
+enum {
+    VSPACE_FREE,
+    VSPACE_PRESERVE,
+};
+
+void *vspace_new_pages(vspace_t *vspace, seL4_CapRights_t rights, size_t num_pages, size_t size_bits);
+int vspace_new_pages_at_vaddr(vspace_t *vspace, void *vaddr, size_t num_pages, size_t size_bits,
+                              reservation_t reservation);
+int vspace_map_pages_at_vaddr(vspace_t *vspace, seL4_CPtr caps[], uintptr_t cookies[], void *vaddr,
+                              size_t num_pages, size_t size_bits, reservation_t reservation);
+void vspace_unmap_pages(vspace_t *vspace, void *vaddr, size_t num_pages, size_t size_bits, int free);
+seL4_CPtr vspace_get_cap(vspace_t *vspace, void *vaddr);
+uintptr_t vspace_get_cookie(vspace_t *vspace, void *vaddr);
+reservation_t vspace_reserve_range_aligned(vspace_t *vspace, size_t bytes, size_t size_bits,
+                                           seL4_CapRights_t rights, int cacheable, void **vaddr);
+reservation_t vspace_reserve_range_at(vspace_t *vspace, void *vaddr, size_t bytes,
+                                      seL4_CapRights_t rights, int cacheable);
+void vspace_free_reservation(vspace_t *vspace, reservation_t reservation);
+
+/* Set up the fake vspace over size bytes. Returns the vspace */
+vspace_t *fake_vspace_init(size_t size);
+/* Bytes of frames currently allocated */
+size_t fake_vspace_frame_bytes(void);
+/* Make creating frames of size_bits or more fail, to test fall backs */
+void fake_vspace_fail_pages(size_t size_bits);
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Churn benchmark for memory reclamation by the dynamic morecore. Keeps a set
+ * of live mmaps of random sizes and randomly maps, unmaps, shrinks, grows and
+ * madvises them, then reports how much is mapped compared to what is live,
+ * and whether everything is given back once the set is freed. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <vspace/page.h>
+#include <sel4utils/util.h>
+#include <muslcsys/morecore.h>
+#include "morecore_host.h"
+
+#define SLOTS 64
+
+typedef struct slot {
+    uintptr_t addr;
+    size_t size;
+} slot_t;
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dull;
+
+static uint64_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* Mostly small sizes, with the occasional region big enough for large pages */
+static size_t
+random_size(size_t max)
+{
+    size_t size = (rng() % 4 == 0) ? rng() % max : rng() % (max / 64);
+    return ROUND_UP(size + 1, PAGE_SIZE_4K);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <operations> <max size in KiB>\n", argv[0]);
+        return 1;
+    }
+    long ops = atol(argv[1]);
+    size_t max = atol(argv[2]) * 1024;
+    slot_t slots[SLOTS] = {{0}};
+    muslcsys_morecore_stats_t stats;
+    size_t live = 0;
+    size_t peak_mapped = 0;
+    long failed = 0;
+
+    host_morecore_init();
+    host_munmap(host_mmap(PAGE_SIZE_4K), PAGE_SIZE_4K);
+    muslcsys_get_morecore_stats(&stats);
+    size_t base_mapped = stats.bytes_mapped;
+    size_t base_unmapped = stats.bytes_unmapped;
+
+    double start = now();
+    for (long i = 0; i < ops; i++) {
+        slot_t *s = &slots[rng() % SLOTS];
+        if (s->addr == 0) {
+            size_t size = random_size(max);
+            long addr = host_mmap(size);
+            if (addr < 0) {
+                failed++;
+                continue;
+            }
+            s->addr = addr;
+            s->size = size;
+            live += size;
+            /* touch it, as malloc would */
+            memset((void *) s->addr, 1, PAGE_SIZE_4K);
+        } else {
+            switch (rng() % 4) {
+            case 0: {
+                size_t size = random_size(max);
+                long addr = host_mremap(s->addr, s->size, size, MREMAP_MAYMOVE);
+                if (addr < 0) {
+                    failed++;
+                    break;
+                }
+                live = live - s->size + size;
+                s->addr = addr;
+                s->size = size;
+                break;
+            }
+            case 1:
+                host_madvise(s->addr, s->size, MADV_DONTNEED);
+                break;
+            default:
+                host_munmap(s->addr, s->size);
+                live -= s->size;
+                s->addr = 0;
+                break;
+            }
+        }
+        muslcsys_get_morecore_stats(&stats);
+        peak_mapped = MAX(peak_mapped, stats.bytes_mapped - base_mapped);
+    }
+    double elapsed = now() - start;
+
+    muslcsys_get_morecore_stats(&stats);
+    size_t churn_mapped = stats.bytes_mapped - base_mapped;
+    for (int i = 0; i < SLOTS; i++) {
+        if (slots[i].addr) {
+            host_munmap(slots[i].addr, slots[i].size);
+        }
+    }
+    muslcsys_get_morecore_stats(&stats);
+
+    printf("%ld operations in %.3f s (%.0f ops/s), %ld failed\n", ops, elapsed, ops / elapsed, failed);
+    printf("live at end:        %zu KiB\n", live / 1024);
+    printf("mapped at end:      %zu KiB (%.2fx live)\n", churn_mapped / 1024,
+           live ? (double) churn_mapped / live : 0);
+    printf("peak mapped:        %zu KiB\n", peak_mapped / 1024);
+    printf("returned to vka:    %zu KiB\n", (stats.bytes_unmapped - base_unmapped) / 1024);
+    printf("mapped after free:  %zu KiB\n", (stats.bytes_mapped - base_mapped) / 1024);
+    printf("large pages mapped: %zu, small pages mapped: %zu\n", stats.large_pages, stats.small_pages);
+    return stats.bytes_mapped == base_mapped ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <vspace/vspace.h>
+#include <vspace/page.h>
+#include "morecore_host.h"
+#include "../../src/syscalls.h"
+
+extern reservation_t muslc_brk_reservation;
+extern void *muslc_brk_reservation_start;
+
+#define ARENA_SIZE (1ul << 30)
+#define BRK_SIZE (16ul << 20)
+
+/* nothing is file backed here */
+long
+muslcsys_mmap_file(size_t length, int prot, int flags, int fd, uint64_t offset)
+{
+    return -ENODEV;
+}
+
+int
+muslcsys_cpio_contains(void *addr)
+{
+    return 0;
+}
+
+void
+host_morecore_init(void)
+{
+    muslc_this_vspace = fake_vspace_init(ARENA_SIZE);
+    muslc_brk_reservation = vspace_reserve_range_aligned(muslc_this_vspace, BRK_SIZE, seL4_PageBits,
+                                                         seL4_AllRights, 1, &muslc_brk_reservation_start);
+    assert(muslc_brk_reservation.res);
+}
+
+static long
+call(long (*syscall)(va_list), ...)
+{
+    va_list ap;
+    va_start(ap, syscall);
+    long ret = syscall(ap);
+    va_end(ap);
+    return ret;
+}
+
+uintptr_t
+host_brk(uintptr_t newbrk)
+{
+    return call(sys_brk, newbrk);
+}
+
+long
+host_mmap(size_t length)
+{
+    return call(sys_mmap2, (void *) NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                (off_t) 0);
+}
+
+long
+host_mremap(uintptr_t addr, size_t old_size, size_t new_size, int flags)
+{
+    return call(sys_mremap, (void *) addr, old_size, new_size, flags);
+}
+
+long
+host_munmap(uintptr_t addr, size_t length)
+{
+    return call(sys_munmap, (void *) addr, length);
+}
+
+long
+host_madvise(uintptr_t addr, size_t length, int advice)
+{
+    return call(sys_madvise, (void *) addr, length, advice);
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+/* Calls into the morecore syscalls for the host test and benchmark */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vspace/vspace.h>
+
+extern vspace_t *muslc_this_vspace;
+
+/* Point the dynamic morecore at a fresh fake vspace with a brk reservation */
+void host_morecore_init(void);
+
+uintptr_t host_brk(uintptr_t newbrk);
+/* Anonymous mmap. Returns the address, or a negative errno */
+long host_mmap(size_t length);
+long host_mremap(uintptr_t addr, size_t old_size, size_t new_size, int flags);
+long host_munmap(uintptr_t addr, size_t length);
+long host_madvise(uintptr_t addr, size_t length, int advice);
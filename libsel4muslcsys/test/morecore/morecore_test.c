@@ -0,0 +1,291 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Tests for the dynamic morecore's mmap, mremap and munmap, run on the host
+ * against the fake vspace in fake_vspace.c. Every test checks that the frames
+ * it mapped are all given back. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vspace/vspace.h>
+#include <vspace/page.h>
+#include <sel4utils/util.h>
+#include <muslcsys/morecore.h>
+#include "morecore_host.h"
+
+#define MB (1024 * 1024ul)
+
+extern char *morecore_area;
+extern size_t morecore_size;
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long _a = (long) (a), _b = (long) (b); \
+    if (_a != _b) { \
+        printf("%s:%d: %s is %ld (0x%lx), expected %ld (0x%lx)\n", __FILE__, __LINE__, #a, _a, _a, _b, _b); \
+        failures++; \
+    } \
+} while (0)
+
+static size_t
+bytes_mapped(void)
+{
+    muslcsys_morecore_stats_t stats;
+    muslcsys_get_morecore_stats(&stats);
+    return stats.bytes_mapped;
+}
+
+/* Check that everything mapped since the last call has been given back */
+static size_t start_mapped;
+static size_t start_frames;
+
+static void
+start_test(void)
+{
+    start_mapped = bytes_mapped();
+    start_frames = fake_vspace_frame_bytes();
+}
+
+#define CHECK_ALL_FREED() do { \
+    CHECK_EQ(bytes_mapped(), start_mapped); \
+    CHECK_EQ(fake_vspace_frame_bytes(), start_frames); \
+} while (0)
+
+static void
+fill(uintptr_t addr, size_t bytes, char c)
+{
+    memset((void *) addr, c, bytes);
+}
+
+static int
+filled(uintptr_t addr, size_t bytes, char c)
+{
+    for (size_t i = 0; i < bytes; i++) {
+        if (((char *) addr)[i] != c) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+test_large_pages(void)
+{
+    muslcsys_morecore_stats_t before, after;
+
+    start_test();
+    muslcsys_get_morecore_stats(&before);
+    uintptr_t a = host_mmap(4 * MB);
+    muslcsys_get_morecore_stats(&after);
+    CHECK(IS_ALIGNED(a, 21));
+    CHECK_EQ(after.large_pages - before.large_pages, 2);
+    CHECK_EQ(bytes_mapped(), start_mapped + 4 * MB);
+    fill(a, 4 * MB, 1);
+    CHECK_EQ(host_munmap(a, 4 * MB), 0);
+    CHECK_ALL_FREED();
+}
+
+/* shrinking into a large page keeps the page, which a later munmap frees */
+static void
+test_shrink_into_large_page(void)
+{
+    start_test();
+    uintptr_t a = host_mmap(4 * MB);
+    CHECK_EQ(host_mremap(a, 4 * MB, 3 * MB, 0), a);
+    CHECK_EQ(bytes_mapped(), start_mapped + 4 * MB);
+    CHECK_EQ(host_munmap(a, 3 * MB), 0);
+    CHECK_ALL_FREED();
+
+    /* shrinking past a whole large page frees it straight away */
+    start_test();
+    a = host_mmap(4 * MB);
+    CHECK_EQ(host_mremap(a, 4 * MB, 3 * MB, 0), a);
+    CHECK_EQ(host_mremap(a, 3 * MB, 1 * MB, 0), a);
+    CHECK_EQ(bytes_mapped(), start_mapped + 2 * MB);
+    CHECK_EQ(host_munmap(a, 1 * MB), 0);
+    CHECK_ALL_FREED();
+}
+
+/* growing again reuses what is left of a large page */
+static void
+test_shrink_then_grow(void)
+{
+    start_test();
+    uintptr_t a = host_mmap(4 * MB);
+    fill(a, 4 * MB, 2);
+    CHECK_EQ(host_mremap(a, 4 * MB, 3 * MB, 0), a);
+    CHECK_EQ(host_mremap(a, 3 * MB, 4 * MB, 0), a);
+    CHECK_EQ(bytes_mapped(), start_mapped + 4 * MB);
+    CHECK(filled(a, 3 * MB, 2));
+
+    /* something in the way forces a move, which must take the whole page */
+    uintptr_t b = host_mmap(4 * MB);
+    CHECK_EQ(b, a + 4 * MB);
+    CHECK_EQ(host_mremap(a, 4 * MB, 3 * MB, 0), a);
+    uintptr_t c = host_mremap(a, 3 * MB, 6 * MB, MREMAP_MAYMOVE);
+    CHECK(c != a && c > 0);
+    CHECK(filled(c, 3 * MB, 2));
+    CHECK_EQ(vspace_get_cap(muslc_this_vspace, (void *) a), 0);
+    CHECK_EQ(host_munmap(c, 6 * MB), 0);
+    CHECK_EQ(host_munmap(b, 4 * MB), 0);
+    CHECK_ALL_FREED();
+}
+
+/* a large page is freed by whichever munmap gives up the last of it */
+static void
+test_partial_unmaps(void)
+{
+    start_test();
+    uintptr_t a = host_mmap(4 * MB);
+    CHECK_EQ(host_munmap(a + 1 * MB, 2 * MB), 0);
+    CHECK_EQ(bytes_mapped(), start_mapped + 4 * MB);
+    CHECK_EQ(host_munmap(a, 1 * MB), 0);
+    CHECK_EQ(bytes_mapped(), start_mapped + 2 * MB);
+    CHECK_EQ(host_munmap(a + 3 * MB, 1 * MB), 0);
+    CHECK_ALL_FREED();
+
+    /* unmapping the same range twice is harmless */
+    start_test();
+    a = host_mmap(4 * MB);
+    CHECK_EQ(host_munmap(a, 3 * MB), 0);
+    CHECK_EQ(host_munmap(a, 3 * MB), 0);
+    CHECK_EQ(bytes_mapped(), start_mapped + 2 * MB);
+    CHECK_EQ(host_munmap(a, 4 * MB), 0);
+    CHECK_ALL_FREED();
+}
+
+static void
+test_small_pages(void)
+{
+    start_test();
+    fake_vspace_fail_pages(21);
+    uintptr_t a = host_mmap(4 * MB + 8192);
+    fake_vspace_fail_pages(64);
+    CHECK(a > 0);
+    CHECK_EQ(bytes_mapped(), start_mapped + 4 * MB + 8192);
+    CHECK_EQ(host_mremap(a, 4 * MB + 8192, 1 * MB, 0), a);
+    CHECK_EQ(bytes_mapped(), start_mapped + 1 * MB);
+    CHECK_EQ(host_munmap(a, 1 * MB), 0);
+    CHECK_ALL_FREED();
+}
+
+/* a region grown in place can hold large pages without starting on a large
+ * page boundary, and must still be movable */
+static void
+test_move_grown_region(void)
+{
+    start_test();
+    fake_vspace_fail_pages(21);
+    uintptr_t a = host_mmap(8 * MB);
+    fake_vspace_fail_pages(64);
+    CHECK_EQ(host_munmap(a, 2 * MB + PAGE_SIZE_4K), 0);
+    CHECK_EQ(host_munmap(a + 3 * MB, 5 * MB), 0);
+    uintptr_t r = a + 2 * MB + PAGE_SIZE_4K;
+    CHECK_EQ(host_mremap(r, MB - PAGE_SIZE_4K, 5 * MB - PAGE_SIZE_4K, 0), r);
+    fill(r, 5 * MB - PAGE_SIZE_4K, 'g');
+    /* keep it from growing in place again */
+    reservation_t block = vspace_reserve_range_at(muslc_this_vspace, (void *) (a + 7 * MB), PAGE_SIZE_4K,
+                                                  seL4_AllRights, 1);
+    CHECK(block.res);
+    long moved = host_mremap(r, 5 * MB - PAGE_SIZE_4K, 8 * MB, MREMAP_MAYMOVE);
+    CHECK(moved > 0 && moved != r);
+    if (moved > 0) {
+        CHECK(filled(moved, 5 * MB - PAGE_SIZE_4K, 'g'));
+        CHECK_EQ(host_munmap(moved, 8 * MB), 0);
+    }
+    vspace_free_reservation(muslc_this_vspace, block);
+    CHECK_ALL_FREED();
+}
+
+/* remapping part of a region to its own size leaves the region whole */
+static void
+test_same_size_remap(void)
+{
+    start_test();
+    uintptr_t a = host_mmap(8 * PAGE_SIZE_4K);
+    CHECK_EQ(host_mremap(a, 4 * PAGE_SIZE_4K, 4 * PAGE_SIZE_4K, 0), a);
+    long b = host_mremap(a, 8 * PAGE_SIZE_4K, 16 * PAGE_SIZE_4K, MREMAP_MAYMOVE);
+    CHECK(b > 0);
+    if (b > 0) {
+        CHECK_EQ(host_munmap(b, 16 * PAGE_SIZE_4K), 0);
+    }
+    CHECK_ALL_FREED();
+}
+
+/* only what mmap handed out can be unmapped */
+static void
+test_stray_unmaps(void)
+{
+    start_test();
+    uintptr_t brk = host_brk(0);
+    host_brk(brk + 3 * PAGE_SIZE_4K);
+    size_t heap = bytes_mapped();
+    fake_vspace_quiet = 1;
+    CHECK_EQ(host_munmap(brk, PAGE_SIZE_4K), -EINVAL);
+    fake_vspace_quiet = 0;
+    CHECK_EQ(bytes_mapped(), heap);
+    CHECK_EQ(host_mremap(brk, PAGE_SIZE_4K, 2 * PAGE_SIZE_4K, MREMAP_MAYMOVE), -EFAULT);
+}
+
+/* static morecore takes back the most recent mmap, which is not page aligned
+ * when morecore_area does not end on a page boundary */
+static void
+test_static_munmap(void)
+{
+    static char area[MB + PAGE_SIZE_4K];
+
+    morecore_area = &area[3];
+    morecore_size = MB + 50;
+    host_brk(0);
+    long a = host_mmap(10000);
+    CHECK_EQ(a, (uintptr_t) &area[3] + MB + 50 - 10000);
+    CHECK_EQ(host_munmap(a, 10000), 0);
+    CHECK_EQ(host_mmap(20000), (uintptr_t) &area[3] + MB + 50 - 20000);
+    morecore_area = NULL;
+}
+
+int
+main(void)
+{
+    host_morecore_init();
+    /* let the region table be allocated before anything is measured */
+    host_munmap(host_mmap(PAGE_SIZE_4K), PAGE_SIZE_4K);
+
+    test_large_pages();
+    test_shrink_into_large_page();
+    test_shrink_then_grow();
+    test_partial_unmaps();
+    test_small_pages();
+    test_move_grown_region();
+    test_same_size_remap();
+    test_stray_unmaps();
+    /* last, as the dynamic morecore is not used again after it */
+    test_static_munmap();
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All morecore tests passed\n");
+    return 0;
+}
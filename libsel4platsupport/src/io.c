@@ -22,43 +22,247 @@
 #include <vspace/vspace.h>
 #include <vka/capops.h>
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+/* A node in an interval tree over [start, end). The trees are treaps ordered
+ * by start address, with each node also recording the largest end address in
+ * its subtree so that containment queries can skip whole subtrees.
+ */
+typedef struct io_range {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t max_end;
+    unsigned int priority;
+    struct io_range *left, *right;
+} io_range_t;
+
 typedef struct io_mapping {
     /* 1 if we mapped this into the vspace ourselves, or 0
      * if simple just gave us the vaddr */
     int was_mapped;
-    /* address we returned to the user */
-    void *returned_addr;
+    /* caching attribute the frames were mapped with */
+    int cached;
+    /* number of outstanding io_map calls satisfied by this mapping */
+    unsigned int refs;
     /* base address of the mapping with respect to the vspace */
     void *mapped_addr;
     int num_pages;
     int page_size;
     seL4_CPtr *caps;
-    struct io_mapping *next, *prev;
+    /* physical and virtual extent of the whole mapping, each linked into the
+     * corresponding tree in the io mapper */
+    io_range_t phys;
+    io_range_t virt;
 } io_mapping_t;
 
+#define PHYS_TO_MAPPING(r) ((io_mapping_t*)((void*)(r) - offsetof(io_mapping_t, phys)))
+#define VIRT_TO_MAPPING(r) ((io_mapping_t*)((void*)(r) - offsetof(io_mapping_t, virt)))
+
 typedef struct sel4platsupport_io_mapper_cookie {
     vspace_t vspace;
     simple_t simple;
     vka_t vka;
-    io_mapping_t *head;
+    /* mappings indexed by physical range, for sharing mappings */
+    io_range_t *phys_root;
+    /* mappings indexed by virtual range, for unmapping */
+    io_range_t *virt_root;
+    /* state for generating treap priorities */
+    unsigned int seed;
 } sel4platsupport_io_mapper_cookie_t;
 
-static io_mapping_t *new_unmapped_node(void *addr)
+static unsigned int
+_next_priority(sel4platsupport_io_mapper_cookie_t *io_mapper)
+{
+    /* xorshift; all we need is something that doesn't follow address order */
+    unsigned int x = io_mapper->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    io_mapper->seed = x;
+    return x;
+}
+
+static void
+_range_update(io_range_t *node)
+{
+    node->max_end = node->end;
+    if (node->left && node->left->max_end > node->max_end) {
+        node->max_end = node->left->max_end;
+    }
+    if (node->right && node->right->max_end > node->max_end) {
+        node->max_end = node->right->max_end;
+    }
+}
+
+/* Order by start address, breaking ties by node address so that every node
+ * has a unique position. */
+static int
+_range_less(io_range_t *a, io_range_t *b)
+{
+    return a->start < b->start || (a->start == b->start && (uintptr_t)a < (uintptr_t)b);
+}
+
+static io_range_t *
+_range_rotate_right(io_range_t *node)
+{
+    io_range_t *top = node->left;
+    node->left = top->right;
+    top->right = node;
+    _range_update(node);
+    _range_update(top);
+    return top;
+}
+
+static io_range_t *
+_range_rotate_left(io_range_t *node)
+{
+    io_range_t *top = node->right;
+    node->right = top->left;
+    top->left = node;
+    _range_update(node);
+    _range_update(top);
+    return top;
+}
+
+static io_range_t *
+_range_insert(io_range_t *root, io_range_t *node)
+{
+    if (!root) {
+        node->left = node->right = NULL;
+        _range_update(node);
+        return node;
+    }
+    if (_range_less(node, root)) {
+        root->left = _range_insert(root->left, node);
+        if (root->left->priority > root->priority) {
+            return _range_rotate_right(root);
+        }
+    } else {
+        root->right = _range_insert(root->right, node);
+        if (root->right->priority > root->priority) {
+            return _range_rotate_left(root);
+        }
+    }
+    _range_update(root);
+    return root;
+}
+
+static io_range_t *
+_range_merge(io_range_t *left, io_range_t *right)
+{
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    if (left->priority > right->priority) {
+        left->right = _range_merge(left->right, right);
+        _range_update(left);
+        return left;
+    }
+    right->left = _range_merge(left, right->left);
+    _range_update(right);
+    return right;
+}
+
+static io_range_t *
+_range_remove(io_range_t *root, io_range_t *node)
+{
+    assert(root);
+    if (root == node) {
+        return _range_merge(node->left, node->right);
+    }
+    if (_range_less(node, root)) {
+        root->left = _range_remove(root->left, node);
+    } else {
+        root->right = _range_remove(root->right, node);
+    }
+    _range_update(root);
+    return root;
+}
+
+/* Find a node that entirely contains [start, end) and is accepted by the
+ * given filter, if any. */
+static io_range_t *
+_range_find(io_range_t *root, uintptr_t start, uintptr_t end,
+            int (*accept)(io_range_t *node, void *arg), void *arg)
+{
+    if (!root || root->max_end < end) {
+        return NULL;
+    }
+    io_range_t *found = _range_find(root->left, start, end, accept, arg);
+    if (found) {
+        return found;
+    }
+    if (root->start > start) {
+        /* everything to the right starts even later */
+        return NULL;
+    }
+    if (end <= root->end && (!accept || accept(root, arg))) {
+        return root;
+    }
+    return _range_find(root->right, start, end, accept, arg);
+}
+
+/* Find a node that overlaps [start, end), if any. */
+static io_range_t *
+_range_find_overlap(io_range_t *root, uintptr_t start, uintptr_t end)
+{
+    if (!root || root->max_end <= start) {
+        return NULL;
+    }
+    io_range_t *found = _range_find_overlap(root->left, start, end);
+    if (found) {
+        return found;
+    }
+    if (root->start >= end) {
+        return NULL;
+    }
+    if (root->end > start) {
+        return root;
+    }
+    return _range_find_overlap(root->right, start, end);
+}
+
+static int
+_accept_cached(io_range_t *node, void *arg)
+{
+    io_mapping_t *mapping = PHYS_TO_MAPPING(node);
+    /* we have no control over the attributes of mappings simple gave us, so
+     * those are shared regardless */
+    return !mapping->was_mapped || mapping->cached == *(int*)arg;
+}
+
+static io_mapping_t *
+_new_node(sel4platsupport_io_mapper_cookie_t *io_mapper, int was_mapped, int cached,
+          uintptr_t paddr, void *vaddr, int num_pages, int page_size_bits, seL4_CPtr *caps)
 {
     io_mapping_t *ret = (io_mapping_t*)malloc(sizeof(*ret));
     if (!ret) {
         return NULL;
     }
+    size_t bytes = (size_t)num_pages << page_size_bits;
     *ret = (io_mapping_t) {
-        .was_mapped = 0,
-         .returned_addr = addr,
-          .next = NULL,
-           .prev = NULL,
-            .caps = NULL,
-             .mapped_addr = NULL
+        .was_mapped = was_mapped,
+        .cached = cached,
+        .refs = 1,
+        .mapped_addr = vaddr,
+        .num_pages = num_pages,
+        .page_size = page_size_bits,
+        .caps = caps,
+        .phys = {
+            .start = paddr,
+            .end = paddr + bytes,
+            .priority = _next_priority(io_mapper),
+        },
+        .virt = {
+            .start = (uintptr_t)vaddr,
+            .end = (uintptr_t)vaddr + bytes,
+            .priority = _next_priority(io_mapper),
+        },
     };
     return ret;
 }
@@ -66,38 +270,25 @@ static io_mapping_t *new_unmapped_node(void *addr)
 static void
 _insert_node(sel4platsupport_io_mapper_cookie_t *io_mapper, io_mapping_t *node)
 {
-    node->prev = NULL;
-    node->next = io_mapper->head;
-    if (io_mapper->head) {
-        io_mapper->head->prev = node;
-    }
-    io_mapper->head = node;
+    io_mapper->phys_root = _range_insert(io_mapper->phys_root, &node->phys);
+    io_mapper->virt_root = _range_insert(io_mapper->virt_root, &node->virt);
 }
 
+/* Find the mapping an address returned by io_map is in. Mappings never
+ * overlap in the vspace, so there is only ever one. */
 static io_mapping_t *
-_find_node(sel4platsupport_io_mapper_cookie_t *io_mapper, void *returned_addr)
+_find_node(sel4platsupport_io_mapper_cookie_t *io_mapper, void *vaddr)
 {
-    io_mapping_t *current;
-    for (current = io_mapper->head; current; current = current->next) {
-        if (current->returned_addr == returned_addr) {
-            return current;
-        }
-    }
-    return NULL;
+    io_range_t *range = _range_find(io_mapper->virt_root, (uintptr_t)vaddr,
+                                    (uintptr_t)vaddr + 1, NULL, NULL);
+    return range ? VIRT_TO_MAPPING(range) : NULL;
 }
 
 static void
 _remove_node(sel4platsupport_io_mapper_cookie_t *io_mapper, io_mapping_t *node)
 {
-    if (node->prev) {
-        node->prev->next = node->next;
-    } else {
-        assert(io_mapper->head == node);
-        io_mapper->head = node->next;
-    }
-    if (node->next) {
-        node->next->prev = node->prev;
-    }
+    io_mapper->phys_root = _range_remove(io_mapper->phys_root, &node->phys);
+    io_mapper->virt_root = _range_remove(io_mapper->virt_root, &node->virt);
 }
 
 static void
@@ -116,6 +307,21 @@ _remove_free_node(sel4platsupport_io_mapper_cookie_t *io_mapper, io_mapping_t *n
     _free_node(node);
 }
 
+/* Return an address for paddr within an existing mapping covering
+ * [paddr, paddr + size), taking a reference to that mapping. */
+static void *
+sel4platsupport_find_shared_mapping(sel4platsupport_io_mapper_cookie_t *io_mapper, uintptr_t paddr, size_t size, int cached)
+{
+    io_range_t *range = _range_find(io_mapper->phys_root, paddr, paddr + MAX(size, 1),
+                                    _accept_cached, &cached);
+    if (!range) {
+        return NULL;
+    }
+    io_mapping_t *mapping = PHYS_TO_MAPPING(range);
+    mapping->refs++;
+    return mapping->mapped_addr + (paddr - range->start);
+}
+
 static void *
 sel4platsupport_map_paddr_with_page_size(sel4platsupport_io_mapper_cookie_t *io_mapper, uintptr_t paddr, size_t size, int page_size_bits, int cached)
 {
@@ -139,56 +345,64 @@ sel4platsupport_map_paddr_with_page_size(sel4platsupport_io_mapper_cookie_t *io_
         ZF_LOGE("Failed to allocate array of size %zu", sizeof(*frames) * num_pages);
         return NULL;
     }
-    io_mapping_t *node = (io_mapping_t*)malloc(sizeof(*node));
+    io_mapping_t *node = _new_node(io_mapper, 1, cached, start, NULL, num_pages, page_size_bits, frames);
     if (!node) {
         ZF_LOGE("Failed to malloc of size %zu", sizeof(*node));
         free(frames);
         return NULL;
     }
 
-    /* get all of the physical frame caps */
+    cspacepath_t *paths = (cspacepath_t*)malloc(sizeof(*paths) * num_pages);
+    if (!paths) {
+        ZF_LOGE("Failed to allocate array of size %zu", sizeof(*paths) * num_pages);
+        free(frames);
+        free(node);
+        return NULL;
+    }
+
+    /* allocate a cslot for each frame */
     for (unsigned int i = 0; i < num_pages; i++) {
-        /* allocate a cslot */
         int error = vka_cspace_alloc(vka, &frames[i]);
         if (error) {
             ZF_LOGE("cspace alloc failed");
-            assert(error == 0);
-            /* we don't clean up as everything has gone to hell */
+            /* nothing has been copied into the slots yet */
+            while (i-- > 0) {
+                vka_cspace_free(vka, frames[i]);
+            }
+            free(paths);
+            free(frames);
+            free(node);
             return NULL;
         }
+        vka_cspace_make_path(vka, frames[i], &paths[i]);
+    }
 
-        /* create a path */
-        cspacepath_t path;
-        vka_cspace_make_path(vka, frames[i], &path);
-
-        error = simple_get_frame_cap(simple, (void*)start + (i * page_size), page_size_bits, &path);
-
-        if (error) {
-            /* free this slot, and then do general cleanup of the rest of the slots.
-             * this avoids a needless seL4_CNode_Delete of this slot, as there is no
-             * cap in it */
+    /* get all of the physical frame caps at once */
+    int error = simple_get_frame_caps(simple, (void*)start, page_size_bits, num_pages, paths);
+    free(paths);
+    if (error) {
+        /* none of the caps were copied, so just free the slots. this avoids a
+         * needless seL4_CNode_Delete of each empty slot */
+        for (unsigned int i = 0; i < num_pages; i++) {
             vka_cspace_free(vka, frames[i]);
-            num_pages = i;
-            goto error;
         }
-
+        free(frames);
+        free(node);
+        return NULL;
     }
 
     /* Now map the frames in */
     void *vaddr = vspace_map_pages(vspace, frames, NULL, seL4_AllRights, num_pages, page_size_bits, cached);
     if (vaddr) {
         /* fill out and insert the node */
-        *node = (io_mapping_t) {
-            .mapped_addr = vaddr,
-             .returned_addr = vaddr + offset,
-              .num_pages = num_pages,
-               .page_size = page_size_bits,
-                .caps = frames
-        };
+        node->mapped_addr = vaddr;
+        node->virt.start = (uintptr_t)vaddr;
+        node->virt.end = (uintptr_t)vaddr + ((size_t)num_pages << page_size_bits);
         _insert_node(io_mapper, node);
         return vaddr + offset;
     }
-error:
+
+    /* mapping failed, so give back the caps and slots */
     for (unsigned int i = 0; i < num_pages; i++) {
         cspacepath_t path;
         vka_cspace_make_path(vka, frames[i], &path);
@@ -225,11 +439,34 @@ sel4platsupport_get_vaddr_with_page_size(sel4platsupport_io_mapper_cookie_t *io_
             return NULL;
         }
     }
-    io_mapping_t *node = new_unmapped_node(first_vaddr + offset);
+
+    /* Ranges that overlap an existing one without being inside it are not
+     * shared, but simple hands out the same vaddrs for them. Merge all of
+     * those into one node, so that unmap always finds the node whose
+     * reference it is dropping. */
+    io_mapping_t *node = _new_node(io_mapper, 0, 0, start, first_vaddr, num_pages, page_size_bits, NULL);
     if (!node) {
         ZF_LOGE("Failed to allocate node to track mapping");
         return NULL;
     }
+    uintptr_t vaddr_offset = node->virt.start - node->phys.start;
+    io_range_t *range;
+    while ((range = _range_find_overlap(io_mapper->virt_root, node->virt.start, node->virt.end))) {
+        io_mapping_t *other = VIRT_TO_MAPPING(range);
+        /* a vaddr from simple always refers to the same frame, and is never
+         * one the vspace gave to a mapping of our own */
+        assert(!other->was_mapped && other->virt.start - other->phys.start == vaddr_offset);
+        node->virt.start = MIN(node->virt.start, other->virt.start);
+        node->virt.end = MAX(node->virt.end, other->virt.end);
+        node->refs += other->refs;
+        _remove_free_node(io_mapper, other);
+    }
+    node->phys.start = node->virt.start - vaddr_offset;
+    node->phys.end = node->virt.end - vaddr_offset;
+    node->mapped_addr = (void *)node->virt.start;
+    /* the merged range is in whole pages of the smallest size */
+    node->page_size = sel4_page_sizes[0];
+    node->num_pages = (node->virt.end - node->virt.start) >> node->page_size;
     _insert_node(io_mapper, node);
     return first_vaddr + offset;
 }
@@ -249,11 +486,22 @@ sel4platsupport_map_paddr(void *cookie, uintptr_t paddr, size_t size, int cached
      * In both cases we will try and use the largest frame size possible */
     sel4platsupport_io_mapper_cookie_t* io_mapper = (sel4platsupport_io_mapper_cookie_t*)cookie;
 
+    /* Drivers frequently map the same registers more than once, so first see
+     * if an existing mapping already covers this range. */
+    void *shared = sel4platsupport_find_shared_mapping(io_mapper, paddr, size, cached);
+    if (shared) {
+        return shared;
+    }
 
     int frame_size_index = 0;
-    /* find the largest reasonable frame size */
+    /* Find the largest frame size that covers exactly the same frames as the
+     * smallest one would. Using a larger frame that sticks out past either end
+     * of the region could map in neighbouring devices. */
+    uintptr_t small_start = ROUND_DOWN(paddr, BIT(sel4_page_sizes[0]));
+    uintptr_t small_end = ROUND_UP(paddr + size, BIT(sel4_page_sizes[0]));
     while (frame_size_index + 1 < SEL4_NUM_PAGE_SIZES) {
-        if (size >> sel4_page_sizes[frame_size_index + 1] == 0) {
+        uintptr_t large = BIT(sel4_page_sizes[frame_size_index + 1]);
+        if (size < large || small_start % large != 0 || small_end % large != 0) {
             break;
         }
         frame_size_index++;
@@ -293,6 +541,12 @@ sel4platsupport_unmap_vaddr(void *cookie, void *vaddr, size_t size)
         ZF_LOGF("Tried to unmap vaddr %p, which was never mapped in", vaddr);
         return;
     }
+    assert(mapping->refs > 0);
+    mapping->refs--;
+    if (mapping->refs > 0) {
+        /* still in use by another caller */
+        return;
+    }
     if (!mapping->was_mapped) {
         /* this vaddr was given directly from simple, so nothing to unmap */
         _remove_free_node(io_mapper, mapping);
@@ -327,7 +581,8 @@ sel4platsupport_new_io_mapper(simple_t simple, vspace_t vspace, vka_t vka, ps_io
     *cookie = (sel4platsupport_io_mapper_cookie_t) {
         .vspace = vspace,
          .simple = simple,
-          .vka = vka
+          .vka = vka,
+           .seed = 0x9e3779b9
     };
     *io_mapper = (ps_io_mapper_t) {
         .cookie = cookie,
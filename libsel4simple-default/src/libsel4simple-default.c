@@ -20,28 +20,76 @@
 
 #include <vspace/page.h>
 
+#define MAX_DEVICE_REGIONS (sizeof(((seL4_BootInfo *)NULL)->deviceRegions) / sizeof(seL4_DeviceRegion))
+
+/* Device regions of the bootinfo we were initialised with, sorted by base
+ * physical address so that frame lookups can binary search them. The bootinfo
+ * is left as it is and the index is kept here instead. */
+static seL4_BootInfo *indexed_bi = NULL;
+static seL4_DeviceRegion *sorted_regions[MAX_DEVICE_REGIONS];
+
+static seL4_Word device_region_end(seL4_DeviceRegion *region) {
+    return region->basePaddr + ((region->frames.end - region->frames.start) << region->frameSizeBits);
+}
+
+static void build_device_region_index(seL4_BootInfo *bi) {
+    assert(bi->numDeviceRegions <= MAX_DEVICE_REGIONS);
+
+    /* insertion sort, there are never many regions */
+    for (int i = 0; i < bi->numDeviceRegions; i++) {
+        seL4_DeviceRegion *region = &bi->deviceRegions[i];
+        int j = i;
+        while (j > 0 && sorted_regions[j - 1]->basePaddr > region->basePaddr) {
+            sorted_regions[j] = sorted_regions[j - 1];
+            j--;
+        }
+        sorted_regions[j] = region;
+    }
+    indexed_bi = bi;
+}
+
+/* Find the device region containing paddr, or NULL if there isn't one. */
+static seL4_DeviceRegion *find_device_region(seL4_BootInfo *bi, seL4_Word paddr) {
+    if (bi != indexed_bi) {
+        /* we were called without being initialised with this bootinfo, so
+         * fall back to searching it directly */
+        for (int i = 0; i < bi->numDeviceRegions; i++) {
+            seL4_DeviceRegion *region = &bi->deviceRegions[i];
+            if (region->basePaddr <= paddr && paddr < device_region_end(region)) {
+                return region;
+            }
+        }
+        return NULL;
+    }
+
+    /* find the last region starting at or below paddr */
+    int lo = 0;
+    int hi = bi->numDeviceRegions;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (sorted_regions[mid]->basePaddr <= paddr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+    seL4_DeviceRegion *region = sorted_regions[lo - 1];
+    return paddr < device_region_end(region) ? region : NULL;
+}
+
 void *simple_default_get_frame_info(void *data, void *paddr, int size_bits, seL4_CPtr *frame_cap, seL4_Word *offset) {
     assert(data && paddr && frame_cap);
 
     seL4_BootInfo *bi = (seL4_BootInfo *) data;
 
-    int i;
-    seL4_DeviceRegion* region;
-
     *offset = 0;
     *frame_cap = seL4_CapNull;
-    region = bi->deviceRegions;
-    for(i = 0; i < bi->numDeviceRegions; i++, region++){
-        seL4_Word region_start = region->basePaddr;
-        seL4_Word n_caps = region->frames.end - region->frames.start;
-        seL4_Word region_end = region_start + (n_caps << region->frameSizeBits);
-        if(region_start <= (seL4_Word) paddr &&
-           (seL4_Word) paddr < region_end &&
-           region->frameSizeBits == size_bits) {
-
-            *frame_cap =  region->frames.start + (((seL4_Word) paddr - region->basePaddr) >> region->frameSizeBits);
-            i = bi->numDeviceRegions;
-        }
+    seL4_DeviceRegion *region = find_device_region(bi, (seL4_Word) paddr);
+    if (region && region->frameSizeBits == size_bits) {
+        *frame_cap = region->frames.start + (((seL4_Word) paddr - region->basePaddr) >> region->frameSizeBits);
     }
 
     return NULL;
@@ -58,6 +106,41 @@ seL4_Error simple_default_get_frame_cap(void *data, void *paddr, int size_bits,
     return seL4_CNode_Copy(path->root, path->capPtr, path->capDepth, seL4_CapInitThreadCNode, frame_cap, 32, seL4_AllRights);
 }
 
+seL4_Error simple_default_get_frame_caps(void *data, void *paddr, int size_bits, int num_frames, cspacepath_t *paths) {
+    assert(data && paddr && paths);
+
+    seL4_BootInfo *bi = (seL4_BootInfo *) data;
+    seL4_DeviceRegion *region = NULL;
+    seL4_Error error = seL4_NoError;
+    int i;
+
+    /* Device caps for a region are consecutive, so only look up a region
+     * when the range moves into a new one. */
+    for (i = 0; i < num_frames; i++) {
+        seL4_Word frame = (seL4_Word) paddr + ((seL4_Word) i << size_bits);
+        if (!region || frame >= device_region_end(region)) {
+            region = find_device_region(bi, frame);
+            if (!region || region->frameSizeBits != size_bits) {
+                error = seL4_FailedLookup;
+                break;
+            }
+        }
+        seL4_CPtr frame_cap = region->frames.start + ((frame - region->basePaddr) >> size_bits);
+        error = seL4_CNode_Copy(paths[i].root, paths[i].capPtr, paths[i].capDepth, seL4_CapInitThreadCNode, frame_cap, 32, seL4_AllRights);
+        if (error != seL4_NoError) {
+            break;
+        }
+    }
+
+    if (error != seL4_NoError) {
+        /* remove the caps we did copy */
+        while (i-- > 0) {
+            seL4_CNode_Delete(paths[i].root, paths[i].capPtr, paths[i].capDepth);
+        }
+    }
+    return error;
+}
+
 seL4_CPtr simple_default_get_ut_cap(void *data, void *paddr, int size_bits) {
     assert(data && paddr);
 
@@ -213,9 +296,12 @@ void simple_default_init_bootinfo(simple_t *simple, seL4_BootInfo *bi) {
     assert(simple);
     assert(bi);
 
+    build_device_region_index(bi);
+
     simple->data = bi;
     simple->frame_info = &simple_default_get_frame_info;
     simple->frame_cap = &simple_default_get_frame_cap;
+    simple->frame_caps = &simple_default_get_frame_caps;
     simple->frame_mapping = &simple_default_get_frame_mapping;
     simple->ASID_assign = &simple_default_set_ASID;
     simple->cap_count = &simple_default_cap_count;
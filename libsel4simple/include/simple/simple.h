@@ -34,6 +34,27 @@
  */
 typedef seL4_Error (*simple_get_frame_cap_fn)(void *data, void *paddr, int size_bits, cspacepath_t *path);
 
+/**
+ * Get the caps to a physically contiguous range of frames and put them at the specified locations
+ *
+ * Either all of the caps are placed or, on failure, none of them are.
+ *
+ * This is optional and simple_get_frame_caps falls back to frame_cap when it is
+ * NULL. Implementations that fill in a simple_t field by field must therefore
+ * zero it first (or set frame_caps to NULL explicitly).
+ *
+ * @param data cookie for the underlying implementation
+ *
+ * @param page aligned physical address of the first frame
+ *
+ * @param size of each frame in bits
+ *
+ * @param number of frames
+ *
+ * @param array of num_frames paths to put the caps in
+ */
+typedef seL4_Error (*simple_get_frame_caps_fn)(void *data, void *paddr, int size_bits, int num_frames, cspacepath_t *paths);
+
 /**
  * Request mapped address to a region of physical memory.
  *
@@ -177,6 +198,8 @@ typedef void (*simple_print_fn)(void *data);
 typedef struct simple_t {
     void *data;
     simple_get_frame_cap_fn frame_cap;
+    /* optional, must be NULL if not implemented */
+    simple_get_frame_caps_fn frame_caps;
     simple_get_frame_mapping_fn frame_mapping;
     simple_get_frame_info_fn frame_info;
     simple_ASIDPool_assign_fn ASID_assign;
@@ -222,6 +245,33 @@ simple_get_frame_cap(simple_t *simple, void *paddr, int size_bits, cspacepath_t
     return simple->frame_cap(simple->data, paddr, size_bits, path);
 }
 
+static inline seL4_Error
+simple_get_frame_caps(simple_t *simple, void *paddr, int size_bits, int num_frames, cspacepath_t *paths)
+{
+    if (!simple) {
+        ZF_LOGE("Simple is NULL");
+        return seL4_InvalidArgument;
+    }
+    if (simple->frame_caps) {
+        return simple->frame_caps(simple->data, paddr, size_bits, num_frames, paths);
+    }
+    if (!simple->frame_cap) {
+        ZF_LOGE("%s not implemented", __FUNCTION__);
+        return seL4_InvalidArgument;
+    }
+    /* fall back to getting the caps one at a time */
+    for (int i = 0; i < num_frames; i++) {
+        seL4_Error error = simple->frame_cap(simple->data, paddr + ((seL4_Word)i << size_bits), size_bits, &paths[i]);
+        if (error != seL4_NoError) {
+            while (i-- > 0) {
+                seL4_CNode_Delete(paths[i].root, paths[i].capPtr, paths[i].capDepth);
+            }
+            return error;
+        }
+    }
+    return seL4_NoError;
+}
+
 static inline void *
 simple_get_frame_vaddr(simple_t *simple, void *paddr, int size_bits)
 {
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Contention microbenchmark for the spin locks. Each thread repeatedly takes
+ * the lock, does some work, releases it and does some more work, for a fixed
+ * time. Reported for each lock are the acquisitions per second and the
+ * fewest and most acquisitions made by any one thread, which shows how fair
+ * the lock is. A pthread mutex is included for comparison.
+ *
+ * usage: spinlock_bench [threads] [duration ms] [critical spins] [outside spins]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sync/spinlock.h>
+#include <sync/ticketlock.h>
+#include <sync/mcslock.h>
+
+#define MAX_THREADS 256
+
+typedef struct {
+    const char *name;
+    int (*init)(void *lock);
+    int (*lock)(void *lock);
+    int (*unlock)(void *lock);
+} lock_ops_t;
+
+#define LOCK_OPS(name) { #name, \
+    (int (*)(void *)) sync_##name##_init, \
+    (int (*)(void *)) sync_##name##_lock, \
+    (int (*)(void *)) sync_##name##_unlock }
+
+static int pthread_init(void *lock) {
+    return pthread_mutex_init(lock, NULL);
+}
+
+static const lock_ops_t locks[] = {
+    LOCK_OPS(spinlock),
+    LOCK_OPS(ticketlock),
+    LOCK_OPS(mcslock),
+    { "pthread_mutex", pthread_init, (int (*)(void *)) pthread_mutex_lock, (int (*)(void *)) pthread_mutex_unlock },
+};
+
+static union {
+    sync_spinlock_t spinlock;
+    sync_ticketlock_t ticketlock;
+    sync_mcslock_t mcslock;
+    pthread_mutex_t mutex;
+} lock;
+
+static const lock_ops_t *ops;
+static int critical;
+static int outside;
+static volatile int stop;
+static volatile int start;
+/* Only modified with the lock held, to check mutual exclusion. */
+static unsigned long shared_count;
+
+typedef struct {
+    pthread_t thread;
+    unsigned long count;
+    /* Keep threads' counts on separate cache lines. */
+    char pad[64];
+} worker_t;
+
+static worker_t workers[MAX_THREADS];
+
+static void spin(int n) {
+    for (volatile int i = 0; i < n; i++);
+}
+
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    while (!start);
+    while (!stop) {
+        ops->lock(&lock);
+        shared_count++;
+        spin(critical);
+        ops->unlock(&lock);
+        w->count++;
+        spin(outside);
+    }
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(const lock_ops_t *lock_ops, int threads, int duration) {
+    ops = lock_ops;
+    ops->init(&lock);
+    stop = 0;
+    start = 0;
+    shared_count = 0;
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].count = 0;
+        if (pthread_create(&workers[i].thread, NULL, worker, &workers[i]) != 0) {
+            perror("pthread_create");
+            return -1;
+        }
+    }
+
+    double begin = now();
+    start = 1;
+    struct timespec ts = { duration / 1000, (duration % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+    stop = 1;
+
+    unsigned long total = 0, min = -1, max = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].count;
+        min = workers[i].count < min ? workers[i].count : min;
+        max = workers[i].count > max ? workers[i].count : max;
+    }
+    double elapsed = now() - begin;
+
+    printf("%-14s %14.0f %12lu %12lu %8.3f\n", ops->name, total / elapsed, min, max,
+           max ? (double) min / max : 0);
+    if (total != shared_count) {
+        printf("%s: mutual exclusion violated, %lu acquisitions but count is %lu\n", ops->name, total,
+               shared_count);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int duration = argc > 2 ? atoi(argv[2]) : 1000;
+    critical = argc > 3 ? atoi(argv[3]) : 20;
+    outside = argc > 4 ? atoi(argv[4]) : 100;
+
+    if (threads < 1 || threads > MAX_THREADS || duration < 1) {
+        fprintf(stderr, "usage: %s [threads (1-%d)] [duration ms] [critical spins] [outside spins]\n",
+                argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    printf("%d threads, %d ms, %d spins in and %d outside the lock\n", threads, duration, critical, outside);
+    printf("%-14s %14s %12s %12s %8s\n", "lock", "acquires/s", "min/thread", "max/thread", "fairness");
+    int error = 0;
+    for (size_t i = 0; i < sizeof(locks) / sizeof(locks[0]); i++) {
+        error |= run(&locks[i], threads, duration);
+    }
+    return error ? 1 : 0;
+}
@@ -67,4 +67,15 @@ static inline int sync_atomic_decrement(volatile int *x, int memorder) {
     return __atomic_sub_fetch(x, 1, memorder);
 }
 
+/* Hint to the processor that we are in a spin-wait loop. */
+static inline void sync_cpu_relax(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    asm volatile("pause" ::: "memory");
+#elif defined(__ARM_ARCH) && __ARM_ARCH >= 7
+    asm volatile("yield" ::: "memory");
+#else
+    asm volatile("" ::: "memory");
+#endif
+}
+
 #endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _SYNC_BARRIER_H_
+#define _SYNC_BARRIER_H_
+
+/* A reusable barrier for a fixed number of threads.
+ *
+ * The last thread to arrive starts a new generation and signals the
+ * notification. As a notification only remembers a single pending signal, each
+ * released thread signals it again while there are more to release. A thread
+ * that has already moved on and is waiting in the next generation passes such
+ * a wake up along instead of consuming it.
+ */
+
+#include <assert.h>
+#include <sel4/sel4.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sync/atomic.h>
+
+typedef struct {
+    seL4_CPtr notification;
+    unsigned int threads;
+    volatile unsigned int arrived;
+    volatile unsigned int generation;
+    /* Threads of the last generation still to be released. */
+    volatile unsigned int waking;
+} sync_barrier_t;
+
+static inline int sync_barrier_init(sync_barrier_t *barrier, seL4_CPtr notification, unsigned int threads) {
+    assert(barrier != NULL);
+#ifdef SEL4_DEBUG_KERNEL
+    /* Check the cap actually is a notification. */
+    assert(seL4_DebugCapIdentify(notification) == 6);
+#endif
+    if (threads == 0) {
+        return -1;
+    }
+
+    barrier->notification = notification;
+    barrier->threads = threads;
+    barrier->arrived = 0;
+    barrier->generation = 0;
+    barrier->waking = 0;
+    return 0;
+}
+
+/* Wait for all threads to arrive. Returns 1 in the last thread to arrive and 0
+ * in the others. */
+static inline int sync_barrier_wait(sync_barrier_t *barrier) {
+    assert(barrier != NULL);
+    unsigned int generation = __atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE);
+
+    if (__atomic_add_fetch(&barrier->arrived, 1, __ATOMIC_ACQ_REL) == barrier->threads) {
+        /* No one else can arrive until we start the next generation. */
+        barrier->arrived = 0;
+        barrier->waking = barrier->threads - 1;
+        __atomic_store_n(&barrier->generation, generation + 1, __ATOMIC_RELEASE);
+        if (barrier->threads > 1) {
+            seL4_Signal(barrier->notification);
+        }
+        return 1;
+    }
+
+    while (true) {
+        seL4_Wait(barrier->notification, NULL);
+        if (__atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE) != generation) {
+            if (__atomic_sub_fetch(&barrier->waking, 1, __ATOMIC_ACQ_REL) > 0) {
+                seL4_Signal(barrier->notification);
+            }
+            return 0;
+        }
+        /* The wake up was for a thread from the last generation. */
+        if (__atomic_load_n(&barrier->waking, __ATOMIC_ACQUIRE) > 0) {
+            seL4_Signal(barrier->notification);
+            seL4_Yield();
+        }
+    }
+}
+
+static inline int sync_barrier_destroy(sync_barrier_t *barrier) {
+    assert(barrier != NULL);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _SYNC_CONDITION_VAR_H_
+#define _SYNC_CONDITION_VAR_H_
+
+/* A condition variable, used with a sync_mutex_t.
+ *
+ * A notification only remembers a single pending signal, so the condition
+ * variable cannot signal once per waiter to be woken. Instead waiters take a
+ * ticket, and signalling advances the number of tickets released. A woken
+ * waiter returns if its ticket has been released and, if any other released
+ * waiter is still blocked, signals the notification again to pass the wake up
+ * along. Tickets also stop a thread that starts waiting after a signal from
+ * taking the wake up meant for a thread that was already waiting.
+ *
+ * sync_cv_signal and sync_cv_broadcast must be called with the mutex held.
+ */
+
+#include <assert.h>
+#include <sel4/sel4.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sync/atomic.h>
+#include <sync/mutex.h>
+
+typedef struct {
+    seL4_CPtr notification;
+    /* Tickets handed out to waiters. Protected by the mutex. */
+    unsigned int tickets;
+    /* Tickets below this have been released. */
+    volatile unsigned int released;
+    /* Released waiters that have returned. */
+    volatile unsigned int exited;
+} sync_cv_t;
+
+static inline int sync_cv_init(sync_cv_t *cv, seL4_CPtr notification) {
+    assert(cv != NULL);
+#ifdef SEL4_DEBUG_KERNEL
+    /* Check the cap actually is a notification. */
+    assert(seL4_DebugCapIdentify(notification) == 6);
+#endif
+
+    cv->notification = notification;
+    cv->tickets = 0;
+    cv->released = 0;
+    cv->exited = 0;
+    return 0;
+}
+
+/* Number of released waiters that have not yet returned. */
+static inline int sync_cv_pending(sync_cv_t *cv) {
+    return (int) (__atomic_load_n(&cv->released, __ATOMIC_ACQUIRE) - __atomic_load_n(&cv->exited, __ATOMIC_ACQUIRE));
+}
+
+static inline int sync_cv_wait(sync_cv_t *cv, sync_mutex_t *mutex) {
+    assert(cv != NULL);
+    assert(mutex != NULL);
+
+    unsigned int ticket = cv->tickets++;
+    int error = sync_mutex_unlock(mutex);
+    if (error) {
+        return error;
+    }
+
+    while (true) {
+        seL4_Wait(cv->notification, NULL);
+        if ((int) (ticket - __atomic_load_n(&cv->released, __ATOMIC_ACQUIRE)) < 0) {
+            __atomic_fetch_add(&cv->exited, 1, __ATOMIC_RELEASE);
+            if (sync_cv_pending(cv) > 0) {
+                seL4_Signal(cv->notification);
+            }
+            break;
+        }
+        /* The wake up was for someone else. Pass it on and give them a chance
+         * to run before we wait again. */
+        if (sync_cv_pending(cv) > 0) {
+            seL4_Signal(cv->notification);
+            seL4_Yield();
+        }
+    }
+
+    return sync_mutex_lock(mutex);
+}
+
+/* Wake the longest waiting thread, if any. */
+static inline int sync_cv_signal(sync_cv_t *cv) {
+    assert(cv != NULL);
+    if (cv->released != cv->tickets) {
+        __atomic_store_n(&cv->released, cv->released + 1, __ATOMIC_RELEASE);
+        seL4_Signal(cv->notification);
+    }
+    return 0;
+}
+
+/* Wake every waiting thread. */
+static inline int sync_cv_broadcast(sync_cv_t *cv) {
+    assert(cv != NULL);
+    if (cv->released != cv->tickets) {
+        __atomic_store_n(&cv->released, cv->tickets, __ATOMIC_RELEASE);
+        seL4_Signal(cv->notification);
+    }
+    return 0;
+}
+
+static inline int sync_cv_destroy(sync_cv_t *cv) {
+    assert(cv != NULL);
+    return 0;
+}
+
+#endif
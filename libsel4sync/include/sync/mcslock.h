@@ -0,0 +1,117 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _SYNC_MCSLOCK_H_
+#define _SYNC_MCSLOCK_H_
+
+/* A queued (MCS) spin lock. Waiters form a queue and each spins on a flag in
+ * its own queue node, so a release only disturbs the next waiter's cache line
+ * and the lock is granted in FIFO order.
+ *
+ * This is the variant without caller supplied queue nodes (Scott, "Shared-Memory
+ * Synchronization", after the K42 lock): a waiter's node lives on its stack
+ * only while it waits, and whoever holds the lock is represented by a node
+ * embedded in the lock itself. That gives it the same interface as spinlock.h.
+ * As with spinlock.h this is not seL4-specific and should not be used between
+ * threads of different priorities.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sync/atomic.h>
+
+typedef struct sync_mcslock_node {
+    /* Non-NULL while the owner of the node is waiting. */
+    struct sync_mcslock_node *volatile wait;
+    struct sync_mcslock_node *volatile next;
+} sync_mcslock_node_t;
+
+typedef struct {
+    /* Last node in the queue. NULL when free, &head when held and no one is
+     * waiting. */
+    sync_mcslock_node_t *volatile tail;
+    /* head.next is the first waiter. */
+    sync_mcslock_node_t head;
+} sync_mcslock_t;
+
+static inline int sync_mcslock_init(sync_mcslock_t *lock) {
+    lock->tail = NULL;
+    lock->head.wait = NULL;
+    lock->head.next = NULL;
+    return 0;
+}
+
+static inline int sync_mcslock_trylock(sync_mcslock_t *lock) {
+    sync_mcslock_node_t *expected = NULL;
+    return !__atomic_compare_exchange_n(&lock->tail, &expected, &lock->head, 0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED);
+}
+
+static inline int sync_mcslock_lock(sync_mcslock_t *lock) {
+    while (true) {
+        sync_mcslock_node_t *prev = __atomic_load_n(&lock->tail, __ATOMIC_RELAXED);
+        if (prev == NULL) {
+            if (sync_mcslock_trylock(lock) == 0) {
+                return 0;
+            }
+            continue;
+        }
+
+        sync_mcslock_node_t node = { .wait = &node, .next = NULL };
+        if (!__atomic_compare_exchange_n(&lock->tail, &prev, &node, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        __atomic_store_n(&prev->next, &node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node.wait, __ATOMIC_ACQUIRE) != NULL) {
+            sync_cpu_relax();
+        }
+
+        /* We hold the lock. Move our place in the queue into the lock so that
+         * our node can go out of scope. */
+        sync_mcslock_node_t *next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE);
+        if (next == NULL) {
+            __atomic_store_n(&lock->head.next, NULL, __ATOMIC_RELAXED);
+            sync_mcslock_node_t *expected = &node;
+            if (__atomic_compare_exchange_n(&lock->tail, &expected, &lock->head, 0, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED)) {
+                return 0;
+            }
+            /* Someone queued behind us and is about to link themselves in. */
+            while ((next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE)) == NULL) {
+                sync_cpu_relax();
+            }
+        }
+        __atomic_store_n(&lock->head.next, next, __ATOMIC_RELEASE);
+        return 0;
+    }
+}
+
+static inline int sync_mcslock_unlock(sync_mcslock_t *lock) {
+    sync_mcslock_node_t *next = __atomic_load_n(&lock->head.next, __ATOMIC_ACQUIRE);
+    if (next == NULL) {
+        sync_mcslock_node_t *expected = &lock->head;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+        /* A waiter has swung the tail but not yet linked itself in. */
+        while ((next = __atomic_load_n(&lock->head.next, __ATOMIC_ACQUIRE)) == NULL) {
+            sync_cpu_relax();
+        }
+    }
+    __atomic_store_n(&next->wait, NULL, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static inline int sync_mcslock_destroy(sync_mcslock_t *lock) {
+    /* Nothing required. */
+    return 0;
+}
+
+#endif
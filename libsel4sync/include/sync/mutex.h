@@ -11,25 +11,97 @@
 #ifndef _SYNC_MUTEX_H_
 #define _SYNC_MUTEX_H_
 
+/* An adaptive mutex. Acquiring a free mutex and releasing one nobody is
+ * waiting for are a single atomic operation each. A contended acquire first
+ * spins for a while in case the holder is about to release the mutex, and only
+ * then blocks on the notification. The state is that of a binary semaphore
+ * (see bin_sem_bare.h): 1 when free, 0 when held and negative when there are
+ * blocked waiters, who are handed the mutex directly when it is released.
+ */
+
+#include <assert.h>
+#include <autoconf.h>
 #include <sel4/sel4.h>
-#include <sync/bin_sem.h>
+#include <stddef.h>
+#include <sync/atomic.h>
+#include <sync/bin_sem_bare.h>
+
+#ifdef CONFIG_LIB_SEL4_SYNC_MUTEX_SPIN_MAX
+#define SYNC_MUTEX_SPIN_MAX CONFIG_LIB_SEL4_SYNC_MUTEX_SPIN_MAX
+#else
+#define SYNC_MUTEX_SPIN_MAX 100
+#endif
+
+/* Spins always allowed beyond twice the recent average, so that the average
+ * can grow again after it has fallen. */
+#define SYNC_MUTEX_SPIN_MIN 10
 
-typedef sync_bin_sem_t sync_mutex_t;
+typedef struct {
+    seL4_CPtr notification;
+    volatile int value;
+    /* Running average of the spins needed to acquire the mutex. */
+    int spins;
+} sync_mutex_t;
 
 static inline int sync_mutex_init(sync_mutex_t *mutex, seL4_CPtr notification) {
-    return sync_bin_sem_init(mutex, notification);
+    assert(mutex != NULL);
+#ifdef SEL4_DEBUG_KERNEL
+    /* Check the cap actually is a notification. */
+    assert(seL4_DebugCapIdentify(notification) == 6);
+#endif
+
+    mutex->notification = notification;
+    mutex->value = 1;
+    mutex->spins = 0;
+    return 0;
+}
+
+/* Acquire the mutex if it is free. Returns 0 on success. */
+static inline int sync_mutex_trylock(sync_mutex_t *mutex) {
+    assert(mutex != NULL);
+    int expected = 1;
+    return !__atomic_compare_exchange_n(&mutex->value, &expected, 0, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
 }
 
 static inline int sync_mutex_lock(sync_mutex_t *mutex) {
-    return sync_bin_sem_wait(mutex);
+    assert(mutex != NULL);
+    if (sync_mutex_trylock(mutex) == 0) {
+        return 0;
+    }
+
+    if (SYNC_MUTEX_SPIN_MAX > 0) {
+        /* The average is only a heuristic, so races updating it are benign. */
+        int average = __atomic_load_n(&mutex->spins, __ATOMIC_RELAXED);
+        int limit = 2 * average + SYNC_MUTEX_SPIN_MIN;
+        if (limit > SYNC_MUTEX_SPIN_MAX) {
+            limit = SYNC_MUTEX_SPIN_MAX;
+        }
+
+        for (int i = 0; i < limit; i++) {
+            sync_cpu_relax();
+            /* Only attempt the exchange once it looks like it will succeed,
+             * to keep the cache line shared while the mutex is held. */
+            if (__atomic_load_n(&mutex->value, __ATOMIC_RELAXED) == 1 && sync_mutex_trylock(mutex) == 0) {
+                __atomic_store_n(&mutex->spins, average + (i - average) / 8, __ATOMIC_RELAXED);
+                return 0;
+            }
+        }
+        /* Spinning didn't pay off, so spin less next time. */
+        __atomic_store_n(&mutex->spins, average - (average + 7) / 8, __ATOMIC_RELAXED);
+    }
+
+    return sync_bin_sem_bare_wait(mutex->notification, &mutex->value);
 }
 
 static inline int sync_mutex_unlock(sync_mutex_t *mutex) {
-    return sync_bin_sem_post(mutex);
+    assert(mutex != NULL);
+    /* Only signals if someone has blocked waiting for the mutex. */
+    return sync_bin_sem_bare_post(mutex->notification, &mutex->value);
 }
 
 static inline int sync_mutex_destroy(sync_mutex_t *mutex) {
-    return sync_bin_sem_destroy(mutex);
+    assert(mutex != NULL);
+    return 0;
 }
 
 #endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _SYNC_RWLOCK_H_
+#define _SYNC_RWLOCK_H_
+
+/* A writer-preferring reader-writer lock.
+ *
+ * The state word holds the number of readers holding the lock and the number
+ * of writers holding or waiting for it. While there are no writers a reader
+ * acquires and releases the lock with a single atomic operation each. Once a
+ * writer arrives new readers take the slow path through the gate, a binary
+ * semaphore that writers hold for as long as they hold the lock, so readers
+ * queue up behind the writers that arrived before them. The writer holding the
+ * gate then waits on the drain notification, which the last reader to leave
+ * signals.
+ */
+
+#include <assert.h>
+#include <sel4/sel4.h>
+#include <stddef.h>
+#include <sync/atomic.h>
+#include <sync/bin_sem.h>
+
+#define SYNC_RWLOCK_READER      1
+#define SYNC_RWLOCK_READERS     ((1 << 20) - 1)
+#define SYNC_RWLOCK_WRITER      (1 << 20)
+#define SYNC_RWLOCK_WRITERS     (((1 << 10) - 1) << 20)
+/* Set while a writer waits for the readers to drain. */
+#define SYNC_RWLOCK_DRAINING    (1 << 30)
+
+typedef struct {
+    volatile int state;
+    sync_bin_sem_t gate;
+    seL4_CPtr drain;
+} sync_rwlock_t;
+
+static inline int sync_rwlock_init(sync_rwlock_t *lock, seL4_CPtr gate, seL4_CPtr drain) {
+    assert(lock != NULL);
+#ifdef SEL4_DEBUG_KERNEL
+    /* Check the cap actually is a notification. */
+    assert(seL4_DebugCapIdentify(drain) == 6);
+#endif
+
+    lock->state = 0;
+    lock->drain = drain;
+    return sync_bin_sem_init(&lock->gate, gate);
+}
+
+static inline int sync_rwlock_rdlock(sync_rwlock_t *lock) {
+    assert(lock != NULL);
+    int state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+    while ((state & SYNC_RWLOCK_WRITERS) == 0) {
+        assert((state & SYNC_RWLOCK_READERS) != SYNC_RWLOCK_READERS);
+        if (__atomic_compare_exchange_n(&lock->state, &state, state + SYNC_RWLOCK_READER, 1, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            return 0;
+        }
+    }
+
+    /* There are writers. Once we get through the gate they have all finished,
+     * and none can start until we let go of it. */
+    int error = sync_bin_sem_wait(&lock->gate);
+    if (error) {
+        return error;
+    }
+    __atomic_fetch_add(&lock->state, SYNC_RWLOCK_READER, __ATOMIC_ACQUIRE);
+    return sync_bin_sem_post(&lock->gate);
+}
+
+static inline int sync_rwlock_tryrdlock(sync_rwlock_t *lock) {
+    assert(lock != NULL);
+    int state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+    while ((state & SYNC_RWLOCK_WRITERS) == 0) {
+        if (__atomic_compare_exchange_n(&lock->state, &state, state + SYNC_RWLOCK_READER, 1, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline int sync_rwlock_rdunlock(sync_rwlock_t *lock) {
+    assert(lock != NULL);
+    int state = __atomic_sub_fetch(&lock->state, SYNC_RWLOCK_READER, __ATOMIC_RELEASE);
+    if ((state & SYNC_RWLOCK_READERS) == 0 && (state & SYNC_RWLOCK_DRAINING)) {
+        /* We were the last reader a writer was waiting for. This can only
+         * happen once per writer as no more readers can get in. */
+        seL4_Signal(lock->drain);
+    }
+    return 0;
+}
+
+static inline int sync_rwlock_wrlock(sync_rwlock_t *lock) {
+    assert(lock != NULL);
+    /* Announce ourselves first so that new readers stop taking the fast path. */
+    int state = __atomic_add_fetch(&lock->state, SYNC_RWLOCK_WRITER, __ATOMIC_RELAXED);
+    assert((state & SYNC_RWLOCK_WRITERS) != 0);
+
+    int error = sync_bin_sem_wait(&lock->gate);
+    if (error) {
+        __atomic_fetch_sub(&lock->state, SYNC_RWLOCK_WRITER, __ATOMIC_RELAXED);
+        return error;
+    }
+
+    state = __atomic_fetch_or(&lock->state, SYNC_RWLOCK_DRAINING, __ATOMIC_ACQUIRE);
+    if ((state & SYNC_RWLOCK_READERS) != 0) {
+        seL4_Wait(lock->drain, NULL);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+    __atomic_fetch_and(&lock->state, ~SYNC_RWLOCK_DRAINING, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static inline int sync_rwlock_wrunlock(sync_rwlock_t *lock) {
+    assert(lock != NULL);
+    __atomic_fetch_sub(&lock->state, SYNC_RWLOCK_WRITER, __ATOMIC_RELEASE);
+    return sync_bin_sem_post(&lock->gate);
+}
+
+static inline int sync_rwlock_destroy(sync_rwlock_t *lock) {
+    assert(lock != NULL);
+    return sync_bin_sem_destroy(&lock->gate);
+}
+
+#endif
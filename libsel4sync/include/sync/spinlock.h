@@ -14,9 +14,17 @@
 /* Interface for spin locks. Note, the underlying implementation is not
  * seL4-specific. Spin locks should not be used when you have threads of
  * different priorities.
+ *
+ * This lock is unfair: under contention the same thread may win repeatedly.
+ * See ticketlock.h and mcslock.h for fair locks with the same interface.
  */
 
 #include <stdbool.h>
+#include <sync/atomic.h>
+
+/* Bounds, in spins, of the exponential backoff after failing to take a lock. */
+#define SYNC_SPINLOCK_BACKOFF_MIN 4
+#define SYNC_SPINLOCK_BACKOFF_MAX 1024
 
 typedef int sync_spinlock_t;
 
@@ -26,11 +34,23 @@ static inline int sync_spinlock_init(sync_spinlock_t *lock) {
 }
 
 static inline int sync_spinlock_lock(sync_spinlock_t *lock) {
+    unsigned int backoff = SYNC_SPINLOCK_BACKOFF_MIN;
     while (true) {
         int expected = 0;
         if (__atomic_compare_exchange_n(lock, &expected, 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
             break;
         }
+        /* Back off, then wait until the lock looks free before trying again,
+         * so that waiters only read the lock's cache line while it is held. */
+        for (unsigned int i = 0; i < backoff; i++) {
+            sync_cpu_relax();
+        }
+        if (backoff < SYNC_SPINLOCK_BACKOFF_MAX) {
+            backoff *= 2;
+        }
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED) != 0) {
+            sync_cpu_relax();
+        }
     }
     return 0;
 }
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _SYNC_TICKETLOCK_H_
+#define _SYNC_TICKETLOCK_H_
+
+/* A ticket spin lock. Threads take a ticket and are granted the lock in ticket
+ * order, so the lock is fair. A waiter backs off in proportion to the number of
+ * threads ahead of it, to limit traffic on the lock's cache line. Every waiter
+ * still polls the same line, so under heavy contention on many cores prefer
+ * mcslock.h. As with spinlock.h this is not seL4-specific and should not be
+ * used between threads of different priorities.
+ */
+
+#include <stdbool.h>
+#include <sync/atomic.h>
+
+/* Spins to back off per thread ahead in the queue. */
+#define SYNC_TICKETLOCK_BACKOFF 16
+
+typedef struct {
+    volatile unsigned int next;
+    volatile unsigned int owner;
+} sync_ticketlock_t;
+
+static inline int sync_ticketlock_init(sync_ticketlock_t *lock) {
+    lock->next = 0;
+    lock->owner = 0;
+    return 0;
+}
+
+static inline int sync_ticketlock_lock(sync_ticketlock_t *lock) {
+    unsigned int ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while (true) {
+        unsigned int owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+        if (owner == ticket) {
+            break;
+        }
+        for (unsigned int i = (ticket - owner) * SYNC_TICKETLOCK_BACKOFF; i > 0; i--) {
+            sync_cpu_relax();
+        }
+    }
+    return 0;
+}
+
+static inline int sync_ticketlock_trylock(sync_ticketlock_t *lock) {
+    unsigned int owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    unsigned int expected = owner;
+    return !__atomic_compare_exchange_n(&lock->next, &expected, owner + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline int sync_ticketlock_unlock(sync_ticketlock_t *lock) {
+    /* Only the holder writes owner. */
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static inline int sync_ticketlock_destroy(sync_ticketlock_t *lock) {
+    /* Nothing required. */
+    return 0;
+}
+
+#endif
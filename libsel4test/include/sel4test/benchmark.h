@@ -0,0 +1,76 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef SEL4_TEST_BENCHMARK_H
+#define SEL4_TEST_BENCHMARK_H
+
+/* Include Kconfig variables. */
+#include <autoconf.h>
+
+#ifdef CONFIG_LIB_SEL4_BENCH
+
+#include <sel4test/test.h>
+#include <stdint.h>
+
+/* Benchmark tests time a function over a number of iterations, after some
+ * warm up iterations that are not measured, and report statistics about the
+ * cycles it took. In XML output these are emitted as properties of the test
+ * case, which tools/extract_results.py can compare against a baseline file.
+ *
+ * A benchmark can also carry its own baseline, in which case the test fails
+ * if the median exceeds the baseline by more than the tolerance.
+ *
+ * Benchmarks are always run serially, so that parallel tests do not disturb
+ * their timing. */
+
+/* Prototype of a benchmark function, which is one iteration of the benchmark.
+ * Returns false on failure. */
+typedef int (*benchmark_fn)(env_t);
+
+typedef struct benchmark {
+    const char *name;
+    benchmark_fn function;
+    /* Iterations run before measuring. */
+    unsigned int warmup;
+    /* Iterations measured. */
+    unsigned int iterations;
+    /* Median cycles expected, or 0 for no baseline. */
+    uint64_t baseline;
+    /* Percentage the median may exceed the baseline by. */
+    unsigned int tolerance;
+} benchmark_t;
+
+/*
+ * Run a benchmark and report its results in the current test.
+ *
+ * @return SUCCESS, or FAILURE if any iteration failed or the median exceeds
+ *         the baseline plus tolerance.
+ */
+int sel4test_run_benchmark(benchmark_t *benchmark, env_t env);
+
+/* Declare a benchmark test case. */
+#define DEFINE_BENCHMARK(_name, _description, _function, _warmup, _iterations, _baseline, _tolerance) \
+    static benchmark_t BENCHMARK_ ## _name = { \
+        .name = #_name, \
+        .function = _function, \
+        .warmup = _warmup, \
+        .iterations = _iterations, \
+        .baseline = _baseline, \
+        .tolerance = _tolerance, \
+    }; \
+    static int _name ## _run_benchmark(env_t env) \
+    { \
+        return sel4test_run_benchmark(&BENCHMARK_ ## _name, env); \
+    } \
+    DEFINE_TEST(_name, _description, _name ## _run_benchmark, TEST_FLAG_SERIAL) \
+/**/
+
+#endif /* CONFIG_LIB_SEL4_BENCH */
+#endif /* SEL4_TEST_BENCHMARK_H */
@@ -56,14 +56,25 @@ typedef struct testcase {
     const char *name;
     const char *description;
     test_fn function;
+    int flags;
 } ALIGN(32) testcase_t;
 
-/* Declare a testcase. */
-#define DEFINE_TEST(_name, _description, _function) \
+/* Flags for DEFINE_TEST. */
+/* Never run this test at the same time as any other, e.g. because it needs the
+ * whole machine or uses global resources. */
+#define TEST_FLAG_SERIAL (1 << 0)
+
+/* Declare a testcase. Optionally takes flags as a fourth argument, e.g.
+ * DEFINE_TEST(TEST000, "An example test", a_test, TEST_FLAG_SERIAL) */
+#define DEFINE_TEST(_name, _description, _function, ...) \
+    _DEFINE_TEST(_name, _description, _function, ##__VA_ARGS__, 0)
+
+#define _DEFINE_TEST(_name, _description, _function, _flags, ...) \
     __attribute__((used)) __attribute__((section("_test_case"))) struct testcase TEST_ ## _name = { \
     .name = #_name, \
     .description = _description, \
     .function = _function, \
+    .flags = _flags, \
 }; \
 /**/
 
@@ -226,6 +237,52 @@ sel4test_basic_run_test(struct testcase *t)
  */
 void sel4test_run_tests(const char *name, int (*run_test)(struct testcase *t));
 
+/* Operations for running tests in parallel, implemented by the test driver. */
+typedef struct sel4test_worker_ops {
+    void *cookie;
+    /* Number of workers, e.g. one per core. */
+    int num_workers;
+    /*
+     * Start running a test on a worker, typically a process pinned to the
+     * worker's core. Everything the test prints, including its errors and
+     * failures, should be captured for wait_test rather than printed.
+     *
+     * @return 0 if the test was started.
+     */
+    int (*start_test)(void *cookie, int worker, struct testcase *t);
+    /*
+     * Wait for any started test to finish.
+     *
+     * @param[out] worker the worker the test ran on.
+     * @param[out] result SUCCESS or FAILURE.
+     * @param output buffer for the test's captured output, which must be NUL
+     *               terminated and may be truncated to output_size.
+     * @param[out] time how long the test ran in nanoseconds, measured by the
+     *                  worker from when the test started to when it finished.
+     *                  Only used if timed is set.
+     * @return 0 on success.
+     */
+    int (*wait_test)(void *cookie, int *worker, int *result, char *output, size_t output_size,
+                     uint64_t *time);
+    /* Whether wait_test reports the time each test took. */
+    bool timed;
+} sel4test_worker_ops_t;
+
+/*
+ * Run every test defined with the DEFINE_TEST macro, spreading them across
+ * the workers in ops. Tests flagged with TEST_FLAG_SERIAL run on their own
+ * once all previously started tests are finished. The backwards run of a test
+ * never overlaps its forwards run.
+ *
+ * Results are reported in the same order, and in the same format, as by
+ * sel4test_run_tests, with each test's captured output and time, regardless
+ * of the order they finish in.
+ *
+ * @param name the name of the test suite
+ * @param ops operations to start tests and wait for them.
+ */
+void sel4test_run_tests_parallel(const char *name, sel4test_worker_ops_t *ops);
+
 /* 
  * Get a testcase.
  *
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#include <autoconf.h>
+
+#ifdef CONFIG_LIB_SEL4_BENCH
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <sel4bench/sel4bench.h>
+#include <sel4bench/stats.h>
+#include <sel4test/benchmark.h>
+#include <sel4test/test.h>
+
+/* Results are reported straight to the output, rather than buffered with the
+ * test's own output, so that they are part of the test case in XML. */
+#undef printf
+
+#define BENCHMARK_OVERHEAD_RUNS 100
+#define BENCHMARK_SUB_BUCKET_BITS 7
+#define BENCHMARK_MAX_BITS 40
+#define BENCHMARK_BUCKETS SEL4BENCH_HISTOGRAM_BUCKETS(BENCHMARK_SUB_BUCKET_BITS, BENCHMARK_MAX_BITS)
+
+static uint32_t buckets[BENCHMARK_BUCKETS];
+
+static void
+report_result(const char *statistic, uint64_t value)
+{
+#ifdef CONFIG_PRINT_XML
+    printf("\t\t\t<property name=\"%s\" value=\"%" PRIu64 "\"/>\n", statistic, value);
+#else
+    printf(" %s=%" PRIu64, statistic, value);
+#endif /* CONFIG_PRINT_XML */
+}
+
+static void
+report_results(benchmark_t *benchmark, sel4bench_stats_t *stats)
+{
+#ifdef CONFIG_PRINT_XML
+    printf("\t\t<properties>\n");
+#else
+    printf("\tBenchmark %s (cycles):", benchmark->name);
+#endif /* CONFIG_PRINT_XML */
+    report_result("iterations", stats->count);
+    report_result("overhead", stats->overhead);
+    report_result("min", stats->min);
+    report_result("mean", (uint64_t) stats->mean);
+    report_result("stddev", (uint64_t) sel4bench_stats_stddev(stats));
+    report_result("median", sel4bench_stats_percentile(stats, 50));
+    report_result("p90", sel4bench_stats_percentile(stats, 90));
+    report_result("p99", sel4bench_stats_percentile(stats, 99));
+    report_result("max", stats->max);
+#ifdef CONFIG_PRINT_XML
+    printf("\t\t</properties>\n");
+#else
+    printf("\n");
+#endif /* CONFIG_PRINT_XML */
+}
+
+int
+sel4test_run_benchmark(benchmark_t *benchmark, env_t env)
+{
+    sel4bench_histogram_t histogram;
+    sel4bench_stats_t stats;
+    int result = SUCCESS;
+
+    sel4bench_init();
+    sel4bench_histogram_init(&histogram, buckets, BENCHMARK_BUCKETS, BENCHMARK_SUB_BUCKET_BITS);
+    sel4bench_stats_init(&stats, &histogram, sel4bench_get_cycle_count_overhead(BENCHMARK_OVERHEAD_RUNS));
+
+    for (unsigned int i = 0; i < benchmark->warmup && result == SUCCESS; i++) {
+        result = benchmark->function(env);
+    }
+
+    for (unsigned int i = 0; i < benchmark->iterations && result == SUCCESS; i++) {
+        sel4bench_counter_t start = sel4bench_get_cycle_count();
+        result = benchmark->function(env);
+        sel4bench_counter_t end = sel4bench_get_cycle_count();
+        sel4bench_stats_record(&stats, end - start);
+    }
+    sel4bench_destroy();
+
+    if (result != SUCCESS) {
+        _sel4test_failure("Benchmark iteration failed", __FILE__, __LINE__);
+        return FAILURE;
+    }
+
+    report_results(benchmark, &stats);
+
+    uint64_t median = sel4bench_stats_percentile(&stats, 50);
+    if (benchmark->baseline != 0 &&
+            median * 100 > benchmark->baseline * (100 + benchmark->tolerance)) {
+        char message[128];
+        snprintf(message, sizeof(message), "Median of %" PRIu64 " cycles exceeds baseline of %" PRIu64
+                 " by more than %u%%", median, benchmark->baseline, benchmark->tolerance);
+        _sel4test_failure(message, __FILE__, __LINE__);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+#endif /* CONFIG_LIB_SEL4_BENCH */
@@ -10,6 +10,7 @@
 
 #include <autoconf.h>
 
+#include <inttypes.h>
 #include <regex.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -85,21 +86,36 @@ sel4test_end_suite(void) {
 #endif /* CONFIG_PRINT_XML */
 }
 
-void 
-sel4test_start_test(const char *name) {
+/* Start a test case, reporting how long it took in nanoseconds if timed. */
+static void
+start_test(const char *name, bool timed, uint64_t time)
+{
 #ifdef CONFIG_BUFFER_OUTPUT
     buf_index = 0;
     memset(current_stdout_bank, 0, STDOUT_CACHE); 
 #endif /* CONFIG_BUFFER_OUTPUT */
 #ifdef CONFIG_PRINT_XML
-    printf("\t<testcase classname=\"%s\" name=\"%s\">\n", sel4test_name, name);
+    if (timed) {
+        printf("\t<testcase classname=\"%s\" name=\"%s\" time=\"%" PRIu64 ".%09" PRIu64 "\">\n",
+               sel4test_name, name, time / 1000000000, time % 1000000000);
+    } else {
+        printf("\t<testcase classname=\"%s\" name=\"%s\">\n", sel4test_name, name);
+    }
 #else
     printf("Starting test %d: %s\n", num_tests, name);
+    if (timed) {
+        printf("\tTook %" PRIu64 " us\n", time / 1000);
+    }
 #endif /* CONFIG_PRINT_XML */
     num_tests++;
     current_test_passed = true;
 }
 
+void 
+sel4test_start_test(const char *name) {
+    start_test(name, false, 0);
+}
+
 void 
 _sel4test_report_error(const char *error, const char *file, int line) {
 #ifdef CONFIG_PRINT_XML
@@ -173,19 +189,17 @@ sel4test_get_test(const char *name)
 }
 
 
-void
-sel4test_run_tests(const char *name, int (*run_test)(struct testcase *t)) {
-
-    /* Count how many tests actually exist and allocate space for them */
-    int max_tests = (int)(__stop__test_case - __start__test_case);
-    struct testcase *tests[max_tests];
-
+/* Fill tests with the tests to run, sorted by name. Returns how many there
+ * are, or -1 on error. */
+static int
+collect_tests(struct testcase **tests)
+{
     /* Extract and filter the tests based on the regex */
     regex_t reg;
     int error = regcomp(&reg, CONFIG_TESTPRINTER_REGEX, REG_EXTENDED | REG_NOSUB);
     if (error != 0) {
         printf("Error compiling regex \"%s\"\n", CONFIG_TESTPRINTER_REGEX);
-        return;
+        return -1;
     }
 
     int num_tests = 0;
@@ -208,6 +222,36 @@ sel4test_run_tests(const char *name, int (*run_test)(struct testcase *t)) {
          test_assert_fatal(strcmp(tests[i]->name, tests[i - 1]->name) != 0);
      }
 
+     return num_tests;
+}
+
+static void
+print_summary(void)
+{
+     printf("\n");
+     int tests_run, passes, failures;
+     sel4_test_get_suite_results(&tests_run, &passes, &failures);
+     printf("%d/%d tests passed.\n", tests_run - failures, tests_run);
+     if (failures > 0) {
+         printf("*** FAILURES DETECTED ***\n");
+     } else {
+         printf("All is well in the universe.\n");
+     }
+     printf("\n\n");
+}
+
+void
+sel4test_run_tests(const char *name, int (*run_test)(struct testcase *t)) {
+
+    /* Count how many tests actually exist and allocate space for them */
+    int max_tests = (int)(__stop__test_case - __start__test_case);
+    struct testcase *tests[max_tests];
+
+    int num_tests = collect_tests(tests);
+    if (num_tests < 0) {
+        return;
+    }
+
      sel4test_start_suite(name);
      /* Run tests */
      for (int i = 0; i < num_tests; i++) {
@@ -239,15 +283,222 @@ sel4test_run_tests(const char *name, int (*run_test)(struct testcase *t)) {
      sel4test_end_suite();
 
      /* Print closing banner. */
-     printf("\n");
-     int tests_run, passes, failures;
-     sel4_test_get_suite_results(&tests_run, &passes, &failures);
-     printf("%d/%d tests passed.\n", tests_run - failures, tests_run);
-     if (failures > 0) {
-         printf("*** FAILURES DETECTED ***\n");
-     } else {
-         printf("All is well in the universe.\n");
-     }
-     printf("\n\n");
+     print_summary();
+}
+
+/* A run of a test by sel4test_run_tests_parallel. Like sel4test_run_tests,
+ * every test is run forwards then backwards. */
+typedef struct parallel_job {
+    struct testcase *test;
+    /* Whether this is the second, backwards, run of the test. */
+    bool repeat;
+    bool done;
+    int result;
+    uint64_t time;
+    char *output;
+} parallel_job_t;
+
+/* Captured output of the last test to finish. */
+static char parallel_output[STDOUT_CACHE];
+
+#ifdef CONFIG_BUFFER_OUTPUT
+static bool
+starts_with(const char *string, const char *prefix)
+{
+    return strncmp(string, prefix, strlen(prefix)) == 0;
+}
+
+/* Buffer a worker's captured output as if the test had printed it here. The
+ * errors, failures and benchmark properties it reported are printed straight
+ * away, so that they end up outside <system-out> as they do when tests are
+ * run serially. */
+static void
+replay_output(char *output)
+{
+    bool in_properties = false;
+
+    while (*output != '\0') {
+        char *end = strchr(output, '\n');
+        end = end != NULL ? end + 1 : output + strlen(output);
+        char saved = *end;
+        *end = '\0';
+        if (starts_with(output, "\t\t<properties>")) {
+            in_properties = true;
+        }
+        if (in_properties || starts_with(output, "\t\t<error>") || starts_with(output, "\t\t<failure ")) {
+            printf("%s", output);
+        } else {
+            sel4test_printf(output);
+        }
+        if (starts_with(output, "\t\t</properties>")) {
+            in_properties = false;
+        }
+        *end = saved;
+        output = end;
+    }
+}
+#endif /* CONFIG_BUFFER_OUTPUT */
+
+/* Report a finished job exactly as sel4test_run_tests would have. */
+static void
+report_job(parallel_job_t *job, bool timed)
+{
+    /* junit doesn't like duplicate test names */
+    int length = strlen(job->test->name);
+    char name[length + 2];
+    strncpy(name, job->test->name, length);
+    name[length] = job->repeat ? '2' : '\0';
+    name[length + 1] = '\0';
+
+    start_test(name, timed, job->time);
+    if (job->output != NULL) {
+#ifdef CONFIG_BUFFER_OUTPUT
+        replay_output(job->output);
+#else
+        printf("%s", job->output);
+#endif /* CONFIG_BUFFER_OUTPUT */
+        free(job->output);
+        job->output = NULL;
+    }
+    if (job->result != SUCCESS) {
+        current_test_passed = false;
+    }
+    sel4test_end_test();
+}
+
+/* Report the finished jobs from next onwards that don't follow an unfinished
+ * one, so that results come out in order. Returns the next job to report. */
+static int
+report_jobs(parallel_job_t *jobs, int next, int num_jobs, bool timed)
+{
+    for (; next < num_jobs && jobs[next].done; next++) {
+        report_job(&jobs[next], timed);
+    }
+    return next;
+}
+
+static void
+finish_job(parallel_job_t *job, int result, const char *output, uint64_t time)
+{
+    job->done = true;
+    job->result = result;
+    job->time = time;
+    job->output = malloc(strlen(output) + 1);
+    if (job->output != NULL) {
+        strcpy(job->output, output);
+    } else {
+        /* Still report the result, even if the output is lost */
+        ZF_LOGE("Failed to allocate test output");
+    }
+}
+
+/* Wait for a test to finish and record its result. Returns 0 on success. */
+static int
+wait_job(sel4test_worker_ops_t *ops, parallel_job_t *jobs, int *running)
+{
+    int worker;
+    int result;
+    uint64_t time = 0;
+
+    parallel_output[0] = '\0';
+    int error = ops->wait_test(ops->cookie, &worker, &result, parallel_output, STDOUT_CACHE, &time);
+    if (error != 0 || worker < 0 || worker >= ops->num_workers || running[worker] < 0) {
+        ZF_LOGE("Failed to wait for a test");
+        return -1;
+    }
+    parallel_output[STDOUT_CACHE - 1] = '\0';
+
+    finish_job(&jobs[running[worker]], result, parallel_output, ops->timed ? time : 0);
+    running[worker] = -1;
+    return 0;
+}
+
+void
+sel4test_run_tests_parallel(const char *name, sel4test_worker_ops_t *ops)
+{
+    assert(ops != NULL && ops->num_workers > 0);
+
+    int max_tests = (int)(__stop__test_case - __start__test_case);
+    struct testcase *tests[max_tests];
+
+    int num_tests = collect_tests(tests);
+    if (num_tests < 0) {
+        return;
+    }
+
+    int num_jobs = num_tests * 2;
+    parallel_job_t *jobs = calloc(num_jobs, sizeof(parallel_job_t));
+    if (jobs == NULL && num_jobs > 0) {
+        ZF_LOGE("Failed to allocate test jobs");
+        return;
+    }
+    for (int i = 0; i < num_tests; i++) {
+        jobs[i].test = tests[i];
+        jobs[num_jobs - 1 - i].test = tests[i];
+        jobs[num_jobs - 1 - i].repeat = true;
+    }
+
+    int running[ops->num_workers];
+    for (int i = 0; i < ops->num_workers; i++) {
+        running[i] = -1;
+    }
+    int in_flight = 0;
+    int next_report = 0;
+
+    sel4test_start_suite(name);
+    for (int i = 0; i < num_jobs; i++) {
+        bool serial = (jobs[i].test->flags & TEST_FLAG_SERIAL) != 0;
+        /* the forwards run of the same test, for a backwards run */
+        parallel_job_t *first = jobs[i].repeat ? &jobs[num_jobs - 1 - i] : NULL;
+
+        /* Wait for a free worker, for all of them for a serial test, and for
+         * the test's own forwards run to be out of the way */
+        while (in_flight > 0 && (serial || in_flight == ops->num_workers || (first != NULL && !first->done))) {
+            if (wait_job(ops, jobs, running) != 0) {
+                goto out;
+            }
+            in_flight--;
+            next_report = report_jobs(jobs, next_report, num_jobs, ops->timed);
+        }
+
+        int worker = 0;
+        while (running[worker] >= 0) {
+            worker++;
+        }
+        if (ops->start_test(ops->cookie, worker, jobs[i].test) != 0) {
+            finish_job(&jobs[i], FAILURE, "Failed to start test\n", 0);
+        } else {
+            running[worker] = i;
+            in_flight++;
+        }
+
+        /* Nothing else may start until a serial test is done */
+        while (serial && in_flight > 0) {
+            if (wait_job(ops, jobs, running) != 0) {
+                goto out;
+            }
+            in_flight--;
+        }
+        next_report = report_jobs(jobs, next_report, num_jobs, ops->timed);
+    }
+
+    while (in_flight > 0) {
+        if (wait_job(ops, jobs, running) != 0) {
+            goto out;
+        }
+        in_flight--;
+    }
+
+out:
+    next_report = report_jobs(jobs, next_report, num_jobs, ops->timed);
+    if (next_report != num_jobs) {
+        printf("Abandoning test run with %d tests outstanding\n", num_jobs - next_report);
+        for (int i = next_report; i < num_jobs; i++) {
+            free(jobs[i].output);
+        }
+    }
+    free(jobs);
+    sel4test_end_suite();
+    print_summary();
 }
 
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+/* Configuration for the host test: XML output with buffered stdout, as used
+ * under a test harness */
+#define CONFIG_PRINT_XML 1
+#define CONFIG_BUFFER_OUTPUT 1
+#define CONFIG_TESTPRINTER_REGEX ".*"
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+/* Just what libsel4test needs from libsel4 to build on the host */
+static inline void
+seL4_DebugHalt(void)
+{
+}
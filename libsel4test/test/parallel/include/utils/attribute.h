@@ -0,0 +1,15 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+#define ALIGN(n) __attribute__((__aligned__(n)))
+#define USED __attribute__((used))
+#define SECTION(s) __attribute__((section(s)))
@@ -0,0 +1,16 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <utils/attribute.h>
+
+#define ZF_LOGE(...) fprintf(stderr, __VA_ARGS__)
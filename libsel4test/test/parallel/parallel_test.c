@@ -0,0 +1,247 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Tests for sel4test_run_tests_parallel, run on the host. The workers are
+ * simulated by a fake sel4test_worker_ops_t that finishes tests in a random
+ * order, and the XML the runner prints is checked against what
+ * sel4test_run_tests would have printed. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sel4test/test.h>
+
+/* the runner's output is captured, so report on stderr */
+#undef printf
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: seed %u: check failed: %s\n", __FILE__, __LINE__, seed, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define NUM_WORKERS 3
+/* every test reports this time, 1.000000123s */
+#define TEST_TIME 1000000123ull
+
+static int failures;
+static unsigned int seed;
+
+static int
+pass(env_t env)
+{
+    return SUCCESS;
+}
+
+static int
+fail(env_t env)
+{
+    return FAILURE;
+}
+
+DEFINE_TEST(PASS01, "passes", pass)
+DEFINE_TEST(FAIL01, "fails", fail)
+DEFINE_TEST(BENCH01, "reports benchmark properties", pass)
+DEFINE_TEST(SERIAL01, "runs on its own", pass, TEST_FLAG_SERIAL)
+DEFINE_TEST(NOSTART01, "cannot be started", pass)
+DEFINE_TEST(PASS02, "passes", pass)
+DEFINE_TEST(PASS03, "passes", pass)
+
+/* in the order the runner reports them */
+static const char *expected_names[] = {
+    "BENCH01", "FAIL01", "NOSTART01", "PASS01", "PASS02", "PASS03", "SERIAL01",
+    "SERIAL012", "PASS032", "PASS022", "PASS012", "NOSTART012", "FAIL012", "BENCH012",
+};
+#define NUM_RUNS ((int) (sizeof(expected_names) / sizeof(expected_names[0])))
+
+#define PROPERTIES \
+    "\t\t<properties>\n" \
+    "\t\t\t<property name=\"min\" value=\"10\"/>\n" \
+    "\t\t\t<property name=\"max\" value=\"20\"/>\n" \
+    "\t\t</properties>\n"
+#define FAILURE_LINE "\t\t<failure type=\"failure\">bad thing at line 1 of file fail.c</failure>\n"
+
+/* Simulated workers */
+static struct testcase *running[NUM_WORKERS];
+static bool serial_overlap;
+static bool pair_overlap;
+
+static int
+fake_start_test(void *cookie, int worker, struct testcase *t)
+{
+    if (strcmp(t->name, "NOSTART01") == 0) {
+        return -1;
+    }
+    CHECK(worker >= 0 && worker < NUM_WORKERS && running[worker] == NULL);
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        if (running[i] != NULL && ((running[i]->flags | t->flags) & TEST_FLAG_SERIAL)) {
+            serial_overlap = true;
+        }
+        if (running[i] == t) {
+            pair_overlap = true;
+        }
+    }
+    running[worker] = t;
+    return 0;
+}
+
+static int
+fake_wait_test(void *cookie, int *worker, int *result, char *output, size_t output_size, uint64_t *time)
+{
+    int k = rand() % NUM_WORKERS;
+    for (int i = 0; i < NUM_WORKERS && running[k] == NULL; i++) {
+        k = (k + 1) % NUM_WORKERS;
+    }
+    if (running[k] == NULL) {
+        return -1;
+    }
+    struct testcase *t = running[k];
+    running[k] = NULL;
+
+    *worker = k;
+    *result = t->function(NULL);
+    *time = TEST_TIME;
+    if (strcmp(t->name, "BENCH01") == 0) {
+        snprintf(output, output_size, "before %s\n" PROPERTIES "after %s\n", t->name, t->name);
+    } else if (*result != SUCCESS) {
+        snprintf(output, output_size, "before %s\n" FAILURE_LINE "after %s\n", t->name, t->name);
+    } else {
+        snprintf(output, output_size, "output of %s\n", t->name);
+    }
+    return 0;
+}
+
+/* Run the tests in parallel, returning what the runner printed */
+static char *
+run_parallel(void)
+{
+    sel4test_worker_ops_t ops = {
+        .cookie = NULL,
+        .num_workers = NUM_WORKERS,
+        .start_test = fake_start_test,
+        .wait_test = fake_wait_test,
+        .timed = true,
+    };
+
+    fflush(stdout);
+    FILE *capture = tmpfile();
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    sel4test_run_tests_parallel("parallel", &ops);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    long size = ftell(capture);
+    char *output = malloc(size + 1);
+    rewind(capture);
+    output[fread(output, 1, size, capture)] = '\0';
+    fclose(capture);
+    return output;
+}
+
+/* Whether needle occurs in [start, end) */
+static bool
+contains(const char *start, const char *end, const char *needle)
+{
+    const char *found = strstr(start, needle);
+    return found != NULL && found + strlen(needle) <= end;
+}
+
+/* Check the report of a run of test, printed in [start, end) */
+static void
+check_testcase(const char *test, const char *name, const char *start, const char *end)
+{
+    char expected[200];
+    /* a test that never started took no time */
+    snprintf(expected, sizeof(expected), "\t<testcase classname=\"parallel\" name=\"%s\" time=\"%s\">\n",
+             name, strcmp(test, "NOSTART01") == 0 ? "0.000000000" : "1.000000123");
+    CHECK(strncmp(start, expected, strlen(expected)) == 0);
+
+    /* nothing the XML needs to see may be hidden in system-out */
+    const char *out = strstr(start, "\t\t<system-out>");
+    const char *out_end = out != NULL ? strstr(out, "</system-out>\n") : NULL;
+    CHECK(out != NULL && out_end != NULL && out_end < end);
+    if (out == NULL || out_end == NULL) {
+        return;
+    }
+    CHECK(!contains(out, out_end, "<failure"));
+    CHECK(!contains(out, out_end, "<error>"));
+    CHECK(!contains(out, out_end, "<properties>"));
+    CHECK(!contains(out, out_end, "<property "));
+
+    bool failed = strcmp(test, "FAIL01") == 0 || strcmp(test, "NOSTART01") == 0;
+    CHECK(contains(start, end, "<failure") == failed);
+    if (strcmp(test, "BENCH01") == 0) {
+        CHECK(contains(start, out, PROPERTIES));
+        CHECK(contains(out, out_end, "before BENCH01\nafter BENCH01\n"));
+    } else if (strcmp(test, "FAIL01") == 0) {
+        CHECK(contains(start, out, FAILURE_LINE));
+        CHECK(contains(out, out_end, "before FAIL01\nafter FAIL01\n"));
+    } else if (strcmp(test, "NOSTART01") == 0) {
+        CHECK(contains(out, out_end, "Failed to start test\n"));
+    } else {
+        snprintf(expected, sizeof(expected), "output of %s\n", test);
+        CHECK(contains(out, out_end, expected));
+    }
+}
+
+static void
+test_parallel_run(void)
+{
+    serial_overlap = false;
+    pair_overlap = false;
+    char *output = run_parallel();
+
+    CHECK(strncmp(output, "<testsuite>\n", strlen("<testsuite>\n")) == 0);
+    const char *testcase = strstr(output, "\t<testcase ");
+    for (int i = 0; i < NUM_RUNS; i++) {
+        CHECK(testcase != NULL);
+        if (testcase == NULL) {
+            break;
+        }
+        const char *end = strstr(testcase, "\t</testcase>\n");
+        CHECK(end != NULL);
+        if (end == NULL) {
+            break;
+        }
+        /* the second half are the backwards runs, named with a 2 on the end */
+        char test[20];
+        snprintf(test, sizeof(test), "%.*s", (int) strlen(expected_names[i]) - (i >= NUM_RUNS / 2),
+                 expected_names[i]);
+        check_testcase(test, expected_names[i], testcase, end);
+        testcase = strstr(end, "\t<testcase ");
+    }
+    CHECK(testcase == NULL);
+    CHECK(strstr(output, "</testsuite>\n") != NULL);
+    CHECK(strstr(output, "\n10/14 tests passed.\n") != NULL);
+
+    CHECK(!serial_overlap);
+    CHECK(!pair_overlap);
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        CHECK(running[i] == NULL);
+    }
+    free(output);
+}
+
+int
+main(void)
+{
+    for (seed = 0; seed < 50; seed++) {
+        srand(seed);
+        test_parallel_run();
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    fprintf(stderr, "All parallel runner tests passed\n");
+    return 0;
+}
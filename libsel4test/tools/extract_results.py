@@ -18,6 +18,8 @@ TAG_WHITELIST = {
     'testsuite':False,
     'testcase':False,
     'system-out':True,
+    'properties':False,
+    'property':False,
 }
 
 TOP_TAG = 'testsuite'
@@ -47,6 +49,60 @@ def print_tag(f, tag):
 
         print >>f, '</%s>' % tag.name
 
+def read_benchmarks(top):
+    '''Return a dict mapping the name of each benchmark test case to a dict of
+    its statistics, and one mapping names to the test case tags.'''
+    results = {}
+    cases = {}
+    for case in top.find_all('testcase'):
+        stats = {}
+        for prop in case.find_all('property'):
+            try:
+                stats[prop['name']] = int(prop['value'])
+            except (KeyError, ValueError):
+                continue
+        if stats:
+            results[case['name']] = stats
+            cases[case['name']] = case
+    return results, cases
+
+def is_repeat(name, results):
+    '''Tests are run twice and the second run has a '2' appended to its name.'''
+    return name.endswith('2') and name[:-1] in results
+
+def load_baseline(f):
+    '''Read a baseline file of lines '<test name> <value>'. Blank lines and
+    lines starting with '#' are ignored.'''
+    baseline = {}
+    for line in f:
+        line = line.strip()
+        if not line or line.startswith('#'):
+            continue
+        name, value = line.split()
+        baseline[name] = int(value)
+    return baseline
+
+def write_baseline(f, results, statistic):
+    print >>f, '# Benchmark baseline: test name and %s cycles' % statistic
+    for name in sorted(results):
+        if statistic in results[name] and not is_repeat(name, results):
+            print >>f, '%s %d' % (name, results[name][statistic])
+
+def compare(results, baseline, statistic, tolerance):
+    '''Return (name, value, baseline) for each result that exceeds its
+    baseline by more than tolerance percent.'''
+    regressions = []
+    for name in sorted(results):
+        value = results[name].get(statistic)
+        base = baseline.get(name)
+        if base is None and is_repeat(name, results):
+            base = baseline.get(name[:-1])
+        if value is None or base is None:
+            continue
+        if value * 100 > base * (100 + tolerance):
+            regressions.append((name, value, base))
+    return regressions
+
 def main():
     parser = argparse.ArgumentParser('Cleanup messy XML output from sel4test')
     parser.add_argument('input',
@@ -58,6 +114,18 @@ def main():
     parser.add_argument('--quiet', '-q',
         help='Suppress unmodified output to stdout', action='store_true',
         default=False)
+    parser.add_argument('--baseline', '-b',
+        help='Fail benchmarks that are slower than in this baseline file',
+        type=argparse.FileType('r'))
+    parser.add_argument('--tolerance', '-t',
+        help='Percentage a benchmark may exceed its baseline by (default 10)',
+        type=float, default=10)
+    parser.add_argument('--statistic', '-s',
+        help='Benchmark statistic to compare (default median)',
+        default='median')
+    parser.add_argument('--write-baseline', '-w',
+        help='Write the benchmark results to this file as a new baseline',
+        type=argparse.FileType('w'))
     args = parser.parse_args()
 
     data = args.input.read()
@@ -91,6 +159,21 @@ def main():
         print >>sys.stderr, 'Failed to find initial %s tag: %s' % (TOP_TAG, inst)
         return -1
 
+    results, cases = read_benchmarks(top)
+    if args.write_baseline is not None:
+        write_baseline(args.write_baseline, results, args.statistic)
+    if args.baseline is not None:
+        baseline = load_baseline(args.baseline)
+        for name, value, base in compare(results, baseline, args.statistic,
+                args.tolerance):
+            message = 'Benchmark %s regressed: %s of %d cycles exceeds ' \
+                'baseline of %d by more than %g%%' % (name, args.statistic,
+                value, base, args.tolerance)
+            print >>sys.stderr, message
+            failure = soup.new_tag('failure', type='failure')
+            failure.string = message
+            cases[name].append(failure)
+
     try:
         print_tag(args.output, top)
     except Exception as inst:
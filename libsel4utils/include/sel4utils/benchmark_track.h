@@ -12,8 +12,11 @@
 #ifdef CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES
 
 #include <stdio.h>
+#include <string.h>
 #include <sel4/types.h>
 #include <sel4/benchmark_track_types.h>
+#include <sel4utils/benchmark_track_stream.h>
+#include <utils/util.h>
 
 /* Print out a summary of what has been tracked */
 static inline void
@@ -159,4 +162,73 @@ seL4_BenchmarkTrackDumpFullInterruptLog(void)
     };
 
 }
+/* Encode kernel log entries that have not yet been sent into the given stream (see
+ * benchmark_track_stream.h). This may be called repeatedly while the workload is still running, each
+ * call finalizing the log to that point and sending only the entries logged since the previous call.
+ * Entries are copied out of the IPC buffer before they are encoded, so the stream's write function may
+ * make IPCs, e.g. to a console server. Returns 0 on success.
+ */
+static inline int
+seL4_BenchmarkTrackStreamLog(benchmark_track_stream_t *stream)
+{
+    benchmark_track_kernel_entry_t *ipcBuffer = (benchmark_track_kernel_entry_t *)
+                                                & (seL4_GetIPCBuffer()->msg[0]);
+    benchmark_track_kernel_entry_t entries[sizeof(seL4_GetIPCBuffer()->msg) / sizeof(benchmark_track_kernel_entry_t)];
+
+    seL4_BenchmarkFinalizeLog();
+    seL4_Word log_size = (seL4_Uint32) seL4_BenchmarkLogSize();
+
+    while (stream->next_index < log_size) {
+        seL4_Word received_entries = seL4_BenchmarkDumpLog(stream->next_index, log_size - stream->next_index);
+        if (received_entries == 0) {
+            break;
+        }
+        if (received_entries > ARRAY_SIZE(entries)) {
+            received_entries = ARRAY_SIZE(entries);
+        }
+        memcpy(entries, ipcBuffer, received_entries * sizeof(entries[0]));
+
+        int error = benchmark_track_stream_encode(stream, entries, stream->next_index, received_entries);
+        if (error) {
+            return error;
+        }
+        stream->next_index += received_entries;
+    }
+    return 0;
+}
+
+static inline int
+seL4_BenchmarkTrackDumpStream(FILE *fd, benchmark_track_stream_write_fn write)
+{
+    benchmark_track_stream_t stream;
+
+    int error = benchmark_track_stream_init(&stream, write, fd);
+    if (!error) {
+        error = seL4_BenchmarkTrackStreamLog(&stream);
+    }
+    if (!error) {
+        error = benchmark_track_stream_end(&stream);
+    }
+    fflush(fd);
+    return error;
+}
+
+/* Send the whole kernel log to fd in the binary stream format, for decoding on the host with
+ * tools/benchmark_track_decode.py. fd must be a clean transport, not the serial console.
+ * Returns 0 on success.
+ */
+static inline int
+seL4_BenchmarkTrackDumpBinaryLog(FILE *fd)
+{
+    return seL4_BenchmarkTrackDumpStream(fd, benchmark_track_stream_file_write);
+}
+
+/* Send the whole kernel log to fd as text lines that tools/benchmark_track_decode.py can pick
+ * out of a capture of the serial console. Returns 0 on success.
+ */
+static inline int
+seL4_BenchmarkTrackDumpTextLog(FILE *fd)
+{
+    return seL4_BenchmarkTrackDumpStream(fd, benchmark_track_stream_text_write);
+}
 #endif /* CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES */
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+#pragma once
+#include <autoconf.h>
+#ifdef CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES
+
+/* Compact binary encoding of tracked kernel entries. This only encodes entries
+ * it is handed and makes no system calls, so it can be run against a synthetic
+ * log on any host. See benchmark_track.h for draining the kernel log through
+ * it, and tools/benchmark_track_decode.py in libsel4utils for the decoder.
+ *
+ * The stream is a header followed by any number of chunks and an end marker.
+ * All integers other than the header bytes are unsigned LEB128 varints.
+ *
+ *   header: "SEL4TRK\0", version (1 byte), then the values of Entry_Syscall,
+ *           Entry_Interrupt, Entry_UserLevelFault and Entry_VMFault (1 byte
+ *           each) so the decoder doesn't depend on the kernel's numbering
+ *   chunk:  'C', index of first entry, number of entries, length in bytes of
+ *           the records that follow, records
+ *   end:    'E', total number of entries in the stream
+ *
+ * Each record is its path, the start time as a zigzag encoded difference from
+ * the previous record in the chunk (from 0 for the first), and the duration.
+ * System calls are followed by the system call number, capability type,
+ * invocation tag and fastpath flag; every other path by the entry's word.
+ *
+ * The binary stream needs a clean transport, such as a file or a socket. A
+ * serial console is shared with boot and log messages and may rewrite line
+ * endings, so there the stream should be written with
+ * benchmark_track_stream_text_write instead. That sends it as lines of
+ * BENCHMARK_TRACK_STREAM_TEXT_PREFIX followed by the bytes in hex, which the
+ * decoder picks out from among whatever else was printed.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sel4/types.h>
+#include <sel4/benchmark_track_types.h>
+
+#define BENCHMARK_TRACK_STREAM_MAGIC "SEL4TRK"
+#define BENCHMARK_TRACK_STREAM_VERSION 1
+#define BENCHMARK_TRACK_STREAM_CHUNK 'C'
+#define BENCHMARK_TRACK_STREAM_END 'E'
+#define BENCHMARK_TRACK_STREAM_TEXT_PREFIX "SEL4TRK:"
+/* Stream bytes per line of text output */
+#define BENCHMARK_TRACK_STREAM_TEXT_LINE 32
+
+/* Records are gathered into a chunk of at most this many bytes before being
+ * written out. */
+#define BENCHMARK_TRACK_STREAM_BUFFER_SIZE 1024
+/* Upper bound on the encoded size of a single record. */
+#define BENCHMARK_TRACK_STREAM_MAX_RECORD 48
+
+/* Output function for the stream. Returns 0 on success. */
+typedef int (*benchmark_track_stream_write_fn)(void *cookie, const void *data, size_t len);
+
+typedef struct benchmark_track_stream {
+    benchmark_track_stream_write_fn write;
+    void *cookie;
+    /* index of the next kernel log entry to be drained */
+    seL4_Word next_index;
+    /* entries encoded so far */
+    seL4_Word total;
+    /* encoded records waiting to be written as a chunk */
+    size_t length;
+    uint8_t buffer[BENCHMARK_TRACK_STREAM_BUFFER_SIZE];
+} benchmark_track_stream_t;
+
+/* Write function for a stream to a FILE *, passed as the cookie */
+static inline int
+benchmark_track_stream_file_write(void *cookie, const void *data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE *) cookie) == len ? 0 : -1;
+}
+
+/* Write function for a stream sent as text to a FILE *, passed as the cookie,
+ * such as a serial console. Each line is written in one go, so that it is not
+ * split by other output. */
+static inline int
+benchmark_track_stream_text_write(void *cookie, const void *data, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t *bytes = data;
+    char line[sizeof(BENCHMARK_TRACK_STREAM_TEXT_PREFIX) + BENCHMARK_TRACK_STREAM_TEXT_LINE * 2 + 1];
+
+    while (len > 0) {
+        size_t n = strlen(BENCHMARK_TRACK_STREAM_TEXT_PREFIX);
+        memcpy(line, BENCHMARK_TRACK_STREAM_TEXT_PREFIX, n);
+        for (int i = 0; i < BENCHMARK_TRACK_STREAM_TEXT_LINE && len > 0; i++, len--) {
+            line[n++] = hex[*bytes >> 4];
+            line[n++] = hex[*bytes & 0xf];
+            bytes++;
+        }
+        line[n++] = '\n';
+        if (fwrite(line, 1, n, (FILE *) cookie) != n) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline size_t
+benchmark_track_stream_put_varint(uint8_t *p, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        p[n++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    p[n++] = (uint8_t) value;
+    return n;
+}
+
+/* Start a stream, writing out its header. Returns 0 on success. */
+static inline int
+benchmark_track_stream_init(benchmark_track_stream_t *stream, benchmark_track_stream_write_fn write,
+                            void *cookie)
+{
+    uint8_t header[sizeof(BENCHMARK_TRACK_STREAM_MAGIC) + 5];
+
+    stream->write = write;
+    stream->cookie = cookie;
+    stream->next_index = 0;
+    stream->total = 0;
+    stream->length = 0;
+
+    memcpy(header, BENCHMARK_TRACK_STREAM_MAGIC, sizeof(BENCHMARK_TRACK_STREAM_MAGIC));
+    size_t n = sizeof(BENCHMARK_TRACK_STREAM_MAGIC);
+    header[n++] = BENCHMARK_TRACK_STREAM_VERSION;
+    header[n++] = Entry_Syscall;
+    header[n++] = Entry_Interrupt;
+    header[n++] = Entry_UserLevelFault;
+    header[n++] = Entry_VMFault;
+    return stream->write(stream->cookie, header, n);
+}
+
+/* Write out the records buffered so far as a chunk starting at first_index */
+static inline int
+benchmark_track_stream_flush_chunk(benchmark_track_stream_t *stream, seL4_Word first_index,
+                                   seL4_Word count)
+{
+    uint8_t header[1 + 3 * 10];
+    size_t n = 0;
+
+    if (count == 0) {
+        return 0;
+    }
+    header[n++] = BENCHMARK_TRACK_STREAM_CHUNK;
+    n += benchmark_track_stream_put_varint(&header[n], first_index);
+    n += benchmark_track_stream_put_varint(&header[n], count);
+    n += benchmark_track_stream_put_varint(&header[n], stream->length);
+
+    int error = stream->write(stream->cookie, header, n);
+    if (!error) {
+        error = stream->write(stream->cookie, stream->buffer, stream->length);
+    }
+    stream->length = 0;
+    return error;
+}
+
+/* Encode count entries, the first of which is at first_index in the kernel
+ * log, into one or more chunks. Returns 0 on success. */
+static inline int
+benchmark_track_stream_encode(benchmark_track_stream_t *stream, const benchmark_track_kernel_entry_t *entries,
+                              seL4_Word first_index, seL4_Word count)
+{
+    seL4_Word chunk_start = 0;
+    uint64_t prev_time = 0;
+
+    for (seL4_Word i = 0; i < count; i++) {
+        const benchmark_track_kernel_entry_t *e = &entries[i];
+
+        if (stream->length + BENCHMARK_TRACK_STREAM_MAX_RECORD > sizeof(stream->buffer)) {
+            int error = benchmark_track_stream_flush_chunk(stream, first_index + chunk_start, i - chunk_start);
+            if (error) {
+                return error;
+            }
+            chunk_start = i;
+            prev_time = 0;
+        }
+
+        uint8_t *p = stream->buffer;
+        size_t n = stream->length;
+        uint64_t time = (uint64_t) e->start_time;
+        int64_t delta = (int64_t) (time - prev_time);
+        prev_time = time;
+
+        n += benchmark_track_stream_put_varint(&p[n], e->entry.path);
+        n += benchmark_track_stream_put_varint(&p[n], ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63));
+        n += benchmark_track_stream_put_varint(&p[n], e->duration);
+        if (e->entry.path == Entry_Syscall) {
+            n += benchmark_track_stream_put_varint(&p[n], e->entry.syscall_no);
+            n += benchmark_track_stream_put_varint(&p[n], e->entry.cap_type);
+            n += benchmark_track_stream_put_varint(&p[n], e->entry.invocation_tag);
+            p[n++] = e->entry.is_fastpath;
+        } else {
+            n += benchmark_track_stream_put_varint(&p[n], e->entry.word);
+        }
+        stream->length = n;
+    }
+
+    stream->total += count;
+    return benchmark_track_stream_flush_chunk(stream, first_index + chunk_start, count - chunk_start);
+}
+
+/* Terminate the stream. Returns 0 on success. */
+static inline int
+benchmark_track_stream_end(benchmark_track_stream_t *stream)
+{
+    uint8_t end[1 + 10];
+    size_t n = 0;
+
+    end[n++] = BENCHMARK_TRACK_STREAM_END;
+    n += benchmark_track_stream_put_varint(&end[n], stream->total);
+    return stream->write(stream->cookie, end, n);
+}
+
+#endif /* CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES */
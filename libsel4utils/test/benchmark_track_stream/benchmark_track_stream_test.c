@@ -0,0 +1,164 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Round trip test for sel4utils/benchmark_track_stream.h. Encodes a synthetic
+ * log, in several batches as seL4_BenchmarkTrackStreamLog would, both into a
+ * binary stream file and as text into a file standing in for a serial console
+ * capture, and writes the CSV that tools/benchmark_track_decode.py --csv should
+ * print for either to a third file. Both streams have other output around them
+ * that the decoder has to skip. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sel4utils/benchmark_track_stream.h>
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void
+make_entry(benchmark_track_kernel_entry_t *e, seL4_Word i, uint64_t *time)
+{
+    static const int paths[] = {
+        Entry_Syscall, Entry_Syscall, Entry_Syscall, Entry_Interrupt,
+        Entry_UserLevelFault, Entry_VMFault, Entry_UnknownSyscall, Entry_DebugFault,
+    };
+
+    memset(e, 0, sizeof(*e));
+    e->entry.path = paths[rng() % (sizeof(paths) / sizeof(paths[0]))];
+    if (e->entry.path == Entry_Syscall) {
+        e->entry.is_fastpath = rng() & 1;
+        e->entry.cap_type = rng() % 32;
+        e->entry.syscall_no = rng() % 16;
+        e->entry.invocation_tag = rng() % (1 << 19);
+    } else {
+        e->entry.word = rng() % (1 << 26);
+    }
+
+    switch (i % 1000) {
+    case 500:
+        /* timestamps that go backwards have negative deltas */
+        *time -= rng() % 100000;
+        break;
+    case 700:
+        /* and the full range of the counter has to survive */
+        *time = UINT64_MAX - (rng() % 1000);
+        break;
+    case 701:
+        *time = rng() % 1000;
+        break;
+    default:
+        *time += rng() % (i < 2000 ? 100 : 1ull << 40);
+        break;
+    }
+    e->start_time = *time;
+    e->duration = (i % 97 == 0) ? UINT32_MAX : rng() % 5000;
+}
+
+static void
+print_entry(FILE *f, seL4_Word i, const benchmark_track_kernel_entry_t *e)
+{
+    fprintf(f, "%" PRIuPTR ",%u,%" PRIu64 ",%" PRIu32 ",", i, (unsigned int) e->entry.path,
+            e->start_time, e->duration);
+    if (e->entry.path == Entry_Syscall) {
+        fprintf(f, "%u,%u,%u,%u,\r\n", (unsigned int) e->entry.syscall_no, (unsigned int) e->entry.cap_type,
+                (unsigned int) e->entry.invocation_tag, (unsigned int) e->entry.is_fastpath);
+    } else {
+        fprintf(f, ",,,,%u\r\n", (unsigned int) e->entry.word);
+    }
+}
+
+static FILE *stream_file;
+static FILE *console_file;
+
+/* Write to both files, with console output from elsewhere in between */
+static int
+write_both(void *cookie, const void *data, size_t len)
+{
+    static int writes;
+
+    if (writes++ % 3 == 0) {
+        fprintf(console_file, "[%5d.%06d] unrelated console output\r\n", writes, writes * 7);
+    }
+    if (benchmark_track_stream_text_write(console_file, data, len)) {
+        return -1;
+    }
+    return benchmark_track_stream_file_write(stream_file, data, len);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 5) {
+        fprintf(stderr, "usage: %s <entries> <stream file> <console file> <expected csv>\n", argv[0]);
+        return 1;
+    }
+    seL4_Word num_entries = strtoul(argv[1], NULL, 0);
+    stream_file = fopen(argv[2], "wb");
+    console_file = fopen(argv[3], "wb");
+    FILE *csv_file = fopen(argv[4], "w");
+    if (!stream_file || !console_file || !csv_file) {
+        perror("fopen");
+        return 1;
+    }
+
+    benchmark_track_kernel_entry_t *log = calloc(num_entries, sizeof(*log));
+    if (!log && num_entries) {
+        perror("calloc");
+        return 1;
+    }
+    uint64_t time = 1000;
+    fprintf(csv_file, "index,path,start_time,duration,syscall_no,cap_type,invocation_tag,is_fastpath,word\r\n");
+    for (seL4_Word i = 0; i < num_entries; i++) {
+        make_entry(&log[i], i, &time);
+        print_entry(csv_file, i, &log[i]);
+    }
+
+    fprintf(stream_file, "Booting all finished, dropped to user space\n");
+    fprintf(console_file, "Booting all finished, dropped to user space\r\n");
+
+    benchmark_track_stream_t stream;
+    if (benchmark_track_stream_init(&stream, write_both, NULL)) {
+        fprintf(stderr, "failed to write stream header\n");
+        return 1;
+    }
+    /* drain in uneven batches, including empty ones */
+    while (stream.next_index < num_entries) {
+        seL4_Word count = rng() % 700;
+        if (count > num_entries - stream.next_index) {
+            count = num_entries - stream.next_index;
+        }
+        if (benchmark_track_stream_encode(&stream, &log[stream.next_index], stream.next_index, count)) {
+            fprintf(stderr, "failed to encode entries from %" PRIuPTR "\n", stream.next_index);
+            return 1;
+        }
+        stream.next_index += count;
+    }
+    if (benchmark_track_stream_end(&stream)) {
+        fprintf(stderr, "failed to end stream\n");
+        return 1;
+    }
+
+    printf("Encoded %" PRIuPTR " entries\n", num_entries);
+    fprintf(console_file, "All is well in the universe\r\n");
+    free(log);
+    fclose(stream_file);
+    fclose(console_file);
+    fclose(csv_file);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#pragma once
+
+/* The kernel's tracked entry layout, as exported by libsel4 */
+
+#include <stdint.h>
+#include <sel4/types.h>
+
+typedef enum {
+    Entry_Interrupt,
+    Entry_UnknownSyscall,
+    Entry_UserLevelFault,
+    Entry_DebugFault,
+    Entry_VMFault,
+    Entry_Syscall,
+    Entry_UnimplementedDevice,
+} entry_type_t;
+
+typedef struct kernel_entry {
+    seL4_Word path: 3;
+    union {
+        struct {
+            seL4_Word core: 3;
+            seL4_Word word: 26;
+        };
+        struct {
+            seL4_Word is_fastpath: 1;
+            seL4_Word cap_type: 5;
+            seL4_Word syscall_no: 4;
+            seL4_Word invocation_tag: 19;
+        };
+    };
+} kernel_entry_t;
+
+typedef struct benchmark_syscall_log_entry {
+    uint64_t start_time;
+    uint32_t duration;
+    kernel_entry_t entry;
+} benchmark_track_kernel_entry_t;
@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+#
+# Copyright 2016, NICTA
+#
+# This software may be distributed and modified according to the terms of
+# the BSD 2-Clause license. Note that NO WARRANTY is provided.
+# See "LICENSE_BSD2.txt" for details.
+#
+# @TAG(NICTA_BSD)
+#
+
+'''
+Decode a kernel entry tracking log written in the binary stream format from
+sel4utils/benchmark_track_stream.h. Prints the same summary as
+seL4_BenchmarkTrackDumpSummary, or every entry as CSV with --csv.
+
+The input may be a capture of a serial console: a stream sent as text lines
+(seL4_BenchmarkTrackDumpTextLog) is picked out from among the other output,
+and a binary stream is found by its header after any text printed before it.
+'''
+
+import argparse, binascii, collections, csv, sys
+
+MAGIC = b'SEL4TRK\0'
+TEXT_PREFIX = b'SEL4TRK:'
+VERSION = 1
+TIME_MASK = (1 << 64) - 1
+
+class DecodeError(Exception):
+    pass
+
+class Reader(object):
+    def __init__(self, data):
+        self.data = bytearray(data)
+        self.pos = 0
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise DecodeError('truncated stream at byte %d' % self.pos)
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7f) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+    def done(self):
+        return self.pos >= len(self.data)
+
+Entry = collections.namedtuple('Entry', ['index', 'path', 'start_time',
+    'duration', 'syscall_no', 'cap_type', 'invocation_tag', 'is_fastpath',
+    'word'])
+
+def extract(data):
+    '''Find the stream in data, which may also contain other output.'''
+    data = bytes(data)
+    if TEXT_PREFIX in data:
+        stream = bytearray()
+        for line in data.splitlines():
+            start = line.find(TEXT_PREFIX)
+            if start < 0:
+                continue
+            text = line[start + len(TEXT_PREFIX):].strip()
+            try:
+                stream += bytearray(binascii.unhexlify(text))
+            except (TypeError, binascii.Error):
+                raise DecodeError('corrupt stream line %r' % line)
+        return bytes(stream)
+    start = data.find(MAGIC)
+    if start < 0:
+        raise DecodeError('no benchmark track stream found')
+    return data[start:]
+
+def decode(data):
+    '''Decode a stream. Returns (paths, entries, complete) where paths maps
+    path names to the kernel's values for them.'''
+    r = Reader(data)
+    if bytes(r.data[:len(MAGIC)]) != MAGIC:
+        raise DecodeError('not a benchmark track stream')
+    r.pos = len(MAGIC)
+    version = r.byte()
+    if version != VERSION:
+        raise DecodeError('unsupported stream version %d' % version)
+    paths = collections.OrderedDict()
+    for name in ('syscall', 'interrupt', 'user-level fault', 'vm fault'):
+        paths[name] = r.byte()
+
+    entries = []
+    complete = False
+    while not r.done():
+        kind = chr(r.byte())
+        if kind == 'E':
+            total = r.varint()
+            if total != len(entries):
+                raise DecodeError('stream ended after %d entries but claims %d'
+                    % (len(entries), total))
+            complete = True
+            break
+        if kind != 'C':
+            raise DecodeError('unknown block %r at byte %d' % (kind, r.pos - 1))
+        first = r.varint()
+        count = r.varint()
+        length = r.varint()
+        end = r.pos + length
+        time = 0
+        for i in range(count):
+            path = r.varint()
+            delta = r.varint()
+            # start times are 64 bit counters, so the sum wraps like one
+            time = (time + ((delta >> 1) ^ -(delta & 1))) & TIME_MASK
+            duration = r.varint()
+            if path == paths['syscall']:
+                syscall_no = r.varint()
+                cap_type = r.varint()
+                invocation_tag = r.varint()
+                is_fastpath = r.byte()
+                word = None
+            else:
+                syscall_no = cap_type = invocation_tag = is_fastpath = None
+                word = r.varint()
+            entries.append(Entry(first + i, path, time, duration, syscall_no,
+                cap_type, invocation_tag, is_fastpath, word))
+        if r.pos != end:
+            raise DecodeError('chunk at entry %d has the wrong length' % first)
+    return paths, entries, complete
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode a binary kernel entry tracking log')
+    parser.add_argument('input', nargs='?', help='Input file',
+        default='-')
+    parser.add_argument('--csv', help='Print every entry as CSV',
+        action='store_true', default=False)
+    args = parser.parse_args()
+
+    if args.input == '-':
+        data = getattr(sys.stdin, 'buffer', sys.stdin).read()
+    else:
+        with open(args.input, 'rb') as f:
+            data = f.read()
+
+    try:
+        paths, entries, complete = decode(extract(data))
+    except DecodeError as e:
+        sys.stderr.write('%s: %s\n' % (args.input, e))
+        return 1
+    if not complete:
+        sys.stderr.write('%s: warning: stream has no end marker\n' % args.input)
+
+    if args.csv:
+        w = csv.writer(sys.stdout)
+        w.writerow(Entry._fields)
+        for e in entries:
+            w.writerow(['' if v is None else v for v in e])
+        return 0
+
+    names = dict((v, k) for k, v in paths.items())
+    counts = collections.Counter(e.path for e in entries)
+    sys.stdout.write('The kernel logged %d entries\n' % len(entries))
+    for name, value in paths.items():
+        sys.stdout.write('Number of %s invocations %d\n' % (name,
+            counts[value]))
+    for path, count in sorted(counts.items()):
+        if path not in names:
+            sys.stdout.write('Number of path %d entries %d\n' % (path, count))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#pragma once
+
+/* The parts of the ethdrivers raw interface used by the virtio emulation */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <platsupport/io.h>
+#include <utils/util.h>
+
+#define ETHIF_TX_ENQUEUED 0
+#define ETHIF_TX_FAILED -1
+#define ETHIF_TX_COMPLETE 1
+
+struct eth_driver;
+
+typedef void (*ethif_raw_tx_complete)(void *iface, void *cookie);
+typedef void (*ethif_raw_rx_complete)(void *iface, unsigned int num_bufs, void **cookies, unsigned int *lens);
+typedef uintptr_t (*ethif_raw_allocate_rx_buf)(void *iface, size_t buf_size, void **cookie);
+
+struct raw_iface_callbacks {
+    ethif_raw_tx_complete tx_complete;
+    ethif_raw_rx_complete rx_complete;
+    ethif_raw_allocate_rx_buf allocate_rx_buf;
+};
+
+typedef int (*ethif_raw_tx)(struct eth_driver *driver, unsigned int num, uintptr_t *phys, unsigned int *len, void *cookie);
+typedef void (*ethif_raw_handle_irq)(struct eth_driver *driver, int irq);
+typedef void (*ethif_raw_poll)(struct eth_driver *driver);
+typedef void (*ethif_low_level_init)(struct eth_driver *driver, uint8_t *mac, int *mtu);
+typedef void (*ethif_print_state_t)(struct eth_driver *driver);
+typedef void (*ethif_get_mac)(struct eth_driver *driver, uint8_t *mac);
+
+struct raw_iface_funcs {
+    ethif_raw_tx raw_tx;
+    ethif_raw_handle_irq raw_handleIRQ;
+    ethif_raw_poll raw_poll;
+    ethif_print_state_t print_state;
+    ethif_low_level_init low_level_init;
+    ethif_get_mac get_mac;
+};
+
+struct eth_driver {
+    void *eth_data;
+    struct raw_iface_funcs i_fn;
+    struct raw_iface_callbacks i_cb;
+    void *cb_cookie;
+    ps_io_ops_t io_ops;
+};
+
+typedef int (*ethif_driver_init)(struct eth_driver *eth_driver, ps_io_ops_t io_ops, void *config);
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* DMA on the host is plain memory that is its own physical address */
+
+typedef enum ps_mem_flags {
+    PS_MEM_NORMAL,
+} ps_mem_flags_t;
+
+typedef struct ps_dma_man {
+    void *cookie;
+} ps_dma_man_t;
+
+typedef struct ps_io_ops {
+    ps_dma_man_t dma_manager;
+} ps_io_ops_t;
+
+static inline void *ps_dma_alloc(ps_dma_man_t *dma_man, size_t size, int align, int cache, ps_mem_flags_t flags) {
+    return aligned_alloc(align, size);
+}
+
+static inline void ps_dma_free(ps_dma_man_t *dma_man, void *addr, size_t size) {
+    free(addr);
+}
+
+static inline uintptr_t ps_dma_pin(ps_dma_man_t *dma_man, void *addr, size_t size) {
+    return (uintptr_t)addr;
+}
+
+static inline void ps_dma_unpin(ps_dma_man_t *dma_man, void *addr, size_t size) {
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+/* Host stand ins for the parts of the seL4 environment the virtio emulation uses */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uintptr_t seL4_CPtr;
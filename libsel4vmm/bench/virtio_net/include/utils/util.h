@@ -0,0 +1,23 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BIT(n) (1ul << (n))
+#define MASK(n) (BIT(n) - 1ul)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define ROUND_UP(n, b) (((n) + (b) - 1) / (b) * (b))
+
+#define ZF_LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while (0)
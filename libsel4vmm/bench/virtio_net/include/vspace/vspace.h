@@ -0,0 +1,17 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#pragma once
+
+/* The bench implements the guest vspace functions over a flat buffer, so a
+ * vspace only needs to point at that */
+typedef struct vspace {
+    void *data;
+} vspace_t;
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+/* Packet rate benchmark for the virtio-net emulation, run on the host.
+ *
+ * A simulated guest driver transmits bursts of packets through the emulated
+ * device to a loopback driver, which hands each one back as a received
+ * packet. Guest memory is a flat buffer that is its own guest physical
+ * address space. The loopback driver completes its work either by calling
+ * back into the emulation directly, one packet at a time as an interrupt
+ * driven driver would, or from within the emulation's poll, which publishes
+ * the whole batch to the guest at once. Reported for each are the packets
+ * looped back per second and the guest interrupts per packet. Every received
+ * packet is checked against what was sent.
+ *
+ * usage: virtio_net_bench [duration ms] [packet bytes] [burst] [queue size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vmm/driver/virtio_emul.h>
+#include <ethdrivers/virtio/virtio_pci.h>
+#include <ethdrivers/virtio/virtio_net.h>
+#include <ethdrivers/virtio/virtio_ring.h>
+#include <ethdrivers/virtio/virtio_config.h>
+
+#define PAGE_SIZE 4096
+#define GUEST_MEM_SIZE (8 * 1024 * 1024)
+#define RX_RING_PFN 1
+#define TX_RING_PFN 64
+#define RX_BUFS 0x100000
+#define TX_BUFS 0x400000
+#define GUEST_BUF_SIZE 2048
+#define MAX_PACKET 1514
+
+/* Header the guest puts in front of packets with mergeable receive buffers */
+typedef struct guest_net_hdr {
+    struct virtio_net_hdr hdr;
+    uint16_t num_buffers;
+} guest_net_hdr_t;
+
+/* Guest memory */
+
+static char *guest_mem;
+
+int vmm_guest_vspace_touch(vspace_t *guest_vspace, uintptr_t addr, size_t size, vmm_guest_vspace_touch_callback callback, void *cookie) {
+    char *mem = guest_vspace->data;
+    size_t offset = 0;
+    while (offset < size) {
+        uintptr_t current = addr + offset;
+        size_t len = MIN(size - offset, PAGE_SIZE - (current % PAGE_SIZE));
+        assert(current + len <= GUEST_MEM_SIZE);
+        int result = callback(current, mem + current, len, offset, cookie);
+        if (result) {
+            return result;
+        }
+        offset += len;
+    }
+    return 0;
+}
+
+void *vmm_guest_vspace_translate(vspace_t *guest_vspace, uintptr_t addr) {
+    if (addr >= GUEST_MEM_SIZE) {
+        return NULL;
+    }
+    return (char*)guest_vspace->data + addr;
+}
+
+/* Loopback driver. Transmitted packets are copied into the driver, as a NIC
+ * would DMA them, and later completed and received back */
+
+typedef struct loop_packet {
+    void *cookie;
+    unsigned int len;
+    char data[MAX_PACKET];
+} loop_packet_t;
+
+typedef struct loop_driver {
+    struct eth_driver *driver;
+    loop_packet_t *pending;
+    int max_pending;
+    int num_pending;
+    /* number of interrupts raised in the guest */
+    unsigned long irqs;
+} loop_driver_t;
+
+static loop_driver_t loop;
+
+static int loop_tx(struct eth_driver *driver, unsigned int num, uintptr_t *phys, unsigned int *len, void *cookie) {
+    loop_driver_t *dev = driver->eth_data;
+    if (num != 1 || len[0] > MAX_PACKET || dev->num_pending == dev->max_pending) {
+        return ETHIF_TX_FAILED;
+    }
+    loop_packet_t *packet = &dev->pending[dev->num_pending++];
+    packet->cookie = cookie;
+    packet->len = len[0];
+    memcpy(packet->data, (void*)phys[0], len[0]);
+    return ETHIF_TX_ENQUEUED;
+}
+
+/* Complete every pending transmit and receive it back */
+static void loop_complete(struct eth_driver *driver) {
+    loop_driver_t *dev = driver->eth_data;
+    for (int i = 0; i < dev->num_pending; i++) {
+        loop_packet_t *packet = &dev->pending[i];
+        driver->i_cb.tx_complete(driver->cb_cookie, packet->cookie);
+        void *cookie;
+        uintptr_t phys = driver->i_cb.allocate_rx_buf(driver->cb_cookie, packet->len, &cookie);
+        if (phys) {
+            memcpy((void*)phys, packet->data, packet->len);
+            driver->i_cb.rx_complete(driver->cb_cookie, 1, &cookie, &packet->len);
+        }
+    }
+    dev->num_pending = 0;
+}
+
+/* The emulation raises guest interrupts through the driver */
+static void loop_handle_irq(struct eth_driver *driver, int irq) {
+    loop_driver_t *dev = driver->eth_data;
+    dev->irqs++;
+}
+
+static void loop_low_level_init(struct eth_driver *driver, uint8_t *mac, int *mtu) {
+    memset(mac, 0x02, 6);
+    *mtu = MAX_PACKET;
+}
+
+static int loop_init(struct eth_driver *driver, ps_io_ops_t io_ops, void *config) {
+    driver->eth_data = &loop;
+    loop.driver = driver;
+    driver->i_fn = (struct raw_iface_funcs) {
+        .raw_tx = loop_tx,
+        .raw_handleIRQ = loop_handle_irq,
+        .raw_poll = loop_complete,
+        .low_level_init = loop_low_level_init,
+    };
+    return 0;
+}
+
+/* Guest driver */
+
+typedef struct guest_queue {
+    struct vring vring;
+    uint16_t avail_idx;
+    uint16_t last_used;
+    /* stack of free descriptors */
+    uint16_t *free;
+    int num_free;
+} guest_queue_t;
+
+static guest_queue_t guest_rx, guest_tx;
+static uint32_t tx_seq, rx_seq;
+static unsigned long rx_packets;
+static size_t hdr_len;
+
+static void guest_queue_init(ethif_virtio_emul_t *emul, guest_queue_t *q, int queue, uint32_t pfn, int num) {
+    vring_init(&q->vring, num, guest_mem + pfn * PAGE_SIZE, VIRTIO_PCI_VRING_ALIGN);
+    assert(pfn * PAGE_SIZE + vring_size(num, VIRTIO_PCI_VRING_ALIGN) <= RX_BUFS);
+    q->avail_idx = 0;
+    q->last_used = 0;
+    q->free = malloc(sizeof(*q->free) * num);
+    q->num_free = 0;
+    for (int i = 0; i < num; i++) {
+        q->free[q->num_free++] = i;
+    }
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_SEL, 2, queue);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_PFN, 4, pfn);
+}
+
+static void guest_queue_add(guest_queue_t *q, uint64_t addr, uint32_t len, uint16_t flags) {
+    assert(q->num_free > 0);
+    uint16_t desc = q->free[--q->num_free];
+    q->vring.desc[desc] = (struct vring_desc) {
+        .addr = addr, .len = len, .flags = flags, .next = 0
+    };
+    q->vring.avail->ring[q->avail_idx % q->vring.num] = desc;
+    q->avail_idx++;
+}
+
+static void guest_queue_kick(guest_queue_t *q) {
+    __sync_synchronize();
+    q->vring.avail->idx = q->avail_idx;
+    __sync_synchronize();
+}
+
+static void guest_rx_refill(void) {
+    while (guest_rx.num_free > 0) {
+        uint16_t desc = guest_rx.free[guest_rx.num_free - 1];
+        guest_queue_add(&guest_rx, RX_BUFS + desc * GUEST_BUF_SIZE, GUEST_BUF_SIZE, VRING_DESC_F_WRITE);
+    }
+    guest_queue_kick(&guest_rx);
+}
+
+/* Take back everything the device has used, checking received packets */
+static void guest_reap(size_t packet_size) {
+    while (guest_tx.last_used != guest_tx.vring.used->idx) {
+        struct vring_used_elem *elem = &guest_tx.vring.used->ring[guest_tx.last_used % guest_tx.vring.num];
+        guest_tx.free[guest_tx.num_free++] = elem->id;
+        guest_tx.last_used++;
+    }
+    while (guest_rx.last_used != guest_rx.vring.used->idx) {
+        struct vring_used_elem *elem = &guest_rx.vring.used->ring[guest_rx.last_used % guest_rx.vring.num];
+        char *buf = guest_mem + RX_BUFS + elem->id * GUEST_BUF_SIZE;
+        uint32_t seq;
+        memcpy(&seq, buf + hdr_len, sizeof(seq));
+        if (elem->len != hdr_len + packet_size || seq != rx_seq) {
+            printf("Received packet %u of %u bytes, expected packet %u of %zu bytes\n", seq, elem->len, rx_seq,
+                   hdr_len + packet_size);
+            exit(1);
+        }
+        rx_seq++;
+        rx_packets++;
+        guest_rx.free[guest_rx.num_free++] = elem->id;
+        guest_rx.last_used++;
+    }
+    /* ask for an interrupt on the next used element */
+    vring_used_event(&guest_rx.vring) = guest_rx.last_used;
+    vring_used_event(&guest_tx.vring) = guest_tx.last_used;
+}
+
+static void guest_transmit(ethif_virtio_emul_t *emul, size_t packet_size, int burst) {
+    for (int i = 0; i < burst && guest_tx.num_free > 0; i++) {
+        uint16_t desc = guest_tx.free[guest_tx.num_free - 1];
+        uintptr_t addr = TX_BUFS + desc * GUEST_BUF_SIZE;
+        memset(guest_mem + addr, 0, hdr_len);
+        memset(guest_mem + addr + hdr_len, 0xab, packet_size);
+        memcpy(guest_mem + addr + hdr_len, &tx_seq, sizeof(tx_seq));
+        tx_seq++;
+        guest_queue_add(&guest_tx, addr, hdr_len + packet_size, 0);
+    }
+    guest_queue_kick(&guest_tx);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_NOTIFY, 2, 1);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, int batched, int duration, size_t packet_size, int burst, int queue_size) {
+    vspace_t guest_vspace = { .data = guest_mem };
+    ps_io_ops_t io_ops = {};
+    memset(guest_mem, 0, GUEST_MEM_SIZE);
+    loop.max_pending = queue_size;
+    loop.pending = malloc(sizeof(*loop.pending) * queue_size);
+    loop.num_pending = 0;
+    loop.irqs = 0;
+    tx_seq = rx_seq = 0;
+    rx_packets = 0;
+
+    ethif_virtio_emul_t *emul = ethif_virtio_emul_init(io_ops, queue_size, &guest_vspace, loop_init, NULL);
+    assert(emul);
+    unsigned int features;
+    emul->io_in(emul, VIRTIO_PCI_HOST_FEATURES, 4, &features);
+    emul->io_out(emul, VIRTIO_PCI_GUEST_FEATURES, 4, features);
+    hdr_len = features & BIT(VIRTIO_NET_F_MRG_RXBUF) ? sizeof(guest_net_hdr_t) : sizeof(struct virtio_net_hdr);
+    guest_queue_init(emul, &guest_rx, 0, RX_RING_PFN, queue_size);
+    guest_queue_init(emul, &guest_tx, 1, TX_RING_PFN, queue_size);
+    emul->io_out(emul, VIRTIO_PCI_STATUS, 1, VIRTIO_CONFIG_S_DRIVER_OK);
+    guest_rx_refill();
+
+    double start = now();
+    double end = start + duration / 1000.0;
+    double finish;
+    do {
+        for (int i = 0; i < 64; i++) {
+            guest_transmit(emul, packet_size, burst);
+            if (batched) {
+                emul->poll(emul);
+            } else {
+                loop_complete(loop.driver);
+            }
+            guest_reap(packet_size);
+            guest_rx_refill();
+        }
+        finish = now();
+    } while (finish < end);
+
+    printf("%-10s %12.0f pps %8.3f irqs/packet\n", name, rx_packets / (finish - start),
+           rx_packets ? (double)loop.irqs / rx_packets : 0.0);
+    free(loop.pending);
+    free(guest_rx.free);
+    free(guest_tx.free);
+}
+
+int main(int argc, char **argv) {
+    int duration = argc > 1 ? atoi(argv[1]) : 1000;
+    size_t packet_size = argc > 2 ? atoi(argv[2]) : 64;
+    int burst = argc > 3 ? atoi(argv[3]) : 32;
+    int queue_size = argc > 4 ? atoi(argv[4]) : 256;
+    if (packet_size < sizeof(uint32_t) || packet_size > MAX_PACKET || burst < 1 || queue_size < 1 ||
+            queue_size > 1024 || (queue_size & (queue_size - 1))) {
+        printf("usage: %s [duration ms] [packet bytes] [burst] [queue size]\n", argv[0]);
+        return 1;
+    }
+    guest_mem = aligned_alloc(PAGE_SIZE, GUEST_MEM_SIZE);
+    assert(guest_mem);
+
+    printf("%zu byte packets, bursts of %d, %d entry queues\n", packet_size, burst, queue_size);
+    run("unbatched", 0, duration, packet_size, burst, queue_size);
+    run("batched", 1, duration, packet_size, burst, queue_size);
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#ifndef __LIB_VMM_DRIVER_BLOCK_STORE_H__
+#define __LIB_VMM_DRIVER_BLOCK_STORE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define VMM_BLOCK_SECTOR_SIZE 512
+
+/* Interface to whatever is backing an emulated block device. Offsets and
+ * lengths are in bytes, and the device only ever passes ranges that lie
+ * within size. Functions return 0 on success */
+typedef struct vmm_block_store {
+    void *cookie;
+    /* size of the store in bytes. Must be a multiple of VMM_BLOCK_SECTOR_SIZE */
+    uint64_t size;
+    int (*read)(void *cookie, uint64_t offset, void *buf, size_t len);
+    int (*write)(void *cookie, uint64_t offset, const void *buf, size_t len);
+    /* make all completed writes durable. May be NULL if writes are always durable */
+    int (*flush)(void *cookie);
+} vmm_block_store_t;
+
+/* Create a block store backed by zeroed memory from malloc. Mostly useful as a
+ * stand in for testing */
+int vmm_block_store_ramdisk_init(vmm_block_store_t *store, uint64_t size);
+
+#endif /* __LIB_VMM_DRIVER_BLOCK_STORE_H__ */
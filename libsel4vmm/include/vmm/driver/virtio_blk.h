@@ -0,0 +1,36 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#ifndef __LIB_VMM_DRIVER_VIRTIO_BLK_H__
+#define __LIB_VMM_DRIVER_VIRTIO_BLK_H__
+
+#include <vmm/platform/guest_vspace.h>
+#include <vmm/driver/block_store.h>
+#include <vmm/driver/virtio_queue.h>
+
+/* PCI device id of a legacy virtio block device */
+#define VIRTIO_BLK_PCI_DEVICE_ID 0x1001
+
+struct virtio_blk_emul_internal;
+
+typedef struct virtio_blk_emul {
+    /* pointer to internal information */
+    struct virtio_blk_emul_internal *internal;
+    /* io port interface functions */
+    int (*io_in)(struct virtio_blk_emul *emul, unsigned int offset, unsigned int size, unsigned int *result);
+    int (*io_out)(struct virtio_blk_emul *emul, unsigned int offset, unsigned int size, unsigned int value);
+} virtio_blk_emul_t;
+
+/* Create a virtio block device on top of the given store. The store is copied
+ * and must remain usable for the lifetime of the device */
+virtio_blk_emul_t *virtio_blk_emul_init(int queue_size, vspace_t *guest_vspace, vmm_block_store_t *store,
+                                        virtio_emul_irq_fn irq, void *irq_cookie);
+
+#endif /* __LIB_VMM_DRIVER_VIRTIO_BLK_H__ */
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#ifndef __LIB_VMM_DRIVER_VIRTIO_CONSOLE_H__
+#define __LIB_VMM_DRIVER_VIRTIO_CONSOLE_H__
+
+#include <vmm/platform/guest_vspace.h>
+#include <vmm/driver/virtio_queue.h>
+
+/* PCI device id of a legacy virtio console device */
+#define VIRTIO_CONSOLE_PCI_DEVICE_ID 0x1003
+
+/* Receives output written by the guest. The buffer points directly into
+ * guest memory and is only valid for the duration of the call */
+typedef void (*virtio_console_write_fn)(void *cookie, const char *buf, size_t len);
+
+struct virtio_console_emul_internal;
+
+typedef struct virtio_console_emul {
+    /* pointer to internal information */
+    struct virtio_console_emul_internal *internal;
+    /* io port interface functions */
+    int (*io_in)(struct virtio_console_emul *emul, unsigned int offset, unsigned int size, unsigned int *result);
+    int (*io_out)(struct virtio_console_emul *emul, unsigned int offset, unsigned int size, unsigned int value);
+} virtio_console_emul_t;
+
+virtio_console_emul_t *virtio_console_emul_init(int queue_size, vspace_t *guest_vspace,
+                                                virtio_console_write_fn write, void *write_cookie,
+                                                virtio_emul_irq_fn irq, void *irq_cookie);
+
+/* Pass input to the guest. Returns how many characters were accepted, which
+ * may be less than len if the guest has not provided enough buffers */
+size_t virtio_console_emul_putchars(virtio_console_emul_t *emul, const char *buf, size_t len);
+
+#endif /* __LIB_VMM_DRIVER_VIRTIO_CONSOLE_H__ */
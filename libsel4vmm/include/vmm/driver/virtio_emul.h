@@ -27,6 +27,11 @@ typedef struct ethif_virtio_emul {
      * typically this would be due to link coming up
      * meaning that transmits can finally happen */
     int (*notify)(struct ethif_virtio_emul *emul);
+    /* poll the underlying driver. everything it completes during the poll is
+     * handed to the guest at the end with at most one interrupt, whereas
+     * completions the driver makes outside of a poll are published to the
+     * guest as they happen. returns -1 if the driver cannot be polled */
+    int (*poll)(struct ethif_virtio_emul *emul);
 } ethif_virtio_emul_t;
 
 ethif_virtio_emul_t *ethif_virtio_emul_init(ps_io_ops_t io_ops, int queue_size, vspace_t *guest_vspace, ethif_driver_init driver, void *config);
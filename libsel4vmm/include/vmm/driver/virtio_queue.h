@@ -0,0 +1,93 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#ifndef __LIB_VMM_DRIVER_VIRTIO_QUEUE_H__
+#define __LIB_VMM_DRIVER_VIRTIO_QUEUE_H__
+
+#include <stdint.h>
+#include <ethdrivers/virtio/virtio_ring.h>
+#include <vmm/platform/guest_vspace.h>
+
+/* Feature bits that may be missing from older copies of the virtio headers */
+#ifndef VIRTIO_RING_F_EVENT_IDX
+#define VIRTIO_RING_F_EVENT_IDX 29
+#endif
+
+/* Called when an emulated device wants to interrupt the guest */
+typedef void (*virtio_emul_irq_fn)(void *cookie);
+
+/* Device side of a single legacy virtio queue that lives in guest memory.
+ * Elements taken from the avail ring are returned by adding them to the
+ * used ring, which is only made visible to the guest in batches by
+ * vmm_virtqueue_publish */
+typedef struct vmm_virtqueue {
+    vspace_t *guest_vspace;
+    /* vring with pointers that are guest physical addresses */
+    struct vring vring;
+    uint16_t num;
+    uint32_t pfn;
+    /* next avail index we will consume */
+    uint16_t last_idx;
+    /* our copy of the used ring index. The guest never writes to it so we
+     * only need to publish it, never read it back */
+    uint16_t used_idx;
+    /* used index at the point we last published to the guest */
+    uint16_t used_published;
+    /* whether VIRTIO_RING_F_EVENT_IDX was negotiated */
+    int event_idx;
+    /* vmm mappings of each 4K page of the vring. NULL if the ring could
+     * not be translated, in which case we fall back to touching guest memory */
+    void **ring_pages;
+    int ring_num_pages;
+} vmm_virtqueue_t;
+
+/* Initialise a queue of the given size. The queue is unusable until the guest
+ * gives it a location with vmm_virtqueue_set_pfn */
+void vmm_virtqueue_init(vmm_virtqueue_t *vq, vspace_t *guest_vspace, uint16_t num);
+
+/* Place the queue at a guest page frame, as written to VIRTIO_PCI_QUEUE_PFN.
+ * A pfn of 0 resets the queue */
+void vmm_virtqueue_set_pfn(vmm_virtqueue_t *vq, uint32_t pfn);
+
+static inline int vmm_virtqueue_ready(vmm_virtqueue_t *vq) {
+    return vq->pfn != 0;
+}
+
+/* Take the next descriptor chain head from the avail ring.
+ * Returns 0 and sets *desc_head on success, or -1 if the ring is empty */
+int vmm_virtqueue_pop(vmm_virtqueue_t *vq, uint16_t *desc_head);
+
+/* Return the last n chains popped to the avail ring */
+static inline void vmm_virtqueue_unpop(vmm_virtqueue_t *vq, uint16_t n) {
+    vq->last_idx -= n;
+}
+
+/* Read a descriptor from the descriptor table */
+struct vring_desc vmm_virtqueue_desc(vmm_virtqueue_t *vq, uint16_t idx);
+
+/* Add a completed chain to the used ring. This is not seen by the guest
+ * until the next publish */
+void vmm_virtqueue_used_add(vmm_virtqueue_t *vq, uint16_t desc_head, uint32_t len);
+
+/* Make all used elements added since the last publish visible to the guest.
+ * Returns non zero if the guest wants an interrupt for them */
+int vmm_virtqueue_publish(vmm_virtqueue_t *vq);
+
+/* Ask the guest not to notify us until it has added the chain at the current
+ * avail index. Returns non zero if new chains arrived in the meantime, in which
+ * case the caller should keep processing */
+int vmm_virtqueue_enable_notify(vmm_virtqueue_t *vq);
+
+/* Copy between a buffer and the guest memory described by a descriptor.
+ * Both return the number of bytes copied */
+size_t vmm_virtqueue_desc_read(vmm_virtqueue_t *vq, struct vring_desc *desc, size_t offset, void *buf, size_t len);
+size_t vmm_virtqueue_desc_write(vmm_virtqueue_t *vq, struct vring_desc *desc, size_t offset, const void *buf, size_t len);
+
+#endif /* __LIB_VMM_DRIVER_VIRTIO_QUEUE_H__ */
@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
 typedef int EVTCHN;
 
 struct libvchan;
@@ -94,6 +95,17 @@ int libvchan_read(libvchan_t *ctrl, void *data, size_t size);
 */
 int libvchan_write(libvchan_t *ctrl, const void *data, size_t size);
 
+/**
+* Scatter/gather versions of libvchan_read and libvchan_write. The vectors are
+* transferred as a single stream operation, with at most one notification of the peer.
+* @param ctrl The vchan control structure
+* @param iov Array of buffers
+* @param iovcnt Number of buffers in iov
+* @return -1 on error, otherwise the total amount of data transferred
+*/
+int libvchan_readv(libvchan_t *ctrl, const struct iovec *iov, int iovcnt);
+int libvchan_writev(libvchan_t *ctrl, const struct iovec *iov, int iovcnt);
+
 /**
 * Query the state of the vchan shared page:
 * return 0 when one side has called libxenvchan_close() or crashed
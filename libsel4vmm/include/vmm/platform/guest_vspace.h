@@ -36,6 +36,12 @@ typedef int (*vmm_guest_vspace_touch_callback)(uintptr_t guest_phys, void *vmm_v
  * each equivalent range of addresses in the vmm vspace */
 int vmm_guest_vspace_touch(vspace_t *guest_vspace, uintptr_t addr, size_t size, vmm_guest_vspace_touch_callback callback, void *cookie);
 
+/* Translate a guest physical address into the address it is mapped at in the vmm
+ * vspace. The returned pointer is only valid up to the end of the 4K page containing
+ * addr, as consecutive guest pages are not necessarily contiguous in the vmm.
+ * Returns NULL if addr is not mapped */
+void *vmm_guest_vspace_translate(vspace_t *guest_vspace, uintptr_t addr);
+
 #ifdef CONFIG_IOMMU
 /* Attach an additional IO space to the vspace */
 int vmm_guest_vspace_add_iospace(vspace_t *vspace, seL4_CPtr iospace);
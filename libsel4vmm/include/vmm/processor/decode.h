@@ -15,6 +15,10 @@
 
 int vmm_fetch_instruction(vmm_vcpu_t *vcpu, uint32_t eip, uintptr_t cr3, int len, uint8_t *buf);
 
+/* Drop all cached guest page table walks. Must be called whenever the guest
+ * switches paging mode */
+void vmm_guest_tlb_flush(vmm_vcpu_t *vcpu);
+
 int vmm_decode_instruction(uint8_t *instr, int instr_len, int *reg, uint32_t *imm, int *op_len);
 
 /* Interpret just enough virtual 8086 instructions to run trampoline code.
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#ifndef _VMM_GUEST_TLB_H
+#define _VMM_GUEST_TLB_H
+
+#include <stdint.h>
+
+/* Number of entries in the software TLB. Must be a power of 2 */
+#define VMM_GUEST_TLB_ENTRIES 16
+
+/* Caches guest virtual to guest physical translations, at 4K granularity,
+ * from walking the guest page tables. Guest invlpg and cr3 loads do not
+ * cause exits, so an entry is only trusted after re-reading the leaf entry
+ * it came from and finding it unchanged. That is one guest memory read per
+ * lookup instead of a full walk */
+typedef struct vmm_guest_tlb_entry {
+    int valid;
+    uintptr_t cr3;
+    uint32_t vpn;
+    /* guest physical address, size and contents of the leaf page table entry */
+    uint64_t leaf_addr;
+    int leaf_bytes;
+    uint64_t leaf;
+    /* guest physical address of the 4K page */
+    uint64_t paddr;
+} vmm_guest_tlb_entry_t;
+
+typedef struct vmm_guest_tlb {
+    vmm_guest_tlb_entry_t entries[VMM_GUEST_TLB_ENTRIES];
+    uint64_t hits;
+    uint64_t misses;
+    /* lookups that matched an entry whose leaf had since changed */
+    uint64_t stale;
+} vmm_guest_tlb_t;
+
+#endif
@@ -11,6 +11,9 @@
 #ifndef __VMM_X86_LAPIC_H
 #define __VMM_X86_LAPIC_H
 
+#include <autoconf.h>
+#include <stdint.h>
+
 enum vmm_lapic_state {
     LAPIC_STATE_NEW,
     LAPIC_STATE_WAITSIPI,
@@ -33,10 +36,15 @@ typedef struct vmm_lapic {
     //struct vmm_timer lapic_timer;
     uint32_t divide_count;
 
-    bool irr_pending;
+    /* Bit n is set if IRR/ISR register n has any vectors set. This lets
+     * us find the highest vector without scanning every register */
+    uint8_t irr_summary;
+    uint8_t isr_summary;
+    /* The highest vector set in IRR, or -1 if none */
+    int highest_irr_cache;
     /* Number of bits set in ISR. */
     int16_t isr_count;
-    /* The highest vector set in ISR; if -1 - invalid, must scan ISR. */
+    /* The highest vector set in ISR, or -1 if none */
     int highest_isr_cache;
     /**
      * APIC register page.  The layout matches the register layout seen by
@@ -48,6 +56,16 @@ typedef struct vmm_lapic {
 
     enum vmm_lapic_state state; 
     int arb_prio;
+
+#ifdef CONFIG_LIB_VMM_LAPIC_STATS
+    /* Time, in TSC cycles, from a vector being set in IRR to it being injected */
+    struct {
+        uint64_t pending_since[256];
+        uint64_t injections;
+        uint64_t total_latency;
+        uint64_t max_latency;
+    } stats;
+#endif
 } vmm_lapic_t;
 
 int vmm_apic_enabled(vmm_lapic_t *apic);
@@ -72,6 +90,13 @@ void vmm_apic_mmio_write(vmm_vcpu_t *vcpu, void *cookie, uint32_t offset,
 void vmm_apic_mmio_read(vmm_vcpu_t *vcpu, void *cookie, uint32_t offset,
         int len, uint32_t *data);
 
+#ifdef CONFIG_LIB_VMM_LAPIC_STATS
+/* Interrupt injection latency statistics, measured in TSC cycles */
+void vmm_apic_get_latency_stats(vmm_vcpu_t *vcpu, uint64_t *injections,
+        uint64_t *total_latency, uint64_t *max_latency);
+void vmm_apic_reset_latency_stats(vmm_vcpu_t *vcpu);
+#endif
+
 uint64_t vmm_get_lapic_tscdeadline_msr(vmm_vcpu_t *vcpu);
 void vmm_set_lapic_tscdeadline_msr(vmm_vcpu_t *vcpu, uint64_t data);
 
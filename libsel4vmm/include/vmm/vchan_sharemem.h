@@ -19,14 +19,36 @@
 #include <simple/simple.h>
 
 
+/* Must be a power of two so that positions can be reduced with a mask */
 #define VCHAN_BUF_SIZE PAGE_SIZE_4K
+#define VCHAN_BUF_MASK (VCHAN_BUF_SIZE - 1)
 #define NUM_BUFFERS 2
 
+/* Feature bits advertised by each end of a ring. WAIT_FLAGS means the end
+   sets its waiting flag before blocking, so only needs alerts while it is set */
+#define VCHAN_FEATURE_WAIT_FLAGS BIT(0)
+
+/*
+    Single producer, single consumer ring
+
+    read_pos and write_pos are free running byte counters that are only
+    ever reduced modulo VCHAN_BUF_SIZE when indexing sync_data, so the fill
+    level is always write_pos - read_pos, even across wrap around.
+    The producer only writes write_pos and the consumer only writes read_pos.
+
+    A side that is about to block sets its waiting flag, and the other side
+    only sends an alert after moving its position if that flag is set.
+    Peers that predate the flags never set them, so alerts are only
+    suppressed once the peer has advertised VCHAN_FEATURE_WAIT_FLAGS in its
+    features word, which it does before it first blocks.
+*/
 typedef struct vchan_buf {
     int owner;
     char sync_data[VCHAN_BUF_SIZE];
     int filled;
-    int read_pos, write_pos;
+    uint32_t read_pos, write_pos;
+    uint32_t reader_waiting, writer_waiting;
+    uint32_t reader_features, writer_features;
 } vchan_buf_t;
 
 /*
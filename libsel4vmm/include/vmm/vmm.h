@@ -30,6 +30,7 @@ typedef struct vmm_vcpu vmm_vcpu_t;
 #include "vmm/vmexit.h"
 #include "vmm/mmio.h"
 #include "vmm/processor/lapic.h"
+#include "vmm/processor/guest_tlb.h"
 #include "vmm/vmcall.h"
 #include "vmm/vmm_manager.h"
 
@@ -96,6 +97,9 @@ typedef struct vmm_vcpu {
     vmm_lapic_t *lapic;
     int vcpu_id;
 
+    /* cached guest page table walks for instruction fetching */
+    vmm_guest_tlb_t tlb;
+
     /* is the vcpu online */
     int online;
 } vmm_vcpu_t;
@@ -139,6 +143,9 @@ typedef struct vmm {
 
     unsigned int num_vcpus;
     vmm_vcpu_t *vcpus;
+    /* vcpu that last accepted PIC interrupts. Only a hint, and is
+     * checked before use */
+    unsigned int extint_vcpu;
 
     vmcall_handler_t *vmcall_handlers;
     unsigned int vmcall_num_handlers;
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#include <autoconf.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/util.h>
+
+#include <vmm/driver/block_store.h>
+
+static int ramdisk_read(void *cookie, uint64_t offset, void *buf, size_t len) {
+    memcpy(buf, cookie + offset, len);
+    return 0;
+}
+
+static int ramdisk_write(void *cookie, uint64_t offset, const void *buf, size_t len) {
+    memcpy(cookie + offset, buf, len);
+    return 0;
+}
+
+int vmm_block_store_ramdisk_init(vmm_block_store_t *store, uint64_t size) {
+    if (size % VMM_BLOCK_SECTOR_SIZE != 0) {
+        ZF_LOGE("Ramdisk size must be a multiple of the sector size");
+        return -1;
+    }
+    void *base = calloc(1, size);
+    if (!base) {
+        ZF_LOGE("Failed to allocate ramdisk of %llu bytes", (long long unsigned int)size);
+        return -1;
+    }
+    store->cookie = base;
+    store->size = size;
+    store->read = ramdisk_read;
+    store->write = ramdisk_write;
+    store->flush = NULL;
+    return 0;
+}
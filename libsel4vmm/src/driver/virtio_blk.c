@@ -0,0 +1,292 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#include <autoconf.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/util.h>
+
+#include <vmm/driver/virtio_blk.h>
+#include <vmm/driver/virtio_queue.h>
+#include <ethdrivers/virtio/virtio_pci.h>
+#include <ethdrivers/virtio/virtio_config.h>
+
+#define REQ_QUEUE 0
+
+/* Definitions from the virtio block specification */
+#define VIRTIO_BLK_F_FLUSH 9
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+#define VIRTIO_BLK_T_GET_ID 8
+
+#define VIRTIO_BLK_S_OK 0
+#define VIRTIO_BLK_S_IOERR 1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+#define VIRTIO_BLK_ID_BYTES 20
+
+#define HOST_FEATURES (BIT(VIRTIO_BLK_F_FLUSH) | BIT(VIRTIO_RING_F_EVENT_IDX))
+
+/* Device configuration starts after the legacy virtio registers */
+#define CONFIG_OFFSET 0x14
+
+typedef struct virtio_blk_req_hdr {
+    uint32_t type;
+    uint32_t ioprio;
+    uint64_t sector;
+} virtio_blk_req_hdr_t;
+
+typedef struct virtio_blk_emul_internal {
+    int status;
+    uint32_t guest_features;
+    vmm_virtqueue_t vq;
+    /* scratch space for the descriptors of the request being processed */
+    struct vring_desc *descs;
+    vmm_block_store_t store;
+    virtio_emul_irq_fn irq;
+    void *irq_cookie;
+    vspace_t guest_vspace;
+} virtio_blk_emul_internal_t;
+
+typedef struct blk_touch_args {
+    vmm_block_store_t *store;
+    uint64_t offset;
+    int write;
+} blk_touch_args_t;
+
+/* moves data directly between the block store and guest memory */
+static int blk_touch_store(uintptr_t phys, void *vaddr, size_t size, size_t offset, void *cookie) {
+    blk_touch_args_t *args = (blk_touch_args_t*)cookie;
+    int error;
+    if (args->write) {
+        error = args->store->write(args->store->cookie, args->offset + offset, vaddr, size);
+    } else {
+        error = args->store->read(args->store->cookie, args->offset + offset, vaddr, size);
+    }
+    return error;
+}
+
+/* Collect all descriptors of a chain into the scratch list, returning how many
+ * there are or -1 if the chain is malformed */
+static int blk_get_chain(virtio_blk_emul_internal_t *blk, uint16_t desc_head) {
+    vmm_virtqueue_t *vq = &blk->vq;
+    uint16_t desc_idx = desc_head;
+    int num = 0;
+    do {
+        if (num == vq->num) {
+            ZF_LOGE("Descriptor chain loops");
+            return -1;
+        }
+        blk->descs[num] = vmm_virtqueue_desc(vq, desc_idx);
+        desc_idx = blk->descs[num].next;
+        num++;
+    } while (blk->descs[num - 1].flags & VRING_DESC_F_NEXT);
+    return num;
+}
+
+/* Process a single request, returning the number of bytes written to the guest */
+static uint32_t blk_handle_request(virtio_blk_emul_internal_t *blk, uint16_t desc_head) {
+    vmm_virtqueue_t *vq = &blk->vq;
+    virtio_blk_req_hdr_t hdr;
+    int num_descs = blk_get_chain(blk, desc_head);
+    if (num_descs < 0) {
+        return 0;
+    }
+    struct vring_desc *status_desc = &blk->descs[num_descs - 1];
+    if (vmm_virtqueue_desc_read(vq, &blk->descs[0], 0, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+            status_desc->len == 0 || (num_descs == 1 && status_desc->len <= sizeof(hdr))) {
+        ZF_LOGE("Malformed block request");
+        return 0;
+    }
+    /* everything between the header and the final status byte is data, which may
+     * be spread over any number of descriptors */
+    uint8_t status = VIRTIO_BLK_S_OK;
+    uint32_t written = 0;
+    uint64_t data_len = 0;
+    for (int i = 0; i < num_descs; i++) {
+        size_t start = i == 0 ? sizeof(hdr) : 0;
+        size_t end = i == num_descs - 1 ? blk->descs[i].len - 1 : blk->descs[i].len;
+        if (end > start) {
+            data_len += end - start;
+        }
+    }
+    switch (hdr.type) {
+    case VIRTIO_BLK_T_IN:
+    case VIRTIO_BLK_T_OUT: {
+        blk_touch_args_t args = {
+            .store = &blk->store,
+            .offset = hdr.sector * VMM_BLOCK_SECTOR_SIZE,
+            .write = hdr.type == VIRTIO_BLK_T_OUT
+        };
+        if (args.offset > blk->store.size || data_len > blk->store.size - args.offset) {
+            status = VIRTIO_BLK_S_IOERR;
+            break;
+        }
+        for (int i = 0; i < num_descs && status == VIRTIO_BLK_S_OK; i++) {
+            size_t start = i == 0 ? sizeof(hdr) : 0;
+            size_t end = i == num_descs - 1 ? blk->descs[i].len - 1 : blk->descs[i].len;
+            if (end <= start) {
+                continue;
+            }
+            if (vmm_guest_vspace_touch(&blk->guest_vspace, (uintptr_t)blk->descs[i].addr + start, end - start, blk_touch_store, &args)) {
+                status = VIRTIO_BLK_S_IOERR;
+            }
+            args.offset += end - start;
+            if (!args.write) {
+                written += end - start;
+            }
+        }
+        break;
+    }
+    case VIRTIO_BLK_T_FLUSH:
+        if (blk->store.flush && blk->store.flush(blk->store.cookie)) {
+            status = VIRTIO_BLK_S_IOERR;
+        }
+        break;
+    case VIRTIO_BLK_T_GET_ID: {
+        char id[VIRTIO_BLK_ID_BYTES] = "sel4-vmm-blk";
+        if (num_descs > 2) {
+            written += vmm_virtqueue_desc_write(vq, &blk->descs[1], 0, id, sizeof(id));
+        } else {
+            status = VIRTIO_BLK_S_IOERR;
+        }
+        break;
+    }
+    default:
+        status = VIRTIO_BLK_S_UNSUPP;
+        break;
+    }
+    written += vmm_virtqueue_desc_write(vq, status_desc, status_desc->len - 1, &status, sizeof(status));
+    return written;
+}
+
+/* Process every outstanding request and complete them as a single batch */
+static void blk_notify(virtio_blk_emul_internal_t *blk) {
+    uint16_t desc_head;
+    do {
+        while (vmm_virtqueue_pop(&blk->vq, &desc_head) == 0) {
+            uint32_t len = blk_handle_request(blk, desc_head);
+            vmm_virtqueue_used_add(&blk->vq, desc_head, len);
+        }
+    } while (vmm_virtqueue_enable_notify(&blk->vq));
+    if (vmm_virtqueue_publish(&blk->vq)) {
+        blk->irq(blk->irq_cookie);
+    }
+}
+
+static int emul_io_in(struct virtio_blk_emul *emul, unsigned int offset, unsigned int size, unsigned int *result) {
+    virtio_blk_emul_internal_t *blk = emul->internal;
+    switch(offset) {
+    case VIRTIO_PCI_HOST_FEATURES:
+        assert(size == 4);
+        *result = HOST_FEATURES;
+        break;
+    case VIRTIO_PCI_STATUS:
+        assert(size == 1);
+        *result = blk->status;
+        break;
+    case VIRTIO_PCI_QUEUE_NUM:
+        assert(size == 2);
+        *result = blk->vq.num;
+        break;
+    case VIRTIO_PCI_QUEUE_PFN:
+        assert(size == 4);
+        *result = blk->vq.pfn;
+        break;
+    case VIRTIO_PCI_ISR:
+        assert(size == 1);
+        *result = 1;
+        break;
+    case CONFIG_OFFSET ... CONFIG_OFFSET + sizeof(uint64_t) - 1: {
+        /* capacity in sectors */
+        uint64_t capacity = blk->store.size / VMM_BLOCK_SECTOR_SIZE;
+        unsigned int shift = (offset - CONFIG_OFFSET) * 8;
+        *result = (uint32_t)(capacity >> shift);
+        if (size < 4) {
+            *result &= MASK(size * 8);
+        }
+        break;
+    }
+    default:
+        if (offset > CONFIG_OFFSET) {
+            /* rest of the config space is for features we do not offer */
+            *result = 0;
+            break;
+        }
+        printf("Unhandled offset of 0x%x of size %d, reading\n", offset, size);
+        assert(!"panic");
+    }
+    return 0;
+}
+
+static int emul_io_out(struct virtio_blk_emul *emul, unsigned int offset, unsigned int size, unsigned int value) {
+    virtio_blk_emul_internal_t *blk = emul->internal;
+    switch(offset) {
+    case VIRTIO_PCI_GUEST_FEATURES:
+        assert(size == 4);
+        blk->guest_features = value & HOST_FEATURES;
+        blk->vq.event_idx = !!(blk->guest_features & BIT(VIRTIO_RING_F_EVENT_IDX));
+        break;
+    case VIRTIO_PCI_STATUS:
+        assert(size == 1);
+        blk->status = value & 0xff;
+        break;
+    case VIRTIO_PCI_QUEUE_SEL:
+        assert(size == 2);
+        assert((value & 0xffff) == REQ_QUEUE);
+        break;
+    case VIRTIO_PCI_QUEUE_PFN:
+        assert(size == 4);
+        vmm_virtqueue_set_pfn(&blk->vq, value);
+        break;
+    case VIRTIO_PCI_QUEUE_NOTIFY:
+        if (value == REQ_QUEUE) {
+            blk_notify(blk);
+        }
+        break;
+    default:
+        printf("Unhandled offset of 0x%x of size %d, writing 0x%x\n", offset, size, value);
+        assert(!"panic");
+    }
+    return 0;
+}
+
+virtio_blk_emul_t *virtio_blk_emul_init(int queue_size, vspace_t *guest_vspace, vmm_block_store_t *store,
+                                        virtio_emul_irq_fn irq, void *irq_cookie) {
+    virtio_blk_emul_t *emul = calloc(1, sizeof(*emul));
+    virtio_blk_emul_internal_t *internal = calloc(1, sizeof(*internal));
+    if (!emul || !internal) {
+        goto error;
+    }
+    internal->descs = malloc(sizeof(*internal->descs) * queue_size);
+    if (!internal->descs) {
+        goto error;
+    }
+    emul->internal = internal;
+    emul->io_in = emul_io_in;
+    emul->io_out = emul_io_out;
+    internal->store = *store;
+    internal->irq = irq;
+    internal->irq_cookie = irq_cookie;
+    internal->guest_vspace = *guest_vspace;
+    vmm_virtqueue_init(&internal->vq, &internal->guest_vspace, queue_size);
+    return emul;
+error:
+    ZF_LOGE("Failed to allocate virtio block device");
+    free(emul);
+    if (internal) {
+        free(internal->descs);
+        free(internal);
+    }
+    return NULL;
+}
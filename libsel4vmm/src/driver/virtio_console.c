@@ -0,0 +1,194 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#include <autoconf.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/util.h>
+
+#include <vmm/driver/virtio_console.h>
+#include <vmm/driver/virtio_queue.h>
+#include <ethdrivers/virtio/virtio_pci.h>
+#include <ethdrivers/virtio/virtio_config.h>
+
+#define RX_QUEUE 0
+#define TX_QUEUE 1
+
+#define HOST_FEATURES (BIT(VIRTIO_RING_F_EVENT_IDX))
+
+/* Device configuration starts after the legacy virtio registers */
+#define CONFIG_OFFSET 0x14
+
+typedef struct virtio_console_emul_internal {
+    int status;
+    uint16_t queue;
+    uint32_t guest_features;
+    vmm_virtqueue_t vq[2];
+    virtio_console_write_fn write;
+    void *write_cookie;
+    virtio_emul_irq_fn irq;
+    void *irq_cookie;
+    vspace_t guest_vspace;
+} virtio_console_emul_internal_t;
+
+static void console_publish(virtio_console_emul_internal_t *con, int queue) {
+    if (vmm_virtqueue_publish(&con->vq[queue])) {
+        con->irq(con->irq_cookie);
+    }
+}
+
+/* hands guest output straight to the backend without copying it */
+static int console_touch_write(uintptr_t phys, void *vaddr, size_t size, size_t offset, void *cookie) {
+    virtio_console_emul_internal_t *con = (virtio_console_emul_internal_t*)cookie;
+    con->write(con->write_cookie, vaddr, size);
+    return 0;
+}
+
+static void console_notify_tx(virtio_console_emul_internal_t *con) {
+    vmm_virtqueue_t *vq = &con->vq[TX_QUEUE];
+    uint16_t desc_head;
+    do {
+        while (vmm_virtqueue_pop(vq, &desc_head) == 0) {
+            struct vring_desc desc;
+            uint16_t desc_idx = desc_head;
+            int num_descs = 0;
+            do {
+                desc = vmm_virtqueue_desc(vq, desc_idx);
+                vmm_guest_vspace_touch(&con->guest_vspace, (uintptr_t)desc.addr, desc.len, console_touch_write, con);
+                desc_idx = desc.next;
+                num_descs++;
+            } while ((desc.flags & VRING_DESC_F_NEXT) && num_descs < vq->num);
+            vmm_virtqueue_used_add(vq, desc_head, 0);
+        }
+    } while (vmm_virtqueue_enable_notify(vq));
+    console_publish(con, TX_QUEUE);
+}
+
+size_t virtio_console_emul_putchars(virtio_console_emul_t *emul, const char *buf, size_t len) {
+    virtio_console_emul_internal_t *con = emul->internal;
+    vmm_virtqueue_t *vq = &con->vq[RX_QUEUE];
+    size_t done = 0;
+    uint16_t desc_head;
+    if (con->status != VIRTIO_CONFIG_S_DRIVER_OK) {
+        return 0;
+    }
+    while (done < len && vmm_virtqueue_pop(vq, &desc_head) == 0) {
+        /* fill as much of this chain as we can */
+        struct vring_desc desc;
+        uint16_t desc_idx = desc_head;
+        uint32_t written = 0;
+        int num_descs = 0;
+        do {
+            desc = vmm_virtqueue_desc(vq, desc_idx);
+            written += vmm_virtqueue_desc_write(vq, &desc, 0, buf + done + written, len - done - written);
+            desc_idx = desc.next;
+            num_descs++;
+        } while (done + written < len && (desc.flags & VRING_DESC_F_NEXT) && num_descs < vq->num);
+        vmm_virtqueue_used_add(vq, desc_head, written);
+        done += written;
+    }
+    console_publish(con, RX_QUEUE);
+    return done;
+}
+
+static int emul_io_in(struct virtio_console_emul *emul, unsigned int offset, unsigned int size, unsigned int *result) {
+    virtio_console_emul_internal_t *con = emul->internal;
+    switch(offset) {
+    case VIRTIO_PCI_HOST_FEATURES:
+        assert(size == 4);
+        *result = HOST_FEATURES;
+        break;
+    case VIRTIO_PCI_STATUS:
+        assert(size == 1);
+        *result = con->status;
+        break;
+    case VIRTIO_PCI_QUEUE_NUM:
+        assert(size == 2);
+        *result = con->vq[con->queue].num;
+        break;
+    case VIRTIO_PCI_QUEUE_PFN:
+        assert(size == 4);
+        *result = con->vq[con->queue].pfn;
+        break;
+    case VIRTIO_PCI_ISR:
+        assert(size == 1);
+        *result = 1;
+        break;
+    default:
+        if (offset >= CONFIG_OFFSET) {
+            /* config space is only used by features we do not offer */
+            *result = 0;
+            break;
+        }
+        printf("Unhandled offset of 0x%x of size %d, reading\n", offset, size);
+        assert(!"panic");
+    }
+    return 0;
+}
+
+static int emul_io_out(struct virtio_console_emul *emul, unsigned int offset, unsigned int size, unsigned int value) {
+    virtio_console_emul_internal_t *con = emul->internal;
+    switch(offset) {
+    case VIRTIO_PCI_GUEST_FEATURES:
+        assert(size == 4);
+        con->guest_features = value & HOST_FEATURES;
+        con->vq[RX_QUEUE].event_idx = !!(con->guest_features & BIT(VIRTIO_RING_F_EVENT_IDX));
+        con->vq[TX_QUEUE].event_idx = con->vq[RX_QUEUE].event_idx;
+        break;
+    case VIRTIO_PCI_STATUS:
+        assert(size == 1);
+        con->status = value & 0xff;
+        break;
+    case VIRTIO_PCI_QUEUE_SEL:
+        assert(size == 2);
+        con->queue = (value & 0xffff);
+        assert(con->queue == RX_QUEUE || con->queue == TX_QUEUE);
+        break;
+    case VIRTIO_PCI_QUEUE_PFN:
+        assert(size == 4);
+        vmm_virtqueue_set_pfn(&con->vq[con->queue], value);
+        break;
+    case VIRTIO_PCI_QUEUE_NOTIFY:
+        if (value == TX_QUEUE) {
+            console_notify_tx(con);
+        }
+        /* new receive buffers are picked up on the next putchars */
+        break;
+    default:
+        printf("Unhandled offset of 0x%x of size %d, writing 0x%x\n", offset, size, value);
+        assert(!"panic");
+    }
+    return 0;
+}
+
+virtio_console_emul_t *virtio_console_emul_init(int queue_size, vspace_t *guest_vspace,
+                                                virtio_console_write_fn write, void *write_cookie,
+                                                virtio_emul_irq_fn irq, void *irq_cookie) {
+    virtio_console_emul_t *emul = calloc(1, sizeof(*emul));
+    virtio_console_emul_internal_t *internal = calloc(1, sizeof(*internal));
+    if (!emul || !internal) {
+        ZF_LOGE("Failed to allocate virtio console device");
+        free(emul);
+        free(internal);
+        return NULL;
+    }
+    emul->internal = internal;
+    emul->io_in = emul_io_in;
+    emul->io_out = emul_io_out;
+    internal->write = write;
+    internal->write_cookie = write_cookie;
+    internal->irq = irq;
+    internal->irq_cookie = irq_cookie;
+    internal->guest_vspace = *guest_vspace;
+    vmm_virtqueue_init(&internal->vq[RX_QUEUE], &internal->guest_vspace, queue_size);
+    vmm_virtqueue_init(&internal->vq[TX_QUEUE], &internal->guest_vspace, queue_size);
+    return emul;
+}
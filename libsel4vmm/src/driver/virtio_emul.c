@@ -10,9 +10,11 @@
 
 #include <autoconf.h>
 
+#include <stddef.h>
 #include <string.h>
 
 #include <vmm/driver/virtio_emul.h>
+#include <vmm/driver/virtio_queue.h>
 #include <ethdrivers/virtio/virtio_pci.h>
 #include <ethdrivers/virtio/virtio_net.h>
 #include <ethdrivers/virtio/virtio_ring.h>
@@ -23,58 +25,104 @@
 
 #define BUF_SIZE 2048
 
+/* Feature bits we may not get from older copies of the virtio headers */
+#ifndef VIRTIO_NET_F_MRG_RXBUF
+#define VIRTIO_NET_F_MRG_RXBUF 15
+#endif
+
+#define HOST_FEATURES (BIT(VIRTIO_NET_F_MAC) | BIT(VIRTIO_NET_F_MRG_RXBUF) | BIT(VIRTIO_RING_F_EVENT_IDX))
+
+/* Header used in front of every packet when mergeable receive buffers
+ * have been negotiated */
+typedef struct emul_net_hdr_mrg {
+    struct virtio_net_hdr hdr;
+    uint16_t num_buffers;
+} emul_net_hdr_mrg_t;
+
+struct emul_buf_pool;
+
+/* A DMA buffer from the persistent pool. These are allocated and pinned
+ * once when the device is created and recycled for every packet */
+typedef struct emul_buf {
+    void *vaddr;
+    uintptr_t phys;
+    /* head of the descriptor chain that is waiting on this buffer */
+    uint16_t desc_head;
+    /* pool the buffer is returned to */
+    struct emul_buf_pool *pool;
+} emul_buf_t;
+
+/* A stack of free buffers. Receive and transmit have a pool each so that
+ * the driver holding every receive buffer cannot stall transmits */
+typedef struct emul_buf_pool {
+    emul_buf_t **free_bufs;
+    int num_bufs;
+    int num_free_bufs;
+} emul_buf_pool_t;
+
 typedef struct ethif_virtio_emul_internal {
     struct eth_driver driver;
     int status;
     uint8_t mac[6];
     uint16_t queue;
-    struct vring vring[2];
-    uint16_t queue_size[2];
-    uint32_t queue_pfn[2];
-    uint16_t last_idx[2];
+    uint32_t guest_features;
+    vmm_virtqueue_t vq[2];
+    /* scratch space for staging used elements of a mergeable receive */
+    struct vring_used_elem *rx_stage;
+    /* persistent packet buffers, split between the two pools */
+    emul_buf_t *bufs;
+    int num_bufs;
+    emul_buf_pool_t rx_pool;
+    emul_buf_pool_t tx_pool;
+    /* set whilst the driver is being polled, during which completions
+     * are only published to the guest once the poll is over */
+    int batching;
+    /* a transmit completed during the current batch */
+    int tx_completed;
     vspace_t guest_vspace;
     ps_dma_man_t dma_man;
 } ethif_virtio_emul_internal_t;
 
-typedef struct emul_tx_cookie {
-    uint16_t desc_head;
-    void *vaddr;
-} emul_tx_cookie_t;
-
-static int read_guest_mem(uintptr_t phys, void *vaddr, size_t size, size_t offset, void *cookie) {
-    memcpy(cookie + offset, vaddr, size);
-    return 0;
-}
-
 static int write_guest_mem(uintptr_t phys, void *vaddr, size_t size, size_t offset, void *cookie) {
     memcpy(vaddr, cookie + offset, size);
     return 0;
 }
 
-static uint16_t ring_avail_idx(ethif_virtio_emul_t *emul, struct vring *vring) {
-    uint16_t idx;
-    vmm_guest_vspace_touch(&emul->internal->guest_vspace, (uintptr_t)&vring->avail->idx, sizeof(vring->avail->idx), read_guest_mem, &idx);
-    return idx;
+static inline int has_feature(ethif_virtio_emul_internal_t *net, int feature) {
+    return !!(net->guest_features & BIT(feature));
+}
+
+/* Publish the used rings of both queues, interrupting the guest at most once */
+static void emul_flush(ethif_virtio_emul_internal_t *net) {
+    int irq = vmm_virtqueue_publish(&net->vq[RX_QUEUE]);
+    irq |= vmm_virtqueue_publish(&net->vq[TX_QUEUE]);
+    if (irq) {
+        /* notify the guest that there is something in its used ring */
+        net->driver.i_fn.raw_handleIRQ(&net->driver, 0);
+    }
 }
 
-static uint16_t ring_avail(ethif_virtio_emul_t *emul, struct vring *vring, uint16_t idx) {
-    uint16_t elem;
-    vmm_guest_vspace_touch(&emul->internal->guest_vspace, (uintptr_t)&(vring->avail->ring[idx % vring->num]), sizeof(elem), read_guest_mem, &elem);
-    return elem;
+/* Make completions visible to the guest, unless they are being batched up
+ * until the end of a poll */
+static void emul_publish(ethif_virtio_emul_internal_t *net) {
+    if (!net->batching) {
+        emul_flush(net);
+    }
 }
 
-static struct vring_desc ring_desc(ethif_virtio_emul_t *emul, struct vring *vring, uint16_t idx) {
-    struct vring_desc desc;
-    vmm_guest_vspace_touch(&emul->internal->guest_vspace, (uintptr_t)&(vring->desc[idx]), sizeof(desc), read_guest_mem, &desc);
-    return desc;
+static emul_buf_t *buf_get(emul_buf_pool_t *pool) {
+    if (pool->num_free_bufs == 0) {
+        return NULL;
+    }
+    pool->num_free_bufs--;
+    return pool->free_bufs[pool->num_free_bufs];
 }
 
-static void ring_used_add(ethif_virtio_emul_t *emul, struct vring *vring, struct vring_used_elem elem) {
-    uint16_t guest_idx;
-    vmm_guest_vspace_touch(&emul->internal->guest_vspace, (uintptr_t)&vring->used->idx, sizeof(vring->used->idx), read_guest_mem, &guest_idx);
-    vmm_guest_vspace_touch(&emul->internal->guest_vspace, (uintptr_t)&vring->used->ring[guest_idx % vring->num], sizeof(elem), write_guest_mem, &elem);
-    guest_idx++;
-    vmm_guest_vspace_touch(&emul->internal->guest_vspace, (uintptr_t)&vring->used->idx, sizeof(vring->used->idx), write_guest_mem, &guest_idx);
+static void buf_put(emul_buf_t *buf) {
+    emul_buf_pool_t *pool = buf->pool;
+    assert(pool->num_free_bufs < pool->num_bufs);
+    pool->free_bufs[pool->num_free_bufs] = buf;
+    pool->num_free_bufs++;
 }
 
 static uintptr_t emul_allocate_rx_buf(void *iface, size_t buf_size, void **cookie) {
@@ -83,184 +131,208 @@ static uintptr_t emul_allocate_rx_buf(void *iface, size_t buf_size, void **cooki
     if (buf_size > BUF_SIZE) {
         return 0;
     }
-    void *vaddr = ps_dma_alloc(&net->dma_man, BUF_SIZE, net->driver.dma_alignment, 1, PS_MEM_NORMAL);
-    if (!vaddr) {
+    emul_buf_t *buf = buf_get(&net->rx_pool);
+    if (!buf) {
         return 0;
     }
-    uintptr_t phys = ps_dma_pin(&net->dma_man, vaddr, BUF_SIZE);
-    *cookie = vaddr;
-    return phys;
+    *cookie = buf;
+    return buf->phys;
+}
+
+/* Describes the packet being written into guest receive buffers as a
+ * sequence of source chunks: the virtio header followed by each driver buffer */
+typedef struct rx_stream {
+    void *hdr;
+    size_t hdr_len;
+    unsigned int num_bufs;
+    void **cookies;
+    unsigned int *lens;
+    /* current chunk. -1 indicates the virtio net header */
+    int current;
+    /* how much of the current chunk has been written */
+    size_t written;
+} rx_stream_t;
+
+static int rx_stream_done(rx_stream_t *stream) {
+    return stream->current >= (int)stream->num_bufs;
+}
+
+/* Fill a single guest descriptor chain from the stream, returning how much was written */
+static uint32_t rx_fill_chain(ethif_virtio_emul_internal_t *net, uint16_t desc_head, rx_stream_t *stream) {
+    uint32_t tot_written = 0;
+    /* amount of the current descriptor written */
+    uint32_t desc_written = 0;
+    vmm_virtqueue_t *vq = &net->vq[RX_QUEUE];
+    struct vring_desc desc = vmm_virtqueue_desc(vq, desc_head);
+    while (!rx_stream_done(stream)) {
+        size_t chunk_len;
+        void *chunk;
+        if (stream->current == -1) {
+            chunk_len = stream->hdr_len;
+            chunk = stream->hdr;
+        } else {
+            chunk_len = stream->lens[stream->current];
+            chunk = ((emul_buf_t*)stream->cookies[stream->current])->vaddr;
+        }
+        uint32_t copy = vmm_virtqueue_desc_write(vq, &desc, desc_written, chunk + stream->written, chunk_len - stream->written);
+        tot_written += copy;
+        desc_written += copy;
+        stream->written += copy;
+        if (stream->written == chunk_len) {
+            stream->current++;
+            stream->written = 0;
+        }
+        if (desc_written == desc.len && !rx_stream_done(stream)) {
+            if (!(desc.flags & VRING_DESC_F_NEXT)) {
+                /* end of this chain */
+                break;
+            }
+            desc = vmm_virtqueue_desc(vq, desc.next);
+            desc_written = 0;
+        }
+    }
+    return tot_written;
 }
 
 static void emul_rx_complete(void *iface, unsigned int num_bufs, void **cookies, unsigned int *lens) {
     ethif_virtio_emul_t *emul = (ethif_virtio_emul_t*)iface;
     ethif_virtio_emul_internal_t *net = emul->internal;
-    unsigned int tot_len = 0;
+    vmm_virtqueue_t *vq = &net->vq[RX_QUEUE];
     int i;
-    struct vring *vring = &net->vring[RX_QUEUE];
-    for (i = 0; i < num_bufs; i++) {
-        tot_len += lens[i];
-    }
-    /* grab the next receive chain */
-    struct virtio_net_hdr virtio_hdr;
+    int mergeable = has_feature(net, VIRTIO_NET_F_MRG_RXBUF);
+    emul_net_hdr_mrg_t virtio_hdr;
     memset(&virtio_hdr, 0, sizeof(virtio_hdr));
-    uint16_t guest_idx = ring_avail_idx(emul, vring);
-    uint16_t idx = net->last_idx[RX_QUEUE];
-    if (idx != guest_idx) {
-        /* total length of the written packet so far */
-        size_t tot_written = 0;
-        /* amount of the current descriptor written */
-        size_t desc_written = 0;
-        /* how much we have written of the current buffer */
-        size_t buf_written = 0;
-        /* the current buffer. -1 indicates the virtio net buffer */
-        int current_buf = -1;
-        uint16_t desc_head = ring_avail(emul, vring, idx);
-        /* start walking the descriptors */
-        struct vring_desc desc;
-        uint16_t desc_idx = desc_head;
-        do {
-            desc = ring_desc(emul, vring, desc_idx);
-            /* determine how much we can copy */
-            uint32_t copy;
-            void *buf_base = NULL;
-            if (current_buf == -1) {
-                copy = sizeof(struct virtio_net_hdr) - buf_written;
-                buf_base = &virtio_hdr;
-            } else {
-                copy = lens[current_buf] - buf_written;
-                buf_base = cookies[current_buf];
-            }
-            copy = MIN(copy, desc.len - desc_written);
-            /* copy it */
-            vmm_guest_vspace_touch(&net->guest_vspace, (uintptr_t)desc.addr + desc_written, copy, write_guest_mem, buf_base + buf_written);
-            /* update amounts */
-            tot_written += copy;
-            desc_written += copy;
-            buf_written += copy;
-            /* see what's gone over */
-            if (desc_written == desc.len) {
-                if (!desc.flags & VRING_DESC_F_NEXT) {
-                    /* descriptor chain is too short to hold the whole packet.
-                     * just truncate */
+    rx_stream_t stream = {
+        .hdr = &virtio_hdr,
+        .hdr_len = mergeable ? sizeof(emul_net_hdr_mrg_t) : sizeof(struct virtio_net_hdr),
+        .num_bufs = num_bufs,
+        .cookies = cookies,
+        .lens = lens,
+        .current = -1,
+        .written = 0
+    };
+    uint16_t desc_head;
+    if (!mergeable) {
+        /* grab the next receive chain. if it is too short to hold the
+         * whole packet it just gets truncated */
+        if (vmm_virtqueue_pop(vq, &desc_head) == 0) {
+            uint32_t written = rx_fill_chain(net, desc_head, &stream);
+            vmm_virtqueue_used_add(vq, desc_head, written);
+        }
+    } else {
+        /* spread the packet over as many chains as it needs. nothing is
+         * committed until the whole packet has been placed, so if we run
+         * out of chains the packet is dropped */
+        uint16_t num_chains = 0;
+        uintptr_t hdr_addr = 0;
+        while (!rx_stream_done(&stream) && num_chains < vq->num && vmm_virtqueue_pop(vq, &desc_head) == 0) {
+            if (num_chains == 0) {
+                /* num_buffers is patched in place below, so the whole header
+                 * has to be in the first descriptor */
+                struct vring_desc head = vmm_virtqueue_desc(vq, desc_head);
+                if (head.len < sizeof(emul_net_hdr_mrg_t)) {
+                    ZF_LOGE("Receive buffer too small for the virtio net header, dropping packet");
+                    vmm_virtqueue_used_add(vq, desc_head, 0);
                     break;
                 }
-                desc_idx = desc.next;
-                desc_written = 0;
+                hdr_addr = head.addr;
             }
-            if (current_buf == -1) {
-                if (buf_written == sizeof(struct virtio_net_hdr)) {
-                    current_buf++;
-                    buf_written = 0;
-                }
-            } else {
-                if (buf_written == lens[current_buf]) {
-                    current_buf++;
-                    buf_written = 0;
-                }
+            uint32_t written = rx_fill_chain(net, desc_head, &stream);
+            net->rx_stage[num_chains] = (struct vring_used_elem) {desc_head, written};
+            num_chains++;
+        }
+        if (rx_stream_done(&stream)) {
+            /* now that we know how many buffers were used, patch the header */
+            uint16_t num_buffers = num_chains;
+            vmm_guest_vspace_touch(&net->guest_vspace, hdr_addr + offsetof(emul_net_hdr_mrg_t, num_buffers),
+                                   sizeof(num_buffers), write_guest_mem, &num_buffers);
+            for (i = 0; i < num_chains; i++) {
+                vmm_virtqueue_used_add(vq, net->rx_stage[i].id, net->rx_stage[i].len);
             }
-        } while (current_buf < num_bufs);
-        /* now put it in the used ring */
-        struct vring_used_elem used_elem = {desc_head, tot_written};
-        ring_used_add(emul, vring, used_elem);
-
-        /* record that we've used this descriptor chain now */
-        net->last_idx[RX_QUEUE]++;
-        /* notify the guest that there is something in its used ring */
-        net->driver.i_fn.raw_handleIRQ(&net->driver, 0);
+        } else {
+            vmm_virtqueue_unpop(vq, num_chains);
+        }
     }
+    vmm_virtqueue_enable_notify(vq);
+    emul_publish(net);
     for (i = 0; i < num_bufs; i++) {
-        ps_dma_unpin(&net->dma_man, cookies[i], BUF_SIZE);
-        ps_dma_free(&net->dma_man, cookies[i], BUF_SIZE);
+        buf_put((emul_buf_t*)cookies[i]);
     }
 }
 
 static void emul_tx_complete(void *iface, void *cookie) {
     ethif_virtio_emul_t *emul = (ethif_virtio_emul_t*)iface;
     ethif_virtio_emul_internal_t *net = emul->internal;
-    emul_tx_cookie_t *tx_cookie = (emul_tx_cookie_t*)cookie;
-    /* free the dma memory */
-    ps_dma_unpin(&net->dma_man, tx_cookie->vaddr, BUF_SIZE);
-    ps_dma_free(&net->dma_man, tx_cookie->vaddr, BUF_SIZE);
-    /* put the descriptor chain into the used list */
-    struct vring_used_elem used_elem = {tx_cookie->desc_head, 0};
-    ring_used_add(emul, &net->vring[TX_QUEUE], used_elem);
-    free(tx_cookie);
-    /* notify the guest that we have completed some of its buffers */
-    net->driver.i_fn.raw_handleIRQ(&net->driver, 0);
+    emul_buf_t *buf = (emul_buf_t*)cookie;
+    /* put the descriptor chain into the used list. this gets published
+     * to the guest by whoever is batching completions */
+    vmm_virtqueue_used_add(&net->vq[TX_QUEUE], buf->desc_head, 0);
+    buf_put(buf);
 }
 
 static void emul_notify_tx(ethif_virtio_emul_t *emul) {
     ethif_virtio_emul_internal_t *net = emul->internal;
-    struct vring *vring = &net->vring[TX_QUEUE];
-    /* read the index */
-    uint16_t guest_idx = ring_avail_idx(emul, vring);
-    /* process what we can of the ring */
-    uint16_t idx = net->last_idx[TX_QUEUE];
-    while (idx != guest_idx) {
+    vmm_virtqueue_t *vq = &net->vq[TX_QUEUE];
+    size_t hdr_len = has_feature(net, VIRTIO_NET_F_MRG_RXBUF) ? sizeof(emul_net_hdr_mrg_t) : sizeof(struct virtio_net_hdr);
+    do {
         uint16_t desc_head;
-        /* read the head of the descriptor chain */
-        desc_head = ring_avail(emul, vring, idx);
-        /* allocate a packet */
-        void *vaddr = ps_dma_alloc(&net->dma_man, BUF_SIZE, net->driver.dma_alignment, 1, PS_MEM_NORMAL);
-        if (!vaddr) {
-            /* try again later */
-            break;
-        }
-        uintptr_t phys = ps_dma_pin(&net->dma_man, vaddr, BUF_SIZE);
-        assert(phys);
-        /* length of the final packet to deliver */
-        uint32_t len = 0;
-        /* we want to skip the initial virtio header, as this should
-         * not be sent to the actual ethernet driver. This records
-         * how much we have skipped so far. */
-        uint32_t skipped = 0;
-        /* start walking the descriptors */
-        struct vring_desc desc;
-        uint16_t desc_idx = desc_head;
-        do {
-            desc = ring_desc(emul, vring, desc_idx);
-            uint32_t skip = 0;
-            /* if we haven't yet skipped the full virtio net header, work
-             * out how much of this descriptor should be skipped */
-            if (skipped < sizeof(struct virtio_net_hdr)) {
-                skip = MIN(sizeof(struct virtio_net_hdr) - skipped, desc.len);
-                skipped += skip;
+        emul_buf_t *buf;
+        /* process what we can of the ring */
+        while (net->tx_pool.num_free_bufs > 0 && vmm_virtqueue_pop(vq, &desc_head) == 0) {
+            /* grab a packet buffer */
+            buf = buf_get(&net->tx_pool);
+            /* length of the final packet to deliver */
+            uint32_t len = 0;
+            /* we want to skip the initial virtio header, as this should
+             * not be sent to the actual ethernet driver. This records
+             * how much we have skipped so far. */
+            uint32_t skipped = 0;
+            /* start walking the descriptors */
+            struct vring_desc desc;
+            uint16_t desc_idx = desc_head;
+            do {
+                desc = vmm_virtqueue_desc(vq, desc_idx);
+                uint32_t skip = 0;
+                /* if we haven't yet skipped the full virtio net header, work
+                 * out how much of this descriptor should be skipped */
+                if (skipped < hdr_len) {
+                    skip = MIN(hdr_len - skipped, desc.len);
+                    skipped += skip;
+                }
+                /* truncate packets that are too large */
+                len += vmm_virtqueue_desc_read(vq, &desc, skip, buf->vaddr + len, BUF_SIZE - len);
+                desc_idx = desc.next;
+            } while (desc.flags & VRING_DESC_F_NEXT);
+            /* ship it */
+            buf->desc_head = desc_head;
+            uintptr_t phys = buf->phys;
+            int result = net->driver.i_fn.raw_tx(&net->driver, 1, &phys, &len, buf);
+            switch (result) {
+            case ETHIF_TX_COMPLETE:
+                emul_tx_complete(emul, buf);
+                break;
+            case ETHIF_TX_FAILED:
+                buf_put(buf);
+                break;
             }
-            /* truncate packets that are too large */
-            uint32_t this_len = desc.len - skip;
-            this_len = MIN(BUF_SIZE - len, this_len);
-            vmm_guest_vspace_touch(&net->guest_vspace, (uintptr_t)desc.addr + skip, this_len, read_guest_mem, vaddr + len);
-            len += this_len;
-            desc_idx = desc.next;
-        } while (desc.flags & VRING_DESC_F_NEXT);
-        /* ship it */
-        emul_tx_cookie_t *cookie = malloc(sizeof(*cookie));
-        assert(cookie);
-        cookie->desc_head = desc_head;
-        cookie->vaddr = vaddr;
-        int result = net->driver.i_fn.raw_tx(&net->driver, 1, &phys, &len, cookie);
-        switch (result) {
-        case ETHIF_TX_COMPLETE:
-            emul_tx_complete(emul, cookie);
-            break;
-        case ETHIF_TX_FAILED:
-            ps_dma_unpin(&net->dma_man, vaddr, BUF_SIZE);
-            ps_dma_free(&net->dma_man, vaddr, BUF_SIZE);
-            free(cookie);
-            break;
         }
-        /* next */
-        idx++;
-    }
-    /* update which parts of the ring we have processed */
-    net->last_idx[TX_QUEUE] = idx;
+        /* if we ran out of buffers we will try again when a transmit completes */
+    } while (net->tx_pool.num_free_bufs > 0 && vmm_virtqueue_enable_notify(vq));
+    /* hand all the completed transmits back in one go */
+    emul_publish(net);
 }
 
 static void emul_tx_complete_external(void *iface, void *cookie) {
+    ethif_virtio_emul_t *emul = (ethif_virtio_emul_t*)iface;
     emul_tx_complete(iface, cookie);
-    /* space may have cleared for additional transmits */
-    emul_notify_tx(iface);
+    if (emul->internal->batching) {
+        /* retry transmits once, at the end of the poll */
+        emul->internal->tx_completed = 1;
+        return;
+    }
+    /* space may have cleared for additional transmits. this will
+     * also publish the completion we just added */
+    emul_notify_tx(emul);
 }
 
 static struct raw_iface_callbacks emul_callbacks = {
@@ -273,7 +345,7 @@ static int emul_io_in(struct ethif_virtio_emul *emul, unsigned int offset, unsig
     switch(offset) {
     case VIRTIO_PCI_HOST_FEATURES:
         assert(size == 4);
-        *result = BIT(VIRTIO_NET_F_MAC);
+        *result = HOST_FEATURES;
         break;
     case VIRTIO_PCI_STATUS:
         assert(size == 1);
@@ -281,7 +353,7 @@ static int emul_io_in(struct ethif_virtio_emul *emul, unsigned int offset, unsig
         break;
     case VIRTIO_PCI_QUEUE_NUM:
         assert(size == 2);
-        *result = emul->internal->queue_size[emul->internal->queue];
+        *result = emul->internal->vq[emul->internal->queue].num;
         break;
     case 0x14 ... 0x19:
         assert(size == 1);
@@ -289,7 +361,7 @@ static int emul_io_in(struct ethif_virtio_emul *emul, unsigned int offset, unsig
         break;
     case VIRTIO_PCI_QUEUE_PFN:
         assert(size == 4);
-        *result = emul->internal->queue_pfn[emul->internal->queue];
+        *result = emul->internal->vq[emul->internal->queue].pfn;
         break;
     case VIRTIO_PCI_ISR:
         assert(size == 1);
@@ -306,7 +378,10 @@ static int emul_io_out(struct ethif_virtio_emul *emul, unsigned int offset, unsi
     switch(offset) {
     case VIRTIO_PCI_GUEST_FEATURES:
         assert(size == 4);
-        assert(value == BIT(VIRTIO_NET_F_MAC));
+        assert(value & BIT(VIRTIO_NET_F_MAC));
+        emul->internal->guest_features = value & HOST_FEATURES;
+        emul->internal->vq[RX_QUEUE].event_idx = has_feature(emul->internal, VIRTIO_RING_F_EVENT_IDX);
+        emul->internal->vq[TX_QUEUE].event_idx = has_feature(emul->internal, VIRTIO_RING_F_EVENT_IDX);
         break;
     case VIRTIO_PCI_STATUS:
         assert(size == 1);
@@ -317,13 +392,10 @@ static int emul_io_out(struct ethif_virtio_emul *emul, unsigned int offset, unsi
         emul->internal->queue = (value & 0xffff);
         assert(emul->internal->queue == 0 || emul->internal->queue == 1);
         break;
-    case VIRTIO_PCI_QUEUE_PFN: {
+    case VIRTIO_PCI_QUEUE_PFN:
         assert(size == 4);
-        int queue = emul->internal->queue;
-        emul->internal->queue_pfn[queue] = value;
-        vring_init(&emul->internal->vring[queue], emul->internal->queue_size[queue], (void*)(value << 12), VIRTIO_PCI_VRING_ALIGN);
+        vmm_virtqueue_set_pfn(&emul->internal->vq[emul->internal->queue], value);
         break;
-    }
     case VIRTIO_PCI_QUEUE_NOTIFY:
         if (value == RX_QUEUE) {
             /* Currently RX packets will just get dropped if there was no space
@@ -340,6 +412,48 @@ static int emul_io_out(struct ethif_virtio_emul *emul, unsigned int offset, unsi
     return 0;
 }
 
+/* Allocate and pin the persistent packet buffers, enough for each queue to be
+ * full. Buffers are aligned to their own size, which satisfies the alignment of
+ * any driver we might sit on top of, so the pool can be created before the
+ * driver is */
+static int buf_pool_init(ethif_virtio_emul_internal_t *net, int queue_size) {
+    net->bufs = malloc(sizeof(*net->bufs) * queue_size * 2);
+    net->rx_pool.free_bufs = malloc(sizeof(*net->rx_pool.free_bufs) * queue_size);
+    net->tx_pool.free_bufs = malloc(sizeof(*net->tx_pool.free_bufs) * queue_size);
+    if (!net->bufs || !net->rx_pool.free_bufs || !net->tx_pool.free_bufs) {
+        return -1;
+    }
+    for (int i = 0; i < queue_size * 2; i++) {
+        emul_buf_t *buf = &net->bufs[i];
+        buf->vaddr = ps_dma_alloc(&net->dma_man, BUF_SIZE, BUF_SIZE, 1, PS_MEM_NORMAL);
+        if (!buf->vaddr) {
+            ZF_LOGE("Failed to allocate packet buffer %d of %d", i, queue_size * 2);
+            return -1;
+        }
+        buf->phys = ps_dma_pin(&net->dma_man, buf->vaddr, BUF_SIZE);
+        if (!buf->phys) {
+            ZF_LOGE("Failed to pin packet buffer");
+            ps_dma_free(&net->dma_man, buf->vaddr, BUF_SIZE);
+            return -1;
+        }
+        net->num_bufs++;
+        buf->pool = i < queue_size ? &net->rx_pool : &net->tx_pool;
+        buf->pool->num_bufs++;
+        buf_put(buf);
+    }
+    return 0;
+}
+
+static void buf_pool_destroy(ethif_virtio_emul_internal_t *net) {
+    for (int i = 0; i < net->num_bufs; i++) {
+        ps_dma_unpin(&net->dma_man, net->bufs[i].vaddr, BUF_SIZE);
+        ps_dma_free(&net->dma_man, net->bufs[i].vaddr, BUF_SIZE);
+    }
+    free(net->bufs);
+    free(net->rx_pool.free_bufs);
+    free(net->tx_pool.free_bufs);
+}
+
 static int emul_notify(ethif_virtio_emul_t *emul) {
     if (emul->internal->status != VIRTIO_CONFIG_S_DRIVER_OK) {
         return -1;
@@ -348,12 +462,31 @@ static int emul_notify(ethif_virtio_emul_t *emul) {
     return 0;
 }
 
+static int emul_poll(ethif_virtio_emul_t *emul) {
+    ethif_virtio_emul_internal_t *net = emul->internal;
+    if (!net->driver.i_fn.raw_poll) {
+        return -1;
+    }
+    net->batching = 1;
+    net->tx_completed = 0;
+    net->driver.i_fn.raw_poll(&net->driver);
+    net->batching = 0;
+    if (net->tx_completed) {
+        /* space cleared for more transmits. this also publishes everything
+         * completed during the poll */
+        emul_notify_tx(emul);
+    } else {
+        emul_flush(net);
+    }
+    return 0;
+}
+
 ethif_virtio_emul_t *ethif_virtio_emul_init(ps_io_ops_t io_ops, int queue_size, vspace_t *guest_vspace, ethif_driver_init driver, void *config) {
     ethif_virtio_emul_t *emul = NULL;
     ethif_virtio_emul_internal_t *internal = NULL;
     int err;
     emul = malloc(sizeof(*emul));
-    internal = malloc(sizeof(*internal));
+    internal = calloc(1, sizeof(*internal));
     if (!emul || !internal) {
         goto error;
     }
@@ -363,15 +496,22 @@ ethif_virtio_emul_t *ethif_virtio_emul_init(ps_io_ops_t io_ops, int queue_size,
     emul->io_in = emul_io_in;
     emul->io_out = emul_io_out;
     emul->notify = emul_notify;
-    internal->queue_size[RX_QUEUE] = queue_size;
-    internal->queue_size[TX_QUEUE] = queue_size;
-    /* create dummy rings. we never actually dereference the rings so they can be null */
-    vring_init(&internal->vring[RX_QUEUE], emul->internal->queue_size[RX_QUEUE], 0, VIRTIO_PCI_VRING_ALIGN);
-    vring_init(&internal->vring[TX_QUEUE], emul->internal->queue_size[RX_QUEUE], 0, VIRTIO_PCI_VRING_ALIGN);
+    emul->poll = emul_poll;
     internal->driver.cb_cookie = emul;
     internal->driver.i_cb = emul_callbacks;
     internal->guest_vspace = *guest_vspace;
+    vmm_virtqueue_init(&internal->vq[RX_QUEUE], &internal->guest_vspace, queue_size);
+    vmm_virtqueue_init(&internal->vq[TX_QUEUE], &internal->guest_vspace, queue_size);
     internal->dma_man = io_ops.dma_manager;
+    internal->rx_stage = malloc(sizeof(*internal->rx_stage) * queue_size);
+    if (!internal->rx_stage) {
+        goto error;
+    }
+    err = buf_pool_init(internal, queue_size);
+    if (err) {
+        ZF_LOGE("Failed to create packet buffer pool");
+        goto error;
+    }
     err = driver(&internal->driver, io_ops, config);
     if (err) {
         ZF_LOGE("Fafiled to initialize driver");
@@ -385,6 +525,8 @@ error:
         free(emul);
     }
     if (internal) {
+        buf_pool_destroy(internal);
+        free(internal->rx_stage);
         free(internal);
     }
     return NULL;
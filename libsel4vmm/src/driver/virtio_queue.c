@@ -0,0 +1,197 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+#include <autoconf.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/util.h>
+
+#include <vmm/driver/virtio_queue.h>
+#include <ethdrivers/virtio/virtio_pci.h>
+
+static int read_guest_mem(uintptr_t phys, void *vaddr, size_t size, size_t offset, void *cookie) {
+    memcpy(cookie + offset, vaddr, size);
+    return 0;
+}
+
+static int write_guest_mem(uintptr_t phys, void *vaddr, size_t size, size_t offset, void *cookie) {
+    memcpy(vaddr, cookie + offset, size);
+    return 0;
+}
+
+/* Returns a vmm pointer to an object inside the vring, or NULL if the ring
+ * has no direct mapping. Objects in the ring are naturally aligned and so
+ * never cross a page boundary */
+static inline void *ring_ptr(vmm_virtqueue_t *vq, void *guest_addr) {
+    if (!vq->ring_pages) {
+        return NULL;
+    }
+    uintptr_t offset = (uintptr_t)guest_addr - (uintptr_t)vq->vring.desc;
+    assert((offset >> 12) < vq->ring_num_pages);
+    return vq->ring_pages[offset >> 12] + (offset & MASK(12));
+}
+
+static void ring_read(vmm_virtqueue_t *vq, void *guest_addr, void *dest, size_t size) {
+    void *vaddr = ring_ptr(vq, guest_addr);
+    if (vaddr) {
+        memcpy(dest, vaddr, size);
+    } else {
+        vmm_guest_vspace_touch(vq->guest_vspace, (uintptr_t)guest_addr, size, read_guest_mem, dest);
+    }
+}
+
+static void ring_write(vmm_virtqueue_t *vq, void *guest_addr, void *src, size_t size) {
+    void *vaddr = ring_ptr(vq, guest_addr);
+    if (vaddr) {
+        memcpy(vaddr, src, size);
+    } else {
+        vmm_guest_vspace_touch(vq->guest_vspace, (uintptr_t)guest_addr, size, write_guest_mem, src);
+    }
+}
+
+/* Build the direct mappings for a vring that the guest has just placed. The
+ * ring is contiguous in guest physical memory but not necessarily in the vmm,
+ * so we remember where each page ended up */
+static void ring_map(vmm_virtqueue_t *vq) {
+    struct vring *vring = &vq->vring;
+    free(vq->ring_pages);
+    vq->ring_pages = NULL;
+    if (!vring->desc) {
+        return;
+    }
+    uintptr_t base = (uintptr_t)vring->desc;
+    /* the used ring, followed by the avail event index, is the last thing in the ring */
+    uintptr_t end = (uintptr_t)&vring->used->ring[vring->num] + sizeof(uint16_t);
+    int num_pages = ROUND_UP(end - base, BIT(12)) >> 12;
+    void **pages = malloc(sizeof(*pages) * num_pages);
+    if (!pages) {
+        ZF_LOGE("Failed to allocate vring page list, falling back to slow ring access");
+        return;
+    }
+    for (int i = 0; i < num_pages; i++) {
+        pages[i] = vmm_guest_vspace_translate(vq->guest_vspace, base + i * BIT(12));
+        if (!pages[i]) {
+            ZF_LOGE("Failed to translate vring page, falling back to slow ring access");
+            free(pages);
+            return;
+        }
+    }
+    vq->ring_pages = pages;
+    vq->ring_num_pages = num_pages;
+}
+
+void vmm_virtqueue_init(vmm_virtqueue_t *vq, vspace_t *guest_vspace, uint16_t num) {
+    memset(vq, 0, sizeof(*vq));
+    vq->guest_vspace = guest_vspace;
+    vq->num = num;
+    /* create a dummy ring. it is never dereferenced until the guest gives us a pfn */
+    vring_init(&vq->vring, num, 0, VIRTIO_PCI_VRING_ALIGN);
+}
+
+void vmm_virtqueue_set_pfn(vmm_virtqueue_t *vq, uint32_t pfn) {
+    vq->pfn = pfn;
+    vring_init(&vq->vring, vq->num, (void*)((uintptr_t)pfn << 12), VIRTIO_PCI_VRING_ALIGN);
+    /* a new ring starts with nothing used */
+    vq->last_idx = 0;
+    vq->used_idx = 0;
+    vq->used_published = 0;
+    ring_map(vq);
+}
+
+static uint16_t ring_avail_idx(vmm_virtqueue_t *vq) {
+    uint16_t idx;
+    ring_read(vq, &vq->vring.avail->idx, &idx, sizeof(idx));
+    /* order reading the index before reading any ring entries it covers */
+    __sync_synchronize();
+    return idx;
+}
+
+int vmm_virtqueue_pop(vmm_virtqueue_t *vq, uint16_t *desc_head) {
+    if (!vmm_virtqueue_ready(vq) || vq->last_idx == ring_avail_idx(vq)) {
+        return -1;
+    }
+    ring_read(vq, &vq->vring.avail->ring[vq->last_idx % vq->num], desc_head, sizeof(*desc_head));
+    vq->last_idx++;
+    return 0;
+}
+
+struct vring_desc vmm_virtqueue_desc(vmm_virtqueue_t *vq, uint16_t idx) {
+    struct vring_desc desc;
+    ring_read(vq, &vq->vring.desc[idx % vq->num], &desc, sizeof(desc));
+    return desc;
+}
+
+void vmm_virtqueue_used_add(vmm_virtqueue_t *vq, uint16_t desc_head, uint32_t len) {
+    struct vring_used_elem elem = {desc_head, len};
+    ring_write(vq, &vq->vring.used->ring[vq->used_idx % vq->num], &elem, sizeof(elem));
+    vq->used_idx++;
+}
+
+/* Same as vring_need_event from the virtio spec */
+static inline int need_event(uint16_t event_idx, uint16_t new_idx, uint16_t old_idx) {
+    return (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old_idx);
+}
+
+int vmm_virtqueue_publish(vmm_virtqueue_t *vq) {
+    struct vring *vring = &vq->vring;
+    uint16_t old_idx = vq->used_published;
+    uint16_t new_idx = vq->used_idx;
+    if (old_idx == new_idx) {
+        return 0;
+    }
+    /* used elements must be visible before the index that covers them */
+    __sync_synchronize();
+    ring_write(vq, &vring->used->idx, &new_idx, sizeof(new_idx));
+    vq->used_published = new_idx;
+    /* the guest may be updating its suppression state as we publish */
+    __sync_synchronize();
+    if (vq->event_idx) {
+        uint16_t used_event;
+        ring_read(vq, &vring->avail->ring[vq->num], &used_event, sizeof(used_event));
+        return need_event(used_event, new_idx, old_idx);
+    } else {
+        uint16_t flags;
+        ring_read(vq, &vring->avail->flags, &flags, sizeof(flags));
+        return !(flags & VRING_AVAIL_F_NO_INTERRUPT);
+    }
+}
+
+int vmm_virtqueue_enable_notify(vmm_virtqueue_t *vq) {
+    if (!vmm_virtqueue_ready(vq)) {
+        return 0;
+    }
+    if (vq->event_idx) {
+        uint16_t idx = vq->last_idx;
+        ring_write(vq, &vq->vring.used->ring[vq->num], &idx, sizeof(idx));
+        __sync_synchronize();
+    }
+    /* check that the guest didn't add anything whilst we were not looking */
+    return vq->last_idx != ring_avail_idx(vq);
+}
+
+size_t vmm_virtqueue_desc_read(vmm_virtqueue_t *vq, struct vring_desc *desc, size_t offset, void *buf, size_t len) {
+    if (offset >= desc->len) {
+        return 0;
+    }
+    len = MIN(len, desc->len - offset);
+    vmm_guest_vspace_touch(vq->guest_vspace, (uintptr_t)desc->addr + offset, len, read_guest_mem, buf);
+    return len;
+}
+
+size_t vmm_virtqueue_desc_write(vmm_virtqueue_t *vq, struct vring_desc *desc, size_t offset, const void *buf, size_t len) {
+    if (offset >= desc->len) {
+        return 0;
+    }
+    len = MIN(len, desc->len - offset);
+    vmm_guest_vspace_touch(vq->guest_vspace, (uintptr_t)desc->addr + offset, len, write_guest_mem, (void*)buf);
+    return len;
+}
@@ -24,6 +24,7 @@
 #include "vmm/platform/boot.h"
 #include "vmm/platform/guest_vspace.h"
 #include "vmm/processor/apicdef.h"
+#include "vmm/processor/decode.h"
 #include "vmm/processor/lapic.h"
 
 int vmm_init(vmm_t *vmm, simple_t simple, vka_t vka, vspace_t vspace, platform_callbacks_t callbacks) {
@@ -77,6 +78,10 @@ static int vmm_init_vcpu(vmm_t *vmm, unsigned int vcpu_num, int priority) {
 
     vcpu->vmm = vmm;
     vcpu->vcpu_id = vcpu_num;
+    vcpu->tlb.hits = 0;
+    vcpu->tlb.misses = 0;
+    vcpu->tlb.stale = 0;
+    vmm_guest_tlb_flush(vcpu);
 
     /* All LAPICs are created enabled, in virtual wire mode */
     vmm_create_lapic(vcpu, 1);
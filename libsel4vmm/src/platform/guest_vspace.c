@@ -180,3 +180,14 @@ int vmm_guest_vspace_touch(vspace_t *vspace, uintptr_t addr, size_t size, vmm_gu
     }
     return 0;
 }
+
+void *vmm_guest_vspace_translate(vspace_t *vspace, uintptr_t addr) {
+    struct sel4utils_alloc_data *data = get_alloc_data(vspace);
+    guest_vspace_t *guest_vspace = (guest_vspace_t*) data;
+    uintptr_t aligned = PAGE_ALIGN_4K(addr);
+    void *vaddr = (void*)sel4utils_get_cookie(&guest_vspace->translation_vspace, (void*)aligned);
+    if (!vaddr) {
+        return NULL;
+    }
+    return vaddr + (addr - aligned);
+}
@@ -21,6 +21,7 @@
 #include "vmm/platform/vmcs.h"
 
 #include "vmm/vmm.h"
+#include "vmm/processor/decode.h"
 
 static int vmm_cr_set_cr0(vmm_vcpu_t *vcpu, unsigned int value) {
 
@@ -39,6 +40,8 @@ static int vmm_cr_set_cr0(vmm_vcpu_t *vcpu, unsigned int value) {
         return 0;
 
     vmm_guest_state_set_cr0(&vcpu->guest_state, value);
+    /* paging may have been turned on or off */
+    vmm_guest_tlb_flush(vcpu);
 
     return 0;
 }
@@ -71,6 +74,8 @@ static int vmm_cr_set_cr4(vmm_vcpu_t *vcpu, unsigned int value) {
         return 0;
 
     vmm_guest_state_set_cr4(&vcpu->guest_state, value);
+    /* PSE or PAE may have changed */
+    vmm_guest_tlb_flush(vcpu);
 
     return 0;
 }
@@ -18,10 +18,14 @@ Author: W.A.
 #include <stdlib.h>
 #include <string.h>
 
+#include <utils/util.h>
+
 #include "vmm/debug.h"
 #include "vmm/platform/guest_vspace.h"
 #include "vmm/platform/guest_memory.h"
 #include "vmm/guest_state.h"
+#include "vmm/processor/decode.h"
+#include "vmm/processor/platfeature.h"
 
 /* TODO are these defined elsewhere? */
 #define IA32_PDE_SIZE(pde) (pde & BIT(7))
@@ -29,6 +33,9 @@ Author: W.A.
 #define IA32_PTE_ADDR(pte) (pte & 0xFFFFF000)
 #define IA32_PSE_ADDR(pde) (pde & 0xFFC00000)
 
+/* Entry address for PAE and long mode paging structures */
+#define IA32_PAE_ADDR(pte) (pte & 0x000FFFFFFFFFF000ull)
+#define IA32_PAE_CR3_ADDR(cr3) (cr3 & 0xFFFFFFE0)
 
 #define IA32_OPCODE_S(op) (op & BIT(0))
 #define IA32_OPCODE_D(op) (op & BIT(1))
@@ -47,38 +54,169 @@ inline static uint32_t guest_get_phys_word(vmm_t *vmm, uintptr_t addr) {
     return val;
 }
 
-/* Fetch a guest's instruction */
-int vmm_fetch_instruction(vmm_vcpu_t *vcpu, uint32_t eip, uintptr_t cr3,
-        int len, uint8_t *buf) {
-    /* Walk page tables to get physical address of instruction */
-    uintptr_t instr_phys = 0;
-
-    // TODO implement page-boundary crossing properly
-    assert((eip >> 12) == ((eip + len) >> 12));
+/* Get a 64-bit page table entry from a guest physical address */
+inline static uint64_t guest_get_phys_qword(vmm_t *vmm, uintptr_t addr) {
+    uint64_t val;
 
-    uint32_t pdi = eip >> 22;
-    uint32_t pti = (eip >> 12) & 0x3FF;
+    vmm_guest_vspace_touch(&vmm->guest_mem.vspace, addr, sizeof(uint64_t),
+            vmm_guest_get_phys_data_help, &val);
 
-    uint32_t pde = guest_get_phys_word(vcpu->vmm, cr3 + pdi * 4);
+    return val;
+}
 
-    assert(IA32_PDE_PRESENT(pde)); /* WTF? */
+/* Where a walk found the translation, so a cached translation can be checked
+ * against the guest page tables by reading just the leaf entry again */
+typedef struct guest_walk_leaf {
+    uint64_t addr;
+    int bytes;
+    uint64_t entry;
+} guest_walk_leaf_t;
+
+/* Walk 2-level 32-bit page tables */
+static int guest_walk_32(vmm_vcpu_t *vcpu, uintptr_t cr3, uint32_t vaddr, uint64_t *paddr,
+        guest_walk_leaf_t *leaf) {
+    uint32_t pdi = vaddr >> 22;
+    uint32_t pti = (vaddr >> 12) & 0x3FF;
+
+    uintptr_t pde_addr = IA32_PTE_ADDR(cr3) + pdi * 4;
+    uint32_t pde = guest_get_phys_word(vcpu->vmm, pde_addr);
+    if (!IA32_PDE_PRESENT(pde)) {
+        return -1;
+    }
 
     if (IA32_PDE_SIZE(pde)) {
         /* PSE is used, 4M pages */
-        instr_phys = (uintptr_t)IA32_PSE_ADDR(pde) + (eip & 0x3FFFFF);
-    } else {
-        /* 4k pages */
-        uint32_t pte = guest_get_phys_word(vcpu->vmm,
-                (uintptr_t)IA32_PTE_ADDR(pde) + pti * 4);
+        *paddr = (uintptr_t)IA32_PSE_ADDR(pde) + (vaddr & 0x3FFFFF);
+        *leaf = (guest_walk_leaf_t) {.addr = pde_addr, .bytes = 4, .entry = pde};
+        return 0;
+    }
+
+    /* 4k pages */
+    uintptr_t pte_addr = (uintptr_t)IA32_PTE_ADDR(pde) + pti * 4;
+    uint32_t pte = guest_get_phys_word(vcpu->vmm, pte_addr);
+    if (!IA32_PDE_PRESENT(pte)) {
+        return -1;
+    }
+
+    *paddr = (uintptr_t)IA32_PTE_ADDR(pte) + (vaddr & 0xFFF);
+    *leaf = (guest_walk_leaf_t) {.addr = pte_addr, .bytes = 4, .entry = pte};
+    return 0;
+}
+
+/* Walk PAE (levels == 3) or 4-level (levels == 4) page tables. Each level
+ * resolves 9 bits, except the top PAE level which resolves 2 */
+static int guest_walk_pae(vmm_vcpu_t *vcpu, uintptr_t cr3, uint64_t vaddr, int levels, uint64_t *paddr,
+        guest_walk_leaf_t *leaf) {
+    uint64_t table = (levels == 3) ? IA32_PAE_CR3_ADDR(cr3) : IA32_PTE_ADDR(cr3);
+
+    for (int level = levels; level > 0; level--) {
+        int shift = 12 + 9 * (level - 1);
+        int index = (vaddr >> shift) & MASK(9);
+        uint64_t entry_addr = table + index * 8;
+        uint64_t entry = guest_get_phys_qword(vcpu->vmm, entry_addr);
+
+        if (!IA32_PDE_PRESENT(entry)) {
+            return -1;
+        }
+        *leaf = (guest_walk_leaf_t) {.addr = entry_addr, .bytes = 8, .entry = entry};
+        /* 1G and 2M pages. PAE PDPTEs have no size bit */
+        if ((level == 2 || (level == 3 && levels == 4)) && IA32_PDE_SIZE(entry)) {
+            *paddr = (IA32_PAE_ADDR(entry) & ~(uint64_t)MASK(shift)) + (vaddr & MASK(shift));
+            return 0;
+        }
+        table = IA32_PAE_ADDR(entry);
+    }
+
+    *paddr = table + (vaddr & 0xFFF);
+    return 0;
+}
+
+/* Translate a guest virtual address with whatever paging mode the guest is
+ * in. Returns 1 if paging is off, as there is then no leaf entry */
+static int guest_walk(vmm_vcpu_t *vcpu, uintptr_t cr3, uint32_t vaddr, uint64_t *paddr,
+        guest_walk_leaf_t *leaf) {
+    guest_state_t *gs = &vcpu->guest_state;
+    uint32_t cr0 = vmm_guest_state_get_cr0(gs, vcpu->guest_vcpu);
+
+    if (!(cr0 & X86_CR0_PG)) {
+        *paddr = vaddr;
+        return 1;
+    }
+
+    uint32_t cr4 = vmm_guest_state_get_cr4(gs, vcpu->guest_vcpu);
+    if (!(cr4 & X86_CR4_PAE)) {
+        return guest_walk_32(vcpu, cr3, vaddr, paddr, leaf);
+    }
 
-        assert(IA32_PDE_PRESENT(pte));
+    /* Long mode needs EFER.LME, and EFER writes are not emulated (see
+     * vmm_wrmsr_handler), so a guest with PAE on is always using 3-level
+     * tables */
+    return guest_walk_pae(vcpu, cr3, vaddr, 3, paddr, leaf);
+}
+
+void vmm_guest_tlb_flush(vmm_vcpu_t *vcpu) {
+    for (int i = 0; i < VMM_GUEST_TLB_ENTRIES; i++) {
+        vcpu->tlb.entries[i].valid = 0;
+    }
+}
 
-        instr_phys = (uintptr_t)IA32_PTE_ADDR(pte) + (eip & 0xFFF);
+/* Translate a guest virtual address, using the software TLB if the leaf entry
+ * of the cached translation has not changed */
+static int guest_translate(vmm_vcpu_t *vcpu, uintptr_t cr3, uint32_t vaddr, uint64_t *paddr) {
+    uint32_t vpn = vaddr >> 12;
+    vmm_guest_tlb_entry_t *entry = &vcpu->tlb.entries[vpn & (VMM_GUEST_TLB_ENTRIES - 1)];
+
+    if (entry->valid && entry->vpn == vpn && entry->cr3 == cr3) {
+        uint64_t leaf = (entry->leaf_bytes == 8) ? guest_get_phys_qword(vcpu->vmm, entry->leaf_addr) :
+                        guest_get_phys_word(vcpu->vmm, entry->leaf_addr);
+        if (leaf == entry->leaf) {
+            vcpu->tlb.hits++;
+            *paddr = entry->paddr + (vaddr & 0xFFF);
+            return 0;
+        }
+        vcpu->tlb.stale++;
+        entry->valid = 0;
     }
 
-    /* Fetch instruction */
-    vmm_guest_vspace_touch(&vcpu->vmm->guest_mem.vspace, instr_phys, len,
-            vmm_guest_get_phys_data_help, buf);
+    vcpu->tlb.misses++;
+    guest_walk_leaf_t leaf;
+    int error = guest_walk(vcpu, cr3, vaddr, paddr, &leaf);
+    if (error) {
+        /* unmapped, or paging is off and there is nothing to cache */
+        return (error == 1) ? 0 : -1;
+    }
+
+    entry->valid = 1;
+    entry->vpn = vpn;
+    entry->cr3 = cr3;
+    entry->leaf_addr = leaf.addr;
+    entry->leaf_bytes = leaf.bytes;
+    entry->leaf = leaf.entry;
+    entry->paddr = *paddr & ~0xFFFull;
+    return 0;
+}
+
+/* Fetch a guest's instruction */
+int vmm_fetch_instruction(vmm_vcpu_t *vcpu, uint32_t eip, uintptr_t cr3,
+        int len, uint8_t *buf) {
+    /* The instruction may cross into a page that is not physically
+     * contiguous, so translate and fetch each page separately */
+    while (len > 0) {
+        uint64_t instr_phys;
+        int chunk = MIN(len, 0x1000 - (eip & 0xFFF));
+
+        if (guest_translate(vcpu, cr3, eip, &instr_phys)) {
+            ZF_LOGE("Instruction fetch from unmapped address 0x%x", eip);
+            return -1;
+        }
+
+        vmm_guest_vspace_touch(&vcpu->vmm->guest_mem.vspace, instr_phys, chunk,
+                vmm_guest_get_phys_data_help, buf);
+
+        eip += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
 
     return 0;
 }
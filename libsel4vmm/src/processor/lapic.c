@@ -46,6 +46,10 @@
 #define APIC_DEST_MASK          0x800
 #define MAX_APIC_VECTOR         256
 #define APIC_VECTORS_PER_REG        32
+/* vector registers are 32 bits each but spaced 16 bytes apart */
+#define VEC_POS(v) ((v) & (APIC_VECTORS_PER_REG - 1))
+#define REG_POS(v) (((v) >> 5) << 4)
+#define REG_BANK(v) ((v) >> 5)
 
 inline static int pic_get_interrupt(vmm_t *vmm)
 {
@@ -127,9 +131,14 @@ inline uint32_t vmm_apic_get_reg(vmm_lapic_t *apic, int reg_off)
     return *((uint32_t *) (apic->regs + reg_off));
 }
 
+static inline uint32_t *apic_vector_reg(int vec, void *bitmap)
+{
+    return (uint32_t *)(bitmap + REG_POS(vec));
+}
+
 static inline int apic_test_vector(int vec, void *bitmap)
 {
-    return ((1UL << (vec & 31)) & ((uint32_t *)bitmap)[vec >> 5]) != 0;
+    return (BIT(VEC_POS(vec)) & *apic_vector_reg(vec, bitmap)) != 0;
 }
 
 bool vmm_apic_pending_eoi(vmm_vcpu_t *vcpu, int vector)
@@ -140,14 +149,20 @@ bool vmm_apic_pending_eoi(vmm_vcpu_t *vcpu, int vector)
         apic_test_vector(vector, apic->regs + APIC_IRR);
 }
 
-static inline void apic_set_vector(int vec, void *bitmap)
+/* Set a vector, recording its bank in the summary of non empty banks */
+static inline void apic_set_vector(int vec, void *bitmap, uint8_t *summary)
 {
-    ((uint32_t *)bitmap)[vec >> 5] |= 1UL << (vec & 31);
+    *apic_vector_reg(vec, bitmap) |= BIT(VEC_POS(vec));
+    *summary |= BIT(REG_BANK(vec));
 }
 
-static inline void apic_clear_vector(int vec, void *bitmap)
+static inline void apic_clear_vector(int vec, void *bitmap, uint8_t *summary)
 {
-    ((uint32_t *)bitmap)[vec >> 5] &= ~(1UL << (vec & 31));
+    uint32_t *reg = apic_vector_reg(vec, bitmap);
+    *reg &= ~BIT(VEC_POS(vec));
+    if (!*reg) {
+        *summary &= ~BIT(REG_BANK(vec));
+    }
 }
 
 inline int vmm_apic_sw_enabled(vmm_lapic_t *apic)
@@ -228,62 +243,55 @@ int vmm_apic_compare_prio(vmm_vcpu_t *vcpu1, vmm_vcpu_t *vcpu2)
 static void UNUSED dump_vector(const char *name, void *bitmap)
 {
     int vec;
-    uint32_t *reg = bitmap;
     
     printf("%s = 0x", name);
 
     for (vec = MAX_APIC_VECTOR - APIC_VECTORS_PER_REG;
             vec >= 0; vec -= APIC_VECTORS_PER_REG) {
-        printf("%08x", reg[vec >> 5]);
+        printf("%08x", *apic_vector_reg(vec, bitmap));
     }
 
     printf("\n");
 }
 
-
-static int find_highest_vector(void *bitmap)
+/* Find the highest set vector. Only the bank named by the summary
+ * needs to be looked at, so this is constant time */
+static int find_highest_vector(void *bitmap, uint8_t summary)
 {
     int vec;
-    uint32_t *reg = bitmap;
 
-    for (vec = MAX_APIC_VECTOR - APIC_VECTORS_PER_REG;
-         vec >= 0; vec -= APIC_VECTORS_PER_REG) {
-        if (reg[vec >> 5])
-            return fls(reg[vec >> 5]) - 1 + vec;
-    }
+    if (!summary)
+        return -1;
 
-    return -1;
+    vec = (fls(summary) - 1) * APIC_VECTORS_PER_REG;
+    return fls(*apic_vector_reg(vec, bitmap)) - 1 + vec;
 }
 
 static uint8_t UNUSED count_vectors(void *bitmap)
 {
     int vec;
-    uint32_t *reg = bitmap;
     uint8_t count = 0;
 
     for (vec = 0; vec < MAX_APIC_VECTOR; vec += APIC_VECTORS_PER_REG) {
-        count += hweight32(reg[vec >> 5]);
+        count += hweight32(*apic_vector_reg(vec, bitmap));
     }
 
     return count;
 }
 
-static inline int apic_search_irr(vmm_lapic_t *apic)
+#ifdef CONFIG_LIB_VMM_LAPIC_STATS
+static inline uint64_t apic_rdtsc(void)
 {
-    return find_highest_vector(apic->regs + APIC_IRR);
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
 }
+#endif
 
 static inline int apic_find_highest_irr(vmm_lapic_t *apic)
 {
-    int result;
-
-    if (!apic->irr_pending)
-        return -1;
-
-    result = apic_search_irr(apic);
-    assert(result == -1 || result >= 16);
-
-    return result;
+    assert(apic->highest_irr_cache == -1 || apic->highest_irr_cache >= 16);
+    return apic->highest_irr_cache;
 }
 
 static inline void apic_set_irr(int vec, vmm_lapic_t *apic)
@@ -292,16 +300,22 @@ static inline void apic_set_irr(int vec, vmm_lapic_t *apic)
         apic_debug(5, "!settting irr 0x%x\n", vec);
     }
 
-    apic->irr_pending = true;
-    apic_set_vector(vec, apic->regs + APIC_IRR);
+#ifdef CONFIG_LIB_VMM_LAPIC_STATS
+    if (!apic_test_vector(vec, apic->regs + APIC_IRR)) {
+        apic->stats.pending_since[vec] = apic_rdtsc();
+    }
+#endif
+    apic_set_vector(vec, apic->regs + APIC_IRR, &apic->irr_summary);
+    apic->highest_irr_cache = MAX(apic->highest_irr_cache, vec);
 }
 
 static inline void apic_clear_irr(int vec, vmm_lapic_t *apic)
 {
-    apic_clear_vector(vec, apic->regs + APIC_IRR);
+    apic_clear_vector(vec, apic->regs + APIC_IRR, &apic->irr_summary);
     
-    vec = apic_search_irr(apic);
-    apic->irr_pending = (vec != -1);
+    if (vec == apic->highest_irr_cache) {
+        apic->highest_irr_cache = find_highest_vector(apic->regs + APIC_IRR, apic->irr_summary);
+    }
 }
 
 static inline void apic_set_isr(int vec, vmm_lapic_t *apic)
@@ -309,7 +323,7 @@ static inline void apic_set_isr(int vec, vmm_lapic_t *apic)
     if (apic_test_vector(vec, apic->regs + APIC_ISR)) {
         return;
     }
-    apic_set_vector(vec, apic->regs + APIC_ISR);
+    apic_set_vector(vec, apic->regs + APIC_ISR, &apic->isr_summary);
 
     ++apic->isr_count;
     /*
@@ -317,25 +331,13 @@ static inline void apic_set_isr(int vec, vmm_lapic_t *apic)
      * The highest vector is injected. Thus the latest bit set matches
      * the highest bit in ISR.
      */
+    apic->highest_isr_cache = MAX(apic->highest_isr_cache, vec);
 }
 
 static inline int apic_find_highest_isr(vmm_lapic_t *apic)
 {
-    int result;
-
-    /*
-     * Note that isr_count is always 1, and highest_isr_cache
-     * is always -1, with APIC virtualization enabled.
-     */
-    if (!apic->isr_count)
-        return -1;
-    if (apic->highest_isr_cache != -1)
-        return apic->highest_isr_cache;
-
-    result = find_highest_vector(apic->regs + APIC_ISR);
-    assert(result == -1 || result >= 16);
-
-    return result;
+    assert(apic->highest_isr_cache == -1 || apic->highest_isr_cache >= 16);
+    return apic->highest_isr_cache;
 }
 
 static inline void apic_clear_isr(int vec, vmm_lapic_t *apic)
@@ -343,10 +345,12 @@ static inline void apic_clear_isr(int vec, vmm_lapic_t *apic)
     if (!apic_test_vector(vec, apic->regs + APIC_ISR)) {
         return;
     }
-    apic_clear_vector(vec, apic->regs + APIC_ISR);
+    apic_clear_vector(vec, apic->regs + APIC_ISR, &apic->isr_summary);
 
     --apic->isr_count;
-    apic->highest_isr_cache = -1;
+    if (vec == apic->highest_isr_cache) {
+        apic->highest_isr_cache = find_highest_vector(apic->regs + APIC_ISR, apic->isr_summary);
+    }
 }
 
 int vmm_lapic_find_highest_irr(vmm_vcpu_t *vcpu)
@@ -939,7 +943,9 @@ void vmm_lapic_reset(vmm_vcpu_t *vcpu)
         apic_set_reg(apic, APIC_ISR + 0x10 * i, 0);
         apic_set_reg(apic, APIC_TMR + 0x10 * i, 0);
     }
-    apic->irr_pending = 0;
+    apic->irr_summary = 0;
+    apic->isr_summary = 0;
+    apic->highest_irr_cache = -1;
     apic->isr_count = 0;
     apic->highest_isr_cache = -1;
     apic_update_ppr(vcpu);
@@ -970,7 +976,7 @@ int vmm_create_lapic(vmm_vcpu_t *vcpu, int enabled)
     assert(vcpu != NULL);
     apic_debug(2, "apic_init %d\n", vcpu->vcpu_id);
 
-    apic = malloc(sizeof(*apic));
+    apic = calloc(1, sizeof(*apic));
     if (!apic)
         goto nomem;
 
@@ -1022,12 +1028,40 @@ int vmm_apic_get_interrupt(vmm_vcpu_t *vcpu)
         return -1;
     }
 
+#ifdef CONFIG_LIB_VMM_LAPIC_STATS
+    uint64_t latency = apic_rdtsc() - apic->stats.pending_since[vector];
+    apic->stats.injections++;
+    apic->stats.total_latency += latency;
+    apic->stats.max_latency = MAX(apic->stats.max_latency, latency);
+#endif
+
     apic_set_isr(vector, apic);
     apic_update_ppr(vcpu);
     apic_clear_irr(vector, apic);
     return vector;
 }
 
+#ifdef CONFIG_LIB_VMM_LAPIC_STATS
+void vmm_apic_get_latency_stats(vmm_vcpu_t *vcpu, uint64_t *injections,
+        uint64_t *total_latency, uint64_t *max_latency)
+{
+    vmm_lapic_t *apic = vcpu->lapic;
+
+    *injections = apic->stats.injections;
+    *total_latency = apic->stats.total_latency;
+    *max_latency = apic->stats.max_latency;
+}
+
+void vmm_apic_reset_latency_stats(vmm_vcpu_t *vcpu)
+{
+    vmm_lapic_t *apic = vcpu->lapic;
+
+    apic->stats.injections = 0;
+    apic->stats.total_latency = 0;
+    apic->stats.max_latency = 0;
+}
+#endif
+
 /* Return which vector is next up for servicing */
 int vmm_apic_has_interrupt(vmm_vcpu_t *vcpu)
 {
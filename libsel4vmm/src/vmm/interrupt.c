@@ -14,6 +14,7 @@
 #include <stdlib.h>
 
 #include <sel4/sel4.h>
+#include <utils/util.h>
 
 #include "vmm/debug.h"
 #include "vmm/vmm.h"
@@ -115,8 +116,11 @@ void vmm_start_ap_vcpu(vmm_vcpu_t *vcpu, unsigned int sipi_vector)
 
     /* Emulate up to 100 bytes of trampoline code */
     uint8_t instr[TRAMPOLINE_LENGTH];
-    vmm_fetch_instruction(vcpu, eip, vmm_guest_state_get_cr3(gs, vcpu->guest_vcpu),
-            TRAMPOLINE_LENGTH, instr);
+    if (vmm_fetch_instruction(vcpu, eip, vmm_guest_state_get_cr3(gs, vcpu->guest_vcpu),
+            TRAMPOLINE_LENGTH, instr)) {
+        ZF_LOGE("Failed to fetch trampoline code for vcpu %d", vcpu->vcpu_id);
+        return;
+    }
     
     eip = vmm_emulate_realmode(&vcpu->vmm->guest_mem, instr, &segment, eip,
             TRAMPOLINE_LENGTH, gs);
@@ -133,14 +137,20 @@ void vmm_start_ap_vcpu(vmm_vcpu_t *vcpu, unsigned int sipi_vector)
 /* Got interrupt(s) from PIC, propagate to relevant vcpu lapic */
 void vmm_check_external_interrupt(vmm_t *vmm)
 {
-    /* TODO if all lapics are enabled, store which lapic
-       (only one allowed) receives extints, and short circuit this */
     if (vmm->plat_callbacks.has_interrupt() != -1) {
+        /* Only one VCPU can take a PIC interrupt, and it is almost always
+           the same one as last time, so try that first */
+        if (vmm->extint_vcpu < vmm->num_vcpus &&
+                vmm_apic_accept_pic_intr(&vmm->vcpus[vmm->extint_vcpu])) {
+            vmm_vcpu_accept_interrupt(&vmm->vcpus[vmm->extint_vcpu]);
+            return;
+        }
         for (int i = 0; i < vmm->num_vcpus; i++) {
             vmm_vcpu_t *vcpu = &vmm->vcpus[i];
             if (vmm_apic_accept_pic_intr(vcpu)) {
+                vmm->extint_vcpu = i;
                 vmm_vcpu_accept_interrupt(vcpu);
-                break; /* Only one VCPU can take a PIC interrupt */
+                break;
             } 
         }
     }
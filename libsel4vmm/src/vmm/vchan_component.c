@@ -16,6 +16,9 @@
 
 static libvchan_t *vchan_init(int domain, int port, int server);
 static int libvchan_readwrite_action(libvchan_t *ctrl, void *data, size_t size, int stream, int action);
+static int libvchan_readwritev_action(libvchan_t *ctrl, const struct iovec *iov, int iovcnt, int stream, int action);
+
+compile_time_assert(vchan_buf_size_pow2, (VCHAN_BUF_SIZE & VCHAN_BUF_MASK) == 0);
 
 static camkes_vchan_con_t *vchan_comp_con = NULL;
 
@@ -104,6 +107,14 @@ int libvchan_recv(libvchan_t *ctrl, void *data, size_t size) {
     return libvchan_readwrite_action(ctrl, data, size, 1, VCHAN_RECV);
 }
 
+int libvchan_writev(libvchan_t *ctrl, const struct iovec *iov, int iovcnt) {
+    return libvchan_readwritev_action(ctrl, iov, iovcnt, 1, VCHAN_SEND);
+}
+
+int libvchan_readv(libvchan_t *ctrl, const struct iovec *iov, int iovcnt) {
+    return libvchan_readwritev_action(ctrl, iov, iovcnt, 1, VCHAN_RECV);
+}
+
 /*
     Return correct buffer for given vchan read/write action
 */
@@ -141,105 +152,140 @@ vchan_buf_t *get_vchan_ctrl_databuf(libvchan_t *ctrl, int action) {
 }
 
 /*
-    Perform a vchan read/write action into a given buffer
-     This function is intended for non Init components, Init components have a different method
+    How much can be done for the given action without blocking.
+    The acquire on the peer's position pairs with the release in vchan_publish,
+    so that anything the peer did before moving its position is visible to us
 */
-int libvchan_readwrite_action(libvchan_t *ctrl, void *data, size_t size, int stream, int action) {
-    int *update;
-    vchan_buf_t *b = get_vchan_ctrl_databuf(ctrl, action);
-    if(b == NULL) {
-        return -1;
+static inline size_t vchan_available(vchan_buf_t *b, int action) {
+    if(action == VCHAN_SEND) {
+        uint32_t read_pos = __atomic_load_n(&b->read_pos, __ATOMIC_ACQUIRE);
+        return VCHAN_BUF_SIZE - (b->write_pos - read_pos);
+    } else {
+        uint32_t write_pos = __atomic_load_n(&b->write_pos, __ATOMIC_ACQUIRE);
+        return write_pos - b->read_pos;
     }
+}
 
-    /*
-        How data is stored in a given vchan buffer
-
-        Position of data in buffer is given by
-            (either b->write_pos or b->read_pos) % VCHAN_BUF_SIZE
-            read_pos is incremented by x when x bytes are read from the buffer
-            write_pos is incremented by x when x bytes are read from the buffer
-
-        Amount of bytes in buffer is given by the difference between read_pos and write_pos
-            if write_pos > read_pos, there is data yet to be read
-    */
-    size_t filled = abs(b->write_pos - b->read_pos);
-    if(action == VCHAN_SEND) {
-        while(filled == VCHAN_BUF_SIZE) {
+/*
+    Block until the given action can make progress.
+    We advertise that we are about to sleep and then check again before
+    waiting, so that the peer either sees the flag or we see its update
+*/
+static size_t vchan_wait_available(libvchan_t *ctrl, vchan_buf_t *b, int action) {
+    uint32_t *waiting = (action == VCHAN_SEND) ? &b->writer_waiting : &b->reader_waiting;
+    uint32_t *features = (action == VCHAN_SEND) ? &b->writer_features : &b->reader_features;
+    size_t avail = vchan_available(b, action);
+    while(avail == 0) {
+        __atomic_store_n(features, VCHAN_FEATURE_WAIT_FLAGS, __ATOMIC_RELAXED);
+        __atomic_store_n(waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        avail = vchan_available(b, action);
+        if(avail == 0) {
             ctrl->con->wait();
-            filled = abs(b->write_pos - b->read_pos);
-        }
-
-        if(stream) {
-            size = MIN(VCHAN_BUF_SIZE - filled, size);
-        } else if(size > VCHAN_BUF_SIZE - filled) {
-            return -1;
+            avail = vchan_available(b, action);
         }
+        __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+    }
+    return avail;
+}
 
-        update = &b->write_pos;
+/*
+    Make a new position visible to the peer, alerting it only if it is asleep.
+    A peer that does not advertise waiting flags is always alerted
+*/
+static void vchan_publish(libvchan_t *ctrl, vchan_buf_t *b, int action, uint32_t pos) {
+    uint32_t *peer_waiting, *peer_features;
+    if(action == VCHAN_SEND) {
+        __atomic_store_n(&b->write_pos, pos, __ATOMIC_RELEASE);
+        peer_waiting = &b->reader_waiting;
+        peer_features = &b->reader_features;
     } else {
-        while(filled == 0) {
-            ctrl->con->wait();
-            filled = abs(b->write_pos - b->read_pos);
-        }
-
-        if(stream) {
-            size = MIN(filled, size);
-        } else if(size > filled) {
-            return -1;
-        }
-
-        update = &b->read_pos;
+        __atomic_store_n(&b->read_pos, pos, __ATOMIC_RELEASE);
+        peer_waiting = &b->writer_waiting;
+        peer_features = &b->writer_features;
     }
+    /* order our position update against reading the peer's flag */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(!(__atomic_load_n(peer_features, __ATOMIC_RELAXED) & VCHAN_FEATURE_WAIT_FLAGS) ||
+            __atomic_load_n(peer_waiting, __ATOMIC_RELAXED)) {
+        ctrl->con->alert();
+    }
+}
 
-    /*
-        Because this buffer is circular,
-            data may have to wrap around to the start of the buffer
-            This is achieved by doing two copies, one to buffer end
-            And one at start of buffer for remaining data
+/*
+    Copy between a linear buffer and the ring starting at the free running
+    position pos. Data may have to wrap around to the start of the ring,
+    which is done with a second copy
 
-        E.g if buffer size = 12
-        and if write pos = 7 && number of bytes to write = 8
+    E.g if buffer size = 12
+    and if write pos = 7 && number of bytes to write = 8
 
-        Start:
-                write_pos
-                    V
-            [oooooooooooo]
-        End:
+    Start:
             write_pos
                 V
-            [xxxooooxxxxx]
+        [oooooooooooo]
+    End:
+        write_pos
+            V
+        [xxxooooxxxxx]
+*/
+static void vchan_ring_copy(vchan_buf_t *b, uint32_t pos, void *data, size_t size, int action) {
+    size_t start = pos & VCHAN_BUF_MASK;
+    size_t first = MIN(size, VCHAN_BUF_SIZE - start);
+    void *dbuf = &b->sync_data;
 
-    */
-    off_t start = (*update % VCHAN_BUF_SIZE);
-    off_t remain = 0;
+    if(action == VCHAN_SEND) {
+        memcpy(dbuf + start, data, first);
+        memcpy(dbuf, data + first, size - first);
+    } else {
+        memcpy(data, dbuf + start, first);
+        memcpy(data + first, dbuf, size - first);
+    }
+}
 
-    if(start + size > VCHAN_BUF_SIZE) {
-        remain = (start + size) - VCHAN_BUF_SIZE;
-        size -= remain;
+/*
+    Perform a vchan read/write action into a given set of buffers
+     This function is intended for non Init components, Init components have a different method
+*/
+int libvchan_readwritev_action(libvchan_t *ctrl, const struct iovec *iov, int iovcnt, int stream, int action) {
+    vchan_buf_t *b = get_vchan_ctrl_databuf(ctrl, action);
+    if(b == NULL) {
+        return -1;
     }
 
-    void *dbuf = &b->sync_data;
+    size_t size = 0;
+    for(int i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
 
-    if(action == VCHAN_SEND) {
-        memcpy(dbuf + start, data, size);
-        memcpy(dbuf, data + size, remain);
-    } else {
-        memcpy(data, ((void *) dbuf) + start, size);
-        memcpy(data + size, dbuf, remain);
+    size_t avail = vchan_wait_available(ctrl, b, action);
+    if(stream) {
+        size = MIN(avail, size);
+    } else if(size > avail) {
+        return -1;
     }
-    __sync_synchronize();
 
-    /*
-        Update either the read byte counter or the written byte counter
-            With how much was written or read
-    */
-    *update += (size + remain);
+    /* we are the only writer of our own position */
+    uint32_t pos = (action == VCHAN_SEND) ? b->write_pos : b->read_pos;
+    size_t done = 0;
+    for(int i = 0; i < iovcnt && done < size; i++) {
+        size_t len = MIN(iov[i].iov_len, size - done);
+        vchan_ring_copy(b, pos + done, iov[i].iov_base, len, action);
+        done += len;
+    }
 
-    ctrl->con->alert();
+    vchan_publish(ctrl, b, action, pos + done);
 
-    return (size + remain);
+    return done;
 }
 
+int libvchan_readwrite_action(libvchan_t *ctrl, void *data, size_t size, int stream, int action) {
+    struct iovec iov = {
+        .iov_base = data,
+        .iov_len = size,
+    };
+    return libvchan_readwritev_action(ctrl, &iov, 1, stream, action);
+}
 
 /*
     Wait for data to arrive to a component from a given vchan
@@ -248,12 +294,7 @@ int libvchan_wait(libvchan_t *ctrl) {
     vchan_buf_t *b = get_vchan_ctrl_databuf(ctrl, VCHAN_RECV);
     assert(b != NULL);
 
-    size_t filled = abs(b->write_pos - b->read_pos);
-    while(filled == 0) {
-        ctrl->con->wait();
-        b = get_vchan_ctrl_databuf(ctrl, VCHAN_RECV);
-        filled = abs(b->write_pos - b->read_pos);
-    }
+    vchan_wait_available(ctrl, b, VCHAN_RECV);
 
     return 0;
 }
@@ -288,8 +329,7 @@ int libvchan_is_open(libvchan_t *ctrl) {
 */
 int libvchan_data_ready(libvchan_t *ctrl) {
     vchan_buf_t *b = get_vchan_ctrl_databuf(ctrl, VCHAN_RECV);
-    size_t filled = abs(b->write_pos - b->read_pos);
-    return filled;
+    return vchan_available(b, VCHAN_RECV);
 }
 
 /*
@@ -297,6 +337,5 @@ int libvchan_data_ready(libvchan_t *ctrl) {
 */
 int libvchan_buffer_space(libvchan_t *ctrl) {
     vchan_buf_t *b = get_vchan_ctrl_databuf(ctrl, VCHAN_SEND);
-    size_t filled = abs(b->write_pos - b->read_pos);
-    return VCHAN_BUF_SIZE - filled;
+    return vchan_available(b, VCHAN_SEND);
 }
@@ -0,0 +1,627 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(NICTA_GPL)
+ */
+
+/* Tests for the virtio-blk and virtio-console emulations and the ramdisk
+ * block store, run on the host. A simulated guest driver places requests in
+ * a flat buffer that is its own guest physical address space, and checks
+ * what the device leaves in the used ring and in guest memory. Everything is
+ * run both with the vrings mapped directly and with every ring access going
+ * through vmm_guest_vspace_touch. Also checks that virtio-net never writes a
+ * mergeable receive header past the end of the guest's first buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vmm/driver/block_store.h>
+#include <vmm/driver/virtio_blk.h>
+#include <vmm/driver/virtio_console.h>
+#include <vmm/driver/virtio_emul.h>
+#include <ethdrivers/virtio/virtio_pci.h>
+#include <ethdrivers/virtio/virtio_net.h>
+#include <ethdrivers/virtio/virtio_ring.h>
+#include <ethdrivers/virtio/virtio_config.h>
+
+#define PAGE_SIZE 4096
+#define GUEST_MEM_SIZE (4 * 1024 * 1024)
+#define QUEUE_SIZE 64
+/* the second queue of a device goes after the first */
+#define RING_PFN 1
+#define RING2_PFN 16
+#define DATA 0x100000
+
+#define CONFIG_OFFSET 0x14
+#define SECTORS 64
+
+/* Definitions from the virtio block specification */
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+#define VIRTIO_BLK_T_GET_ID 8
+
+#define VIRTIO_BLK_S_OK 0
+#define VIRTIO_BLK_S_IOERR 1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed%s: %s\n", __FILE__, __LINE__, direct_rings ? "" : " (touched rings)", #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long _a = (long)(a), _b = (long)(b); \
+    if (_a != _b) { \
+        printf("%s:%d: %s is %ld, expected %ld%s\n", __FILE__, __LINE__, #a, _a, _b, \
+               direct_rings ? "" : " (touched rings)"); \
+        failures++; \
+    } \
+} while (0)
+
+typedef struct guest_blk_req_hdr {
+    uint32_t type;
+    uint32_t ioprio;
+    uint64_t sector;
+} guest_blk_req_hdr_t;
+
+/* Header the guest gets in front of packets with mergeable receive buffers */
+typedef struct guest_net_hdr {
+    struct virtio_net_hdr hdr;
+    uint16_t num_buffers;
+} guest_net_hdr_t;
+
+static int failures;
+static int irqs;
+
+/* Guest memory */
+
+static char *guest_mem;
+/* whether the vmm can translate guest memory, letting the vrings be mapped directly */
+static int direct_rings;
+/* next free guest memory for buffers */
+static uintptr_t guest_next;
+
+int vmm_guest_vspace_touch(vspace_t *guest_vspace, uintptr_t addr, size_t size, vmm_guest_vspace_touch_callback callback, void *cookie) {
+    char *mem = guest_vspace->data;
+    size_t offset = 0;
+    while (offset < size) {
+        uintptr_t current = addr + offset;
+        size_t len = MIN(size - offset, PAGE_SIZE - (current % PAGE_SIZE));
+        assert(current + len <= GUEST_MEM_SIZE);
+        int result = callback(current, mem + current, len, offset, cookie);
+        if (result) {
+            return result;
+        }
+        offset += len;
+    }
+    return 0;
+}
+
+void *vmm_guest_vspace_translate(vspace_t *guest_vspace, uintptr_t addr) {
+    if (!direct_rings || addr >= GUEST_MEM_SIZE) {
+        return NULL;
+    }
+    return (char*)guest_vspace->data + addr;
+}
+
+static void guest_reset(void) {
+    memset(guest_mem, 0, GUEST_MEM_SIZE);
+    guest_next = DATA;
+    irqs = 0;
+}
+
+static uintptr_t guest_alloc(size_t size) {
+    uintptr_t addr = guest_next;
+    guest_next += size;
+    assert(guest_next <= GUEST_MEM_SIZE);
+    return addr;
+}
+
+static void count_irq(void *cookie) {
+    irqs++;
+}
+
+/* Guest driver side of a queue */
+
+typedef struct guest_queue {
+    struct vring vring;
+    uint16_t avail_idx;
+    uint16_t last_used;
+    uint16_t next_desc;
+} guest_queue_t;
+
+static void guest_queue_init(guest_queue_t *q, uint32_t pfn) {
+    vring_init(&q->vring, QUEUE_SIZE, guest_mem + pfn * PAGE_SIZE, VIRTIO_PCI_VRING_ALIGN);
+    assert(pfn * PAGE_SIZE + vring_size(QUEUE_SIZE, VIRTIO_PCI_VRING_ALIGN) <= RING2_PFN * PAGE_SIZE ||
+           pfn >= RING2_PFN);
+    q->avail_idx = 0;
+    q->last_used = 0;
+    q->next_desc = 0;
+}
+
+/* Add a chain of n buffers, returning its head. Nothing is visible to the
+ * device until the next kick */
+static uint16_t guest_add_chain(guest_queue_t *q, int n, const uintptr_t *addrs, const uint32_t *lens, uint16_t flags) {
+    uint16_t head = q->next_desc % QUEUE_SIZE;
+    for (int i = 0; i < n; i++) {
+        uint16_t desc = (head + i) % QUEUE_SIZE;
+        q->vring.desc[desc] = (struct vring_desc) {
+            .addr = addrs[i],
+            .len = lens[i],
+            .flags = flags | (i < n - 1 ? VRING_DESC_F_NEXT : 0),
+            .next = (desc + 1) % QUEUE_SIZE
+        };
+    }
+    q->next_desc += n;
+    q->vring.avail->ring[q->avail_idx % QUEUE_SIZE] = head;
+    q->avail_idx++;
+    return head;
+}
+
+static void guest_kick(guest_queue_t *q) {
+    __sync_synchronize();
+    q->vring.avail->idx = q->avail_idx;
+    __sync_synchronize();
+}
+
+/* Take the next used element, or NULL if the device has not published one.
+ * Like most drivers, the guest asks for an interrupt on the next one */
+static struct vring_used_elem *guest_get_used(guest_queue_t *q) {
+    if (q->last_used == q->vring.used->idx) {
+        return NULL;
+    }
+    struct vring_used_elem *elem = &q->vring.used->ring[q->last_used++ % QUEUE_SIZE];
+    vring_used_event(&q->vring) = q->last_used;
+    return elem;
+}
+
+static void fill(uintptr_t addr, size_t len, int seed) {
+    for (size_t i = 0; i < len; i++) {
+        guest_mem[addr + i] = (char)(i * 7 + seed);
+    }
+}
+
+static int filled(const char *buf, size_t len, int seed) {
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] != (char)(i * 7 + seed)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Ramdisk */
+
+static void test_ramdisk(void) {
+    vmm_block_store_t store;
+    char buf[2 * VMM_BLOCK_SECTOR_SIZE];
+
+    CHECK(vmm_block_store_ramdisk_init(&store, VMM_BLOCK_SECTOR_SIZE + 1) != 0);
+    CHECK_EQ(vmm_block_store_ramdisk_init(&store, SECTORS * VMM_BLOCK_SECTOR_SIZE), 0);
+    CHECK_EQ(store.size, SECTORS * VMM_BLOCK_SECTOR_SIZE);
+    CHECK(store.flush == NULL);
+
+    CHECK_EQ(store.read(store.cookie, 5 * VMM_BLOCK_SECTOR_SIZE, buf, sizeof(buf)), 0);
+    CHECK(buf[0] == 0 && buf[sizeof(buf) - 1] == 0);
+    for (int i = 0; i < sizeof(buf); i++) {
+        buf[i] = (char)(i * 7 + 1);
+    }
+    CHECK_EQ(store.write(store.cookie, 100, buf, sizeof(buf)), 0);
+    memset(buf, 0, sizeof(buf));
+    CHECK_EQ(store.read(store.cookie, 100, buf, sizeof(buf)), 0);
+    CHECK(filled(buf, sizeof(buf), 1));
+    free(store.cookie);
+}
+
+/* virtio-blk */
+
+static int flushes;
+
+static int count_flush(void *cookie) {
+    flushes++;
+    return 0;
+}
+
+static virtio_blk_emul_t *blk_setup(vmm_block_store_t *store, guest_queue_t *q, int event_idx) {
+    vspace_t guest_vspace = { .data = guest_mem };
+    guest_reset();
+    virtio_blk_emul_t *emul = virtio_blk_emul_init(QUEUE_SIZE, &guest_vspace, store, count_irq, NULL);
+    assert(emul);
+    unsigned int features;
+    emul->io_in(emul, VIRTIO_PCI_HOST_FEATURES, 4, &features);
+    if (!event_idx) {
+        features &= ~BIT(VIRTIO_RING_F_EVENT_IDX);
+    }
+    emul->io_out(emul, VIRTIO_PCI_GUEST_FEATURES, 4, features);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_SEL, 2, 0);
+    guest_queue_init(q, RING_PFN);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_PFN, 4, RING_PFN);
+    emul->io_out(emul, VIRTIO_PCI_STATUS, 1, VIRTIO_CONFIG_S_DRIVER_OK);
+    return emul;
+}
+
+typedef struct blk_req {
+    uint16_t head;
+    uintptr_t status;
+} blk_req_t;
+
+/* Queue a request with the header and status each in their own descriptor and
+ * the data at data, split into descriptors of the given lengths */
+static blk_req_t blk_queue(guest_queue_t *q, uint32_t type, uint64_t sector, uintptr_t data, int n, const uint32_t *lens) {
+    uintptr_t addrs[QUEUE_SIZE];
+    uint32_t desc_lens[QUEUE_SIZE];
+    assert(n + 2 <= QUEUE_SIZE);
+    blk_req_t req;
+    guest_blk_req_hdr_t hdr = { .type = type, .sector = sector };
+    addrs[0] = guest_alloc(sizeof(hdr));
+    desc_lens[0] = sizeof(hdr);
+    memcpy(guest_mem + addrs[0], &hdr, sizeof(hdr));
+    for (int i = 0; i < n; i++) {
+        addrs[i + 1] = data;
+        desc_lens[i + 1] = lens[i];
+        data += lens[i];
+    }
+    req.status = guest_alloc(1);
+    guest_mem[req.status] = 0xff;
+    addrs[n + 1] = req.status;
+    desc_lens[n + 1] = 1;
+    /* the device only reads the header, but the write flag is not checked */
+    req.head = guest_add_chain(q, n + 2, addrs, desc_lens, 0);
+    return req;
+}
+
+static void blk_notify(virtio_blk_emul_t *emul, guest_queue_t *q) {
+    guest_kick(q);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_NOTIFY, 2, 0);
+}
+
+/* Check the next used element is req, with the given length and status */
+static void blk_check_done(guest_queue_t *q, blk_req_t req, uint32_t len, uint8_t status) {
+    struct vring_used_elem *elem = guest_get_used(q);
+    CHECK(elem != NULL);
+    if (elem) {
+        CHECK_EQ(elem->id, req.head);
+        CHECK_EQ(elem->len, len);
+    }
+    CHECK_EQ((uint8_t)guest_mem[req.status], status);
+}
+
+/* data spread over descriptors of uneven sizes, some crossing pages */
+static void test_blk_read_write(void) {
+    vmm_block_store_t store;
+    guest_queue_t q;
+    char buf[4096];
+    vmm_block_store_ramdisk_init(&store, SECTORS * VMM_BLOCK_SECTOR_SIZE);
+    virtio_blk_emul_t *emul = blk_setup(&store, &q, 1);
+
+    unsigned int capacity;
+    emul->io_in(emul, CONFIG_OFFSET, 4, &capacity);
+    CHECK_EQ(capacity, SECTORS);
+    emul->io_in(emul, CONFIG_OFFSET + 4, 4, &capacity);
+    CHECK_EQ(capacity, 0);
+
+    uint32_t write_lens[] = {700, 3000, 396};
+    uintptr_t out = guest_alloc(4096);
+    fill(out, 4096, 3);
+    blk_req_t req = blk_queue(&q, VIRTIO_BLK_T_OUT, 3, out, 3, write_lens);
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, 1, VIRTIO_BLK_S_OK);
+    store.read(store.cookie, 3 * VMM_BLOCK_SECTOR_SIZE, buf, sizeof(buf));
+    CHECK(filled(buf, sizeof(buf), 3));
+    store.read(store.cookie, 2 * VMM_BLOCK_SECTOR_SIZE, buf, VMM_BLOCK_SECTOR_SIZE);
+    CHECK(buf[0] == 0 && buf[VMM_BLOCK_SECTOR_SIZE - 1] == 0);
+
+    uint32_t read_lens[] = {512, 1, 3583};
+    uintptr_t in = guest_alloc(4096);
+    req = blk_queue(&q, VIRTIO_BLK_T_IN, 3, in, 3, read_lens);
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, 4096 + 1, VIRTIO_BLK_S_OK);
+    CHECK(filled(guest_mem + in, 4096, 3));
+
+    /* the header, data and status can also share a single descriptor */
+    uintptr_t all = guest_alloc(sizeof(guest_blk_req_hdr_t) + VMM_BLOCK_SECTOR_SIZE + 1);
+    guest_blk_req_hdr_t hdr = { .type = VIRTIO_BLK_T_IN, .sector = 4 };
+    memcpy(guest_mem + all, &hdr, sizeof(hdr));
+    uint32_t all_len = sizeof(hdr) + VMM_BLOCK_SECTOR_SIZE + 1;
+    req.head = guest_add_chain(&q, 1, &all, &all_len, 0);
+    req.status = all + all_len - 1;
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, VMM_BLOCK_SECTOR_SIZE + 1, VIRTIO_BLK_S_OK);
+    CHECK(filled(guest_mem + all + sizeof(hdr), VMM_BLOCK_SECTOR_SIZE, 3 + 7 * VMM_BLOCK_SECTOR_SIZE));
+    CHECK_EQ(irqs, 3);
+    free(store.cookie);
+}
+
+static void test_blk_flush_and_errors(void) {
+    vmm_block_store_t store;
+    guest_queue_t q;
+    vmm_block_store_ramdisk_init(&store, SECTORS * VMM_BLOCK_SECTOR_SIZE);
+    store.flush = count_flush;
+    flushes = 0;
+    virtio_blk_emul_t *emul = blk_setup(&store, &q, 1);
+
+    blk_req_t req = blk_queue(&q, VIRTIO_BLK_T_FLUSH, 0, 0, 0, NULL);
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, 1, VIRTIO_BLK_S_OK);
+    CHECK_EQ(flushes, 1);
+
+    /* reads that run off the end of the store fail without touching it */
+    uint32_t len = 2 * VMM_BLOCK_SECTOR_SIZE;
+    uintptr_t data = guest_alloc(len);
+    req = blk_queue(&q, VIRTIO_BLK_T_IN, SECTORS - 1, data, 1, &len);
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, 1, VIRTIO_BLK_S_IOERR);
+
+    req = blk_queue(&q, 99, 0, data, 1, &len);
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, 1, VIRTIO_BLK_S_UNSUPP);
+
+    uint32_t id_len = 20;
+    req = blk_queue(&q, VIRTIO_BLK_T_GET_ID, 0, data, 1, &id_len);
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, id_len + 1, VIRTIO_BLK_S_OK);
+    CHECK(strcmp(guest_mem + data, "sel4-vmm-blk") == 0);
+    free(store.cookie);
+
+    /* a store without a flush function is always durable */
+    vmm_block_store_ramdisk_init(&store, SECTORS * VMM_BLOCK_SECTOR_SIZE);
+    emul = blk_setup(&store, &q, 1);
+    req = blk_queue(&q, VIRTIO_BLK_T_FLUSH, 0, 0, 0, NULL);
+    blk_notify(emul, &q);
+    blk_check_done(&q, req, 1, VIRTIO_BLK_S_OK);
+    free(store.cookie);
+}
+
+/* everything outstanding at a notify completes as one batch */
+static void test_blk_batching(void) {
+    vmm_block_store_t store;
+    guest_queue_t q;
+    blk_req_t reqs[8];
+    uint32_t len = VMM_BLOCK_SECTOR_SIZE;
+
+    for (int event_idx = 0; event_idx < 2; event_idx++) {
+        vmm_block_store_ramdisk_init(&store, SECTORS * VMM_BLOCK_SECTOR_SIZE);
+        virtio_blk_emul_t *emul = blk_setup(&store, &q, event_idx);
+        for (int i = 0; i < 8; i++) {
+            uintptr_t data = guest_alloc(len);
+            fill(data, len, i);
+            reqs[i] = blk_queue(&q, VIRTIO_BLK_T_OUT, i, data, 1, &len);
+        }
+        blk_notify(emul, &q);
+        CHECK_EQ(q.vring.used->idx, 8);
+        CHECK_EQ(irqs, 1);
+        for (int i = 0; i < 8; i++) {
+            blk_check_done(&q, reqs[i], 1, VIRTIO_BLK_S_OK);
+        }
+        if (event_idx) {
+            /* the device asks to be notified of the next request */
+            CHECK_EQ(vring_avail_event(&q.vring), 8);
+        }
+
+        /* suppressed interrupts */
+        if (event_idx) {
+            vring_used_event(&q.vring) = q.last_used + 4;
+        } else {
+            q.vring.avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+        }
+        for (int i = 0; i < 4; i++) {
+            uintptr_t data = guest_alloc(len);
+            reqs[i] = blk_queue(&q, VIRTIO_BLK_T_IN, i, data, 1, &len);
+        }
+        blk_notify(emul, &q);
+        CHECK_EQ(q.vring.used->idx, 12);
+        CHECK_EQ(irqs, 1);
+        for (int i = 0; i < 4; i++) {
+            blk_check_done(&q, reqs[i], len + 1, VIRTIO_BLK_S_OK);
+        }
+        free(store.cookie);
+    }
+}
+
+/* virtio-console */
+
+static char console_out[256];
+static size_t console_out_len;
+
+static void console_write(void *cookie, const char *buf, size_t len) {
+    assert(console_out_len + len <= sizeof(console_out));
+    memcpy(console_out + console_out_len, buf, len);
+    console_out_len += len;
+}
+
+static virtio_console_emul_t *console_setup(guest_queue_t *rx, guest_queue_t *tx) {
+    vspace_t guest_vspace = { .data = guest_mem };
+    guest_reset();
+    console_out_len = 0;
+    virtio_console_emul_t *emul = virtio_console_emul_init(QUEUE_SIZE, &guest_vspace, console_write, NULL,
+                                                           count_irq, NULL);
+    assert(emul);
+    unsigned int features;
+    emul->io_in(emul, VIRTIO_PCI_HOST_FEATURES, 4, &features);
+    emul->io_out(emul, VIRTIO_PCI_GUEST_FEATURES, 4, features);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_SEL, 2, 0);
+    guest_queue_init(rx, RING_PFN);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_PFN, 4, RING_PFN);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_SEL, 2, 1);
+    guest_queue_init(tx, RING2_PFN);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_PFN, 4, RING2_PFN);
+    return emul;
+}
+
+static uintptr_t guest_string(const char *s) {
+    uintptr_t addr = guest_alloc(strlen(s));
+    memcpy(guest_mem + addr, s, strlen(s));
+    return addr;
+}
+
+static void test_console_output(void) {
+    guest_queue_t rx, tx;
+    virtio_console_emul_t *emul = console_setup(&rx, &tx);
+    emul->io_out(emul, VIRTIO_PCI_STATUS, 1, VIRTIO_CONFIG_S_DRIVER_OK);
+
+    /* the last part straddles a page boundary */
+    uintptr_t parts[] = {guest_string("hello"), guest_string(", "), PAGE_SIZE * 2 - 2};
+    memcpy(guest_mem + parts[2], "world", 5);
+    uint32_t lens[] = {5, 2, 5};
+    uint16_t first = guest_add_chain(&tx, 3, parts, lens, 0);
+    uintptr_t end = guest_string("!\n");
+    uint32_t end_len = 2;
+    uint16_t second = guest_add_chain(&tx, 1, &end, &end_len, 0);
+    guest_kick(&tx);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_NOTIFY, 2, 1);
+
+    CHECK_EQ(console_out_len, 14);
+    CHECK(memcmp(console_out, "hello, world!\n", 14) == 0);
+    struct vring_used_elem *elem = guest_get_used(&tx);
+    CHECK(elem && elem->id == first && elem->len == 0);
+    elem = guest_get_used(&tx);
+    CHECK(elem && elem->id == second && elem->len == 0);
+    CHECK(guest_get_used(&tx) == NULL);
+    CHECK_EQ(irqs, 1);
+}
+
+static void test_console_input(void) {
+    guest_queue_t rx, tx;
+    virtio_console_emul_t *emul = console_setup(&rx, &tx);
+    const char *input = "abcdefghijklmnopqrst";
+
+    uintptr_t bufs[4];
+    uint32_t lens[4];
+    for (int i = 0; i < 4; i++) {
+        bufs[i] = guest_alloc(4);
+        lens[i] = 4;
+    }
+    uint16_t first = guest_add_chain(&rx, 2, &bufs[0], &lens[0], VRING_DESC_F_WRITE);
+    uint16_t second = guest_add_chain(&rx, 2, &bufs[2], &lens[2], VRING_DESC_F_WRITE);
+    guest_kick(&rx);
+
+    /* nothing is delivered until the driver is ready */
+    CHECK_EQ(virtio_console_emul_putchars(emul, input, 20), 0);
+    emul->io_out(emul, VIRTIO_PCI_STATUS, 1, VIRTIO_CONFIG_S_DRIVER_OK);
+
+    CHECK_EQ(virtio_console_emul_putchars(emul, input, 20), 16);
+    CHECK(memcmp(guest_mem + bufs[0], "abcd", 4) == 0);
+    CHECK(memcmp(guest_mem + bufs[1], "efgh", 4) == 0);
+    CHECK(memcmp(guest_mem + bufs[2], "ijkl", 4) == 0);
+    CHECK(memcmp(guest_mem + bufs[3], "mnop", 4) == 0);
+    struct vring_used_elem *elem = guest_get_used(&rx);
+    CHECK(elem && elem->id == first && elem->len == 8);
+    elem = guest_get_used(&rx);
+    CHECK(elem && elem->id == second && elem->len == 8);
+    CHECK_EQ(irqs, 1);
+
+    /* out of buffers */
+    CHECK_EQ(virtio_console_emul_putchars(emul, input + 16, 4), 0);
+    CHECK(guest_get_used(&rx) == NULL);
+}
+
+/* virtio-net */
+
+static struct eth_driver *net_driver;
+
+static void net_handle_irq(struct eth_driver *driver, int irq) {
+    irqs++;
+}
+
+static void net_low_level_init(struct eth_driver *driver, uint8_t *mac, int *mtu) {
+    memset(mac, 0x02, 6);
+    *mtu = 1500;
+}
+
+static int net_driver_init(struct eth_driver *driver, ps_io_ops_t io_ops, void *config) {
+    net_driver = driver;
+    driver->i_fn = (struct raw_iface_funcs) {
+        .raw_handleIRQ = net_handle_irq,
+        .low_level_init = net_low_level_init,
+    };
+    return 0;
+}
+
+/* Have the driver receive a packet of len bytes */
+static void net_receive(unsigned int len, int seed) {
+    void *cookie;
+    uintptr_t phys = net_driver->i_cb.allocate_rx_buf(net_driver->cb_cookie, len, &cookie);
+    assert(phys);
+    for (unsigned int i = 0; i < len; i++) {
+        ((char*)phys)[i] = (char)(i * 7 + seed);
+    }
+    net_driver->i_cb.rx_complete(net_driver->cb_cookie, 1, &cookie, &len);
+}
+
+/* a first buffer too small for the header gets nothing written past its end */
+static void test_net_short_header_buffer(void) {
+    vspace_t guest_vspace = { .data = guest_mem };
+    ps_io_ops_t io_ops = {};
+    guest_queue_t rx, tx;
+    guest_reset();
+    ethif_virtio_emul_t *emul = ethif_virtio_emul_init(io_ops, QUEUE_SIZE, &guest_vspace, net_driver_init, NULL);
+    assert(emul);
+    unsigned int features;
+    emul->io_in(emul, VIRTIO_PCI_HOST_FEATURES, 4, &features);
+    CHECK(features & BIT(VIRTIO_NET_F_MRG_RXBUF));
+    emul->io_out(emul, VIRTIO_PCI_GUEST_FEATURES, 4, features);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_SEL, 2, 0);
+    guest_queue_init(&rx, RING_PFN);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_PFN, 4, RING_PFN);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_SEL, 2, 1);
+    guest_queue_init(&tx, RING2_PFN);
+    emul->io_out(emul, VIRTIO_PCI_QUEUE_PFN, 4, RING2_PFN);
+    emul->io_out(emul, VIRTIO_PCI_STATUS, 1, VIRTIO_CONFIG_S_DRIVER_OK);
+
+    uintptr_t small = guest_alloc(sizeof(guest_net_hdr_t));
+    memset(guest_mem + small, 0xcc, sizeof(guest_net_hdr_t));
+    uint32_t small_len = 4;
+    uint16_t first = guest_add_chain(&rx, 1, &small, &small_len, VRING_DESC_F_WRITE);
+    uintptr_t big = guest_alloc(2048);
+    uint32_t big_len = 2048;
+    uint16_t second = guest_add_chain(&rx, 1, &big, &big_len, VRING_DESC_F_WRITE);
+    guest_kick(&rx);
+
+    /* the short buffer is handed back empty and the packet dropped */
+    net_receive(60, 5);
+    struct vring_used_elem *elem = guest_get_used(&rx);
+    CHECK(elem && elem->id == first && elem->len == 0);
+    CHECK(guest_get_used(&rx) == NULL);
+    for (int i = small_len; i < sizeof(guest_net_hdr_t); i++) {
+        CHECK_EQ((uint8_t)guest_mem[small + i], 0xcc);
+    }
+
+    net_receive(60, 6);
+    elem = guest_get_used(&rx);
+    CHECK(elem && elem->id == second && elem->len == sizeof(guest_net_hdr_t) + 60);
+    guest_net_hdr_t hdr;
+    memcpy(&hdr, guest_mem + big, sizeof(hdr));
+    CHECK_EQ(hdr.num_buffers, 1);
+    CHECK(filled(guest_mem + big + sizeof(hdr), 60, 6));
+}
+
+int main(void) {
+    guest_mem = aligned_alloc(PAGE_SIZE, GUEST_MEM_SIZE);
+    assert(guest_mem);
+
+    test_ramdisk();
+    for (direct_rings = 1; direct_rings >= 0; direct_rings--) {
+        test_blk_read_write();
+        test_blk_flush_and_errors();
+        test_blk_batching();
+        test_console_output();
+        test_console_input();
+        test_net_short_header_buffer();
+    }
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All virtio tests passed\n");
+    return 0;
+}